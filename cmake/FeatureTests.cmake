@@ -51,6 +51,11 @@ if(NOT have_mempcpy)
 	add_compile_definitions(NO_MEMPCPY)
 endif()
 
+check_symbol_exists(writev sys/uio.h have_writev)
+if(NOT have_writev)
+	add_compile_definitions(NO_WRITEV)
+endif()
+
 check_symbol_exists(memset_s string.h have_memset_s)
 if(NOT have_memset_s)
 	add_compile_definitions(NO_MEMSET_S)
@@ -4,3 +4,13 @@ set(CMAKE_RUNTIME_OUTPUT_DIRECTORY $ENV{BRTOOL_BUILD_PREFIX})
 add_executable(t1000-pk_dirname test/t1000-pk_dirname_main.c)
 
 add_executable(t1100-binhex-convert test/t1100-binhex-convert_main.c)
+
+add_executable(t1101-hex-kernels test/t1101-hex-kernels_main.c)
+
+add_executable(t1102-sort-kernels test/t1102-sort-kernels_main.c)
+
+add_executable(t1103-hashmap test/t1103-hashmap_main.c)
+
+add_executable(t1104-bitmap test/t1104-bitmap_main.c)
+
+add_executable(t1300-spawn-latency test/t1300-spawn-latency_main.c)
@@ -33,4 +33,355 @@ void merge_sort(void *array, size_t nmemb, size_t size, int (*compar)(const void
 #define MSORT(array, nmemb, compar)\
 	merge_sort(array, nmemb, sizeof(*(array)), compar)
 
+/**
+ * runs this short are insertion sorted before any merging is done
+ */
+#define SORT_INSERTION_RUN 16
+
+/**
+ * inputs shorter than this are sorted by one thread, a parallel sort
+ * does not pay for itself below it
+ */
+#define SORT_PARALLEL_MIN (1 << 15)
+
+/**
+ * what parallel_sort() needs to know of a type-specialised kernel,
+ * filled in by DEFINE_PARALLEL_MERGE_SORT()
+ *
+ * sort() sorts ‘nmemb’ elements of ‘array’ in place, using ‘buf’ of
+ * the same length as scratch; merge() stably merges two sorted runs
+ * into ‘dst’; split() tells how many of the first ‘k’ merged elements
+ * come from ‘a’
+ */
+struct sort_kernel
+{
+	size_t size;
+	void (*sort)(void *array, void *buf, size_t nmemb);
+	void (*merge)(void *dst, const void *a, size_t na,
+		      const void *b, size_t nb);
+	size_t (*split)(const void *a, size_t na,
+			const void *b, size_t nb, size_t k);
+};
+
+void parallel_sort(void *array, size_t nmemb,
+		   const struct sort_kernel *kernel, unsigned nthreads);
+
+/**
+ * DEFINE_MERGE_SORT(name, type, less) defines a stable merge sort
+ * specialised for ‘type’
+ *
+ *	static void name(type *array, size_t nmemb);
+ *
+ * ‘less(a, b)’ is given two ‘const type *’ and is expanded inline, so
+ * nothing is called through a pointer and elements are moved by plain
+ * assignment rather than memcpy() of a run-time size
+ */
+#define DEFINE_MERGE_SORT(name, type, less)				\
+static inline void name##_insertion(type *array, size_t nmemb)		\
+{									\
+	size_t i, j;							\
+	type tmp;							\
+									\
+	for (i = 1; i < nmemb; i++)					\
+	{								\
+		tmp = array[i];						\
+		for (j = i; j > 0 && less(&tmp, &array[j - 1]); j--)	\
+		{							\
+			array[j] = array[j - 1];			\
+		}							\
+		array[j] = tmp;						\
+	}								\
+}									\
+									\
+static inline void name##_merge(type *dst, const type *a, size_t na,	\
+				const type *b, size_t nb)		\
+{									\
+	const type *ea = a + na, *eb = b + nb;				\
+									\
+	while (a < ea && b < eb)					\
+	{								\
+		*dst++ = less(b, a) ? *b++ : *a++;			\
+	}								\
+									\
+	while (a < ea)							\
+	{								\
+		*dst++ = *a++;						\
+	}								\
+									\
+	while (b < eb)							\
+	{								\
+		*dst++ = *b++;						\
+	}								\
+}									\
+									\
+static inline size_t name##_split(const type *a, size_t na,		\
+				  const type *b, size_t nb, size_t k)	\
+{									\
+	size_t lo, hi, mid;						\
+									\
+	lo = k > nb ? k - nb : 0;					\
+	hi = k < na ? k : na;						\
+	while (lo < hi)							\
+	{								\
+		mid = lo + (hi - lo) / 2;				\
+		if (!less(&b[k - mid - 1], &a[mid]))			\
+		{							\
+			lo = mid + 1;					\
+		}							\
+		else							\
+		{							\
+			hi = mid;					\
+		}							\
+	}								\
+									\
+	return lo;							\
+}									\
+									\
+static inline void name##_range(type *array, type *buf, size_t nmemb)	\
+{									\
+	type *src, *dst, *tmp;						\
+	size_t width, lo, mid, hi;					\
+									\
+	for (lo = 0; lo < nmemb; lo += SORT_INSERTION_RUN)		\
+	{								\
+		hi = nmemb - lo < SORT_INSERTION_RUN ?			\
+			nmemb - lo : SORT_INSERTION_RUN;		\
+		name##_insertion(array + lo, hi);			\
+	}								\
+									\
+	src = array;							\
+	dst = buf;							\
+	for (width = SORT_INSERTION_RUN; width < nmemb; width *= 2)	\
+	{								\
+		for (lo = 0; lo < nmemb; lo = hi)			\
+		{							\
+			mid = nmemb - lo < width ? nmemb : lo + width;	\
+			hi = nmemb - mid < width ? nmemb : mid + width;	\
+			name##_merge(dst + lo, src + lo, mid - lo,	\
+				     src + mid, hi - mid);		\
+		}							\
+									\
+		tmp = src;						\
+		src = dst;						\
+		dst = tmp;						\
+	}								\
+									\
+	if (src != array)						\
+	{								\
+		memcpy(array, src, nmemb * sizeof(type));		\
+	}								\
+}									\
+									\
+static UNUSED void name(type *array, size_t nmemb)			\
+{									\
+	type *buf;							\
+									\
+	if (nmemb <= SORT_INSERTION_RUN)				\
+	{								\
+		name##_insertion(array, nmemb);				\
+		return;							\
+	}								\
+									\
+	MALLOC_ARRAY(buf, nmemb);					\
+	name##_range(array, buf, nmemb);				\
+	free(buf);							\
+}
+
+/**
+ * DEFINE_PARALLEL_MERGE_SORT(name, type, less) defines, on top of
+ * DEFINE_MERGE_SORT(name##_serial, type, less),
+ *
+ *	static void name(type *array, size_t nmemb, unsigned nthreads);
+ *
+ * which sorts slices on ‘nthreads’ threads (0 means one per online
+ * processor) and merges them with every thread busy in every round;
+ * the result is the same as the serial sort's
+ */
+#define DEFINE_PARALLEL_MERGE_SORT(name, type, less)			\
+DEFINE_MERGE_SORT(name##_serial, type, less)				\
+									\
+static void name##_sort_fn(void *array, void *buf, size_t nmemb)	\
+{									\
+	name##_serial_range(array, buf, nmemb);				\
+}									\
+									\
+static void name##_merge_fn(void *dst, const void *a, size_t na,	\
+			    const void *b, size_t nb)			\
+{									\
+	name##_serial_merge(dst, a, na, b, nb);				\
+}									\
+									\
+static size_t name##_split_fn(const void *a, size_t na,			\
+			      const void *b, size_t nb, size_t k)	\
+{									\
+	return name##_serial_split(a, na, b, nb, k);			\
+}									\
+									\
+static const struct sort_kernel name##_kernel = {			\
+	.size = sizeof(type),						\
+	.sort = name##_sort_fn,						\
+	.merge = name##_merge_fn,					\
+	.split = name##_split_fn,					\
+};									\
+									\
+static UNUSED void name(type *array, size_t nmemb, unsigned nthreads)	\
+{									\
+	parallel_sort(array, nmemb, &name##_kernel, nthreads);		\
+}
+
+/**
+ * DEFINE_RADIX_SORT(name, type, key) defines a stable LSD radix sort
+ * on the unsigned 64-bit ‘key(const type *)’
+ *
+ *	static void name(type *array, size_t nmemb);
+ *
+ * it takes one pass to count every digit and then one scatter pass per
+ * byte of the key, skipping bytes all keys agree on, so small keys
+ * cost as few passes as they have significant bytes
+ */
+#define DEFINE_RADIX_SORT(name, type, key)				\
+static UNUSED void name(type *array, size_t nmemb)			\
+{									\
+	size_t count[8][256], sum, n, i;				\
+	type *buf, *src, *dst, *tmp;					\
+	unsigned d, shift;						\
+	uint64_t k;							\
+									\
+	if (nmemb <= SORT_INSERTION_RUN)				\
+	{								\
+		for (i = 1; i < nmemb; i++)				\
+		{							\
+			type elem = array[i];				\
+			k = key(&elem);					\
+			for (n = i; n > 0 && k < key(&array[n - 1]); n--) \
+			{						\
+				array[n] = array[n - 1];		\
+			}						\
+			array[n] = elem;				\
+		}							\
+		return;							\
+	}								\
+									\
+	memset(count, 0, sizeof(count));				\
+	for (i = 0; i < nmemb; i++)					\
+	{								\
+		k = key(&array[i]);					\
+		for (d = 0; d < 8; d++)					\
+		{							\
+			count[d][(k >> (d * 8)) & 0xFF]++;		\
+		}							\
+	}								\
+									\
+	MALLOC_ARRAY(buf, nmemb);					\
+	src = array;							\
+	dst = buf;							\
+	k = key(&array[0]);						\
+	for (d = 0; d < 8; d++)						\
+	{								\
+		shift = d * 8;						\
+		if (count[d][(k >> shift) & 0xFF] == nmemb)		\
+		{							\
+			continue;					\
+		}							\
+									\
+		for (sum = 0, i = 0; i < 256; i++)			\
+		{							\
+			n = count[d][i];				\
+			count[d][i] = sum;				\
+			sum += n;					\
+		}							\
+									\
+		for (i = 0; i < nmemb; i++)				\
+		{							\
+			dst[count[d][(key(&src[i]) >> shift) & 0xFF]++] = \
+				src[i];					\
+		}							\
+									\
+		tmp = src;						\
+		src = dst;						\
+		dst = tmp;						\
+	}								\
+									\
+	if (src != array)						\
+	{								\
+		memcpy(array, src, nmemb * sizeof(type));		\
+	}								\
+									\
+	free(buf);							\
+}
+
+/**
+ * DEFINE_TOP_K(name, type, less) defines a bounded heap that keeps the
+ * ‘k’ greatest elements of a stream
+ *
+ *	static void name##_push(type *heap, size_t *nr, size_t k,
+ *				type elem);
+ *	static void name##_sort(type *heap, size_t nr);
+ *
+ * ‘heap’ has room for ‘k’ elements and ‘*nr’ starts at 0; the least
+ * element kept is at the root, so a push costs O(log k) and most are
+ * turned away by one comparison; sort() leaves the heap greatest first
+ */
+#define DEFINE_TOP_K(name, type, less)					\
+static inline void name##_sift_down(type *heap, size_t nr, size_t i)	\
+{									\
+	type elem = heap[i];						\
+	size_t child;							\
+									\
+	while ((child = i * 2 + 1) < nr)				\
+	{								\
+		if (child + 1 < nr && less(&heap[child + 1], &heap[child])) \
+		{							\
+			child++;					\
+		}							\
+									\
+		if (!less(&heap[child], &elem))				\
+		{							\
+			break;						\
+		}							\
+									\
+		heap[i] = heap[child];					\
+		i = child;						\
+	}								\
+	heap[i] = elem;							\
+}									\
+									\
+static UNUSED void name##_push(type *heap, size_t *nr, size_t k,	\
+			       type elem)				\
+{									\
+	size_t i, parent;						\
+									\
+	if (*nr < k)							\
+	{								\
+		for (i = (*nr)++; i > 0; i = parent)			\
+		{							\
+			parent = (i - 1) / 2;				\
+			if (!less(&elem, &heap[parent]))		\
+			{						\
+				break;					\
+			}						\
+			heap[i] = heap[parent];				\
+		}							\
+		heap[i] = elem;						\
+	}								\
+	else if (k > 0 && less(&heap[0], &elem))			\
+	{								\
+		heap[0] = elem;						\
+		name##_sift_down(heap, *nr, 0);				\
+	}								\
+}									\
+									\
+static UNUSED void name##_sort(type *heap, size_t nr)			\
+{									\
+	type tmp;							\
+									\
+	while (nr > 1)							\
+	{								\
+		tmp = heap[0];						\
+		heap[0] = heap[--nr];					\
+		heap[nr] = tmp;						\
+		name##_sift_down(heap, nr, 0);				\
+	}								\
+}
+
 #endif /* ALGORITHM_H */
@@ -21,6 +21,7 @@
 ****************************************************************************/
 
 #include "atexit-chain.h"
+#include <pthread.h>
 
 struct atexit_node
 {
@@ -30,6 +31,12 @@ struct atexit_node
 
 static struct atexit_node *atexit_func;
 
+static jmp_buf *exit_point;
+
+static volatile int *exit_status;
+
+static pthread_t exit_thread;
+
 void atexit_chain_push(void (*fn)(void))
 {
 	struct atexit_node *head;
@@ -70,3 +77,36 @@ void apply_atexit_chain(void)
 		fn();
 	}
 }
+
+void catch_exit(jmp_buf *point, volatile int *status)
+{
+	exit_point = point;
+	exit_status = status;
+	exit_thread = pthread_self();
+}
+
+void pk_exit(int status)
+{
+	jmp_buf *point;
+
+	/**
+	 * ‘point’ is on the stack of the thread that armed it, a worker
+	 * of a thread pool can't jump there
+	 */
+	if ((point = exit_point) == NULL ||
+	     !pthread_equal(pthread_self(), exit_thread))
+	{
+		(exit)(status);
+	}
+
+	/**
+	 * disarm first, a failure in the chain must not jump back
+	 * again
+	 */
+	exit_point = NULL;
+	*exit_status = status;
+
+	apply_atexit_chain();
+
+	longjmp(*point, 1);
+}
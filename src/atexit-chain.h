@@ -23,10 +23,20 @@
 #ifndef ATEXIT_CHAIN_H
 #define ATEXIT_CHAIN_H
 
+#include <setjmp.h>
+
 void atexit_chain_push(void (*fn)(void));
 
 void (*atexit_chain_pop(void))(void);
 
 void apply_atexit_chain(void);
 
+/**
+ * make exit() store its status to ‘status’ and jump to ‘point’
+ * instead of terminating the process, the chain is applied before
+ * the jump; a NULL ‘point’ restores the default behavior; exit() on
+ * any other thread than the caller still terminates the process
+ */
+void catch_exit(jmp_buf *point, volatile int *status);
+
 #endif /* ATEXIT_CHAIN_H */
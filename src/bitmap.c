@@ -0,0 +1,827 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "bitmap.h"
+
+#define BITMAP_HEADER_SIZE 4
+#define BITMAP_DIRENT_SIZE 16
+#define BITMAP_WORDS_SIZE (BITMAP_NR_WORDS * 8)
+
+#define high_key(x) ((x) >> 16)
+#define low_bits(x) ((uint16_t)((x) & 0xFFFF))
+
+#define is_array_container(c) ((c)->cap != 0)
+
+static inline FORCEINLINE uint64_t get_le(const uint8_t *p, size_t n)
+{
+	uint64_t v;
+
+	v = 0;
+	while (n--)
+	{
+		v = v << 8 | p[n];
+	}
+
+	return v;
+}
+
+static inline FORCEINLINE void put_le(uint8_t *p, uint64_t v, size_t n)
+{
+	while (n--)
+	{
+		*p++ = v & 0xFF;
+		v >>= 8;
+	}
+}
+
+/**
+ * index of the first element of ‘arr’ not less than ‘v’
+ */
+static size_t lower_bound(const uint16_t *arr, size_t nr, uint16_t v)
+{
+	size_t lo, hi, mid;
+
+	lo = 0;
+	hi = nr;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (arr[mid] < v)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static size_t find_container(const struct bitmap *bm, uint64_t key,
+			     bool *found)
+{
+	size_t lo, hi, mid;
+
+	lo = 0;
+	hi = bm->nr;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (bm->conts[mid].key < key)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	*found = lo < bm->nr && bm->conts[lo].key == key;
+	return lo;
+}
+
+static bool container_contains(const struct bitmap_container *c, uint16_t v)
+{
+	size_t i;
+
+	if (!is_array_container(c))
+	{
+		return c->words[v >> 6] >> (v & 63) & 1;
+	}
+
+	i = lower_bound(c->array, c->card, v);
+	return i < c->card && c->array[i] == v;
+}
+
+static void array_to_words(struct bitmap_container *c)
+{
+	uint64_t *words;
+	uint32_t i;
+
+	words = xcalloc(BITMAP_NR_WORDS, sizeof(*words));
+	for (i = 0; i < c->card; i++)
+	{
+		words[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+	}
+
+	free(c->array);
+	c->words = words;
+	c->cap = 0;
+}
+
+static void words_to_array(struct bitmap_container *c)
+{
+	uint16_t *array;
+	uint64_t word;
+	size_t i, n;
+
+	MALLOC_ARRAY(array, c->card > 0 ? c->card : 1);
+	for (n = 0, i = 0; i < BITMAP_NR_WORDS; i++)
+	{
+		for (word = c->words[i]; word != 0; word &= word - 1)
+		{
+			array[n++] = i * 64 + __builtin_ctzll(word);
+		}
+	}
+
+	free(c->words);
+	c->array = array;
+	c->cap = c->card > 0 ? c->card : 1;
+}
+
+static uint32_t count_words(const uint64_t *words)
+{
+	uint32_t card;
+	size_t i;
+
+	for (card = 0, i = 0; i < BITMAP_NR_WORDS; i++)
+	{
+		card += __builtin_popcountll(words[i]);
+	}
+
+	return card;
+}
+
+/**
+ * keep a container in the smaller of its two forms
+ */
+static void normalize(struct bitmap_container *c)
+{
+	if (!is_array_container(c) && c->card <= BITMAP_ARRAY_MAX)
+	{
+		words_to_array(c);
+	}
+	else if (is_array_container(c) && c->card > BITMAP_ARRAY_MAX)
+	{
+		array_to_words(c);
+	}
+}
+
+static void copy_container(struct bitmap_container *dst,
+			   const struct bitmap_container *src)
+{
+	*dst = *src;
+
+	if (is_array_container(src))
+	{
+		dst->cap = src->card;
+		dst->array = xmemdup(src->array,
+				     src->card * sizeof(*src->array));
+	}
+	else
+	{
+		dst->words = xmemdup(src->words, BITMAP_WORDS_SIZE);
+	}
+}
+
+static void container_add(struct bitmap_container *c, uint16_t v)
+{
+	size_t i;
+
+	if (!is_array_container(c))
+	{
+		c->card += !(c->words[v >> 6] >> (v & 63) & 1);
+		c->words[v >> 6] |= 1ULL << (v & 63);
+		return;
+	}
+
+	if ((i = lower_bound(c->array, c->card, v)) < c->card &&
+	     c->array[i] == v)
+	{
+		return;
+	}
+
+	if (c->card == BITMAP_ARRAY_MAX)
+	{
+		array_to_words(c);
+		container_add(c, v);
+		return;
+	}
+
+	if (c->card == c->cap)
+	{
+		c->cap = c->cap * 2 < BITMAP_ARRAY_MAX ?
+				c->cap * 2 : BITMAP_ARRAY_MAX;
+		REALLOC_ARRAY(c->array, c->cap);
+	}
+
+	memmove(c->array + i + 1, c->array + i,
+		(c->card - i) * sizeof(*c->array));
+	c->array[i] = v;
+	c->card++;
+}
+
+static bool container_remove(struct bitmap_container *c, uint16_t v)
+{
+	size_t i;
+
+	if (!is_array_container(c))
+	{
+		if (!(c->words[v >> 6] >> (v & 63) & 1))
+		{
+			return false;
+		}
+
+		c->words[v >> 6] &= ~(1ULL << (v & 63));
+		c->card--;
+		normalize(c);
+
+		return true;
+	}
+
+	if ((i = lower_bound(c->array, c->card, v)) == c->card ||
+	     c->array[i] != v)
+	{
+		return false;
+	}
+
+	memmove(c->array + i, c->array + i + 1,
+		(c->card - i - 1) * sizeof(*c->array));
+	c->card--;
+
+	return true;
+}
+
+void bitmap_destroy(struct bitmap *bm)
+{
+	size_t i;
+
+	for (i = 0; i < bm->nr; i++)
+	{
+		free(bm->conts[i].array);
+	}
+
+	free(bm->conts);
+	*bm = (struct bitmap)BITMAP_INIT;
+}
+
+void bitmap_add(struct bitmap *bm, uint64_t x)
+{
+	struct bitmap_container *c;
+	bool found;
+	size_t i;
+
+	if (!(i = find_container(bm, high_key(x), &found), found))
+	{
+		CAPACITY_GROW(bm->conts, bm->nr + 1, bm->cap);
+		memmove(bm->conts + i + 1, bm->conts + i,
+			(bm->nr - i) * sizeof(*bm->conts));
+		bm->nr++;
+
+		c = &bm->conts[i];
+		*c = (struct bitmap_container){
+			.key = high_key(x),
+			.cap = 4,
+		};
+		MALLOC_ARRAY(c->array, c->cap);
+	}
+
+	container_add(&bm->conts[i], low_bits(x));
+}
+
+bool bitmap_remove(struct bitmap *bm, uint64_t x)
+{
+	bool found;
+	size_t i;
+
+	i = find_container(bm, high_key(x), &found);
+	if (!found || !container_remove(&bm->conts[i], low_bits(x)))
+	{
+		return false;
+	}
+
+	if (bm->conts[i].card == 0)
+	{
+		free(bm->conts[i].array);
+		memmove(bm->conts + i, bm->conts + i + 1,
+			(bm->nr - i - 1) * sizeof(*bm->conts));
+		bm->nr--;
+	}
+
+	return true;
+}
+
+bool bitmap_contains(const struct bitmap *bm, uint64_t x)
+{
+	bool found;
+	size_t i;
+
+	i = find_container(bm, high_key(x), &found);
+	return found && container_contains(&bm->conts[i], low_bits(x));
+}
+
+uint64_t bitmap_cardinality(const struct bitmap *bm)
+{
+	uint64_t card;
+	size_t i;
+
+	for (card = 0, i = 0; i < bm->nr; i++)
+	{
+		card += bm->conts[i].card;
+	}
+
+	return card;
+}
+
+/**
+ * keep the elements of array container ‘c’ that are (or, if ‘keep’
+ * is false, are not) in ‘d’
+ */
+static void filter_array(struct bitmap_container *c,
+			 const struct bitmap_container *d, bool keep)
+{
+	uint32_t i, n;
+
+	for (n = 0, i = 0; i < c->card; i++)
+	{
+		if (container_contains(d, c->array[i]) == keep)
+		{
+			c->array[n++] = c->array[i];
+		}
+	}
+
+	c->card = n;
+}
+
+static void container_and(struct bitmap_container *c,
+			  const struct bitmap_container *d)
+{
+	size_t i;
+
+	if (is_array_container(c))
+	{
+		filter_array(c, d, true);
+	}
+	else if (is_array_container(d))
+	{
+		struct bitmap_container tmp;
+
+		copy_container(&tmp, d);
+		filter_array(&tmp, c, true);
+		free(c->words);
+		*c = tmp;
+	}
+	else
+	{
+		for (i = 0; i < BITMAP_NR_WORDS; i++)
+		{
+			c->words[i] &= d->words[i];
+		}
+		c->card = count_words(c->words);
+		normalize(c);
+	}
+}
+
+static void container_andnot(struct bitmap_container *c,
+			     const struct bitmap_container *d)
+{
+	size_t i;
+
+	if (is_array_container(c))
+	{
+		filter_array(c, d, false);
+		return;
+	}
+
+	if (is_array_container(d))
+	{
+		for (i = 0; i < d->card; i++)
+		{
+			c->words[d->array[i] >> 6] &=
+				~(1ULL << (d->array[i] & 63));
+		}
+	}
+	else
+	{
+		for (i = 0; i < BITMAP_NR_WORDS; i++)
+		{
+			c->words[i] &= ~d->words[i];
+		}
+	}
+
+	c->card = count_words(c->words);
+	normalize(c);
+}
+
+static void container_or(struct bitmap_container *c,
+			 const struct bitmap_container *d)
+{
+	uint16_t *merged;
+	size_t i, j, n, total;
+
+	total = c->card + d->card;
+	if (is_array_container(c) && is_array_container(d) &&
+	     total <= BITMAP_ARRAY_MAX)
+	{
+		MALLOC_ARRAY(merged, total);
+		for (n = i = j = 0; i < c->card || j < d->card; )
+		{
+			if (j == d->card ||
+			     (i < c->card && c->array[i] < d->array[j]))
+			{
+				merged[n++] = c->array[i++];
+			}
+			else if (i == c->card || d->array[j] < c->array[i])
+			{
+				merged[n++] = d->array[j++];
+			}
+			else
+			{
+				merged[n++] = c->array[i++];
+				j++;
+			}
+		}
+
+		free(c->array);
+		c->array = merged;
+		c->card = n;
+		c->cap = total;
+		return;
+	}
+
+	if (is_array_container(c))
+	{
+		array_to_words(c);
+	}
+
+	if (is_array_container(d))
+	{
+		for (i = 0; i < d->card; i++)
+		{
+			c->words[d->array[i] >> 6] |=
+				1ULL << (d->array[i] & 63);
+		}
+	}
+	else
+	{
+		for (i = 0; i < BITMAP_NR_WORDS; i++)
+		{
+			c->words[i] |= d->words[i];
+		}
+	}
+
+	c->card = count_words(c->words);
+	normalize(c);
+}
+
+/**
+ * ‘a’ only shrinks under AND and ANDNOT, so containers are compacted
+ * in place; ‘and’ tells whether containers of ‘a’ missing from ‘b’ are
+ * dropped (AND) or kept (ANDNOT)
+ */
+static void intersect(struct bitmap *a, const struct bitmap *b, bool and)
+{
+	struct bitmap_container *c;
+	size_t i, j, n;
+
+	for (n = i = j = 0; i < a->nr; i++)
+	{
+		c = &a->conts[i];
+		while (j < b->nr && b->conts[j].key < c->key)
+		{
+			j++;
+		}
+
+		if (j < b->nr && b->conts[j].key == c->key)
+		{
+			if (and)
+			{
+				container_and(c, &b->conts[j]);
+			}
+			else
+			{
+				container_andnot(c, &b->conts[j]);
+			}
+		}
+		else if (and)
+		{
+			c->card = 0;
+		}
+
+		if (c->card == 0)
+		{
+			free(c->array);
+			continue;
+		}
+
+		a->conts[n++] = *c;
+	}
+
+	a->nr = n;
+}
+
+void bitmap_and(struct bitmap *a, const struct bitmap *b)
+{
+	intersect(a, b, true);
+}
+
+void bitmap_andnot(struct bitmap *a, const struct bitmap *b)
+{
+	intersect(a, b, false);
+}
+
+void bitmap_or(struct bitmap *a, const struct bitmap *b)
+{
+	struct bitmap_container *conts;
+	size_t i, j, n;
+
+	MALLOC_ARRAY(conts, a->nr + b->nr > 0 ? a->nr + b->nr : 1);
+	for (n = i = j = 0; i < a->nr || j < b->nr; n++)
+	{
+		if (j == b->nr ||
+		     (i < a->nr && a->conts[i].key < b->conts[j].key))
+		{
+			conts[n] = a->conts[i++];
+		}
+		else if (i == a->nr || b->conts[j].key < a->conts[i].key)
+		{
+			copy_container(&conts[n], &b->conts[j++]);
+		}
+		else
+		{
+			conts[n] = a->conts[i++];
+			container_or(&conts[n], &b->conts[j++]);
+		}
+	}
+
+	free(a->conts);
+	a->conts = conts;
+	a->nr = n;
+	a->cap = a->nr + b->nr;
+}
+
+uint64_t *bitmap_to_array(const struct bitmap *bm, size_t *nr)
+{
+	const struct bitmap_container *c;
+	uint64_t *out, word, base;
+	size_t i, j, n;
+
+	MALLOC_ARRAY(out, bitmap_cardinality(bm) + 1);
+	for (n = 0, i = 0; i < bm->nr; i++)
+	{
+		c = &bm->conts[i];
+		base = c->key << 16;
+
+		if (is_array_container(c))
+		{
+			for (j = 0; j < c->card; j++)
+			{
+				out[n++] = base | c->array[j];
+			}
+			continue;
+		}
+
+		for (j = 0; j < BITMAP_NR_WORDS; j++)
+		{
+			for (word = c->words[j]; word != 0; word &= word - 1)
+			{
+				out[n++] = base | (j * 64 +
+						   __builtin_ctzll(word));
+			}
+		}
+	}
+
+	*nr = n;
+	return out;
+}
+
+static size_t payload_size(uint32_t card)
+{
+	return card <= BITMAP_ARRAY_MAX ? card * 2 : BITMAP_WORDS_SIZE;
+}
+
+uint8_t *bitmap_serialize(const struct bitmap *bm, size_t *len)
+{
+	const struct bitmap_container *c;
+	uint8_t *buf, *dirent, *ptr;
+	size_t i, j;
+
+	*len = BITMAP_HEADER_SIZE + bm->nr * BITMAP_DIRENT_SIZE;
+	for (i = 0; i < bm->nr; i++)
+	{
+		*len += payload_size(bm->conts[i].card);
+	}
+
+	buf = xmalloc(*len);
+	put_le(buf, bm->nr, 4);
+
+	dirent = buf + BITMAP_HEADER_SIZE;
+	ptr = dirent + bm->nr * BITMAP_DIRENT_SIZE;
+	for (i = 0; i < bm->nr; i++, dirent += BITMAP_DIRENT_SIZE)
+	{
+		c = &bm->conts[i];
+
+		put_le(dirent, c->key, 8);
+		put_le(dirent + 8, c->card, 4);
+		put_le(dirent + 12, ptr - buf, 4);
+
+		if (is_array_container(c))
+		{
+			for (j = 0; j < c->card; j++, ptr += 2)
+			{
+				put_le(ptr, c->array[j], 2);
+			}
+		}
+		else
+		{
+			for (j = 0; j < BITMAP_NR_WORDS; j++, ptr += 8)
+			{
+				put_le(ptr, c->words[j], 8);
+			}
+		}
+	}
+
+	return buf;
+}
+
+/**
+ * check the directory entry ‘i’ of a serialized bitmap, and find its
+ * payload
+ */
+static int read_dirent(const uint8_t *buf, size_t len, size_t i,
+		       uint64_t *key, uint32_t *card, const uint8_t **payload)
+{
+	const uint8_t *dirent;
+	uint64_t offset;
+
+	dirent = buf + BITMAP_HEADER_SIZE + i * BITMAP_DIRENT_SIZE;
+	*key = get_le(dirent, 8);
+	*card = get_le(dirent + 8, 4);
+	offset = get_le(dirent + 12, 4);
+
+	if (*card == 0 || *card > 65536 || *key > UINT64_MAX >> 16 ||
+	     offset > len || len - offset < payload_size(*card))
+	{
+		return -1;
+	}
+
+	*payload = buf + offset;
+	return 0;
+}
+
+static int check_header(const uint8_t *buf, size_t len, size_t *nr)
+{
+	if (len < BITMAP_HEADER_SIZE)
+	{
+		return -1;
+	}
+
+	*nr = get_le(buf, 4);
+
+	return (len - BITMAP_HEADER_SIZE) / BITMAP_DIRENT_SIZE < *nr ? -1 : 0;
+}
+
+int bitmap_deserialize(struct bitmap *bm, const uint8_t *buf, size_t len)
+{
+	struct bitmap_container *c;
+	const uint8_t *payload;
+	size_t nr, i, j;
+
+	*bm = (struct bitmap)BITMAP_INIT;
+	if (len == 0)
+	{
+		return 0;
+	}
+	else if (check_header(buf, len, &nr) != 0)
+	{
+		return -1;
+	}
+
+	CALLOC_ARRAY(bm->conts, nr > 0 ? nr : 1);
+	bm->cap = nr;
+
+	for (i = 0; i < nr; i++)
+	{
+		c = &bm->conts[i];
+		if (read_dirent(buf, len, i, &c->key, &c->card, &payload) != 0 ||
+		     (i > 0 && c->key <= c[-1].key))
+		{
+			goto malformed;
+		}
+		bm->nr++;
+
+		if (c->card <= BITMAP_ARRAY_MAX)
+		{
+			c->cap = c->card;
+			MALLOC_ARRAY(c->array, c->cap);
+			for (j = 0; j < c->card; j++, payload += 2)
+			{
+				c->array[j] = get_le(payload, 2);
+				if (j > 0 && c->array[j] <= c->array[j - 1])
+				{
+					goto malformed;
+				}
+			}
+		}
+		else
+		{
+			MALLOC_ARRAY(c->words, BITMAP_NR_WORDS);
+			for (j = 0; j < BITMAP_NR_WORDS; j++, payload += 8)
+			{
+				c->words[j] = get_le(payload, 8);
+			}
+
+			if (count_words(c->words) != c->card)
+			{
+				goto malformed;
+			}
+		}
+	}
+
+	return 0;
+
+malformed:
+	bitmap_destroy(bm);
+	return -1;
+}
+
+int bitmap_blob_contains(const uint8_t *buf, size_t len, uint64_t x)
+{
+	const uint8_t *payload;
+	size_t nr, lo, hi, mid;
+	uint64_t key;
+	uint32_t card;
+	uint16_t v;
+
+	if (len == 0)
+	{
+		return 0;
+	}
+	else if (check_header(buf, len, &nr) != 0)
+	{
+		return -1;
+	}
+
+	lo = 0;
+	hi = nr;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (read_dirent(buf, len, mid, &key, &card, &payload) != 0)
+		{
+			return -1;
+		}
+		else if (key < high_key(x))
+		{
+			lo = mid + 1;
+		}
+		else if (key > high_key(x))
+		{
+			hi = mid;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (lo >= hi)
+	{
+		return 0;
+	}
+
+	v = low_bits(x);
+	if (card > BITMAP_ARRAY_MAX)
+	{
+		return payload[v >> 3] >> (v & 7) & 1;
+	}
+
+	lo = 0;
+	hi = card;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (get_le(payload + mid * 2, 2) < v)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo < card && get_le(payload + lo * 2, 2) == v;
+}
@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+/**
+ * compressed bitmaps of 64-bit integers, in the manner of roaring
+ * bitmaps: integers are grouped by their high 48 bits into containers,
+ * and a container holds the low 16 bits either as a sorted array (up
+ * to BITMAP_ARRAY_MAX of them) or as a 65536-bit bitmap, whichever is
+ * smaller; containers are kept sorted by key
+ */
+#define BITMAP_ARRAY_MAX 4096
+
+#define BITMAP_NR_WORDS (65536 / 64)
+
+struct bitmap_container
+{
+	uint64_t key;
+	uint32_t card;
+
+	/* capacity of ‘array’, 0 if the container is a bitmap */
+	uint32_t cap;
+
+	union
+	{
+		uint16_t *array;
+		uint64_t *words;
+	};
+};
+
+struct bitmap
+{
+	struct bitmap_container *conts;
+	size_t nr;
+	size_t cap;
+};
+
+#define BITMAP_INIT { 0 }
+
+void bitmap_destroy(struct bitmap *bm);
+
+void bitmap_add(struct bitmap *bm, uint64_t x);
+
+/**
+ * returns false if ‘x’ was not there
+ */
+bool bitmap_remove(struct bitmap *bm, uint64_t x);
+
+bool bitmap_contains(const struct bitmap *bm, uint64_t x);
+
+uint64_t bitmap_cardinality(const struct bitmap *bm);
+
+/**
+ * in place ‘a’ &= ‘b’, ‘a’ |= ‘b’ and ‘a’ &= ~‘b’
+ */
+void bitmap_and(struct bitmap *a, const struct bitmap *b);
+
+void bitmap_or(struct bitmap *a, const struct bitmap *b);
+
+void bitmap_andnot(struct bitmap *a, const struct bitmap *b);
+
+/**
+ * all integers of ‘bm’ in ascending order, the array is malloc'ed
+ */
+uint64_t *bitmap_to_array(const struct bitmap *bm, size_t *nr);
+
+/**
+ * serialized form, integers are little-endian:
+ *
+ *   nr[4] directory[nr] { key[8] card[4] offset[4] } containers
+ *
+ * a container is ‘card’ 16-bit integers if ‘card’ is at most
+ * BITMAP_ARRAY_MAX, otherwise BITMAP_NR_WORDS 64-bit words; an empty
+ * blob is an empty bitmap
+ */
+uint8_t *bitmap_serialize(const struct bitmap *bm, size_t *len);
+
+int bitmap_deserialize(struct bitmap *bm, const uint8_t *buf, size_t len);
+
+/**
+ * test ‘x’ against a serialized bitmap without loading it, only the
+ * directory and the container of ‘x’ are read; returns -1 if they are
+ * malformed
+ */
+int bitmap_blob_contains(const uint8_t *buf, size_t len, uint64_t x);
+
+#endif /* BITMAP_H */
@@ -0,0 +1,404 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "breach.h"
+#include "filesys.h"
+#include <openssl/sha.h>
+
+/**
+ * layout of an index, integers are little-endian:
+ *
+ *   magic[8] version[4] reserved[4] nr[8] table_offset[8]
+ *   records[nr] { hash[2..20] count[4] }
+ *   table[BREACH_NR_BUCKET + 1] { first record of bucket[8] }
+ *
+ * the bucket table is a few hundred KiB whatever the corpus size, so
+ * a lookup only touches it and the pages of one bucket
+ */
+#define BREACH_MAGIC "PKBREACH"
+#define BREACH_VERSION 1
+#define BREACH_HEADER_SIZE 32
+
+#define BREACH_PREFIX_LEN 2
+#define BREACH_NR_BUCKET (1 << (8 * BREACH_PREFIX_LEN))
+#define BREACH_SUFFIX_LEN (BREACH_HASH_LEN - BREACH_PREFIX_LEN)
+#define BREACH_RECORD_SIZE (BREACH_SUFFIX_LEN + 4)
+
+#define BREACH_HEX_LEN (BREACH_HASH_LEN * 2)
+
+#define BREACH_WRITE_BUFSIZE (1 << 20)
+
+static inline FORCEINLINE uint64_t get_le(const uint8_t *p, size_t n)
+{
+	uint64_t v;
+
+	v = 0;
+	while (n--)
+	{
+		v = v << 8 | p[n];
+	}
+
+	return v;
+}
+
+static inline FORCEINLINE void put_le(uint8_t *p, uint64_t v, size_t n)
+{
+	while (n--)
+	{
+		*p++ = v & 0xFF;
+		v >>= 8;
+	}
+}
+
+static inline FORCEINLINE int hexval(int c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+	{
+		return (c | 0x20) - 'a' + 10;
+	}
+
+	return -1;
+}
+
+/**
+ * parse the ‘HASH:count’ line at ‘line’, return -1 if it's malformed
+ */
+static int parse_line(const char *line, const char *end,
+		      uint8_t hash[BREACH_HASH_LEN], uint64_t *count)
+{
+	int hi, lo;
+	size_t i;
+
+	if (end - line <= BREACH_HEX_LEN || line[BREACH_HEX_LEN] != ':')
+	{
+		return -1;
+	}
+
+	for (i = 0; i < BREACH_HASH_LEN; i++)
+	{
+		if ((hi = hexval(line[2 * i])) == -1 ||
+		     (lo = hexval(line[2 * i + 1])) == -1)
+		{
+			return -1;
+		}
+
+		hash[i] = hi << 4 | lo;
+	}
+
+	*count = 0;
+	for (line += BREACH_HEX_LEN + 1;
+	      line < end && isdigit(*line); line++)
+	{
+		*count = *count * 10 + (*line - '0');
+	}
+
+	return 0;
+}
+
+int open_breach_db(struct breach_db *db, const char *pathname)
+{
+	uint64_t table_offset;
+
+	if ((db->map = map_file(pathname, &db->map_len)) == NULL)
+	{
+		return -1;
+	}
+
+	if (db->map_len < BREACH_HEADER_SIZE ||
+	     memcmp(db->map, BREACH_MAGIC, strlen(BREACH_MAGIC)))
+	{
+		db->indexed = false;
+		return 0;
+	}
+
+	db->indexed = true;
+	db->nr = get_le(db->map + 16, 8);
+	table_offset = get_le(db->map + 24, 8);
+
+	if (get_le(db->map + 8, 4) != BREACH_VERSION ||
+	     db->nr > (db->map_len - BREACH_HEADER_SIZE) /
+		      BREACH_RECORD_SIZE ||
+	     table_offset != BREACH_HEADER_SIZE +
+			     db->nr * BREACH_RECORD_SIZE ||
+	      db->map_len != table_offset +
+			     (BREACH_NR_BUCKET + 1) * 8)
+	{
+		goto invalid;
+	}
+
+	db->records = db->map + BREACH_HEADER_SIZE;
+	db->table = db->map + table_offset;
+
+	/**
+	 * buckets in between are only trusted as far as lookup_index()
+	 * clamps them, checking all of them would touch the whole table
+	 */
+	if (get_le(db->table, 8) != 0 ||
+	     get_le(db->table + BREACH_NR_BUCKET * 8, 8) != db->nr)
+	{
+		goto invalid;
+	}
+
+	return 0;
+
+invalid:
+	close_breach_db(db);
+	return error("‘%s’ is not a valid breach index", pathname);
+}
+
+void close_breach_db(struct breach_db *db)
+{
+	if (db->map != NULL)
+	{
+		unmap_file((void *)db->map, db->map_len);
+		db->map = NULL;
+	}
+}
+
+void breach_hash(const char *password, size_t len,
+		 uint8_t hash[BREACH_HASH_LEN])
+{
+	SHA1((const unsigned char *)password, len, hash);
+}
+
+static uint64_t lookup_index(const struct breach_db *db,
+			     const uint8_t hash[BREACH_HASH_LEN])
+{
+	uint64_t lo, hi, mid;
+	const uint8_t *rec;
+	size_t bucket;
+	int rescode;
+
+	bucket = hash[0] << 8 | hash[1];
+
+	lo = get_le(db->table + bucket * 8, 8);
+	hi = get_le(db->table + (bucket + 1) * 8, 8);
+	hi = hi > db->nr ? db->nr : hi;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		rec = db->records + mid * BREACH_RECORD_SIZE;
+
+		if ((rescode = memcmp(hash + BREACH_PREFIX_LEN, rec,
+				      BREACH_SUFFIX_LEN)) == 0)
+		{
+			return get_le(rec + BREACH_SUFFIX_LEN, 4);
+		}
+		else if (rescode < 0)
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * binary search over byte offsets of the text corpus, a probe lands
+ * somewhere in a line and compares against the line it lands in
+ */
+static uint64_t lookup_text(const struct breach_db *db,
+			    const uint8_t hash[BREACH_HASH_LEN])
+{
+	const char *map, *line, *eol, *mid;
+	uint8_t probe[BREACH_HASH_LEN];
+	size_t lo, hi;
+	uint64_t count;
+	int rescode;
+
+	map = (const char *)db->map;
+	lo = 0;
+	hi = db->map_len;
+
+	while (lo < hi)
+	{
+		mid = map + lo + (hi - lo) / 2;
+
+		for (line = mid; line > map + lo && line[-1] != '\n'; line--);
+
+		if ((eol = memchr(mid, '\n', map + hi - mid)) == NULL)
+		{
+			eol = map + hi;
+		}
+
+		if (parse_line(line, eol, probe, &count))
+		{
+			/**
+			 * blank or junk lines sort nowhere, skip them
+			 * rather than failing the whole lookup
+			 */
+			rescode = 1;
+		}
+		else if ((rescode = memcmp(hash, probe, BREACH_HASH_LEN)) == 0)
+		{
+			return count;
+		}
+
+		if (rescode < 0)
+		{
+			hi = line - map;
+		}
+		else
+		{
+			lo = eol - map + 1;
+		}
+	}
+
+	return 0;
+}
+
+uint64_t lookup_breach_db(const struct breach_db *db,
+			  const uint8_t hash[BREACH_HASH_LEN])
+{
+	return db->indexed ? lookup_index(db, hash) : lookup_text(db, hash);
+}
+
+struct index_writer
+{
+	int fd;
+	size_t len;
+	uint8_t buf[BREACH_WRITE_BUFSIZE];
+};
+
+static void writer_add(struct index_writer *w, const void *data, size_t n)
+{
+	if (w->len + n > sizeof(w->buf))
+	{
+		xwrite(w->fd, w->buf, w->len);
+		w->len = 0;
+	}
+
+	memcpy(w->buf + w->len, data, n);
+	w->len += n;
+}
+
+static void writer_flush(struct index_writer *w)
+{
+	xwrite(w->fd, w->buf, w->len);
+	w->len = 0;
+}
+
+int build_breach_index(const char *src, const char *dest)
+{
+	uint8_t hash[BREACH_HASH_LEN], prev[BREACH_HASH_LEN];
+	uint8_t rec[BREACH_RECORD_SIZE], header[BREACH_HEADER_SIZE];
+	const char *map, *line, *eol, *end;
+	struct index_writer *w;
+	uint64_t *table, count, nr;
+	size_t map_len, lineno, bucket;
+
+	if ((map = map_file(src, &map_len)) == NULL)
+	{
+		return -1;
+	}
+
+	CALLOC_ARRAY(table, BREACH_NR_BUCKET + 1);
+	w = xmalloc(sizeof(*w));
+	w->len = 0;
+
+	xiopath = dest;
+	w->fd = xopen(dest, O_WRONLY | O_CREAT | O_TRUNC, FILCRT_BIT);
+	xlseek(w->fd, BREACH_HEADER_SIZE, SEEK_SET);
+
+	nr = lineno = 0;
+	end = map + map_len;
+	for (line = map; line < end; line = eol + 1)
+	{
+		lineno++;
+		if ((eol = memchr(line, '\n', end - line)) == NULL)
+		{
+			eol = end;
+		}
+
+		if (line == eol || (*line == '\r' && line + 1 == eol))
+		{
+			continue;
+		}
+		else if (parse_line(line, eol, hash, &count))
+		{
+			error("%s:%zu: malformed line", src, lineno);
+			goto fail;
+		}
+		else if (nr != 0 && memcmp(prev, hash, BREACH_HASH_LEN) >= 0)
+		{
+			error("%s:%zu: hashes are not sorted", src, lineno);
+			goto fail;
+		}
+
+		memcpy(rec, hash + BREACH_PREFIX_LEN, BREACH_SUFFIX_LEN);
+		put_le(rec + BREACH_SUFFIX_LEN,
+			count > UINT32_MAX ? UINT32_MAX : count, 4);
+		writer_add(w, rec, sizeof(rec));
+
+		bucket = hash[0] << 8 | hash[1];
+		table[bucket + 1]++;
+		memcpy(prev, hash, BREACH_HASH_LEN);
+		nr++;
+	}
+
+	for (bucket = 0; bucket < BREACH_NR_BUCKET; bucket++)
+	{
+		table[bucket + 1] += table[bucket];
+	}
+
+	for (bucket = 0; bucket <= BREACH_NR_BUCKET; bucket++)
+	{
+		put_le(rec, table[bucket], 8);
+		writer_add(w, rec, 8);
+	}
+
+	writer_flush(w);
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, BREACH_MAGIC, strlen(BREACH_MAGIC));
+	put_le(header + 8, BREACH_VERSION, 4);
+	put_le(header + 16, nr, 8);
+	put_le(header + 24, BREACH_HEADER_SIZE + nr * BREACH_RECORD_SIZE, 8);
+
+	xlseek(w->fd, 0, SEEK_SET);
+	xwrite(w->fd, header, sizeof(header));
+
+	close(w->fd);
+	unmap_file((void *)map, map_len);
+	free(table);
+	free(w);
+
+	return 0;
+
+fail:
+	close(w->fd);
+	unlink(dest);
+	unmap_file((void *)map, map_len);
+	free(table);
+	free(w);
+
+	return -1;
+}
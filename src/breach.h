@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef BREACH_H
+#define BREACH_H
+
+#define BREACH_HASH_LEN 20
+
+/**
+ * a Pwned Passwords corpus, either the sorted ‘HASH:count’ text file
+ * as published, or the binary index built from it by
+ * build_breach_index()
+ */
+struct breach_db
+{
+	const uint8_t *map;
+	size_t map_len;
+
+	/**
+	 * for an index, records of a bucket (first two bytes of hash)
+	 * are in between table[bucket] and table[bucket + 1]
+	 */
+	bool indexed;
+	const uint8_t *records;
+	const uint8_t *table;
+	uint64_t nr;
+};
+
+#define BREACH_DB_INIT { 0 }
+
+/**
+ * map the corpus at ‘pathname’, telling the format by its header,
+ * an error message is printed on failure
+ */
+int open_breach_db(struct breach_db *db, const char *pathname);
+
+void close_breach_db(struct breach_db *db);
+
+/**
+ * times a password with SHA-1 ‘hash’ has been seen in breaches,
+ * 0 if never
+ */
+uint64_t lookup_breach_db(const struct breach_db *db,
+			  const uint8_t hash[BREACH_HASH_LEN]);
+
+/**
+ * compute the SHA-1 of ‘password’ as the corpus is keyed by it
+ */
+void breach_hash(const char *password, size_t len,
+		 uint8_t hash[BREACH_HASH_LEN]);
+
+/**
+ * convert the text corpus at ‘src’ to an index at ‘dest’, the source
+ * must be sorted by hash
+ */
+int build_breach_index(const char *src, const char *dest);
+
+#endif /* BREACH_H */
@@ -119,7 +119,7 @@ uint8_t *serialize_cipher_config(
 
 	if (key->buf != NULL)
 	{
-		append_field(blob, FIELD_KEY + key->is_binary,
+		append_field(blob, FIELD_KEY_PASSPHRASE + key->is_binary,
 				key->buf, key->len);
 	}
 
@@ -148,12 +148,12 @@ int deserialize_cipher_config(
 {
 	const uint8_t *buf0, *buf9;
 	void *fmap[] = {
-		&config->kdf_algorithm,
-		&config->hmac_algorithm,
-		&config->compatibility,
-		&config->page_size,
-		&config->kdf_iter,
-		&key->buf,
+		[FIELD_KDF_ALGORITHM] = &config->kdf_algorithm,
+		[FIELD_HMAC_ALGORITHM] = &config->hmac_algorithm,
+		[FIELD_COMPATIBILITY]  = &config->compatibility,
+		[FIELD_PAGE_SIZE]      = &config->page_size,
+		[FIELD_KDF_ITER]       = &config->kdf_iter,
+		[FIELD_KEY]            = &key->buf,
 	};
 
 	buf0 = buf;
@@ -181,9 +181,10 @@ int deserialize_cipher_config(
 	{
 	case FIELD_KDF_ALGORITHM:
 	case FIELD_HMAC_ALGORITHM:
-		*(char **)fmap[type] = xmalloc(dtlen);
+		*(char **)fmap[type] = xmalloc(dtlen + 1);
 
 		memcpy(*(char **)fmap[type], buf, dtlen);
+		(*(char **)fmap[type])[dtlen] = 0;
 
 		break;
 	case FIELD_COMPATIBILITY:
@@ -194,7 +195,7 @@ int deserialize_cipher_config(
 		break;
 	case FIELD_KEY_PASSPHRASE:
 	case FIELD_KEY_BINARY:
-		*(uint8_t **)fmap[FIELD_KEY] = xmalloc(dtlen);
+		*(uint8_t **)fmap[FIELD_KEY] = secure_alloc(dtlen);
 
 		memcpy(*(uint8_t **)fmap[FIELD_KEY], buf, dtlen);
 		key->len = dtlen;
@@ -227,7 +228,10 @@ void free_cipher_config(struct cipher_config *cc, struct cipher_key *ck)
 {
 	free(cc->kdf_algorithm);
 	free(cc->hmac_algorithm);
-	sfree(ck->buf, ck->len);
+
+	/* ck->buf lives in the secure arena */
+	ck->buf = NULL;
+	ck->len = 0;
 }
 
 int find_cipher_config(const char **path)
@@ -267,7 +271,7 @@ int resolve_cipher_config(
 
 	xlseek(fd, 0, SEEK_SET);
 
-	buf = xmalloc(len);
+	buf = secure_alloc(len);
 	xread(fd, buf, len);
 
 	close(fd);
@@ -285,38 +289,140 @@ int resolve_cipher_config(
 	return 0;
 }
 
-char *format_apply_cc_sqlstr(struct cipher_config *cc)
+char *format_apply_cc_sqlstr_routine(
+	const struct cipher_config *cc, const char *schema)
 {
 	struct strbuf *sb = STRBUF_INIT_PTR;
+	const char *dot;
+
+	dot = ".";
+	if (schema == NULL)
+	{
+		schema = "";
+		dot = "";
+	}
 
 	if (cc->kdf_algorithm != NULL)
 	{
-		strbuf_printf(sb, "PRAGMA cipher_kdf_algorithm = %s;",
-				cc->kdf_algorithm);
+		strbuf_printf(sb, "PRAGMA %s%scipher_kdf_algorithm = %s;",
+				schema, dot, cc->kdf_algorithm);
 	}
 
 	if (cc->hmac_algorithm != NULL)
 	{
-		strbuf_printf(sb, "PRAGMA cipher_hmac_algorithm = %s;",
-				cc->hmac_algorithm);
+		strbuf_printf(sb, "PRAGMA %s%scipher_hmac_algorithm = %s;",
+				schema, dot, cc->hmac_algorithm);
 	}
 
 	if (cc->kdf_iter != CPRDEF_KDF_ITER)
 	{
-		strbuf_printf(sb, "PRAGMA kdf_iter = %d;", cc->kdf_iter);
+		strbuf_printf(sb, "PRAGMA %s%skdf_iter = %d;",
+				schema, dot, cc->kdf_iter);
 	}
 
 	if (cc->page_size != CPRDEF_PAGE_SIZE)
 	{
-		strbuf_printf(sb, "PRAGMA cipher_page_size = %d;",
-				cc->page_size);
+		strbuf_printf(sb, "PRAGMA %s%scipher_page_size = %d;",
+				schema, dot, cc->page_size);
 	}
 
 	if (cc->compatibility != CPRDEF_COMPATIBILITY)
 	{
-		strbuf_printf(sb, "PRAGMA cipher_compatibility = %d;",
-				cc->compatibility);
+		strbuf_printf(sb, "PRAGMA %s%scipher_compatibility = %d;",
+				schema, dot, cc->compatibility);
 	}
 
 	return sb->capacity == 0 ? NULL : sb->buf;
 }
+
+bool prune_cipher_config(struct cipher_config *cc, bool use_passphrase)
+{
+	bool use_cc;
+
+	use_cc = false;
+
+	/* kdf algorithm */
+	if (cc->kdf_algorithm != NULL)
+	{
+/* START IF */
+	if (!use_passphrase)
+	{
+		warning("Setting the KDF algorithm on a "
+			 "non-passphrase key has no effect.");
+		cc->kdf_algorithm = NULL;
+	}
+	else if (!is_cc_kdf_algorithm(cc->kdf_algorithm))
+	{
+		exit(error("invalid KDF algorithm ‘%s’", cc->kdf_algorithm));
+	}
+	else
+	{
+		use_cc |= strcmp(cc->kdf_algorithm, CPRDEF_KDF_ALGORITHM);
+	}
+/* END IF */
+	}
+
+	/* hmac algorithm */
+	if (cc->hmac_algorithm != NULL)
+	{
+/* START IF */
+	if (!is_cc_hmac_algorithm(cc->hmac_algorithm))
+	{
+		exit(error("invalid HMAC algorithm ‘%s’", cc->hmac_algorithm));
+	}
+	else
+	{
+		use_cc |= strcmp(cc->hmac_algorithm, CPRDEF_HMAC_ALGORITHM);
+	}
+/* END IF */
+	}
+
+	/* kdf iter */
+	if (cc->kdf_iter == CPRDEF_KDF_ITER);
+	else if (!use_passphrase)
+	{
+		warning("Setting the KDF iteration times on a "
+			  "non-passphrase key has no effect.");
+		cc->kdf_iter = CPRDEF_KDF_ITER;
+	}
+	else
+	{
+		use_cc |= true;
+	}
+
+	/* page size */
+	if (!is_cc_page_size(cc->page_size))
+	{
+		exit(error("invalid page size ‘%u’", cc->page_size));
+	}
+	use_cc |= cc->page_size != CPRDEF_PAGE_SIZE;
+
+	/* compatibility */
+	if (!is_cc_compatibility(cc->compatibility))
+	{
+		exit(error("invalid cipher compatibility "
+			    "‘%u’", cc->compatibility));
+	}
+	use_cc |= cc->compatibility != CPRDEF_COMPATIBILITY;
+
+	return use_cc;
+}
+
+void persist_cipher_config(
+	const char *pathname,
+	const struct cipher_config *cc, const struct cipher_key *ck)
+{
+	uint8_t *buf, *digest;
+	size_t len;
+
+	buf = serialize_cipher_config(cc, ck, &len);
+	digest = digest_message_sha256(buf, len);
+
+	memcpy(buf + len, digest, CIPHER_DIGEST_LENGTH);
+	clean_digest(digest);
+
+	len += CIPHER_DIGEST_LENGTH;
+
+	populate_file(pathname, buf, len);
+	sfree(buf, len);
+}
@@ -76,7 +76,7 @@ struct cipher_key
 	findstr(algo, cc_hmac_algorithm_list)
 
 #define is_cc_page_size(sz)\
-	( in_range_i(sz, CPRMIN_PAGE_SIZE, CPRMAX_PAGE_SIZE) || !is_pow2(sz) )
+	( in_range_i(sz, CPRMIN_PAGE_SIZE, CPRMAX_PAGE_SIZE) && is_pow2(sz) )
 
 #define is_cc_compatibility(cap)\
 	in_range_i(cap, CPRMIN_COMPATIBILITY, CPRMAX_COMPATIBILITY)
@@ -103,6 +103,27 @@ int find_cipher_config(const char **path);
 
 int resolve_cipher_config(const char *pathname, uint8_t **buf, off_t *len);
 
-char *format_apply_cc_sqlstr(struct cipher_config *cc);
+/**
+ * check the values of ‘cc’ and exit on invalid one, settings that have
+ * no effect on a non-passphrase key are reset to their default values
+ *
+ * returns true if ‘cc’ differs from the default cipher config
+ */
+bool prune_cipher_config(struct cipher_config *cc, bool use_passphrase);
+
+/**
+ * serialize ‘cc’ and ‘ck’, and write them along with
+ * the message digest to ‘pathname’
+ */
+void persist_cipher_config(const char *pathname, const struct cipher_config *cc, const struct cipher_key *ck);
+
+/**
+ * format pragmas that apply ‘cc’ to database ‘schema’, returns NULL
+ * if ‘cc’ matches the default cipher config
+ */
+char *format_apply_cc_sqlstr_routine(const struct cipher_config *cc, const char *schema);
+
+#define format_apply_cc_sqlstr(cc)\
+	format_apply_cc_sqlstr_routine(cc, NULL)
 
 #endif /* CIPHER_CONFIG_H */
@@ -24,14 +24,29 @@
 #include "strlist.h"
 #include "algorithm.h"
 #include "strbuf.h"
+#include "hashmap.h"
 
+int cmd_complete(int argc, const char **argv, const char *prefix);
+int cmd_audit  (int argc,  const char **argv, const char *prefix);
+int cmd_backup (int argc,  const char **argv, const char *prefix);
+int cmd_breach_index(int argc, const char **argv, const char *prefix);
 int cmd_count  (int argc,  const char **argv, const char *prefix);
 int cmd_create (int argc,  const char **argv, const char *prefix);
 int cmd_delete (int argc,  const char **argv, const char *prefix);
+int cmd_diff   (int argc,  const char **argv, const char *prefix);
+int cmd_export (int argc,  const char **argv, const char *prefix);
+int cmd_gc     (int argc,  const char **argv, const char *prefix);
 int cmd_help   (int argc,  const char **argv, const char *prefix);
+int cmd_history(int argc,  const char **argv, const char *prefix);
 int cmd_init   (int argc,  const char **argv, const char *prefix);
 int cmd_makekey(int argc,  const char **argv, const char *prefix);
 int cmd_read   (int argc,  const char **argv, const char *prefix);
+int cmd_rekey  (int argc,  const char **argv, const char *prefix);
+int cmd_restore(int argc,  const char **argv, const char *prefix);
+int cmd_session(int argc,  const char **argv, const char *prefix);
+int cmd_snapshot(int argc, const char **argv, const char *prefix);
+int cmd_sync   (int argc,  const char **argv, const char *prefix);
+int cmd_tag    (int argc,  const char **argv, const char *prefix);
 int cmd_update (int argc,  const char **argv, const char *prefix);
 int cmd_version(int argc,  const char **argv, const char *prefix);
 
@@ -41,47 +56,64 @@ int cmd_reset  (int argc,  const char **argv, const char *prefix);
 	array_iterate_each_t(iter, command_list, (iter)->name)
 
 const struct cmdinfo command_list[] = {
-	{ "count",    cmd_count,  USE_CREDDB },
-	{ "create",   cmd_create, USE_CREDDB | USE_RECFILE },
-	{ "delete",   cmd_delete, USE_CREDDB },
-	{ "help",     cmd_help },
+	{ "__complete", cmd_complete },
+	{ "audit",    cmd_audit,   USE_CREDDB | IN_SESSION },
+	{ "backup",   cmd_backup,  USE_CREDDB },
+	{ "breach-index", cmd_breach_index },
+	{ "count",    cmd_count,   USE_CREDDB | IN_SESSION },
+	{ "create",   cmd_create,  USE_CREDDB | USE_RECFILE | IN_SESSION },
+	{ "delete",   cmd_delete,  USE_CREDDB | IN_SESSION },
+	{ "diff",     cmd_diff,    USE_CREDDB },
+	{ "export",   cmd_export,  USE_CREDDB | IN_SESSION },
+	{ "gc",       cmd_gc,      USE_CREDDB },
+	{ "help",     cmd_help,    IN_SESSION },
+	{ "history",  cmd_history, USE_CREDDB | IN_SESSION },
 	{ "init",     cmd_init },
-	{ "makekey",  cmd_makekey },
-	{ "read",     cmd_read, USE_CREDDB },
+	{ "makekey",  cmd_makekey, IN_SESSION },
+	{ "read",     cmd_read,    IN_SESSION },
+	{ "rekey",    cmd_rekey,   USE_CREDDB },
+	{ "restore",  cmd_restore, USE_CREDDB | IN_SESSION },
+	{ "session",  cmd_session, USE_CREDDB },
+	{ "snapshot", cmd_snapshot, USE_CREDDB },
+	{ "sync",     cmd_sync,    USE_CREDDB },
+	{ "tag",      cmd_tag,     USE_CREDDB | IN_SESSION },
 	/* { "show",     cmd_show, USE_CREDDB  }, */
-	{ "update",   cmd_update, USE_CREDDB | USE_RECFILE },
-	{ "version",  cmd_version },
+	{ "update",   cmd_update,  USE_CREDDB | USE_RECFILE | IN_SESSION },
+	{ "version",  cmd_version, IN_SESSION },
 	/* { "validate", cmd_validate, USE_CREDDB  }, */
 #ifdef PK_DEBUG
-	{ "reset",    cmd_reset, USE_CREDDB },
+	{ "reset",    cmd_reset,   USE_CREDDB },
 #endif
 	{ NULL },
 };
 
+DEFINE_STRMAP(command_map, const struct cmdinfo *)
+
 const struct cmdinfo *find_command(const char *cmd)
 {
+	static struct command_map map = HASHMAP_INIT;
+	struct command_map_entry *entry;
 	const struct cmdinfo *iter;
+	bool found;
 
-	iterate_command_list(iter)
+	/* a session looks commands up once per line */
+	if (map.nr == 0)
 	{
-		if (!strcmp(cmd, iter->name))
+		iterate_command_list(iter)
 		{
-			return iter;
+			entry = command_map_insert(&map, iter->name, &found);
+			entry->value = iter;
 		}
 	}
 
-	return NULL;
-}
+	entry = command_map_find(&map, cmd);
 
-static int command_distance_compar(const void *o1, const void *o2)
-{
-	struct strlist_elem *e1, *e2;
+	return entry == NULL ? NULL : entry->value;
+}
 
-	e1 = (struct strlist_elem *)o1;
-	e2 = (struct strlist_elem *)o2;
+#define command_distance(elem) ((uint64_t)(elem)->ext)
 
-	return e1->ext - e2->ext;
-}
+DEFINE_RADIX_SORT(sort_by_distance, struct strlist_elem, command_distance)
 
 char **get_approximate_command(const char *cmd)
 {
@@ -91,7 +123,11 @@ char **get_approximate_command(const char *cmd)
 
 	iterate_command_list(iter)
 	{
-		strlist_push(&sl, iter->name);
+		/* hidden commands are never suggested */
+		if (*iter->name != '_')
+		{
+			strlist_push(&sl, iter->name);
+		}
 	}
 
 	array_for_each(i, sl.size)
@@ -108,7 +144,7 @@ char **get_approximate_command(const char *cmd)
 
 	}
 
-	MSORT(sl.elvec, sl.size, command_distance_compar);
+	sort_by_distance(sl.elvec, sl.size);
 
 	if ((most_similar = sl.elvec[0].ext) > 5)
 	{
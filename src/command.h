@@ -27,6 +27,8 @@ enum cmdreq
 {
 	USE_CREDDB  = 1 << 0,
 	USE_RECFILE = 1 << 1,
+	/* can be run by ‘pk session’ */
+	IN_SESSION  = 1 << 2,
 };
 
 struct cmdinfo
@@ -36,6 +38,8 @@ struct cmdinfo
 	enum cmdreq reqs;
 };
 
+extern const struct cmdinfo command_list[];
+
 const struct cmdinfo *find_command(const char *cmd);
 
 char **get_approximate_command(const char *cmd);
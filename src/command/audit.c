@@ -0,0 +1,400 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "cred-db.h"
+#include "security.h"
+#include "thread-pool.h"
+#include "password-strength.h"
+#include "breach.h"
+#include "hashmap.h"
+#include "region.h"
+
+#define SELECT_AUDIT_SQLSTR						\
+	"SELECT id, password, CAST(julianday('now') - "			\
+	"julianday(coalesce(modtime, sqltime)) AS INTEGER) "		\
+	"FROM account ORDER BY id;"
+
+/**
+ * rows are digested in chunks, so that handing a task out is cheap
+ * compared to the work done on it
+ */
+#define AUDIT_CHUNK_SIZE 1024
+
+/**
+ * digests are compared by this many leading bytes, which is plenty
+ * to tell apart passwords within one database
+ */
+#define AUDIT_DIGEST_LENGTH 16
+
+#define NO_ROW SIZE_MAX
+
+struct audit_row
+{
+	int64_t id;
+	char *password;
+	size_t pw_len;
+	int64_t age;
+
+	uint8_t digest[AUDIT_DIGEST_LENGTH];
+	unsigned bits;
+	uint64_t breached;
+
+	/**
+	 * next row sharing the same password, in id order
+	 */
+	size_t next;
+	bool is_repeat;
+};
+
+struct audit_chunk
+{
+	struct audit_row *rows;
+	size_t nr;
+};
+
+struct audit_context
+{
+	uint8_t key[BINKEY_LEN];
+	const struct dictionary *dict;
+	const struct breach_db *breach;
+};
+
+/**
+ * digests are keyed and uniformly distributed, any of their bytes is
+ * as good as a hash
+ */
+static inline uint64_t digest_hash(const uint8_t *digest)
+{
+	uint64_t hash;
+
+	memcpy(&hash, digest, sizeof(hash));
+
+	return hash;
+}
+
+#define digest_eq(d1, d2) (!memcmp(d1, d2, AUDIT_DIGEST_LENGTH))
+
+/**
+ * last row seen of each password, by digest
+ */
+DEFINE_HASHMAP(reuse_map, const uint8_t *, size_t, digest_hash, digest_eq)
+
+static void audit_chunk(void *task, void *data)
+{
+	struct audit_chunk *chunk;
+	struct audit_context *ctx;
+	struct audit_row *row;
+	uint8_t *digest, sha1[BREACH_HASH_LEN];
+
+	chunk = task;
+	ctx = data;
+
+	for (row = chunk->rows; row < chunk->rows + chunk->nr; row++)
+	{
+		digest = hmac_message_sha256(ctx->key, sizeof(ctx->key),
+				(uint8_t *)row->password, row->pw_len);
+		memcpy(row->digest, digest, sizeof(row->digest));
+		clean_digest(digest);
+
+		row->bits = estimate_strength(row->password,
+					      row->pw_len, ctx->dict);
+
+		if (ctx->breach != NULL)
+		{
+			breach_hash(row->password, row->pw_len, sha1);
+			row->breached = lookup_breach_db(ctx->breach, sha1);
+		}
+	}
+}
+
+/**
+ * passwords are copied to ‘secrets’, which outlives the threads
+ * reading them
+ */
+static size_t load_rows(struct sqlite3 *db, struct audit_row **rows,
+			struct region *secrets)
+{
+	struct sqlite3_stmt *stmt;
+	const char *password;
+	size_t nr, cap, len;
+	int rescode;
+
+	nr = cap = 0;
+	*rows = NULL;
+
+	xsqlite3_prepare_v2(db, SELECT_AUDIT_SQLSTR, -1, &stmt, NULL);
+
+	while ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		CAPACITY_GROW(*rows, nr + 1, cap);
+
+		password = (const char *)sqlite3_column_text(stmt, 1);
+		len = sqlite3_column_bytes(stmt, 1);
+		(*rows)[nr] = (struct audit_row){
+			.id       = sqlite3_column_int64(stmt, 0),
+			.password = region_memdup(secrets, password ?
+						   password : "", len),
+			.pw_len   = len,
+			.age      = sqlite3_column_int64(stmt, 2),
+			.next     = NO_ROW,
+		};
+		nr++;
+	}
+
+	if (rescode != SQLITE_DONE)
+	{
+		exit(report_sqlite_error(sqlite3_step, db));
+	}
+
+	sqlite3_finalize(stmt);
+
+	return nr;
+}
+
+/**
+ * chain rows with equal digests together, the first row of each chain
+ * is the one not marked ‘is_repeat’
+ */
+static void link_reused(struct audit_row *rows, size_t nr)
+{
+	struct reuse_map map = HASHMAP_INIT;
+	struct reuse_map_entry *tail;
+	bool found;
+	size_t i;
+
+	for (i = 0; i < nr; i++)
+	{
+		tail = reuse_map_insert(&map, rows[i].digest, &found);
+
+		if (found)
+		{
+			rows[tail->value].next = i;
+			rows[i].is_repeat = true;
+		}
+
+		tail->value = i;
+	}
+
+	reuse_map_destroy(&map);
+}
+
+static void print_id_list(const struct audit_row *rows,
+			  const size_t *idx, size_t nr)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++)
+	{
+		printf("%s%"PRId64, i ? " " : "", rows[idx[i]].id);
+	}
+
+	putchar('\n');
+}
+
+static int report_reused(const struct audit_row *rows, size_t nr)
+{
+	size_t i, j, n, *group;
+	int found;
+
+	found = 0;
+	MALLOC_ARRAY(group, nr);
+
+	for (i = 0; i < nr; i++)
+	{
+		if (rows[i].is_repeat || rows[i].next == NO_ROW)
+		{
+			continue;
+		}
+
+		if (!found++)
+		{
+			puts("# reused passwords");
+		}
+
+		for (n = 0, j = i; j != NO_ROW; j = rows[j].next)
+		{
+			group[n++] = j;
+		}
+
+		print_id_list(rows, group, n);
+	}
+
+	free(group);
+
+	return found;
+}
+
+static int report_matching(const struct audit_row *rows, size_t nr,
+			   bool (*match)(const struct audit_row *, int64_t),
+			   int64_t limit, const char *title)
+{
+	size_t i, n, *idx;
+
+	MALLOC_ARRAY(idx, nr);
+
+	for (i = n = 0; i < nr; i++)
+	{
+		if (match(&rows[i], limit))
+		{
+			idx[n++] = i;
+		}
+	}
+
+	if (n != 0)
+	{
+		printf(title, limit);
+		putchar('\n');
+		print_id_list(rows, idx, n);
+	}
+
+	free(idx);
+
+	return n != 0;
+}
+
+static bool is_weak(const struct audit_row *row, int64_t min_bits)
+{
+	return row->bits < min_bits;
+}
+
+static bool is_breached(const struct audit_row *row, UNUSED int64_t arg)
+{
+	return row->breached != 0;
+}
+
+static bool is_stale(const struct audit_row *row, int64_t max_age)
+{
+	return row->age > max_age;
+}
+
+int cmd_audit(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey        = 0;
+	unsigned max_age      = 365;
+	unsigned min_bits     = 50;
+	unsigned nr_jobs      = 0;
+	const char *dict_path = NULL;
+	const char *breach_db = NULL;
+
+	const struct option cmd_audit_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_UNSIGNED(0, "max-age", &max_age,
+				"days after which a password is stale"),
+		OPTION_UNSIGNED(0, "min-bits", &min_bits,
+				"estimated entropy below which a password "
+				"is weak"),
+		OPTION_FILENAME(0, "dict", &dict_path,
+				"word list to guess passwords from"),
+		OPTION_FILENAME(0, "breach-db", &breach_db,
+				"Pwned Passwords corpus or its index"),
+		OPTION_UNSIGNED('j', "jobs", &nr_jobs,
+				"number of threads auditing records"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_audit_usages[] = {
+		"pk audit [--cmdkey] [--max-age <days>] [--min-bits <n>] "
+		"[--dict <file>] [--breach-db <file>] [--jobs <n>]",
+		NULL,
+	};
+
+	parse_options(argc, argv, prefix, cmd_audit_options,
+			cmd_audit_usages, PARSER_ABORT_NON_OPTION);
+
+	struct dictionary dict = DICTIONARY_INIT;
+	struct breach_db breach = BREACH_DB_INIT;
+	struct audit_context ctx = {
+		.dict   = dict_path ? &dict : NULL,
+		.breach = breach_db ? &breach : NULL,
+	};
+
+	if (dict_path != NULL && load_dictionary(&dict, dict_path))
+	{
+		exit(error("unable to load dictionary ‘%s’", dict_path));
+	}
+
+	if (breach_db != NULL && open_breach_db(&breach, breach_db))
+	{
+		exit(error("unable to load breach corpus ‘%s’", breach_db));
+	}
+
+	struct sqlite3 *db;
+	struct audit_row *rows;
+	struct region secrets = REGION_INIT_SECURE;
+	size_t nr_row, nr_chunk, i;
+	uint8_t *key;
+
+	db = open_cred_db(SQLITE_OPEN_READONLY, use_cmdkey);
+	nr_row = load_rows(db, &rows, &secrets);
+	close_cred_db(db);
+
+	/**
+	 * the key only lives for this run, digests never leave the
+	 * process and can't be precomputed for a password list
+	 */
+	key = ctx.key;
+	if (random_bytes_buffered(&key, sizeof(ctx.key)))
+	{
+		exit(-1);
+	}
+
+	struct audit_chunk *chunks;
+
+	nr_chunk = (nr_row + AUDIT_CHUNK_SIZE - 1) / AUDIT_CHUNK_SIZE;
+	MALLOC_ARRAY(chunks, nr_chunk);
+
+	for (i = 0; i < nr_chunk; i++)
+	{
+		chunks[i].rows = rows + i * AUDIT_CHUNK_SIZE;
+		chunks[i].nr = i + 1 < nr_chunk ?
+			AUDIT_CHUNK_SIZE : nr_row - i * AUDIT_CHUNK_SIZE;
+	}
+
+	run_thread_pool(chunks, nr_chunk, sizeof(*chunks),
+			audit_chunk, &ctx, nr_jobs);
+
+	zeromem(ctx.key, sizeof(ctx.key));
+	free(chunks);
+
+	region_destroy(&secrets);
+
+	link_reused(rows, nr_row);
+
+	int found;
+
+	found = report_reused(rows, nr_row);
+	found |= report_matching(rows, nr_row, is_breached, 0,
+				 "# breached passwords");
+	found |= report_matching(rows, nr_row, is_weak, min_bits,
+				 "# weak passwords (< %"PRId64" bits)");
+	found |= report_matching(rows, nr_row, is_stale, max_age,
+				 "# passwords older than %"PRId64" days");
+
+	free_dictionary(&dict);
+	close_breach_db(&breach);
+	free((char *)dict_path);
+	free((char *)breach_db);
+	free(rows);
+
+	return found;
+}
@@ -0,0 +1,266 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "filesys.h"
+#include "strbuf.h"
+#include "cred-db.h"
+#include "atexit-chain.h"
+
+#define BACKUP_STREAM_CHUNK 65536
+
+static char *backup_path;
+
+static void rm_backup_file(void)
+{
+	if (backup_path != NULL)
+	{
+		unlink(backup_path);
+	}
+}
+
+/**
+ * copy ‘src’ to ‘dest’ ‘nr_page’ pages at a time, the read lock on
+ * ‘src’ is dropped between steps, so writers only wait for one step
+ */
+static int run_backup(struct sqlite3 *dest, struct sqlite3 *src,
+		      int nr_page, int sleep_ms)
+{
+	struct sqlite3_backup *backup;
+	bool show_progress;
+	int rescode, percent, last;
+
+	if ((backup = sqlite3_backup_init(dest, "main",
+					  src, "main")) == NULL)
+	{
+		return error_sqlerr(dest, "cannot start backup of ‘%s’",
+				     cred_db_path);
+	}
+
+	show_progress = isatty(STDERR_FILENO);
+	last = -1;
+
+	while ((rescode = sqlite3_backup_step(backup, nr_page)) != SQLITE_DONE)
+	{
+		if (rescode != SQLITE_OK && rescode != SQLITE_BUSY &&
+		     rescode != SQLITE_LOCKED)
+		{
+			break;
+		}
+
+		percent = 100 - sqlite3_backup_remaining(backup) * 100 /
+				 (sqlite3_backup_pagecount(backup) + 1);
+
+		if (show_progress && percent != last)
+		{
+			last = percent;
+			fprintf(stderr, "\rBacking up: %3d%%", percent);
+		}
+
+		sqlite3_sleep(sleep_ms);
+	}
+
+	if (show_progress)
+	{
+		fputs(rescode == SQLITE_DONE ?
+			"\rBacking up: 100%, done.\n" : "\n", stderr);
+	}
+
+	if ((rescode = sqlite3_backup_finish(backup)) == SQLITE_OK)
+	{
+		return 0;
+	}
+
+	report_sqlite_error(sqlite3_backup_finish, dest);
+
+	/**
+	 * pages are copied as they are, the cipher of destination may
+	 * take another key but not another page size or HMAC setting
+	 */
+	if (rescode == SQLITE_READONLY)
+	{
+		note("A cipher config with another page layout needs "
+		     "‘pk rekey’.");
+	}
+
+	return -1;
+}
+
+static void stream_file(const char *path)
+{
+	char *buf;
+	ssize_t nr;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+	{
+		exit(error_errno("cannot open backup ‘%s’", path));
+	}
+
+	buf = xmalloc(BACKUP_STREAM_CHUNK);
+
+	while ((nr = read(fd, buf, BACKUP_STREAM_CHUNK)) > 0)
+	{
+		if (fwrite(buf, 1, nr, stdout) != (size_t)nr)
+		{
+			exit(error_errno("cannot write backup to stdout"));
+		}
+	}
+
+	if (nr == -1)
+	{
+		exit(error_errno("cannot read backup ‘%s’", path));
+	}
+
+	fflush(stdout);
+	close(fd);
+	free(buf);
+}
+
+int cmd_backup(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey       = 0;
+	int use_dest_cmdkey  = 0;
+	const char *dest_cc  = NULL;
+	unsigned nr_page     = 128;
+	unsigned sleep_ms    = 10;
+
+	const struct option cmd_backup_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_COUNTUP(0, "dest-cmdkey", &use_dest_cmdkey,
+				"read key of the backup from command line"),
+		OPTION_FILENAME(0, "dest-cc", &dest_cc,
+				"cipher config of the backup"),
+		OPTION_UNSIGNED(0, "pages", &nr_page,
+				"pages copied per step"),
+		OPTION_UNSIGNED(0, "sleep-ms", &sleep_ms,
+				"milliseconds to sleep between steps"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_backup_usages[] = {
+		"pk backup [--cmdkey] [--dest-cmdkey] [--dest-cc <file>]\n"
+		"          [--pages <n>] [--sleep-ms <ms>] (<file> | -)",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_backup_options,
+				cmd_backup_usages, 0);
+
+	if (argc != 1)
+	{
+		exit(error(argc == 0 ? "no backup file specified" :
+					"too many arguments"));
+	}
+
+	if (nr_page == 0 || nr_page > INT_MAX)
+	{
+		exit(error("invalid page count %u", nr_page));
+	}
+
+	struct sqlite3 *src, *dest;
+	struct cred_key key, dest_key;
+	const char *cc_path;
+	bool to_stdout;
+
+	to_stdout = !strcmp(argv[0], "-");
+
+	/* sqlite3 writes the backup, so it's staged next to cred db */
+	backup_path = to_stdout ? concat(cred_db_path, ".backup") :
+				  prefix_filename(prefix, argv[0]);
+
+	if (access(backup_path, F_OK) != 0);
+	else if (!to_stdout)
+	{
+		exit(error("‘%s’ already exists", backup_path));
+	}
+	else if (unlink(backup_path) != 0)
+	{
+		exit(error_errno("cannot remove stale file ‘%s’",
+				  backup_path));
+	}
+
+	cc_path = cred_cc_path;
+	if (find_cipher_config(&cc_path) != 0)
+	{
+		exit(error_errno("failed to find cipher config "
+				  "‘%s’", cred_cc_path));
+	}
+
+	EOE(resolve_cred_key(&key, cc_path, use_cmdkey));
+
+	if (connect_cred_db(&src, cred_db_path,
+			     SQLITE_OPEN_READONLY, &key) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	dest_key = key;
+	if (dest_cc != NULL || use_dest_cmdkey)
+	{
+		cc_path = dest_cc;
+		if (cc_path != NULL && find_cipher_config(&cc_path) != 0)
+		{
+			exit(error_errno("failed to find cipher config "
+					  "‘%s’", dest_cc));
+		}
+
+		EOE(resolve_cred_key(&dest_key, cc_path, use_dest_cmdkey));
+	}
+
+	atexit_chain_push(rm_backup_file);
+
+	if (connect_cred_db(&dest, backup_path,
+			     SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+			     &dest_key) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	EOE(run_backup(dest, src, nr_page, sleep_ms));
+
+	sqlite3_close(dest);
+	sqlite3_close(src);
+
+	if (to_stdout)
+	{
+		stream_file(backup_path);
+		unlink(backup_path);
+	}
+	else
+	{
+		printf("Backed up ‘%s’ to ‘%s’.\n", cred_db_path, backup_path);
+	}
+
+	atexit_chain_pop(/* rm_backup_file */);
+
+	if (dest_cc != NULL || use_dest_cmdkey)
+	{
+		free_cred_key(&dest_key);
+	}
+
+	free_cred_key(&key);
+	free(backup_path);
+	free((char *)dest_cc);
+
+	return 0;
+}
@@ -0,0 +1,58 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "breach.h"
+#include "filesys.h"
+
+int cmd_breach_index(int argc, const char **argv, const char *prefix)
+{
+	const struct option cmd_breach_index_options[] = {
+		OPTION_END(),
+	};
+
+	const char *const cmd_breach_index_usages[] = {
+		"pk breach-index <corpus> <index>",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_breach_index_options,
+				cmd_breach_index_usages, 0);
+
+	if (argc != 2)
+	{
+		exit(error("expected a corpus and an index path"));
+	}
+
+	char *src, *dest;
+	int rescode;
+
+	src = prefix_filename(prefix, argv[0]);
+	dest = prefix_filename(prefix, argv[1]);
+
+	rescode = build_breach_index(src, dest);
+
+	free(src);
+	free(dest);
+
+	return rescode;
+}
@@ -0,0 +1,203 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "command.h"
+#include "completion.h"
+#include "strlist.h"
+
+#define BASH_COMPLETION_SCRIPT						\
+"_pk()\n"								\
+"{\n"									\
+"	local cur=${COMP_WORDS[COMP_CWORD]} word\n"			\
+"\n"									\
+"	COMPREPLY=()\n"							\
+"	while IFS= read -r word; do\n"					\
+"		[[ $word == \"$cur\"* ]] && COMPREPLY+=(\"$word\")\n"	\
+"	done < <(pk __complete -- \"${COMP_WORDS[@]:1:COMP_CWORD}\" "	\
+		"2>/dev/null)\n"					\
+"}\n"									\
+"\n"									\
+"complete -o default -F _pk pk\n"
+
+#define ZSH_COMPLETION_SCRIPT						\
+"_pk()\n"								\
+"{\n"									\
+"	local -a candidates\n"						\
+"\n"									\
+"	candidates=(\"${(@f)$(pk __complete -- \"${(@)words[2,CURRENT]}\" "\
+		"2>/dev/null)}\")\n"					\
+"	compadd -a candidates\n"					\
+"}\n"									\
+"\n"									\
+"compdef _pk pk\n"
+
+#define FISH_COMPLETION_SCRIPT						\
+"function __pk_complete\n"						\
+"	set -l words (commandline -opc) (commandline -ct)\n"		\
+"	pk __complete -- $words[2..-1] 2>/dev/null\n"			\
+"end\n"									\
+"\n"									\
+"complete -c pk -f -a '(__pk_complete)'\n"
+
+static const struct
+{
+	const char *shell;
+	const char *script;
+} script_list[] = {
+	{ "bash", BASH_COMPLETION_SCRIPT },
+	{ "zsh",  ZSH_COMPLETION_SCRIPT },
+	{ "fish", FISH_COMPLETION_SCRIPT },
+	{ NULL },
+};
+
+/* options whose values are sitenames */
+static const char *const sitename_options[] = {
+	"--sitename",
+	"--search",
+	NULL,
+};
+
+/* commands whose arguments are sitenames */
+static const char *const sitename_commands[] = {
+	"read",
+	NULL,
+};
+
+static void complete_command(void)
+{
+	const struct cmdinfo *cmd;
+
+	for (cmd = command_list; cmd->name != NULL; cmd++)
+	{
+		if (*cmd->name != '_')
+		{
+			puts(cmd->name);
+		}
+	}
+}
+
+static void complete_sitename(void)
+{
+	char *names;
+	size_t len;
+
+	if (read_completion_cache(&names, &len) == 0)
+	{
+		fwrite(names, 1, len, stdout);
+		free(names);
+	}
+}
+
+/**
+ * ‘words’ are the words after ‘pk’, the last one is the word being
+ * completed, candidates are printed one per line and filtered by
+ * the shell
+ */
+static int complete_words(int nr, const char **words, const char *prefix)
+{
+	const struct cmdinfo *cmd;
+	const char *cur, *prev;
+	const char *helper[] = { "--pk-completion-helper", NULL };
+	int i;
+
+	cmd = NULL;
+	for (i = 0; i < nr - 1 && cmd == NULL; i++)
+	{
+		if (*words[i] != '-')
+		{
+			cmd = find_command(words[i]);
+		}
+	}
+
+	cur = nr > 0 ? words[nr - 1] : "";
+	prev = nr > 1 ? words[nr - 2] : "";
+
+	/* bash breaks ‘--opt=val’ into three words */
+	if (!strcmp(prev, "=") && nr > 2)
+	{
+		prev = words[nr - 3];
+	}
+
+	if (cmd == NULL)
+	{
+		if (*cur != '-')
+		{
+			complete_command();
+		}
+	}
+	else if (*cur == '-')
+	{
+		/* the command lists its options and exits */
+		cmd->handle(1, helper, prefix);
+	}
+	else if (findstr(prev, sitename_options) ||
+		  findstr(cmd->name, sitename_commands))
+	{
+		complete_sitename();
+	}
+
+	return 0;
+}
+
+/**
+ * pk __complete [--shell <name>] [-- <word>...]
+ *
+ * this command answers shell completion without opening any vault,
+ * sitenames come from the completion cache instead
+ */
+int cmd_complete(int argc, const char **argv, const char *prefix)
+{
+	const char *shell = NULL;
+
+	const struct option cmd_complete_options[] = {
+		OPTION_STRING(0, "shell", &shell,
+				"print completion script for the shell"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_complete_usages[] = {
+		"pk __complete [--shell <name>] [-- <word>...]",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_complete_options,
+				cmd_complete_usages, PARSER_UNTIL_NON_OPTION);
+
+	if (shell == NULL)
+	{
+		return complete_words(argc, argv, prefix);
+	}
+
+	size_t i;
+
+	for (i = 0; script_list[i].shell != NULL; i++)
+	{
+		if (!strcmp(shell, script_list[i].shell))
+		{
+			fputs(script_list[i].script, stdout);
+			return 0;
+		}
+	}
+
+	return error("no completion script for ‘%s’", shell);
+}
@@ -21,23 +21,54 @@
 ****************************************************************************/
 
 #include "parse-option.h"
+#include "cred-db.h"
 
-static const char *search_pattern = "%";
-
-const char *const cmd_count_usages[] = {
-	"pk count [--search <pattern>]",
-	NULL,
-};
-
-const struct option cmd_count_options[] = {
-	OPTION_STRING_F(0, "search", &search_pattern, "pattern", "count record for a particular site", OPTION_SHOWARGH),
-	OPTION_END(),
-};
+#define COUNT_ACCOUNT_SQLSTR						\
+	"SELECT count(*) FROM account "					\
+	"WHERE sitename LIKE ? ESCAPE '\\';"
 
 int cmd_count(int argc, const char **argv, const char *prefix)
 {
-	argc = parse_options(argc, argv, prefix, cmd_count_options, cmd_count_usages, PARSER_ABORT_NON_OPTION);
-	printf("s: %s, a: %d\n", search_pattern, argc);
+	int use_cmdkey             = 0;
+	const char *search_pattern = NULL;
+
+	const struct option cmd_count_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_STRING_F(0, "search", &search_pattern, "pattern",
+				"count record for a particular site",
+				OPTION_SHOWARGH),
+		OPTION_END(),
+	};
+
+	const char *const cmd_count_usages[] = {
+		"pk count [--cmdkey] [--search <pattern>]",
+		NULL,
+	};
+
+	parse_options(argc, argv, prefix, cmd_count_options,
+			cmd_count_usages, PARSER_ABORT_NON_OPTION);
+
+	struct sqlite3 *db;
+	struct sqlite3_stmt *stmt;
+	char *pattern;
+
+	db = open_cred_db(SQLITE_OPEN_READONLY, use_cmdkey);
+
+	pattern = make_like_pattern(search_pattern);
+
+	xsqlite3_prepare_v2(db, COUNT_ACCOUNT_SQLSTR, -1, &stmt, NULL);
+	xsqlite3_bind_text(stmt, 1, pattern, -1, SQLITE_STATIC);
+
+	if (sqlite3_step(stmt) != SQLITE_ROW)
+	{
+		exit(report_sqlite_error(sqlite3_step, db));
+	}
+
+	printf("%"PRId64"\n", (int64_t)sqlite3_column_int64(stmt, 0));
+
+	sqlite3_finalize(stmt);
+	close_cred_db(db);
+	free(pattern);
 
 	return 0;
 }
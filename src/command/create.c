@@ -26,9 +26,9 @@
 #include "strbuf.h"
 #include "pkproc.h"
 #include "filesys.h"
-#include "cipher-config.h"
-#include "security.h"
+#include "cred-db.h"
 #include "atexit-chain.h"
+#include "tag.h"
 
 #define INSERT_COMMON_GROUP_SQLSTR		\
 	"INSERT INTO account ("			\
@@ -65,9 +65,20 @@
 		":comment"			\
 	");"
 
+static const char *rec_path;
+
+static int rec_fd = -1;
+
 static void rm_tmp_rec(void)
 {
-	unlink(tmp_rec_path);
+	unlink(rec_path);
+
+	if (rec_fd != -1)
+	{
+		close(rec_fd);
+		free((char *)rec_path);
+		rec_fd = -1;
+	}
 }
 
 int cmd_create(int argc, const char **argv, const char *prefix)
@@ -75,6 +86,7 @@ int cmd_create(int argc, const char **argv, const char *prefix)
 	struct record rec = INIT_RECORD;
 	int use_cmdkey    = 0;
 	int use_editor    = -1;
+	struct strlist tags = STRLIST_INIT_NODUP;
 
 	const struct option cmd_create_options[] = {
 		OPTION__NANO(&use_editor),
@@ -98,6 +110,8 @@ int cmd_create(int argc, const char **argv, const char *prefix)
 		OPTION_GROUP(""),
 		OPTION_STRING(0, "comment", &rec.comment,
 				"you just write what the fuck you want to"),
+		OPTION_STRLIST(0, "tag", &tags, "name",
+				"tag the account, may be repeated"),
 		OPTION_END(),
 	};
 
@@ -146,120 +160,43 @@ int cmd_create(int argc, const char **argv, const char *prefix)
 		goto setup_database;
 	}
 
-	atexit_chain_push(rm_tmp_rec);
-
-	populate_record_file(tmp_rec_path, &rec);
-
-	EOE(edit_file(tmp_rec_path));
-
-	EOE(read_record_file(&rec, tmp_rec_path));
-
-setup_database:;
-	struct sqlite3 *db;
-	bool use_cipher_config;
-
-	msqlite3_pathname = cred_db_path;
-	xsqlite3_open_v2(cred_db_path, &db, SQLITE_OPEN_READWRITE, NULL);
-
-	if (find_cipher_config(&cred_cc_path) != 0)
-	{
-		exit(error_errno("failed to find cipher config "
-				  "‘%s’", cred_cc_path));
-	}
-
-	use_cipher_config = cred_cc_path != NULL;
-
-	if (!use_cipher_config && !use_cmdkey)
-	{
-		goto insert_record;
-	}
-
-	struct cipher_config cc = CC_INIT;
-	struct cipher_key ck = CK_INIT;
-
-	const char *keystr;
-	size_t keylen;
-
-	keystr = NULL;
-	if (use_cmdkey)
-	{
-		if ((ck.len = read_cmdkey((char **)&ck.buf,
-				"[pk] key for decryption: ")) == 0)
-		{
-			return error("Empty keys are illegal.");
-		}
-
-		keystr = (char *)ck.buf;
-		keylen = ck.len;
-	}
-
-	if (!use_cipher_config)
+	rec_path = tmp_rec_path;
+	if (!strcmp(rec_path, PK_TMP_REC_MEMORY) &&
+	     (rec_path = make_memory_file("pk-tmp-rec", &rec_fd)) == NULL)
 	{
-		goto apply_key;
+		return -1;
 	}
 
-	uint8_t *buf;
-	off_t len;
+	atexit_chain_push(rm_tmp_rec);
 
-	if (resolve_cipher_config(cred_cc_path, &buf, &len) != 0)
-	{
-		exit(error_errno("cannot resolve cipher config "
-				  "‘%s’", cred_cc_path));
-	}
+	populate_record_file(rec_path, &rec);
 
-	if (deserialize_cipher_config(&cc, &ck, buf, len) != 0)
-	{
-		exit(error_errno("cannot deserialize cipher config "
-				  "‘%s’", cred_cc_path));
-	}
-
-	sfree(buf, len);
+	EOE(edit_file(rec_path));
 
-	if (keystr != NULL)
+	if (rec_fd != -1)
 	{
-		goto apply_key;
+		EOE(seal_memory_file(rec_fd));
 	}
 
-	if (ck.buf == NULL)
-	{
-		warning("cipher config file at ‘%s’ affects nothing "
-			 "without a key.", cred_cc_path);
+	EOE(read_record_file(&rec, rec_path));
 
-		free_cipher_config(&cc, &ck);
-		goto insert_record;
-	}
-	else if (!ck.is_binary)
-	{
-		keystr = (char *)ck.buf;
-		keylen = ck.len;
-	}
-	else
-	{
-		keylen = bin2blob((char **)&ck.buf, ck.buf, ck.len);
-		keystr = (char *)ck.buf;
-	}
+setup_database:;
+	struct sqlite3 *db;
 
-apply_key:
-	xsqlite3_key(db, keystr, keylen);
+	db = open_cred_db(SQLITE_OPEN_READWRITE, use_cmdkey);
 
-	char *apply_cc_sqlstr;
+	bool have_transaction, in_session;
 
-	if ((apply_cc_sqlstr = format_apply_cc_sqlstr(&cc)) != NULL)
+	/**
+	 * the journal of a session is still in use, and the session
+	 * rolls back a failed command by itself
+	 */
+	if (!(in_session = db == shared_cred_db()))
 	{
-		xsqlite3_exec(db, apply_cc_sqlstr, NULL, NULL, NULL);
-
-		free(apply_cc_sqlstr);
+		atexit_chain_push(rm_journal_file);
 	}
 
-	free_cipher_config(&cc, &ck);
-
-insert_record:
-	xsqlite3_avail(db);
-
-	bool have_transaction;
-
-	atexit_chain_push(rm_journal_file);
-	if ((have_transaction = is_need_transaction(&rec)))
+	if ((have_transaction = is_need_transaction(&rec) || tags.size > 0))
 	{
 		xsqlite3_begin_transaction(db);
 	}
@@ -301,18 +238,29 @@ insert_record:
 		sqlite3_finalize(stmt);
 	}
 
+	size_t i;
+
+	for (i = 0; i < tags.size; i++)
+	{
+		EOE(tag_account(db, account_id, tags.elvec[i].str));
+	}
+	strlist_destroy(&tags, false);
+
 	if (have_transaction)
 	{
 		xsqlite3_end_transaction(db);
 	}
 
-	sqlite3_close(db);
+	close_cred_db(db);
 
 	/**
 	 * at this point, cleanup journal
 	 * file is unnecessary
 	 */
-	atexit_chain_pop();
+	if (!in_session)
+	{
+		atexit_chain_pop();
+	}
 
 	printf("A new record with rowid %"PRId64" was created.\n", account_id);
 	return 0;
@@ -21,8 +21,83 @@
 ****************************************************************************/
 
 #include "parse-option.h"
+#include "cred-db.h"
+
+#define DELETE_ACCOUNT_SQLSTR "DELETE FROM account WHERE id = ?;"
 
 int cmd_delete(int argc, const char **argv, const char *prefix)
 {
-	return 0;
+	int use_cmdkey = 0;
+
+	const struct option cmd_delete_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_END(),
+	};
+
+	const char *const cmd_delete_usages[] = {
+		"pk delete [--cmdkey] <rowid>...",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_delete_options,
+				cmd_delete_usages, 0);
+
+	if (argc == 0)
+	{
+		exit(error("no record specified"));
+	}
+
+	struct sqlite3 *db;
+	struct sqlite3_stmt *stmt;
+	int64_t rowid;
+	char *end;
+	int i, rescode;
+
+	db = open_cred_db(SQLITE_OPEN_READWRITE, use_cmdkey);
+
+	xsqlite3_begin_transaction(db);
+	xsqlite3_prepare_v2(db, DELETE_ACCOUNT_SQLSTR, -1, &stmt, NULL);
+
+	/**
+	 * records are deleted all or nothing, a rowid that is invalid
+	 * or not found rolls back the ones deleted before it
+	 */
+	rescode = 0;
+	for (i = 0; i < argc; i++)
+	{
+		errno = 0;
+		rowid = strtoll(argv[i], &end, 10);
+
+		if (errno != 0 || end == argv[i] || *end != 0)
+		{
+			rescode = error("invalid rowid ‘%s’", argv[i]);
+			break;
+		}
+
+		xsqlite3_bind_int64(stmt, 1, rowid);
+		xsqlite3_step(stmt);
+		sqlite3_reset(stmt);
+
+		if (sqlite3_changes(db) == 0)
+		{
+			rescode = error("no record with rowid %"PRId64, rowid);
+			break;
+		}
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (rescode == 0)
+	{
+		xsqlite3_end_transaction(db);
+		printf("%d record(s) deleted.\n", argc);
+	}
+	else
+	{
+		xsqlite3_rollback_transaction(db);
+	}
+
+	close_cred_db(db);
+
+	return rescode;
 }
@@ -0,0 +1,170 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "filesys.h"
+#include "cred-db.h"
+#include "merkle.h"
+
+#define PEER_SCHEMA "peer"
+
+/* the other vault is read-only, its tree is refreshed in here */
+#define PEER_TREE_SCHEMA "peer_tree"
+
+struct diff_output
+{
+	struct sqlite3_stmt *self_name;
+	struct sqlite3_stmt *peer_name;
+};
+
+static void print_record(struct sqlite3_stmt *stmt, char mark,
+			 const char *uuid)
+{
+	const unsigned char *sitename;
+
+	xsqlite3_bind_text(stmt, 1, uuid, -1, SQLITE_STATIC);
+
+	sitename = NULL;
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		sitename = sqlite3_column_text(stmt, 0);
+	}
+
+	printf("%c %s\t%s\n", mark, uuid,
+		sitename ? (const char *)sitename : "");
+
+	sqlite3_reset(stmt);
+}
+
+static int print_diff(const char *uuid, enum merkle_diff kind, void *out0)
+{
+	struct diff_output *out;
+
+	out = out0;
+	switch (kind)
+	{
+	case MERKLE_ONLY_LEFT:
+		print_record(out->self_name, '-', uuid);
+		break;
+	case MERKLE_ONLY_RIGHT:
+		print_record(out->peer_name, '+', uuid);
+		break;
+	case MERKLE_CHANGED:
+		print_record(out->self_name, '~', uuid);
+		break;
+	}
+
+	return 0;
+}
+
+int cmd_diff(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey      = 0;
+	int use_peer_cmdkey = 0;
+	const char *peer_cc = NULL;
+
+	const struct option cmd_diff_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_COUNTUP(0, "peer-cmdkey", &use_peer_cmdkey,
+				"read key of the other vault from "
+				 "command line"),
+		OPTION_FILENAME(0, "peer-cc", &peer_cc,
+				"cipher config of the other vault"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_diff_usages[] = {
+		"pk diff [--cmdkey] [--peer-cmdkey] [--peer-cc <file>] "
+		"<vault>",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_diff_options,
+				cmd_diff_usages, 0);
+
+	if (argc != 1)
+	{
+		exit(error(argc == 0 ? "no vault to compare with" :
+					"too many arguments"));
+	}
+
+	struct sqlite3 *db;
+	const char *peer_tree;
+	char *peer_path;
+	int rescode;
+
+	peer_path = prefix_filename(prefix, argv[0]);
+
+	db = open_cred_db(SQLITE_OPEN_READWRITE | SQLITE_OPEN_URI,
+			   use_cmdkey);
+
+	attach_peer_cred_db(db, peer_path, peer_cc, use_peer_cmdkey,
+			     PEER_SCHEMA, SQLITE_OPEN_READONLY);
+
+	/* ATTACH is not allowed inside a transaction */
+	EOE(attach_cred_db(db, ":memory:", PEER_TREE_SCHEMA, NULL));
+
+	/**
+	 * bring both trees up to date, this only costs as much as
+	 * changes made since the last refresh; the tree of the other
+	 * vault is used as it is unless it has changes to fold, then
+	 * it's copied and refreshed in memory
+	 */
+	xsqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION;", NULL, NULL, NULL);
+
+	EOE(refresh_merkle_tree(db, "main", "main"));
+
+	peer_tree = PEER_SCHEMA;
+	if ((rescode = is_merkle_tree_stale(db, PEER_SCHEMA)) == -1)
+	{
+		exit(EXIT_FAILURE);
+	}
+	else if (rescode == 1)
+	{
+		peer_tree = PEER_TREE_SCHEMA;
+
+		EOE(copy_merkle_tree(db, PEER_SCHEMA, peer_tree));
+		EOE(refresh_merkle_tree(db, PEER_SCHEMA, peer_tree));
+	}
+
+	xsqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+
+	struct diff_output out;
+
+	xsqlite3_prepare_v2(db, "SELECT sitename FROM main.account "
+				"WHERE uuid = ?;", -1, &out.self_name, NULL);
+	xsqlite3_prepare_v2(db, "SELECT sitename FROM " PEER_SCHEMA
+				".account WHERE uuid = ?;",
+				-1, &out.peer_name, NULL);
+
+	rescode = diff_merkle_tree(db, "main", peer_tree,
+				    print_diff, &out);
+
+	sqlite3_finalize(out.self_name);
+	sqlite3_finalize(out.peer_name);
+	close_cred_db(db);
+
+	free(peer_path);
+
+	/* same as diff(1), 0 for same, 1 for different, 2 for trouble */
+	return rescode < 0 ? 2 : rescode;
+}
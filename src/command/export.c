@@ -0,0 +1,184 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "cred-db.h"
+#include "output.h"
+#include "hex.h"
+#include "field.h"
+
+#define EXPORT_FIELDS							\
+	"id,uuid,sitename,alias,siteurl,username,password,"		\
+	"guard,recovery,memo,comment,sqltime,modtime"
+
+#define EXPORT_TAIL_SQLSTR						\
+	"WHERE a.sitename LIKE ? ESCAPE '\\' ORDER BY a.id;"
+
+/**
+ * text is written as is but for ‘\’, tab, CR and LF, which become
+ * ‘\\’, ‘\t’, ‘\r’ and ‘\n’; a NULL is ‘\N’, and a blob is written in
+ * hex
+ */
+static void export_column(struct output_sink *out,
+			  struct sqlite3_stmt *stmt, int col)
+{
+	const char *val, *run;
+	char hex[512];
+	size_t len, n;
+
+	switch (sqlite3_column_type(stmt, col))
+	{
+	case SQLITE_NULL:
+		output_write(out, "\\N", 2);
+		return;
+
+	case SQLITE_BLOB:
+		val = sqlite3_column_blob(stmt, col);
+		len = sqlite3_column_bytes(stmt, col);
+
+		for (; len > 0; val += n, len -= n)
+		{
+			n = len < sizeof(hex) / 2 ? len : sizeof(hex) / 2;
+			hex_encode(hex, (const uint8_t *)val, n);
+			output_write(out, hex, n * 2);
+		}
+
+		zeromem(hex, sizeof(hex));
+		return;
+	}
+
+	val = (const char *)sqlite3_column_text(stmt, col);
+	len = sqlite3_column_bytes(stmt, col);
+
+	for (run = val; len > 0; val++, len--)
+	{
+		if (*val != '\\' && *val != '\t' &&
+		     *val != '\r' && *val != '\n')
+		{
+			continue;
+		}
+
+		output_write(out, run, val - run);
+		output_putchar(out, '\\');
+		output_putchar(out, *val == '\t' ? 't' : *val == '\r' ? 'r' :
+				    *val == '\n' ? 'n' : '\\');
+		run = val + 1;
+	}
+
+	output_write(out, run, val - run);
+}
+
+static void write_output(void *out, const char *buf, size_t len)
+{
+	output_write(out, buf, len);
+}
+
+int cmd_export(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey             = 0;
+	const char *search_pattern = NULL;
+	const char *field_spec     = EXPORT_FIELDS;
+
+	const struct option cmd_export_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_STRING_F(0, "search", &search_pattern, "pattern",
+				"export records of a particular site",
+				OPTION_SHOWARGH),
+		OPTION_STRING_F(0, "fields", &field_spec, "list",
+				"comma-separated fields to export",
+				OPTION_SHOWARGH),
+		OPTION_END(),
+	};
+
+	const char *const cmd_export_usages[] = {
+		"pk export [--cmdkey] [--search <pattern>] "
+		"[--fields <list>]",
+		NULL,
+	};
+
+	parse_options(argc, argv, prefix, cmd_export_options,
+			cmd_export_usages, PARSER_ABORT_NON_OPTION);
+
+	struct field_list fields;
+
+	EOE(parse_field_list(&fields, field_spec));
+
+	struct output_sink *out;
+	struct sqlite3 *db;
+	struct sqlite3_stmt *stmt;
+	char *pattern, *sql;
+	size_t i;
+	int rescode;
+
+	db = open_cred_db(SQLITE_OPEN_READONLY, use_cmdkey);
+	out = command_output();
+
+	pattern = make_like_pattern(search_pattern);
+	sql = build_field_query(&fields, EXPORT_TAIL_SQLSTR);
+
+	xsqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+	xsqlite3_bind_text(stmt, 1, pattern, -1, SQLITE_STATIC);
+
+	for (i = 0; i < fields.nr; i++)
+	{
+		output_puts(out, field_name(fields.ids[i]));
+		output_putchar(out, i + 1 < fields.nr ? '\t' : '\n');
+	}
+
+	struct lazy_blob memo = MEMO_BLOB_INIT(db);
+
+	while ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		for (i = 0; i < fields.nr; i++)
+		{
+			/* column 0 is the id, field i is column i + 1 */
+			if (fields.ids[i] != FIELD_MEMO ||
+			     sqlite3_column_type(stmt, i + 1) == SQLITE_NULL)
+			{
+				export_column(out, stmt, i + 1);
+			}
+			else if (lazy_blob_hex(&memo,
+					sqlite3_column_int64(stmt, 0),
+					write_output, out) != 0)
+			{
+				exit(EXIT_FAILURE);
+			}
+
+			output_putchar(out, i + 1 < fields.nr ? '\t' : '\n');
+		}
+	}
+
+	if (rescode != SQLITE_DONE)
+	{
+		exit(report_sqlite_error(sqlite3_step, db));
+	}
+
+	output_flush(out);
+
+	lazy_blob_close(&memo);
+	sqlite3_finalize(stmt);
+	close_cred_db(db);
+	free(pattern);
+	free(sql);
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "cred-db.h"
+#include "stopwatch.h"
+
+/**
+ * pages reclaimed by one PRAGMA incremental_vacuum, each slice is a
+ * transaction of its own, so other processes get the db in between
+ */
+#define GC_SLICE_PAGES 256
+
+struct gc_stat
+{
+	int64_t page_size;
+	int64_t page_count;
+	int64_t freelist;
+};
+
+static void get_gc_stat(struct sqlite3 *db, struct gc_stat *stat)
+{
+	EOE(query_pragma(db, "page_size", &stat->page_size));
+	EOE(query_pragma(db, "page_count", &stat->page_count));
+	EOE(query_pragma(db, "freelist_count", &stat->freelist));
+}
+
+static void print_gc_stat(const char *when, const struct gc_stat *stat)
+{
+	printf("%-7s %"PRId64" of %"PRId64" pages free (%"PRId64" KiB)\n",
+		when, stat->freelist, stat->page_count,
+		stat->freelist * stat->page_size / 1024);
+}
+
+int cmd_gc(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey     = 0;
+	unsigned max_pages = 0;
+	unsigned budget_ms = 0;
+
+	const struct option cmd_gc_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_UNSIGNED(0, "pages", &max_pages,
+				"reclaim at most this many pages"),
+		OPTION_UNSIGNED(0, "budget-ms", &budget_ms,
+				"start no slice after this many "
+				"milliseconds"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_gc_usages[] = {
+		"pk gc [--cmdkey] [--pages <n>] [--budget-ms <ms>]",
+		NULL,
+	};
+
+	parse_options(argc, argv, prefix, cmd_gc_options,
+			cmd_gc_usages, PARSER_ABORT_NON_OPTION);
+
+	struct sqlite3 *db;
+	struct gc_stat before, after;
+	struct stopwatch sw;
+	int64_t mode, left, slice;
+	char sql[64];
+	unsigned nr_slice;
+
+	db = open_cred_db(SQLITE_OPEN_READWRITE, use_cmdkey);
+
+	get_gc_stat(db, &before);
+	print_gc_stat("before", &before);
+
+	stopwatch_start(&sw);
+
+	EOE(query_pragma(db, "auto_vacuum", &mode));
+	if (mode == AUTO_VACUUM_NONE)
+	{
+		note("cred db ‘%s’ predates incremental vacuum, rewriting "
+		     "it once to turn it on", cred_db_path);
+
+		EOE(convert_auto_vacuum(db));
+		nr_slice = 1;
+
+		goto finish;
+	}
+
+	left = max_pages == 0 ? before.freelist : max_pages;
+	nr_slice = 0;
+
+	while (left > 0)
+	{
+		if (budget_ms != 0 && nr_slice > 0 &&
+		     stopwatch_elapsed(&sw) >= (uint64_t)budget_ms * 1000)
+		{
+			break;
+		}
+
+		slice = left < GC_SLICE_PAGES ? left : GC_SLICE_PAGES;
+		snprintf(sql, sizeof(sql),
+			 "PRAGMA incremental_vacuum(%"PRId64");", slice);
+
+		xsqlite3_exec(db, sql, NULL, NULL, NULL);
+		nr_slice++;
+
+		EOE(query_pragma(db, "freelist_count", &after.freelist));
+		if (after.freelist == 0)
+		{
+			break;
+		}
+
+		left -= slice;
+	}
+
+finish:
+	get_gc_stat(db, &after);
+	print_gc_stat("after", &after);
+
+	printf("%"PRId64" pages reclaimed in %u slice(s), %.3fs\n",
+		before.page_count - after.page_count, nr_slice,
+		usec_to_sec(stopwatch_elapsed(&sw)));
+
+	close_cred_db(db);
+
+	return 0;
+}
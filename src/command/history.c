@@ -0,0 +1,163 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "cred-db.h"
+#include "history.h"
+#include "strbuf.h"
+#include "hex.h"
+#include "output.h"
+
+static void list_versions(struct sqlite3 *db, int64_t id)
+{
+	struct history_entry *entries;
+	struct strbuf *sb = STRBUF_INIT_PTR;
+	ssize_t nr, i;
+	unsigned j;
+
+	if ((nr = list_history(db, id, &entries)) == -1)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < nr; i++)
+	{
+		strbuf_trunc(sb);
+		strbuf_printf(sb, "%"PRId64"\t%s\t", entries[i].version,
+				entries[i].modtime == NULL ?
+					"-" : entries[i].modtime);
+
+		if (entries[i].kind == HISTORY_DELETED)
+		{
+			strbuf_concat(sb, "(deleted)");
+		}
+
+		for (j = 0; entries[i].kind != HISTORY_DELETED &&
+			    j < HISTORY_NR_FIELDS; j++)
+		{
+			if (entries[i].changed & (1U << j))
+			{
+				strbuf_concat(sb, history_field_names[j]);
+				strbuf_putchar(sb, ' ');
+			}
+		}
+
+		strbuf_trim_end(sb);
+		puts(sb->buf);
+	}
+
+	strbuf_destroy(sb);
+	free_history_list(entries, nr);
+}
+
+static void print_version(const struct history_row *row)
+{
+	struct output_sink *out;
+	const struct history_value *val;
+	char *hex;
+	unsigned i;
+
+	out = command_output();
+	output_printf(out, "modtime\t%s\n",
+		      row->modtime == NULL ? "-" : row->modtime);
+
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		val = &row->field[i];
+
+		if (val->type == SQLITE_TEXT)
+		{
+			output_printf(out, "%s\t%s\n",
+				      history_field_names[i], val->buf);
+		}
+		else if (val->type == SQLITE_BLOB)
+		{
+			hex = xmalloc(val->len * 2 + 1);
+			hex_encode(hex, val->buf, val->len);
+			hex[val->len * 2] = 0;
+
+			output_printf(out, "%s\t%s\n",
+				      history_field_names[i], hex);
+			sfree(hex, val->len * 2);
+		}
+	}
+}
+
+int cmd_history(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey = 0;
+
+	const struct option cmd_history_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_END(),
+	};
+
+	const char *const cmd_history_usages[] = {
+		"pk history [--cmdkey] <rowid>[@<version>]",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_history_options,
+				cmd_history_usages, 0);
+
+	if (argc == 0)
+	{
+		exit(error("no record specified"));
+	}
+	else if (argc > 1)
+	{
+		exit(error("too many arguments"));
+	}
+
+	struct sqlite3 *db;
+	struct history_row row = { 0 };
+	int64_t id, version;
+	int rescode;
+
+	if (parse_history_ref(argv[0], &id, &version) != 0)
+	{
+		exit(error("invalid record ‘%s’", argv[0]));
+	}
+
+	db = open_cred_db(SQLITE_OPEN_READONLY, use_cmdkey);
+
+	rescode = 0;
+	if (version == 0)
+	{
+		list_versions(db, id);
+	}
+	else if ((rescode = rebuild_history_row(db, id,
+						 version, &row)) == 0)
+	{
+		print_version(&row);
+	}
+	else if (rescode == 1)
+	{
+		rescode = error("no version %"PRId64" of record with "
+				 "rowid %"PRId64, version, id);
+	}
+
+	free_history_row(&row);
+	close_cred_db(db);
+
+	return rescode == 0 ? 0 : EXIT_FAILURE;
+}
@@ -23,41 +23,11 @@
 #include "parse-option.h"
 #include "filesys.h"
 #include "security.h"
-#include "cipher-config.h"
+#include "cred-db.h"
 #include "strlist.h"
 #include "strbuf.h"
 #include "atexit-chain.h"
 
-#define INIT_TABLE_SQLSTR						\
-	"CREATE TABLE account ("					\
-		"id       INTEGER PRIMARY KEY AUTOINCREMENT,"		\
-		"sitename TEXT NOT NULL,"				\
-		"alias    TEXT,"					\
-		"siteurl  TEXT,"					\
-		"username TEXT,"					\
-		"password TEXT NOT NULL,"				\
-		"sqltime  DATETIME DEFAULT (datetime(‘now’, ‘utc’)),"	\
-		"modtime  DATETIME"					\
-	");"								\
-									\
-	"CREATE INDEX idx_sitename ON account(sitename);"		\
-									\
-	"CREATE TABLE account_security ("				\
-		"account_id INTEGER PRIMARY KEY,"			\
-		"guard      TEXT,"					\
-		"recovery   TEXT,"					\
-		"memo       BLOB,"					\
-		"FOREIGN KEY (account_id) REFERENCES account(id) "	\
-			"ON DELETE CASCADE"				\
-	");"								\
-									\
-	"CREATE TABLE account_misc ("					\
-		"account_id INTEGER PRIMARY KEY,"			\
-		"comment    TEXT,"					\
-		"FOREIGN KEY (account_id) REFERENCES account(id) "	\
-			"ON DELETE CASCADE"				\
-	");"
-
 static void avail_file_path_or_die(
 	const char *type, const char *path, bool force)
 {
@@ -76,83 +46,6 @@ static void avail_file_path_or_die(
 	avail_file_dir_or_die(path);
 }
 
-static size_t request_cmdkey(char **key)
-{
-	char  *cmdkey_buf1, *cmdkey_buf2;
-	size_t cmdkey_len1,  cmdkey_len2;
-	unsigned retry_count;
-
-	retry_count = 0;
-retry:
-	if ((cmdkey_len1 =
-		read_cmdkey(&cmdkey_buf1, "[pk] key for encryption: ")) == 0)
-	{
-		im_putchar('\n');
-		error("No key was provided.");
-
-		if (retry_count > 0)
-		{
-			note("%u key entry attempt%s made.",
-				retry_count, retry_count > 1 ? "s" : "");
-		}
-		else
-		{
-			note("A key is required.");
-		}
-
-		exit(EXIT_FAILURE);
-	}
-
-	cmdkey_len2 = read_cmdkey(&cmdkey_buf2, "\n[pk] confirm key: ");
-	im_putchar('\n');
-
-	if (cmdkey_len1 != cmdkey_len2 || strcmp(cmdkey_buf1, cmdkey_buf2))
-	{
-		sfree(cmdkey_buf1, cmdkey_len1);
-		sfree(cmdkey_buf2, cmdkey_len2);
-
-		im_fputs("Password does not match previous, "
-			  "try again.\n", stderr);
-
-		clearerr(stdin);
-		retry_count++;
-		goto retry;
-	}
-
-	sfree(cmdkey_buf2, cmdkey_len2);
-
-	*key = cmdkey_buf1;
-	return cmdkey_len1;
-}
-
-static void persist_cipher_config(
-	const struct cipher_config *cc, const struct cipher_key *ck)
-{
-	uint8_t *buf, *digest;
-	size_t len;
-
-	buf = serialize_cipher_config(cc, ck, &len);
-	digest = digest_message_sha256(buf, len);
-
-	memcpy(buf + len, digest, CIPHER_DIGEST_LENGTH);
-	clean_digest(digest);
-
-	len += CIPHER_DIGEST_LENGTH;
-
-	populate_file(cred_cc_path, buf, len);
-	sfree(buf, len);
-}
- 
-static char **keybuf_ref;
-
-static void destroy_key(void)
-{
-	if (keybuf_ref != NULL)
-	{
-		sfree(*keybuf_ref, strlen(*keybuf_ref));
-	}
-}
-
 static void rm_cred_db(void)
 {
 	unlink(cred_db_path);
@@ -224,81 +117,16 @@ int cmd_init(UNUSED int argc, const char **argv, const char *prefix)
 	{
 		uint8_t *binkey;
 
-		EOE(random_bytes(&binkey, BINKEY_LEN));
-		keylen = bin2blob(&keybuf, binkey, BINKEY_LEN);
+		binkey = secure_alloc(BINKEY_LEN);
+		EOE(random_bytes_buffered(&binkey, BINKEY_LEN));
+		keylen = bin2blob_secure(&keybuf, binkey, BINKEY_LEN);
 	}
 
 	bool use_cc, use_passphrase;
 
-	keybuf_ref = &keybuf;
-	atexit_chain_push(destroy_key);
-
-	use_cc = false;
 	use_passphrase = !is_blob_key(keybuf, keylen);
 
-	/* kdf algorithm */
-	if (cc.kdf_algorithm != NULL)
-	{
-/* START IF */
-	if (!use_passphrase)
-	{
-		warning("Setting the KDF algorithm on a "
-			 "non-passphrase key has no effect.");
-		cc.kdf_algorithm = NULL;
-	}
-	else if (!is_cc_kdf_algorithm(cc.kdf_algorithm))
-	{
-		exit(error("invalid KDF algorithm ‘%s’", cc.kdf_algorithm));
-	}
-	else
-	{
-		use_cc |= strcmp(cc.kdf_algorithm, CPRDEF_KDF_ALGORITHM);
-	}
-/* END IF */
-	}
-
-	/* hmac algorithm */
-	if (cc.hmac_algorithm != NULL)
-	{
-/* START IF */
-	if (!is_cc_hmac_algorithm(cc.hmac_algorithm))
-	{
-		exit(error("invalid HMAC algorithm ‘%s’", cc.hmac_algorithm));
-	}
-	else
-	{
-		use_cc |= strcmp(cc.hmac_algorithm, CPRDEF_HMAC_ALGORITHM);
-	}
-/* END IF */
-	}
-
-	/* kdf iter */
-	if (cc.kdf_iter == CPRDEF_KDF_ITER);
-	else if (!use_passphrase)
-	{
-		warning("Setting the KDF iteration times on a "
-			  "non-passphrase key has no effect.");
-		cc.kdf_iter = CPRDEF_KDF_ITER;
-	}
-	else
-	{
-		use_cc |= true;
-	}
-
-	/* page size */
-	if (!is_cc_page_size(cc.page_size))
-	{
-		exit(error("invalid page size ‘%u’", cc.page_size));
-	}
-	use_cc |= cc.page_size != CPRDEF_PAGE_SIZE;
-
-	/* compatibility */
-	if (!is_cc_compatibility(cc.compatibility))
-	{
-		exit(error("invalid cipher compatibility "
-			    "‘%u’", cc.compatibility));
-	}
-	use_cc |= cc.compatibility != CPRDEF_COMPATIBILITY;
+	use_cc = prune_cipher_config(&cc, use_passphrase);
 
 	/**
 	 * non passphrase keys are remembered by default, passphrase keys
@@ -306,8 +134,6 @@ int cmd_init(UNUSED int argc, const char **argv, const char *prefix)
 	 */
 	use_cc |= (!use_passphrase && remember_key) || remember_key == 1;
 
-	atexit_chain_pop(/* destroy_key */);
-
 	if (!use_cc)
 	{
 		goto setup_database;
@@ -323,21 +149,20 @@ int cmd_init(UNUSED int argc, const char **argv, const char *prefix)
 	}
 	else if (use_passphrase)
 	{
-		ck.buf = xmemdup(keybuf, keylen + 1);
+		ck.buf = (uint8_t *)keybuf;
 		ck.len = keylen;
 		ck.is_binary = false;
 	}
 	else
 	{
-		ck.len = blob2bin(&ck.buf, strdup(keybuf), keylen);
+		ck.len = blob2bin(&ck.buf, secure_memdup(keybuf, keylen),
+				  keylen);
 		ck.is_binary = true;
 	}
 
 	atexit_chain_push(rm_cred_cc);
 
-	persist_cipher_config(&cc, &ck);
-
-	sfree(ck.buf, ck.len);
+	persist_cipher_config(cred_cc_path, &cc, &ck);
 
 setup_database:;
 	struct sqlite3 *db;
@@ -359,11 +184,16 @@ setup_database:;
 
 			free(apply_cc_sqlstr);
 		}
-
-		sfree(keybuf, keylen);
 	}
 
-	xsqlite3_exec(db, INIT_TABLE_SQLSTR, NULL, NULL, NULL);
+	/**
+	 * must be set before the first table is created, free pages
+	 * are then reclaimed by pk gc without rewriting the file
+	 */
+	xsqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL;",
+		       NULL, NULL, NULL);
+
+	EOE(migrate_cred_db(db));
 
 	sqlite3_close(db);
 
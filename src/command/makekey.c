@@ -23,55 +23,289 @@
 #include "parse-option.h"
 #include "filesys.h"
 #include "security.h"
+#include "output.h"
 
-static const char *output_file;
-static unsigned key_size = 32;
+#define DEFAULT_KEY_BYTES 32
+#define DEFAULT_KEY_CHARS 20
+#define DEFAULT_KEY_WORDS 6
 
-const char *const cmd_makekey_usages[] = {
-	"pk makekey [--output <file>] [--size <sz>]",
-	NULL,
+#define WORD_SEPARATOR '-'
+
+/**
+ * ‘map’ turns a random byte to a character of ‘set’, bytes beyond
+ * the largest multiple of the set size are mapped to -1 and drawn
+ * again, so every character is equally likely
+ */
+static void make_charset_map(int16_t map[256], const char *set)
+{
+	bool seen[256] = { 0 };
+	uint8_t chars[256], lo, hi;
+	unsigned nr, limit, i;
+
+	nr = 0;
+	for ( ; *set; set++)
+	{
+		lo = hi = *set;
+
+		if (set[1] == '-' && set[2] != 0)
+		{
+			hi = set[2];
+			set += 2;
+		}
+
+		if (lo > hi)
+		{
+			exit(error("invalid range ‘%c-%c’ in charset", lo, hi));
+		}
+
+		for (i = lo; i <= hi; i++)
+		{
+			if (!seen[i])
+			{
+				seen[i] = true;
+				chars[nr++] = i;
+			}
+		}
+	}
+
+	if (nr < 2)
+	{
+		exit(error("charset needs at least 2 distinct characters"));
+	}
+
+	limit = 256 - 256 % nr;
+	for (i = 0; i < 256; i++)
+	{
+		map[i] = i < limit ? chars[i % nr] : -1;
+	}
+}
+
+struct keygen
+{
+	unsigned size, count;
+
+	struct random_pool pool;
+	struct output_sink *out;
 };
 
-const struct option cmd_makekey_options[] = {
-	OPTION_FILENAME(0, "output", &output_file, "file to be written, default is stdout"),
-	OPTION_UNSIGNED('s', "size", &key_size, "specify the key length in bytes, default is 32"),
-	OPTION_END(),
+static void make_charset_keys(struct keygen *kg, const char *charset)
+{
+	int16_t map[256], c;
+	unsigned i, n;
+
+	make_charset_map(map, charset);
+
+	for (n = 0; n < kg->count; n++)
+	{
+		for (i = 0; i < kg->size; )
+		{
+			if ((c = map[random_pool_byte(&kg->pool)]) >= 0)
+			{
+				output_putchar(kg->out, c);
+				i++;
+			}
+		}
+
+		output_putchar(kg->out, '\n');
+	}
+}
+
+static void make_hex_keys(struct keygen *kg)
+{
+	static const char hexchars[] = "0123456789ABCDEF";
+	unsigned i, n;
+	uint8_t byte;
+
+	for (n = 0; n < kg->count; n++)
+	{
+		output_write(kg->out, "0x", 2);
+
+		for (i = 0; i < kg->size; i++)
+		{
+			byte = random_pool_byte(&kg->pool);
+
+			output_putchar(kg->out, hexchars[byte >> 4]);
+			output_putchar(kg->out, hexchars[byte & 0x0F]);
+		}
+
+		output_putchar(kg->out, '\n');
+	}
+}
+
+struct word
+{
+	const char *str;
+	size_t len;
 };
 
+/**
+ * a word is the last field of each line, so both plain lists and
+ * diceware lists (‘11111 word’) work, the list is never copied
+ */
+static size_t parse_wordlist(struct word **words, const char *map,
+			     size_t len)
+{
+	const char *line, *eol, *end, *str;
+	size_t nr, cap;
+
+	nr = cap = 0;
+	for (line = map; line < map + len; line = eol + 1)
+	{
+		if ((eol = memchr(line, '\n', map + len - line)) == NULL)
+		{
+			eol = map + len;
+		}
+
+		for (end = eol; end > line && isspace(end[-1]); end--);
+		for (str = end; str > line && !isspace(str[-1]); str--);
+
+		if (str == end || *line == '#')
+		{
+			continue;
+		}
+
+		CAPACITY_GROW(*words, nr + 1, cap);
+		(*words)[nr++] = (struct word){
+			.str = str,
+			.len = end - str,
+		};
+	}
+
+	return nr;
+}
+
+static void make_word_keys(struct keygen *kg, const char *wordlist)
+{
+	struct word *words;
+	uint64_t limit;
+	uint32_t rnd;
+	size_t len, nr;
+	unsigned i, n;
+	char *map;
+
+	if ((map = map_file(wordlist, &len)) == NULL)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	words = NULL;
+	if ((nr = parse_wordlist(&words, map, len)) < 2)
+	{
+		exit(error("word list ‘%s’ needs at least 2 words",
+			    wordlist));
+	}
+	else if (nr > UINT32_MAX)
+	{
+		exit(error("word list ‘%s’ is too large", wordlist));
+	}
+
+	/* same as make_charset_map(), draw again beyond the limit */
+	limit = (1ULL << 32) - (1ULL << 32) % nr;
+
+	for (n = 0; n < kg->count; n++)
+	{
+		for (i = 0; i < kg->size; i++)
+		{
+			while ((rnd = random_pool_u32(&kg->pool)) >= limit);
+
+			if (i > 0)
+			{
+				output_putchar(kg->out, WORD_SEPARATOR);
+			}
+
+			output_write(kg->out, words[rnd % nr].str,
+					words[rnd % nr].len);
+		}
+
+		output_putchar(kg->out, '\n');
+	}
+
+	free(words);
+	unmap_file(map, len);
+}
+
 int cmd_makekey(int argc, const char **argv, const char *prefix)
 {
+	const char *output_file = NULL;
+	const char *charset     = NULL;
+	const char *wordlist    = NULL;
+	unsigned key_size       = 0;
+	unsigned key_count      = 1;
+
+	const struct option cmd_makekey_options[] = {
+		OPTION_FILENAME(0, "output", &output_file,
+				"file to be written, default is stdout"),
+		OPTION_UNSIGNED('s', "size", &key_size,
+				"key length in bytes, characters or words"),
+		OPTION_UNSIGNED('n', "count", &key_count,
+				"number of keys, default is 1"),
+		OPTION_STRING(0, "charset", &charset,
+				"make keys of these characters, e.g. "
+				"‘a-zA-Z0-9’"),
+		OPTION_FILENAME(0, "words", &wordlist,
+				"make keys of words in a diceware list"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_makekey_usages[] = {
+		"pk makekey [--output <file>] [--count <n>] [--size <sz>]",
+		"pk makekey [<options>] --charset <set>",
+		"pk makekey [<options>] --words <file>",
+		NULL,
+	};
+
 	parse_options(argc, argv, prefix, cmd_makekey_options,
 			cmd_makekey_usages, PARSER_ABORT_NON_OPTION);
 
-	int fd;
-	size_t hexkey_len;
+	if (charset != NULL && wordlist != NULL)
+	{
+		exit(error("--charset and --words are mutually exclusive"));
+	}
 
-	hexkey_len = key_size * 2;
-	char buf0[hexkey_len + 3] /* 0x and \n */, *buf, *hexkey;
+	struct output_sink file_out = OUTPUT_SINK_INIT(-1);
+	struct keygen *kg;
 
-	fd = STDOUT_FILENO;
-	buf = buf0;
+	kg = xmalloc(sizeof(*kg));
+	kg->pool = (struct random_pool)RANDOM_POOL_INIT;
+	kg->out = command_output();
+	kg->count = key_count;
 
 	if (output_file != NULL)
 	{
 		avail_file_dir_or_die(output_file);
 
-		fd = xopen(output_file, O_WRONLY | O_CREAT | O_TRUNC,
-				FILCRT_BIT);
+		file_out.fd = xopen(output_file, O_WRONLY | O_CREAT | O_TRUNC,
+				    FILCRT_BIT);
+		xiopath = output_file;
+		kg->out = &file_out;
 	}
 
-	uint8_t *binkey;
-
-	EOE(random_bytes(&binkey, BINKEY_LEN));
-	bin2hex(&hexkey, binkey, key_size);
+	if (charset != NULL)
+	{
+		kg->size = key_size ? key_size : DEFAULT_KEY_CHARS;
+		make_charset_keys(kg, charset);
+	}
+	else if (wordlist != NULL)
+	{
+		kg->size = key_size ? key_size : DEFAULT_KEY_WORDS;
+		make_word_keys(kg, wordlist);
+	}
+	else
+	{
+		kg->size = key_size ? key_size : DEFAULT_KEY_BYTES;
+		make_hex_keys(kg);
+	}
 
-	*buf++ = '0';
-	*buf++ = 'x';
-	memcpy(buf, hexkey, hexkey_len);
-	buf += hexkey_len;
-	*buf = '\n';
+	if (output_file != NULL)
+	{
+		output_destroy(&file_out);
+		close(file_out.fd);
+		free((char *)output_file);
+	}
 
-	xwrite(fd, buf0, sizeof(buf0));
+	clean_random_pool(&kg->pool);
+	free(kg);
+	free((char *)wordlist);
 
-	exit(EXIT_SUCCESS);
+	return 0;
 }
@@ -21,8 +21,826 @@
 ****************************************************************************/
 
 #include "parse-option.h"
+#include "filesys.h"
+#include "strbuf.h"
+#include "cred-db.h"
+#include "security.h"
+#include "thread-pool.h"
+#include "output.h"
+#include "tag.h"
+#include "frecency.h"
+#include "algorithm.h"
+#include "field.h"
 
-int cmd_read(int argc, const char **argv, const char *prefix)
+#define READ_FIELDS "id,sitename,siteurl,username,password"
+
+/* tails of queries built by build_field_query() */
+#define SEARCH_TAIL_SQLSTR						\
+	"WHERE a.sitename LIKE ? ESCAPE '\\' ORDER BY a.sitename, a.id;"
+
+#define FETCH_TAIL_SQLSTR "WHERE a.id = ?;"
+
+/**
+ * scan for matches, tags are tested row by row, which is what a filter
+ * of only --not-tag needs
+ */
+#define RANK_ACCOUNT_SQLSTR						\
+	"SELECT a.id, s.frecency FROM account a "			\
+	"LEFT JOIN account_access s ON s.account_id = a.id "		\
+	"WHERE a.sitename LIKE ?1 ESCAPE '\\' "				\
+		"AND pk_tag_match(?2, a.id) "				\
+	"ORDER BY a.sitename, a.id;"
+
+/* for vaults that haven't been opened for writing since version 6 */
+#define RANK_ACCOUNT_NO_ACCESS_SQLSTR					\
+	"SELECT id, NULL FROM account WHERE sitename LIKE ?1 ESCAPE '\\' " \
+		"AND pk_tag_match(?2, id) "				\
+	"ORDER BY sitename, id;"
+
+/* test an account of a tag against the pattern */
+#define RANK_TAGGED_SQLSTR						\
+	"SELECT a.id, s.frecency, a.sitename FROM account a "		\
+	"LEFT JOIN account_access s ON s.account_id = a.id "		\
+	"WHERE a.id = ?2 AND a.sitename LIKE ?1 ESCAPE '\\';"
+
+#define RANK_TAGGED_NO_ACCESS_SQLSTR					\
+	"SELECT id, NULL, sitename FROM account "			\
+	"WHERE id = ?2 AND sitename LIKE ?1 ESCAPE '\\';"
+
+/**
+ * a match of a lookup, ‘seq’ is its place in sitename order, which
+ * breaks ties of frecency
+ */
+struct ranked_row
+{
+	int64_t id;
+	double frecency;
+	size_t seq;
+};
+
+#define ranked_row_less(r1, r2)						\
+	((r1)->frecency < (r2)->frecency ||				\
+	 ((r1)->frecency == (r2)->frecency && (r1)->seq > (r2)->seq))
+
+DEFINE_TOP_K(top_rows, struct ranked_row, ranked_row_less)
+
+/**
+ * matches of a lookup kept so far, at most ‘k’ of them
+ */
+struct ranking
+{
+	struct ranked_row *heap;
+	size_t nr;
+	size_t cap;
+	size_t k;
+
+	/* accesses still in the log, they top up table account_access */
+	const struct access_map *pending;
+};
+
+/**
+ * a match of a tag, taken in rowid order and then numbered in
+ * sitename order; the sort is stable, so rowids break ties the way
+ * a scan does
+ */
+struct tagged_row
+{
+	struct ranked_row row;
+	const char *sitename;
+};
+
+#define tagged_row_less(r1, r2) (strcmp((r1)->sitename, (r2)->sitename) < 0)
+
+DEFINE_MERGE_SORT(sort_tagged_rows, struct tagged_row, tagged_row_less)
+
+struct vault
+{
+	const char *db_path;
+	const char *cc_path;
+
+	struct cred_key key;
+
+	/* already opened connection, e.g. the one of a session */
+	struct sqlite3 *db;
+
+	int rescode;
+};
+
+struct search_context
+{
+	const char *pattern;
+
+	/* rows are printed as ‘fields’, selected by these queries */
+	const struct field_list *fields;
+	const char *search_sql;
+	const char *fetch_sql;
+
+	/* resolved against the tags of each vault */
+	const struct tag_filter *filter;
+
+	/* prefix each row with the vault it comes from */
+	bool tag_vault;
+
+	/**
+	 * print matches most frecent first, at most ‘limit’ of them if
+	 * it's not 0, and log them as accessed
+	 */
+	bool rank;
+	size_t limit;
+
+	/* fold the access log once it's due, vaults of a list are not */
+	bool fold;
+
+	struct output_sink *out;
+	struct mutex outlock;
+};
+
+static void format_column(struct strbuf *sb, struct sqlite3_stmt *stmt,
+			  int col, char end)
 {
+	const unsigned char *val;
+
+	if ((val = sqlite3_column_text(stmt, col)) != NULL)
+	{
+		strbuf_write(sb, (const char *)val,
+				sqlite3_column_bytes(stmt, col));
+	}
+
+	strbuf_putchar(sb, end);
+}
+
+/**
+ * hand the rows gathered in ‘sb’ to the sink, they hold passwords so
+ * ‘sb’ is wiped afterwards
+ */
+static void emit_rows(struct search_context *ctx, struct strbuf *sb)
+{
+	mutex_lock(&ctx->outlock);
+	output_write(ctx->out, sb->buf, sb->length);
+	mutex_unlock(&ctx->outlock);
+
+	zeromem(sb->buf, sb->length);
+	strbuf_trunc(sb);
+}
+
+static void write_strbuf(void *sb, const char *buf, size_t len)
+{
+	strbuf_write(sb, buf, len);
+}
+
+static int format_row(struct search_context *ctx, struct vault *vault,
+		      struct strbuf *sb, struct sqlite3_stmt *stmt,
+		      struct lazy_blob *memo)
+{
+	size_t i;
+	char end;
+
+	if (ctx->tag_vault)
+	{
+		strbuf_write(sb, vault->db_path, strlen(vault->db_path));
+		strbuf_putchar(sb, '\t');
+	}
+
+	/* column 0 is the id, field i is column i + 1 */
+	for (i = 0; i < ctx->fields->nr; i++)
+	{
+		end = i + 1 < ctx->fields->nr ? '\t' : '\n';
+
+		if (ctx->fields->ids[i] != FIELD_MEMO ||
+		     sqlite3_column_type(stmt, i + 1) == SQLITE_NULL)
+		{
+			format_column(sb, stmt, i + 1, end);
+			continue;
+		}
+
+		if (lazy_blob_hex(memo, sqlite3_column_int64(stmt, 0),
+				  write_strbuf, sb) != 0)
+		{
+			return -1;
+		}
+		strbuf_putchar(sb, end);
+	}
+
+	/**
+	 * a single vault streams its rows out as they come, rows of
+	 * several vaults are gathered so that they never interleave
+	 */
+	if (!ctx->tag_vault && sb->length >= OUTPUT_BUFSIZE)
+	{
+		emit_rows(ctx, sb);
+	}
+
 	return 0;
 }
+
+static int list_rows(struct search_context *ctx, struct vault *vault,
+		     struct strbuf *sb, struct sqlite3 *db,
+		     struct lazy_blob *memo)
+{
+	struct sqlite3_stmt *stmt;
+	int rescode;
+
+	if (msqlite3_prepare_v2(db, ctx->search_sql,
+				 -1, &stmt, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	if (msqlite3_bind_text(stmt, 1, ctx->pattern,
+				-1, SQLITE_STATIC) != SQLITE_OK)
+	{
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+
+	while ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		if (format_row(ctx, vault, sb, stmt, memo) != 0)
+		{
+			sqlite3_finalize(stmt);
+			return -1;
+		}
+	}
+
+	if (rescode != SQLITE_DONE)
+	{
+		rescode = report_sqlite_error(sqlite3_step, db);
+	}
+	else
+	{
+		rescode = 0;
+	}
+
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+/**
+ * the row ‘stmt’ is on, columns 0 and 1 are its id and frecency
+ */
+static struct ranked_row read_ranked_row(const struct ranking *rk,
+					 struct sqlite3_stmt *stmt,
+					 size_t seq)
+{
+	const struct access_map_entry *entry;
+	struct ranked_row row;
+
+	row.id = sqlite3_column_int64(stmt, 0);
+	row.frecency = sqlite3_column_type(stmt, 1) == SQLITE_NULL ?
+		-INFINITY : sqlite3_column_double(stmt, 1);
+	row.seq = seq;
+
+	if ((entry = access_map_find(rk->pending, row.id)) != NULL)
+	{
+		row.frecency = frecency_merge(row.frecency,
+					      entry->value.frecency);
+	}
+
+	return row;
+}
+
+static void push_ranked_row(struct ranking *rk, struct ranked_row row)
+{
+	if (rk->nr < rk->k)
+	{
+		CAPACITY_GROW(rk->heap, rk->nr + 1, rk->cap);
+	}
+
+	top_rows_push(rk->heap, &rk->nr, rk->k, row);
+}
+
+/**
+ * prepare ‘sql’, or ‘fallback’ if ‘sql’ needs table account_access and
+ * the vault has none; sqlite3_table_column_metadata() isn't in every
+ * build, so the first statement is just tried
+ */
+static int prepare_rank_stmt(struct sqlite3 *db, const char *sql,
+			     const char *fallback,
+			     struct sqlite3_stmt **stmt)
+{
+	if (sqlite3_prepare_v2(db, sql, -1, stmt, NULL) == SQLITE_OK ||
+	     msqlite3_prepare_v2(db, fallback, -1, stmt, NULL) == SQLITE_OK)
+	{
+		return 0;
+	}
+
+	return -1;
+}
+
+/**
+ * test every account against the pattern and ‘match’ (NULL for no
+ * tag filter), in sitename order
+ */
+static int scan_ranked(struct search_context *ctx, struct sqlite3 *db,
+		       struct tag_match *match, struct ranking *rk)
+{
+	struct sqlite3_stmt *stmt;
+	size_t seq;
+	int rescode;
+
+	if (prepare_rank_stmt(db, RANK_ACCOUNT_SQLSTR,
+			      RANK_ACCOUNT_NO_ACCESS_SQLSTR, &stmt) != 0)
+	{
+		return -1;
+	}
+
+	if (msqlite3_bind_text(stmt, 1, ctx->pattern,
+				-1, SQLITE_STATIC) != SQLITE_OK ||
+	     (match != NULL && bind_tag_match(stmt, 2, match) != 0))
+	{
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+
+	for (seq = 0; (rescode = sqlite3_step(stmt)) == SQLITE_ROW; seq++)
+	{
+		push_ranked_row(rk, read_ranked_row(rk, stmt, seq));
+	}
+
+	if (rescode != SQLITE_DONE)
+	{
+		rescode = report_sqlite_error(sqlite3_step, db);
+	}
+	else
+	{
+		rescode = 0;
+	}
+
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+/**
+ * the bitmap of a tag filter drives the lookup, only the accounts in
+ * ‘bm’ are fetched, by rowid, and tested against the pattern
+ */
+static int rank_tagged(struct search_context *ctx, struct sqlite3 *db,
+		       const struct bitmap *bm, struct ranking *rk)
+{
+	struct sqlite3_stmt *stmt;
+	struct region names = REGION_INIT_SECURE;
+	struct tagged_row *rows;
+	uint64_t *ids;
+	size_t nr_id, nr, i;
+	int rescode;
+
+	if (prepare_rank_stmt(db, RANK_TAGGED_SQLSTR,
+			      RANK_TAGGED_NO_ACCESS_SQLSTR, &stmt) != 0)
+	{
+		return -1;
+	}
+
+	if (msqlite3_bind_text(stmt, 1, ctx->pattern,
+				-1, SQLITE_STATIC) != SQLITE_OK)
+	{
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+
+	ids = bitmap_to_array(bm, &nr_id);
+	MALLOC_ARRAY(rows, nr_id > 0 ? nr_id : 1);
+
+	nr = 0;
+	rescode = SQLITE_DONE;
+	for (i = 0; i < nr_id; i++)
+	{
+		xsqlite3_bind_int64(stmt, 2, ids[i]);
+
+		if ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			rows[nr].row = read_ranked_row(rk, stmt, 0);
+			rows[nr].sitename = region_strdup(&names,
+				(const char *)sqlite3_column_text(stmt, 2));
+			nr++;
+		}
+		else if (rescode != SQLITE_DONE)
+		{
+			break;
+		}
+
+		sqlite3_reset(stmt);
+	}
+
+	if (rescode != SQLITE_DONE && rescode != SQLITE_ROW)
+	{
+		rescode = report_sqlite_error(sqlite3_step, db);
+	}
+	else
+	{
+		sort_tagged_rows(rows, nr);
+
+		for (i = 0; i < nr; i++)
+		{
+			rows[i].row.seq = i;
+			push_ranked_row(rk, rows[i].row);
+		}
+
+		rescode = 0;
+	}
+
+	sqlite3_finalize(stmt);
+	region_destroy(&names);
+	free(rows);
+	free(ids);
+
+	return rescode;
+}
+
+/**
+ * fetch and print the rows kept by ‘rk’, most frecent first, and, if
+ * there's a ‘log’, log them as accessed
+ */
+static int print_ranked(struct search_context *ctx, struct vault *vault,
+			struct strbuf *sb, struct sqlite3 *db,
+			struct ranking *rk, const struct access_log *log,
+			struct lazy_blob *memo)
+{
+	struct sqlite3_stmt *fetch;
+	int64_t *ids;
+	size_t i;
+	int rescode;
+
+	top_rows_sort(rk->heap, rk->nr);
+
+	if (msqlite3_prepare_v2(db, ctx->fetch_sql,
+				 -1, &fetch, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	MALLOC_ARRAY(ids, rk->nr > 0 ? rk->nr : 1);
+	rescode = 0;
+	for (i = 0; i < rk->nr && rescode == 0; i++)
+	{
+		ids[i] = rk->heap[i].id;
+		xsqlite3_bind_int64(fetch, 1, ids[i]);
+
+		if (sqlite3_step(fetch) == SQLITE_ROW)
+		{
+			rescode = format_row(ctx, vault, sb, fetch, memo);
+		}
+		sqlite3_reset(fetch);
+	}
+
+	sqlite3_finalize(fetch);
+	if (rescode == 0 && log != NULL && rk->nr <= ACCESS_LOOKUP_MAX)
+	{
+		rescode = record_access(log, ids, rk->nr);
+	}
+
+	free(ids);
+
+	return rescode;
+}
+
+/**
+ * keep the ‘limit’ most frecent matches in a bounded heap, then print
+ * them; ‘match’ is NULL if there's no tag filter
+ */
+static int rank_rows(struct search_context *ctx, struct vault *vault,
+		     struct strbuf *sb, struct sqlite3 *db,
+		     struct tag_match *match, const struct access_log *log,
+		     const struct access_map *pending, struct lazy_blob *memo)
+{
+	struct ranking rk = {
+		.k       = ctx->limit != 0 ? ctx->limit : SIZE_MAX,
+		.pending = pending,
+	};
+	int rescode;
+
+	if (match != NULL && !match->negate)
+	{
+		rescode = rank_tagged(ctx, db, &match->bm, &rk);
+	}
+	else
+	{
+		rescode = scan_ranked(ctx, db, match, &rk);
+	}
+
+	if (rescode == 0)
+	{
+		rescode = print_ranked(ctx, vault, sb, db, &rk, log, memo);
+	}
+
+	free(rk.heap);
+
+	return rescode;
+}
+
+/**
+ * runs on worker threads, the KDF of each vault happens inside
+ * connect_cred_db(), so unlocking vaults costs as long as the
+ * slowest one instead of their sum; rows are formatted in a secure
+ * region of the worker's own
+ */
+static void search_vault(void *vault0, void *ctx0)
+{
+	struct vault *vault;
+	struct search_context *ctx;
+	struct sqlite3 *db;
+	struct region secrets = REGION_INIT_SECURE;
+	struct strbuf *sb = STRBUF_INIT_PTR_REGION(&secrets);
+	struct tag_match match = { BITMAP_INIT, false };
+	struct access_map pending = HASHMAP_INIT;
+	struct lazy_blob memo = MEMO_BLOB_INIT(NULL);
+	struct access_log log;
+	bool fold, has_log, has_filter;
+	int rescode;
+
+	vault = vault0;
+	ctx = ctx0;
+
+	vault->rescode = -1;
+	has_log = false;
+	has_filter = !is_tag_filter_empty(ctx->filter);
+
+	/**
+	 * a standalone lookup opens the vault for writing to fold, but
+	 * it never migrates it, that's left to commands that write
+	 */
+	fold = ctx->fold && ctx->rank && is_access_log_due(vault->db_path);
+	if ((db = vault->db) == NULL &&
+	     connect_cred_db(&db, vault->db_path, fold ?
+				SQLITE_OPEN_READWRITE : SQLITE_OPEN_READONLY,
+			     &vault->key) != 0)
+	{
+		goto cleanup;
+	}
+
+	memo.db = db;
+
+	if (ctx->rank)
+	{
+		if ((rescode = open_access_log(&log, db,
+					       vault->db_path)) == -1)
+		{
+			goto cleanup;
+		}
+
+		has_log = rescode == 0;
+		if (has_log && load_access_log(&log, &pending) == -1)
+		{
+			goto cleanup;
+		}
+	}
+
+	if (has_filter && eval_tag_filter(db, ctx->filter, &match) != 0)
+	{
+		goto cleanup;
+	}
+
+	if ((ctx->rank ? rank_rows(ctx, vault, sb, db,
+				   has_filter ? &match : NULL,
+				   has_log ? &log : NULL, &pending, &memo) :
+			  list_rows(ctx, vault, sb, db, &memo)) != 0)
+	{
+		goto cleanup;
+	}
+
+	if (sb->length > 0)
+	{
+		emit_rows(ctx, sb);
+	}
+
+	if (fold && has_log && fold_access_log(db, &log) != 0)
+	{
+		goto cleanup;
+	}
+
+	vault->rescode = 0;
+
+cleanup:
+	lazy_blob_close(&memo);
+	bitmap_destroy(&match.bm);
+	if (db != NULL)
+	{
+		close_cred_db(db);
+	}
+	if (has_log)
+	{
+		close_access_log(&log);
+	}
+	access_map_destroy(&pending);
+	region_destroy(&secrets);
+}
+
+/**
+ * each line of vault list is ‘<db> [<cc>]’, blank lines and lines
+ * starting with ‘#’ are ignored
+ */
+static size_t parse_vault_list(struct vault **vaults, const char *pathname,
+			       const char *prefix)
+{
+	FILE *stream;
+	char *line, *db_path, *cc_path, *ctx;
+	size_t cap, nr, vcap;
+	ssize_t len;
+
+	if ((stream = fopen(pathname, "r")) == NULL)
+	{
+		exit(error_errno("cannot open vault list ‘%s’", pathname));
+	}
+
+	line = NULL;
+	cap = 0;
+	nr = 0;
+	vcap = 0;
+	while ((len = getline(&line, &cap, stream)) != -1)
+	{
+		if ((db_path = strtok_r(line, " \t\r\n", &ctx)) == NULL ||
+		     *db_path == '#')
+		{
+			continue;
+		}
+
+		cc_path = strtok_r(NULL, " \t\r\n", &ctx);
+
+		CAPACITY_GROW(*vaults, nr + 1, vcap);
+		(*vaults)[nr++] = (struct vault){
+			.db_path = prefix_filename(prefix, db_path),
+			.cc_path = cc_path == NULL ? NULL :
+					prefix_filename(prefix, cc_path),
+		};
+	}
+
+	free(line);
+	fclose(stream);
+
+	if (nr == 0)
+	{
+		exit(error("no vault found in ‘%s’", pathname));
+	}
+
+	return nr;
+}
+
+static void resolve_vault_key(struct vault *vault, char *cmdkey,
+			      size_t cmdkey_len)
+{
+	const char *cc_path;
+
+	if (access_regular(vault->db_path, R_OK) != 0)
+	{
+		exit(error_errno("cannot access cred db ‘%s’",
+				  vault->db_path));
+	}
+
+	cc_path = vault->cc_path;
+	if (cc_path != NULL && find_cipher_config(&cc_path) != 0)
+	{
+		exit(error_errno("failed to find cipher config ‘%s’",
+				  vault->cc_path));
+	}
+
+	EOE(resolve_cred_key(&vault->key, cc_path, false));
+
+	if (cmdkey != NULL)
+	{
+		vault->key.keystr = cmdkey;
+		vault->key.keylen = cmdkey_len;
+	}
+}
+
+int cmd_read(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey         = 0;
+	unsigned nr_jobs       = 0;
+	unsigned limit         = 0;
+	const char *vault_list = NULL;
+	const char *field_spec = READ_FIELDS;
+	struct tag_filter filter = TAG_FILTER_INIT;
+
+	const struct option cmd_read_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_FILENAME(0, "vaults", &vault_list,
+				"file listing cred dbs to search"),
+		OPTION_UNSIGNED('j', "jobs", &nr_jobs,
+				"number of vaults opened in parallel"),
+		OPTION_GROUP(""),
+		OPTION_STRLIST(0, "tag", &filter.all, "tag",
+				"records having this tag"),
+		OPTION_STRLIST(0, "any-tag", &filter.any, "tag",
+				"records having one of these tags"),
+		OPTION_STRLIST(0, "not-tag", &filter.none, "tag",
+				"records not having this tag"),
+		OPTION_UNSIGNED('n', "limit", &limit,
+				"show only the most used matches"),
+		OPTION_STRING_F(0, "fields", &field_spec, "list",
+				"comma-separated fields to show",
+				OPTION_SHOWARGH),
+		OPTION_END(),
+	};
+
+	const char *const cmd_read_usages[] = {
+		"pk read [--cmdkey] [--vaults <file> [--jobs <n>]] "
+		"[--tag <tag>]... [--any-tag <tag>]... [--not-tag <tag>]... "
+		"[--limit <n>] [--fields <list>] [<sitename>]",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_read_options,
+				cmd_read_usages, 0);
+
+	if (argc > 1)
+	{
+		exit(error("too many arguments"));
+	}
+
+	struct field_list fields;
+
+	EOE(parse_field_list(&fields, field_spec));
+
+	struct vault *vaults;
+	size_t nr_vault, i;
+
+	vaults = NULL;
+	if (vault_list != NULL)
+	{
+		nr_vault = parse_vault_list(&vaults, vault_list, prefix);
+	}
+	else
+	{
+		nr_vault = 1;
+		MALLOC_ARRAY(vaults, 1);
+		vaults[0] = (struct vault){
+			.db_path = cred_db_path,
+			.cc_path = cred_cc_path,
+			.db      = shared_cred_db(),
+		};
+	}
+
+	char *cmdkey;
+	size_t cmdkey_len;
+
+	cmdkey = NULL;
+	cmdkey_len = 0;
+	if (use_cmdkey && vaults[0].db == NULL &&
+	     (cmdkey_len = read_cmdkey(&cmdkey,
+				"[pk] key for decryption: ")) == 0)
+	{
+		exit(error("Empty keys are illegal."));
+	}
+
+	/**
+	 * keys are resolved up front, on this thread, since this may
+	 * prompt or print diagnostics; no KDF is involved here
+	 */
+	for (i = 0; i < nr_vault; i++)
+	{
+		if (vaults[i].db == NULL)
+		{
+			resolve_vault_key(&vaults[i], cmdkey, cmdkey_len);
+		}
+	}
+
+	struct search_context ctx = {
+		.pattern    = make_like_pattern(argc > 0 ? argv[0] : NULL),
+		.fields     = &fields,
+		.search_sql = build_field_query(&fields, SEARCH_TAIL_SQLSTR),
+		.fetch_sql  = build_field_query(&fields, FETCH_TAIL_SQLSTR),
+		.filter     = &filter,
+		/**
+		 * a lookup shows the records used most first, listing
+		 * every record keeps sitename order
+		 */
+		.rank       = argc > 0 || limit > 0 ||
+			      !is_tag_filter_empty(&filter),
+		.limit      = limit,
+		.fold       = vault_list == NULL,
+		.tag_vault  = vault_list != NULL,
+		.out        = command_output(),
+	};
+	int rescode;
+
+	mutex_init(&ctx.outlock);
+
+	run_thread_pool(vaults, nr_vault, sizeof(*vaults),
+			search_vault, &ctx, nr_jobs);
+
+	mutex_destroy(&ctx.outlock);
+	output_flush(ctx.out);
+
+	rescode = 0;
+	for (i = 0; i < nr_vault; i++)
+	{
+		rescode |= vaults[i].rescode;
+		free_cred_key(&vaults[i].key);
+
+		if (vault_list != NULL)
+		{
+			free((char *)vaults[i].db_path);
+			free((char *)vaults[i].cc_path);
+		}
+	}
+
+	free((char *)ctx.pattern);
+	free((char *)ctx.search_sql);
+	free((char *)ctx.fetch_sql);
+	free((char *)vault_list);
+	strlist_destroy(&filter.all, false);
+	strlist_destroy(&filter.any, false);
+	strlist_destroy(&filter.none, false);
+	free(vaults);
+
+	return rescode == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,427 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "cred-db.h"
+#include "security.h"
+#include "filesys.h"
+#include "strbuf.h"
+#include "stopwatch.h"
+#include "atexit-chain.h"
+
+/**
+ * page cache used by each schema during the export, in KiB, this
+ * bounds the memory footprint no matter how large the vault is
+ */
+#define REKEY_CACHE_SIZE 4096
+
+/**
+ * number of virtual machine instructions between two progress
+ * callbacks
+ */
+#define REKEY_PROGRESS_PERIOD 4096
+
+#define EXPORT_SQLSTR_ROUTINE(cache_size)			\
+	"PRAGMA main.cache_size = -" #cache_size ";"		\
+	"PRAGMA rekey.cache_size = -" #cache_size ";"		\
+	"PRAGMA rekey.journal_mode = OFF;"			\
+	"PRAGMA rekey.auto_vacuum = INCREMENTAL;"		\
+	"SELECT sqlcipher_export('rekey');"
+
+#define EXPORT_SQLSTR(cache_size) EXPORT_SQLSTR_ROUTINE(cache_size)
+
+#define DETACH_SQLSTR "DETACH DATABASE rekey;"
+
+enum rekey_phase
+{
+	PHASE_UNLOCK,
+	PHASE_EXPORT,
+	PHASE_VERIFY,
+	PHASE_REPLACE,
+	rekey_phase_end,
+};
+
+static const char *const rekey_phase_name[] = {
+	"unlock",
+	"export",
+	"verify",
+	"replace",
+};
+
+struct export_progress
+{
+	const char *target;
+	off_t total;
+	int percent;
+};
+
+static char *rekey_db_path;
+static char *rekey_cc_path;
+
+static void rm_rekey_files(void)
+{
+	if (rekey_db_path != NULL)
+	{
+		unlink(rekey_db_path);
+	}
+
+	if (rekey_cc_path != NULL)
+	{
+		unlink(rekey_cc_path);
+	}
+}
+
+static int show_export_progress(void *data)
+{
+	struct export_progress *ctx;
+	struct stat st;
+	int percent;
+
+	ctx = data;
+	if (stat(ctx->target, &st) != 0)
+	{
+		return 0;
+	}
+
+	percent = st.st_size * 100 / ctx->total;
+
+	/* 100% is printed after the export is committed */
+	if (percent > 99)
+	{
+		percent = 99;
+	}
+
+	if (percent != ctx->percent)
+	{
+		ctx->percent = percent;
+		fprintf(stderr, "\rExporting records: %3d%%", percent);
+	}
+
+	return 0;
+}
+
+static void export_cred_db(struct sqlite3 *db, const char *target)
+{
+	struct export_progress progress = {
+		.target  = target,
+		.percent = -1,
+	};
+	struct stat st;
+	bool show_progress;
+
+	show_progress = isatty(STDERR_FILENO) &&
+			 stat(cred_db_path, &st) == 0 && st.st_size > 0;
+
+	if (show_progress)
+	{
+		progress.total = st.st_size;
+		sqlite3_progress_handler(db, REKEY_PROGRESS_PERIOD,
+					  show_export_progress, &progress);
+	}
+
+	xsqlite3_exec(db, EXPORT_SQLSTR(REKEY_CACHE_SIZE), NULL, NULL, NULL);
+
+	if (show_progress)
+	{
+		sqlite3_progress_handler(db, 0, NULL, NULL);
+		fputs("\rExporting records: 100%, done.\n", stderr);
+	}
+
+	xsqlite3_exec(db, DETACH_SQLSTR, NULL, NULL, NULL);
+}
+
+int cmd_rekey(UNUSED int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey     = 0;
+	int use_new_cmdkey = 0;
+	int keep_key       = 0;
+	int remember_key   = -1;
+
+	struct cipher_config opt_cc = { 0 };
+
+	const struct option cmd_rekey_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_COUNTUP(0, "new-cmdkey", &use_new_cmdkey,
+				"input new key from command line"),
+		OPTION_COUNTUP(0, "keep-key", &keep_key,
+				"keep the current key"),
+		OPTION_SWITCH(0, "remember", &remember_key,
+				"store new key"),
+		OPTION_GROUP(""),
+		OPTION_STRING(0, "kdf-algorithm", &opt_cc.kdf_algorithm,
+				"KDF algorithm used to generate "
+				 "encryption key for database"),
+		OPTION_STRING(0, "hmac-algorithm", &opt_cc.hmac_algorithm,
+				"HMAC algorithm used to detect "
+				 "illegal data tampering"),
+		OPTION_UNSIGNED(0, "cipher-compat", &opt_cc.compatibility,
+				 "version of api to used"),
+		OPTION_UNSIGNED(0, "page-size", &opt_cc.page_size,
+				"size of a page"),
+		OPTION_UNSIGNED(0, "kdf-iter", &opt_cc.kdf_iter,
+				 "key derivation iteration times"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_rekey_usages[] = {
+		"pk rekey [--cmdkey] [--new-cmdkey | --keep-key] "
+		"[--[no]-remember]\n"
+		"         [<options>]",
+		NULL,
+	};
+
+	parse_options(argc, argv, prefix, cmd_rekey_options,
+			cmd_rekey_usages, PARSER_ABORT_NON_OPTION);
+
+	if (keep_key && use_new_cmdkey)
+	{
+		return error("options ‘--keep-key’ and ‘--new-cmdkey’ "
+				"cannot be used together");
+	}
+
+	uint64_t elapsed[rekey_phase_end];
+	struct stopwatch sw;
+	const char *cc_path;
+
+	struct sqlite3 *db;
+	struct cred_key oldkey;
+
+	stopwatch_start(&sw);
+
+	cc_path = cred_cc_path;
+	if (find_cipher_config(&cc_path) != 0)
+	{
+		exit(error_errno("failed to find cipher config "
+				  "‘%s’", cred_cc_path));
+	}
+
+	EOE(resolve_cred_key(&oldkey, cc_path, use_cmdkey));
+
+	if (connect_cred_db(&db, cred_db_path,
+				SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, &oldkey) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	elapsed[PHASE_UNLOCK] = stopwatch_elapsed(&sw);
+
+	char  *keybuf;
+	size_t keylen;
+
+	if (keep_key)
+	{
+		if (oldkey.keystr == NULL)
+		{
+			exit(error("cred db ‘%s’ is not encrypted, there’s "
+				    "no key to keep", cred_db_path));
+		}
+
+		keybuf = oldkey.keystr;
+		keylen = oldkey.keylen;
+	}
+	else if (use_new_cmdkey)
+	{
+		keylen = request_cmdkey(&keybuf);
+	}
+	else
+	{
+		uint8_t *binkey;
+
+		binkey = secure_alloc(BINKEY_LEN);
+		EOE(random_bytes_buffered(&binkey, BINKEY_LEN));
+		keylen = bin2blob_secure(&keybuf, binkey, BINKEY_LEN);
+	}
+
+	bool use_cc, use_passphrase;
+	struct cipher_config cc;
+
+	use_passphrase = !is_blob_key(keybuf, keylen);
+
+	/**
+	 * start with the current cipher config, KDF settings are
+	 * carried over only if they still take effect
+	 */
+	cc = oldkey.cc;
+	if (!use_passphrase)
+	{
+		cc.kdf_algorithm = NULL;
+		cc.kdf_iter = CPRDEF_KDF_ITER;
+	}
+
+	if (opt_cc.kdf_algorithm != NULL)
+	{
+		cc.kdf_algorithm = opt_cc.kdf_algorithm;
+	}
+
+	if (opt_cc.hmac_algorithm != NULL)
+	{
+		cc.hmac_algorithm = opt_cc.hmac_algorithm;
+	}
+
+	if (opt_cc.compatibility != 0)
+	{
+		cc.compatibility = opt_cc.compatibility;
+	}
+
+	if (opt_cc.page_size != 0)
+	{
+		cc.page_size = opt_cc.page_size;
+	}
+
+	if (opt_cc.kdf_iter != 0)
+	{
+		cc.kdf_iter = opt_cc.kdf_iter;
+	}
+
+	use_cc = prune_cipher_config(&cc, use_passphrase);
+
+	/**
+	 * keep storing the key if it was stored, otherwise follow
+	 * the rules of pk init
+	 */
+	if (remember_key == -1)
+	{
+		remember_key = keep_key ? oldkey.ck.buf != NULL :
+					   !use_passphrase;
+	}
+
+	use_cc |= remember_key;
+
+	struct cred_key newkey = {
+		.cc     = cc,
+		.keystr = keybuf,
+		.keylen = keylen,
+	};
+
+	rekey_db_path = concat(cred_db_path, ".rekey");
+	atexit_chain_push(rm_rekey_files);
+
+	if (access(rekey_db_path, F_OK) == 0 && unlink(rekey_db_path) != 0)
+	{
+		exit(error_errno("cannot remove stale file ‘%s’",
+				   rekey_db_path));
+	}
+
+	stopwatch_start(&sw);
+
+	if (attach_cred_db(db, rekey_db_path, "rekey", &newkey) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	export_cred_db(db, rekey_db_path);
+	sqlite3_close(db);
+
+	elapsed[PHASE_EXPORT] = stopwatch_elapsed(&sw);
+	stopwatch_start(&sw);
+
+	/* make sure the new vault opens before replacing the old one */
+	if (connect_cred_db(&db, rekey_db_path,
+				SQLITE_OPEN_READONLY, &newkey) != 0)
+	{
+		exit(error("cannot open migrated cred db ‘%s’",
+			    rekey_db_path));
+	}
+	sqlite3_close(db);
+
+	elapsed[PHASE_VERIFY] = stopwatch_elapsed(&sw);
+	stopwatch_start(&sw);
+
+	if (use_cc)
+	{
+		struct cipher_key ck = CK_INIT;
+
+		if (!remember_key);
+		else if (use_passphrase)
+		{
+			ck.buf = (uint8_t *)keybuf;
+			ck.len = keylen;
+			ck.is_binary = false;
+		}
+		else
+		{
+			ck.len = blob2bin(&ck.buf,
+					  secure_memdup(keybuf, keylen), keylen);
+			ck.is_binary = true;
+		}
+
+		rekey_cc_path = concat(cred_cc_path, ".rekey");
+		persist_cipher_config(rekey_cc_path, &cc, &ck);
+	}
+
+	EOE(replace_file(rekey_db_path, cred_db_path));
+	free(rekey_db_path);
+	rekey_db_path = NULL;
+
+	if (use_cc)
+	{
+		char *new_cc_path;
+
+		/**
+		 * the vault is under the new key from now on, and the new
+		 * cc may be the only copy of it, so it must outlive any
+		 * failure below
+		 */
+		new_cc_path = rekey_cc_path;
+		rekey_cc_path = NULL;
+
+		if (replace_file(new_cc_path, cred_cc_path) != 0)
+		{
+			exit(error("cred db ‘%s’ is rekeyed, but its new "
+				    "cipher config is left at ‘%s’; move it "
+				    "to ‘%s’ by hand", cred_db_path,
+				    new_cc_path, cred_cc_path));
+		}
+		free(new_cc_path);
+	}
+	else if (cc_path != NULL && unlink(cc_path) != 0)
+	{
+		warning_errno("cannot remove outdated cipher config ‘%s’",
+				cc_path);
+	}
+
+	elapsed[PHASE_REPLACE] = stopwatch_elapsed(&sw);
+
+	atexit_chain_pop(/* rm_rekey_files */);
+
+	if (!remember_key && !keep_key && !use_new_cmdkey)
+	{
+		puts(keybuf);
+	}
+
+	free_cred_key(&oldkey);
+
+	size_t i;
+	uint64_t total;
+
+	total = 0;
+	array_for_each(i, rekey_phase_end)
+	{
+		printf("%-8s %.3fs\n", rekey_phase_name[i],
+			usec_to_sec(elapsed[i]));
+		total += elapsed[i];
+	}
+
+	printf("Cred db ‘%s’ was rekeyed in %.3fs.\n",
+		cred_db_path, usec_to_sec(total));
+	return 0;
+}
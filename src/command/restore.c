@@ -0,0 +1,190 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "cred-db.h"
+#include "history.h"
+
+#define UPDATE_ACCOUNT_SQLSTR						\
+	"INSERT INTO account (id, sitename, alias, siteurl, "		\
+		"username, password) "					\
+	"VALUES (?, ?, ?, ?, ?, ?) "					\
+	"ON CONFLICT (id) DO UPDATE SET "				\
+		"sitename = excluded.sitename,"				\
+		"alias    = excluded.alias,"				\
+		"siteurl  = excluded.siteurl,"				\
+		"username = excluded.username,"				\
+		"password = excluded.password;"
+
+#define UPDATE_SECURITY_SQLSTR						\
+	"INSERT INTO account_security "					\
+		"(account_id, guard, recovery, memo) "			\
+	"VALUES (?, ?, ?, ?) "						\
+	"ON CONFLICT (account_id) DO UPDATE SET "			\
+		"guard    = excluded.guard,"				\
+		"recovery = excluded.recovery,"				\
+		"memo     = excluded.memo;"
+
+#define UPDATE_MISC_SQLSTR						\
+	"INSERT INTO account_misc (account_id, comment) "		\
+	"VALUES (?, ?) "						\
+	"ON CONFLICT (account_id) DO UPDATE SET "			\
+		"comment = excluded.comment;"
+
+#define DELETE_SECURITY_SQLSTR						\
+	"DELETE FROM account_security WHERE account_id = ?;"
+
+#define DELETE_MISC_SQLSTR						\
+	"DELETE FROM account_misc WHERE account_id = ?;"
+
+/**
+ * write fields ‘first’ to ‘first + nr’ of ‘row’ with ‘update’, or
+ * run ‘delete’ instead if they're all NULL and ‘delete’ is given
+ */
+static void write_fields(struct sqlite3 *db, int64_t id,
+			 const struct history_row *row, unsigned first,
+			 unsigned nr, const char *update, const char *delete)
+{
+	const struct history_value *val;
+	struct sqlite3_stmt *stmt;
+	unsigned i;
+
+	for (i = 0; delete != NULL && i < nr; i++)
+	{
+		if (row->field[first + i].type != SQLITE_NULL)
+		{
+			break;
+		}
+	}
+
+	if (delete != NULL && i == nr)
+	{
+		xsqlite3_prepare_v2(db, delete, -1, &stmt, NULL);
+		xsqlite3_bind_int64(stmt, 1, id);
+		xsqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+
+		return;
+	}
+
+	xsqlite3_prepare_v2(db, update, -1, &stmt, NULL);
+	xsqlite3_bind_int64(stmt, 1, id);
+
+	for (i = 0; i < nr; i++)
+	{
+		val = &row->field[first + i];
+
+		if (val->type == SQLITE_NULL)
+		{
+			xsqlite3_bind_null(stmt, i + 2);
+		}
+		else if (val->type == SQLITE_BLOB)
+		{
+			xsqlite3_bind_blob(stmt, i + 2, val->buf,
+					    val->len, SQLITE_STATIC);
+		}
+		else
+		{
+			xsqlite3_bind_text(stmt, i + 2, (char *)val->buf,
+					    val->len, SQLITE_STATIC);
+		}
+	}
+
+	xsqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+}
+
+int cmd_restore(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey = 0;
+
+	const struct option cmd_restore_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_END(),
+	};
+
+	const char *const cmd_restore_usages[] = {
+		"pk restore [--cmdkey] <rowid>@<version>",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_restore_options,
+				cmd_restore_usages, 0);
+
+	if (argc == 0)
+	{
+		exit(error("no record specified"));
+	}
+	else if (argc > 1)
+	{
+		exit(error("too many arguments"));
+	}
+
+	struct sqlite3 *db;
+	struct history_row row = { 0 };
+	int64_t id, version;
+	int rescode;
+
+	if (parse_history_ref(argv[0], &id, &version) != 0 || version == 0)
+	{
+		exit(error("invalid version ‘%s’, expected "
+			    "<rowid>@<version>", argv[0]));
+	}
+
+	db = open_cred_db(SQLITE_OPEN_READWRITE, use_cmdkey);
+
+	/**
+	 * changes made here are folded into one version, so the
+	 * restore itself can be undone
+	 */
+	xsqlite3_begin_transaction(db);
+
+	if ((rescode = rebuild_history_row(db, id, version, &row)) == 0)
+	{
+		write_fields(db, id, &row, 0, 5, UPDATE_ACCOUNT_SQLSTR, NULL);
+		write_fields(db, id, &row, 5, 3, UPDATE_SECURITY_SQLSTR,
+			     DELETE_SECURITY_SQLSTR);
+		write_fields(db, id, &row, 8, 1, UPDATE_MISC_SQLSTR,
+			     DELETE_MISC_SQLSTR);
+	}
+	else if (rescode == 1)
+	{
+		rescode = error("no version %"PRId64" of record with "
+				 "rowid %"PRId64, version, id);
+	}
+
+	if (rescode == 0)
+	{
+		xsqlite3_end_transaction(db);
+		printf("record %"PRId64" restored to version %"PRId64".\n",
+			id, version);
+	}
+	else
+	{
+		xsqlite3_rollback_transaction(db);
+	}
+
+	free_history_row(&row);
+	close_cred_db(db);
+
+	return rescode == 0 ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,453 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "command.h"
+#include "cred-db.h"
+#include "strlist.h"
+#include "atexit-chain.h"
+
+#ifndef NO_READLINE
+#include <readline/readline.h>
+#include <readline/history.h>
+#endif
+
+#define SESSION_PROMPT       "pk> "
+#define SESSION_PROMPT_TRANS "pk*> "
+
+struct session
+{
+	struct sqlite3 *db;
+	const char *prefix;
+
+	FILE *input;
+	bool interactive;
+
+	bool quit;
+};
+
+/**
+ * commands that only exist in a session, they work on the shared
+ * connection directly
+ */
+static const struct
+{
+	const char *name;
+	const char *sqlstr;
+} builtin_list[] = {
+	{ "begin",    "BEGIN TRANSACTION;" },
+	{ "commit",   "COMMIT TRANSACTION;" },
+	{ "rollback", "ROLLBACK TRANSACTION;" },
+	{ "exit" },
+	{ "quit" },
+	{ NULL },
+};
+
+/**
+ * split ‘line’ into words in place, words are separated by blanks,
+ * quotes and backslashes work as they do in sh(1), and an unquoted
+ * ‘#’ at the beginning of a word starts a comment
+ */
+static int split_line(struct strlist *words, char *line)
+{
+	char *src, *dst, *word, quote;
+	bool more;
+
+	src = line;
+	while (true)
+	{
+		while (isspace(*src))
+		{
+			src++;
+		}
+
+		if (*src == 0 || *src == '#')
+		{
+			return 0;
+		}
+
+		word = dst = src;
+		quote = 0;
+		for ( ; *src; src++)
+		{
+			if (quote == 0 && isspace(*src))
+			{
+				break;
+			}
+			else if (quote == 0 && (*src == '\'' || *src == '"'))
+			{
+				quote = *src;
+				continue;
+			}
+			else if (quote != 0 && *src == quote)
+			{
+				quote = 0;
+				continue;
+			}
+			else if (*src == '\\' && quote != '\'' && src[1] != 0)
+			{
+				src++;
+			}
+
+			*dst++ = *src;
+		}
+
+		if (quote != 0)
+		{
+			return error("unterminated quote in ‘%s’", word);
+		}
+
+		more = *src != 0;
+		*dst = 0;
+
+		strlist_push(words, word);
+
+		if (!more)
+		{
+			return 0;
+		}
+
+		src++;
+	}
+}
+
+static char *read_line(struct session *ss)
+{
+	const char *prompt;
+	char *line;
+	size_t cap;
+
+	prompt = sqlite3_get_autocommit(ss->db) ?
+			SESSION_PROMPT : SESSION_PROMPT_TRANS;
+
+#ifndef NO_READLINE
+	if (ss->interactive)
+	{
+		/**
+		 * history stays in memory, command lines may carry
+		 * passwords so they are never saved to a file
+		 */
+		if ((line = readline(prompt)) != NULL && *line)
+		{
+			add_history(line);
+		}
+
+		return line;
+	}
+#endif
+
+	if (ss->interactive)
+	{
+		fputs(prompt, stdout);
+		fflush(stdout);
+	}
+
+	line = NULL;
+	cap = 0;
+	if (getline(&line, &cap, ss->input) == -1)
+	{
+		free(line);
+		return NULL;
+	}
+
+	return line;
+}
+
+/**
+ * run a pk command inside a savepoint, whatever it has changed is
+ * rolled back if it fails, even if it fails by exit()
+ */
+static int run_command(struct session *ss, const struct cmdinfo *cmd,
+		       int argc, const char **argv)
+{
+	jmp_buf point;
+	volatile int status;
+	struct sqlite3_stmt *stmt;
+
+	if (msqlite3_exec(ss->db, "SAVEPOINT pk_command;",
+			   NULL, NULL, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	catch_exit(&point, &status);
+	if (setjmp(point) == 0)
+	{
+		status = cmd->handle(argc, argv, ss->prefix);
+		apply_atexit_chain();
+	}
+	catch_exit(NULL, NULL);
+
+	/**
+	 * a command that exits halfway leaves its statements behind,
+	 * they would keep the savepoint from being released
+	 */
+	while ((stmt = sqlite3_next_stmt(ss->db, NULL)) != NULL)
+	{
+		sqlite3_finalize(stmt);
+	}
+
+	if (status != 0)
+	{
+		msqlite3_exec(ss->db, "ROLLBACK TO pk_command;",
+				NULL, NULL, NULL);
+	}
+
+	msqlite3_exec(ss->db, "RELEASE pk_command;", NULL, NULL, NULL);
+
+	fflush(stdout);
+	return status;
+}
+
+static int run_builtin(struct session *ss, const char *name)
+{
+	size_t i;
+
+	for (i = 0; builtin_list[i].name != NULL; i++)
+	{
+		if (strcmp(name, builtin_list[i].name))
+		{
+			continue;
+		}
+		else if (builtin_list[i].sqlstr == NULL)
+		{
+			ss->quit = true;
+			return 0;
+		}
+		else if (msqlite3_exec(ss->db, builtin_list[i].sqlstr,
+					NULL, NULL, NULL) != SQLITE_OK)
+		{
+			return -1;
+		}
+
+		return 0;
+	}
+
+	return 1;
+}
+
+static int run_line(struct session *ss, char *line)
+{
+	struct strlist words = STRLIST_INIT_NODUP;
+	const struct cmdinfo *cmd;
+	const char **args, **argv;
+	int argc, rescode;
+	size_t i;
+
+	if (split_line(&words, line) != 0)
+	{
+		strlist_destroy(&words, false);
+		return -1;
+	}
+
+	MALLOC_ARRAY(args, words.size + 1);
+	for (i = 0; i < words.size; i++)
+	{
+		args[i] = words.elvec[i].str;
+	}
+	args[i] = NULL;
+
+	argv = args;
+	argc = words.size;
+
+	/* command lines of a script may be written as ‘pk <command>’ */
+	if (argc > 0 && !strcmp(argv[0], "pk"))
+	{
+		ARGV_MOVE_FRONT(argc, argv);
+	}
+
+	if (argc == 0)
+	{
+		rescode = 0;
+	}
+	else if ((rescode = run_builtin(ss, argv[0])) != 1);
+	else if ((cmd = find_command(argv[0])) == NULL)
+	{
+		rescode = error("‘%s’ is not a pk command", argv[0]);
+	}
+	else if (!(cmd->reqs & IN_SESSION))
+	{
+		rescode = error("‘%s’ cannot be run in a session", argv[0]);
+	}
+	else
+	{
+		rescode = run_command(ss, cmd, argc - 1, argv + 1);
+	}
+
+	free(args);
+	strlist_destroy(&words, false);
+
+	return rescode;
+}
+
+#ifndef NO_READLINE
+static struct strlist completion_list = STRLIST_INIT_NODUP;
+
+static char *complete_command(const char *text, int state)
+{
+	static size_t idx, len;
+	const char *name;
+
+	if (state == 0)
+	{
+		idx = 0;
+		len = strlen(text);
+	}
+
+	while (idx < completion_list.size)
+	{
+		name = completion_list.elvec[idx++].str;
+
+		if (!strncmp(name, text, len))
+		{
+			return xstrdup(name);
+		}
+	}
+
+	return NULL;
+}
+
+static char **complete_word(const char *text, int start, UNUSED int end)
+{
+	int i;
+
+	/**
+	 * only the command name is completed, readline falls back to
+	 * file names for the other words
+	 */
+	for (i = 0; i < start; i++)
+	{
+		if (!isspace(rl_line_buffer[i]))
+		{
+			return NULL;
+		}
+	}
+
+	return rl_completion_matches(text, complete_command);
+}
+
+static void setup_readline(void)
+{
+	const struct cmdinfo *cmd;
+	size_t i;
+
+	for (i = 0; builtin_list[i].name != NULL; i++)
+	{
+		strlist_push(&completion_list, builtin_list[i].name);
+	}
+
+	for (cmd = command_list; cmd->name != NULL; cmd++)
+	{
+		if (cmd->reqs & IN_SESSION)
+		{
+			strlist_push(&completion_list, cmd->name);
+		}
+	}
+
+	rl_readline_name = "pk";
+	rl_attempted_completion_function = complete_word;
+}
+#endif
+
+int cmd_session(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey     = 0;
+	const char *script = NULL;
+
+	const struct option cmd_session_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_FILENAME(0, "script", &script,
+				"run command lines from file"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_session_usages[] = {
+		"pk session [--cmdkey] [--script <file>]",
+		NULL,
+	};
+
+	parse_options(argc, argv, prefix, cmd_session_options,
+			cmd_session_usages, PARSER_ABORT_NON_OPTION);
+
+	struct session ss = {
+		.prefix = prefix,
+		.input  = stdin,
+	};
+
+	if (script != NULL && (ss.input = fopen(script, "r")) == NULL)
+	{
+		exit(error_errno("cannot open script ‘%s’", script));
+	}
+
+	ss.interactive = script == NULL && isatty(STDIN_FILENO);
+
+	/* the only unlock of the session */
+	ss.db = open_cred_db(SQLITE_OPEN_READWRITE, use_cmdkey);
+	share_cred_db(ss.db);
+
+#ifndef NO_READLINE
+	if (ss.interactive)
+	{
+		setup_readline();
+	}
+#endif
+
+	char *line;
+	int rescode;
+
+	rescode = 0;
+	while (!ss.quit && (line = read_line(&ss)) != NULL)
+	{
+		rescode = run_line(&ss, line);
+		free(line);
+
+		flush_cred_db(ss.db);
+
+		/**
+		 * a script stops at the first failure, the commands
+		 * after it may rely on its outcome
+		 */
+		if (rescode != 0 && !ss.interactive)
+		{
+			break;
+		}
+	}
+
+	if (!sqlite3_get_autocommit(ss.db))
+	{
+		warning("rolling back the transaction that is not "
+			"committed");
+		msqlite3_exec(ss.db, "ROLLBACK TRANSACTION;",
+				NULL, NULL, NULL);
+	}
+
+	share_cred_db(NULL);
+	close_cred_db(ss.db);
+
+	if (script != NULL)
+	{
+		fclose(ss.input);
+		free((char *)script);
+	}
+
+	return ss.interactive ? 0 : rescode;
+}
@@ -0,0 +1,437 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "filesys.h"
+#include "strbuf.h"
+#include "cred-db.h"
+#include "security.h"
+#include "atexit-chain.h"
+#include "hex.h"
+
+/**
+ * a repository holds chunks/<2 hex>/<62 hex>, named by the SHA-256 of
+ * their content, and snapshots/<name>, the manifest listing chunks of
+ * a snapshot in order
+ */
+#define SNAPSHOT_MAGIC "pk-snapshot 1"
+
+#define SNAPSHOT_DIGEST_LEN 32
+#define SNAPSHOT_HEX_LEN    (SNAPSHOT_DIGEST_LEN * 2)
+
+/**
+ * cut points are chosen by content but only at page boundaries, an
+ * unchanged page of the vault is byte-identical across snapshots even
+ * though it's encrypted, so a changed page touches at most the chunk
+ * holding it and the one after; a chunk has 4 to 64 pages, 1 in 16
+ * boundaries in between is a cut point
+ */
+#define SNAPSHOT_MIN_PAGES 4
+#define SNAPSHOT_MAX_PAGES 64
+#define SNAPSHOT_CUT_MASK  (UINT64_C(0xf) << 60)
+
+static uint64_t gear[256];
+
+static void init_gear(void)
+{
+	uint64_t seed, z;
+	unsigned i;
+
+	/* splitmix64, the table must be the same on every run */
+	seed = UINT64_C(0x706b2d736e617073);
+	for (i = 0; i < 256; i++)
+	{
+		z = (seed += UINT64_C(0x9e3779b97f4a7c15));
+		z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+		z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+		gear[i] = z ^ (z >> 31);
+	}
+}
+
+/**
+ * gear hash of the end of a page, a byte is shifted out of the hash
+ * 64 bytes after it comes in, so these are the only bytes that count
+ */
+static uint64_t hash_page_end(const uint8_t *page, size_t len)
+{
+	const uint8_t *p;
+	uint64_t hash;
+
+	p = len > 64 ? page + len - 64 : page;
+	hash = 0;
+
+	for ( ; p < page + len; p++)
+	{
+		hash = (hash << 1) + gear[*p];
+	}
+
+	return hash;
+}
+
+struct snapshot_stat
+{
+	size_t nr_chunk;
+	size_t nr_new;
+	uint64_t written;
+};
+
+/**
+ * path of chunk named by the first SNAPSHOT_HEX_LEN characters of
+ * ‘hex’
+ */
+static char *chunk_path(const char *repo, const char *hex)
+{
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	strbuf_printf(sb, "%s"DIRSEPSTR"chunks"DIRSEPSTR"%.2s"DIRSEPSTR"%.*s",
+			repo, hex, SNAPSHOT_HEX_LEN - 2, hex + 2);
+
+	return sb->buf;
+}
+
+static void store_chunk(const char *repo, const uint8_t *buf, size_t len,
+			struct strbuf *manifest, struct snapshot_stat *stat)
+{
+	uint8_t *digest;
+	char hex[SNAPSHOT_HEX_LEN + 1];
+	char *path, *tmp;
+
+	digest = digest_message_sha256(buf, len);
+	hex_encode(hex, digest, SNAPSHOT_DIGEST_LEN);
+	hex[SNAPSHOT_HEX_LEN] = 0;
+	clean_digest(digest);
+
+	strbuf_printf(manifest, "%s %zu\n", hex, len);
+	stat->nr_chunk++;
+
+	path = chunk_path(repo, hex);
+
+	if (access(path, F_OK) != 0)
+	{
+		avail_file_dir_or_die(path);
+
+		/* a chunk shows up under its name only once complete */
+		tmp = concat(path, ".tmp");
+		populate_file(tmp, buf, len);
+		EOE(replace_file(tmp, path));
+		free(tmp);
+
+		stat->nr_new++;
+		stat->written += len;
+	}
+
+	free(path);
+}
+
+static char *snapshot_name(void)
+{
+	char name[32];
+	time_t now;
+
+	now = time(NULL);
+	strftime(name, sizeof(name), "%Y%m%dT%H%M%SZ", gmtime(&now));
+
+	return xstrdup(name);
+}
+
+static int create_snapshot(const char *repo, bool use_cmdkey)
+{
+	struct sqlite3 *db;
+	struct strbuf *manifest = STRBUF_INIT_PTR;
+	struct strbuf *path = STRBUF_INIT_PTR;
+	struct snapshot_stat stat = { 0 };
+	const uint8_t *map;
+	size_t len, off, start, page, nr_page;
+	int64_t page_size;
+	char *name, *dir, *chunks, *tmp;
+
+	db = open_cred_db(SQLITE_OPEN_READONLY, use_cmdkey);
+	EOE(query_pragma(db, "page_size", &page_size));
+
+	/**
+	 * a read transaction keeps writers from committing while the
+	 * file is being chunked, so the snapshot is never torn
+	 */
+	xsqlite3_exec(db, "BEGIN; SELECT count(*) FROM sqlite_master;",
+		       NULL, NULL, NULL);
+
+	if ((map = map_file(cred_db_path, &len)) == NULL)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	dir = concat(repo, DIRSEPSTR"snapshots");
+	chunks = concat(repo, DIRSEPSTR"chunks");
+	EOE(avail_dir(repo));
+	EOE(avail_dir(dir));
+	EOE(avail_dir(chunks));
+	free(chunks);
+
+	init_gear();
+	strbuf_printf(manifest, SNAPSHOT_MAGIC"\nsize %zu\n", len);
+
+	start = 0;
+	nr_page = 0;
+	for (off = 0; off < len; off += page)
+	{
+		page = len - off < (size_t)page_size ?
+			len - off : (size_t)page_size;
+		nr_page++;
+
+		if (off + page == len || nr_page == SNAPSHOT_MAX_PAGES ||
+		     (nr_page >= SNAPSHOT_MIN_PAGES &&
+		      (hash_page_end(map + off, page) &
+		       SNAPSHOT_CUT_MASK) == 0))
+		{
+			store_chunk(repo, map + start, off + page - start,
+				    manifest, &stat);
+
+			start = off + page;
+			nr_page = 0;
+		}
+	}
+
+	unmap_file((void *)map, len);
+	xsqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+	close_cred_db(db);
+
+	name = snapshot_name();
+	strbuf_printf(path, "%s"DIRSEPSTR"%s", dir, name);
+
+	if (access(path->buf, F_OK) == 0)
+	{
+		exit(error("snapshot ‘%s’ already exists", path->buf));
+	}
+
+	tmp = concat(path->buf, ".tmp");
+	populate_file(tmp, manifest->buf, manifest->length);
+	EOE(replace_file(tmp, path->buf));
+
+	printf("Snapshot ‘%s’: %zu chunks, %zu new, %"PRIu64" KiB "
+	       "written.\n", name, stat.nr_chunk, stat.nr_new,
+	       stat.written / 1024);
+
+	free(tmp);
+	free(name);
+	free(dir);
+	strbuf_destroy(path);
+	strbuf_destroy(manifest);
+
+	return 0;
+}
+
+static const char *restore_path;
+
+static void rm_restore_file(void)
+{
+	if (restore_path != NULL)
+	{
+		unlink(restore_path);
+	}
+}
+
+/**
+ * write the chunk listed in manifest ‘line’ to ‘fd’, the chunk is
+ * checked against its digest first
+ */
+static int restore_chunk(const char *repo, const char *line,
+			 int fd, uint64_t *total)
+{
+	const uint8_t *map;
+	uint8_t *digest;
+	char hex[SNAPSHOT_HEX_LEN + 1];
+	char *path, *end;
+	size_t len, expect;
+	int rescode;
+
+	if (strlen(line) <= SNAPSHOT_HEX_LEN + 1 ||
+	     line[SNAPSHOT_HEX_LEN] != ' ' ||
+	     !is_hex_string(line, SNAPSHOT_HEX_LEN))
+	{
+		return error("bad manifest line ‘%s’", line);
+	}
+
+	expect = strtoull(line + SNAPSHOT_HEX_LEN + 1, &end, 10);
+
+	if (*end != 0)
+	{
+		return error("bad manifest line ‘%s’", line);
+	}
+
+	path = chunk_path(repo, line);
+
+	rescode = -1;
+	if ((map = map_file(path, &len)) == NULL)
+	{
+		goto finish;
+	}
+
+	digest = digest_message_sha256(map, len);
+	hex_encode(hex, digest, SNAPSHOT_DIGEST_LEN);
+	clean_digest(digest);
+
+	if (len != expect || memcmp(hex, line, SNAPSHOT_HEX_LEN) != 0)
+	{
+		error("chunk ‘%s’ is corrupted", path);
+	}
+	else
+	{
+		xwrite(fd, map, len);
+		*total += len;
+		rescode = 0;
+	}
+
+	unmap_file((void *)map, len);
+
+finish:
+	free(path);
+	return rescode;
+}
+
+static int restore_snapshot(const char *repo, const char *name,
+			    const char *dest)
+{
+	struct strbuf *path = STRBUF_INIT_PTR;
+	FILE *stream;
+	char *line;
+	size_t cap;
+	ssize_t nr;
+	uint64_t size, total;
+	int fd, rescode;
+
+	strbuf_printf(path, "%s"DIRSEPSTR"snapshots"DIRSEPSTR"%s",
+			repo, name);
+
+	if ((stream = fopen(path->buf, "r")) == NULL)
+	{
+		exit(error_errno("cannot open snapshot ‘%s’", path->buf));
+	}
+
+	line = NULL;
+	cap = 0;
+	if ((nr = getline(&line, &cap, stream)) == -1 ||
+	     strcmp(line, SNAPSHOT_MAGIC"\n") != 0 ||
+	     getline(&line, &cap, stream) == -1 ||
+	     sscanf(line, "size %"SCNu64, &size) != 1)
+	{
+		exit(error("‘%s’ is not a snapshot manifest", path->buf));
+	}
+
+	if (!strcmp(dest, "-"))
+	{
+		fd = STDOUT_FILENO;
+		xiopath = "stdout";
+	}
+	else
+	{
+		restore_path = dest;
+		atexit_chain_push(rm_restore_file);
+
+		fd = xopen(dest, O_WRONLY | O_CREAT | O_EXCL, FILCRT_BIT);
+		xiopath = dest;
+	}
+
+	total = 0;
+	rescode = 0;
+	while (rescode == 0 && (nr = getline(&line, &cap, stream)) != -1)
+	{
+		if (nr > 0 && line[nr - 1] == '\n')
+		{
+			line[nr - 1] = 0;
+		}
+
+		rescode = restore_chunk(repo, line, fd, &total);
+	}
+
+	if (rescode == 0 && total != size)
+	{
+		rescode = error("snapshot ‘%s’ is truncated", path->buf);
+	}
+
+	if (rescode != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	if (fd != STDOUT_FILENO)
+	{
+		close(fd);
+		atexit_chain_pop(/* rm_restore_file */);
+	}
+
+	free(line);
+	fclose(stream);
+	strbuf_destroy(path);
+
+	return 0;
+}
+
+int cmd_snapshot(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey  = 0;
+	int use_restore = 0;
+
+	const struct option cmd_snapshot_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_SWITCH(0, "restore", &use_restore,
+			      "write a snapshot back to a file"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_snapshot_usages[] = {
+		"pk snapshot [--cmdkey] <repo>",
+		"pk snapshot --restore <repo> <snapshot> (<file> | -)",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_snapshot_options,
+				cmd_snapshot_usages, 0);
+
+	if (argc != (use_restore ? 3 : 1))
+	{
+		exit(error(argc == 0 ? "no repository specified" :
+			    argc < 3 && use_restore ? "missing arguments" :
+						      "too many arguments"));
+	}
+
+	char *repo, *dest;
+	int rescode;
+
+	repo = prefix_filename(prefix, argv[0]);
+
+	if (!use_restore)
+	{
+		rescode = create_snapshot(repo, use_cmdkey);
+	}
+	else
+	{
+		dest = strcmp(argv[2], "-") ?
+			prefix_filename(prefix, argv[2]) : xstrdup("-");
+
+		rescode = restore_snapshot(repo, argv[1], dest);
+		free(dest);
+	}
+
+	free(repo);
+
+	return rescode;
+}
@@ -0,0 +1,329 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "filesys.h"
+#include "strbuf.h"
+#include "cred-db.h"
+
+/**
+ * changes of ‘src’ newer than both the last synced seq and what
+ * ‘dst’ has for the same row, this is where last writer wins
+ */
+#define COLLECT_CHANGES_SQLSTR_FMT					\
+	"CREATE TEMP TABLE %s AS "					\
+	"SELECT s.uuid, s.deleted, s.modtime "				\
+	"FROM %s.change_log s "						\
+	"LEFT JOIN %s.change_log d ON d.uuid = s.uuid "			\
+	"WHERE s.seq > ? AND "						\
+		"(d.uuid IS NULL OR s.modtime > d.modtime);"
+
+#define SAVE_SYNC_STATE_SQLSTR_FMT					\
+	"INSERT OR REPLACE INTO %s.sync_state (peer_uuid, seq) "	\
+	"SELECT uuid, (SELECT coalesce(max(seq), 0) "			\
+		      "FROM %s.change_log) "				\
+	"FROM %s.vault_info;"
+
+#define PEER_SCHEMA "peer"
+
+static int query_text(struct sqlite3 *db, const char *sql,
+		      const char *arg, char **res)
+{
+	struct sqlite3_stmt *stmt;
+	int rescode;
+
+	*res = NULL;
+	if (msqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	if (arg != NULL &&
+	     msqlite3_bind_text(stmt, 1, arg, -1, SQLITE_STATIC) != SQLITE_OK)
+	{
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+
+	rescode = sqlite3_step(stmt);
+	if (rescode == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+	{
+		*res = xstrdup((const char *)sqlite3_column_text(stmt, 0));
+	}
+	else if (rescode != SQLITE_ROW && rescode != SQLITE_DONE)
+	{
+		sqlite3_finalize(stmt);
+		return report_sqlite_error(sqlite3_step, db);
+	}
+
+	sqlite3_finalize(stmt);
+	return 0;
+}
+
+static int64_t get_synced_seq(struct sqlite3 *db, const char *schema,
+			      const char *peer_uuid)
+{
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	char *seq;
+	int64_t res;
+
+	strbuf_printf(sql, "SELECT seq FROM %s.sync_state "
+			   "WHERE peer_uuid = ?;", schema);
+	EOE(query_text(db, sql->buf, peer_uuid, &seq));
+	strbuf_destroy(sql);
+
+	res = seq == NULL ? 0 : strtoll(seq, NULL, 10);
+	free(seq);
+
+	return res;
+}
+
+static int64_t collect_changes(struct sqlite3 *db, const char *table,
+			       const char *src, const char *dst,
+			       int64_t since)
+{
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	struct sqlite3_stmt *stmt;
+	char *count;
+	int64_t res;
+
+	strbuf_printf(sql, COLLECT_CHANGES_SQLSTR_FMT, table, src, dst);
+
+	xsqlite3_prepare_v2(db, sql->buf, -1, &stmt, NULL);
+	xsqlite3_bind_int64(stmt, 1, since);
+	xsqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+
+	strbuf_trunc(sql);
+	strbuf_printf(sql, "SELECT count(*) FROM temp.%s;", table);
+	EOE(query_text(db, sql->buf, NULL, &count));
+	strbuf_destroy(sql);
+
+	res = strtoll(count, NULL, 10);
+	free(count);
+
+	return res;
+}
+
+/**
+ * apply changes listed in temp table ‘t’ from ‘src’ to ‘dst’, the
+ * children of a changed account are replaced as a whole, then the
+ * modtime bumped by their triggers is set back to the one of ‘src’
+ */
+static void apply_changes(struct sqlite3 *db, const char *t,
+			  const char *src, const char *dst)
+{
+	struct strbuf *sql = STRBUF_INIT_PTR;
+
+	strbuf_printf(sql,
+		"DELETE FROM %s.account WHERE uuid IN "
+			"(SELECT uuid FROM temp.%s WHERE deleted);",
+		dst, t);
+
+	strbuf_printf(sql,
+		"INSERT OR REPLACE INTO %s.change_log "
+			"(uuid, deleted, modtime) "
+		"SELECT uuid, 1, modtime FROM temp.%s WHERE deleted;",
+		dst, t);
+
+	strbuf_printf(sql,
+		"INSERT INTO %s.account (uuid, sitename, alias, siteurl, "
+			"username, password, sqltime, modtime) "
+		"SELECT uuid, sitename, alias, siteurl, "
+			"username, password, sqltime, modtime "
+		"FROM %s.account WHERE uuid IN "
+			"(SELECT uuid FROM temp.%s WHERE NOT deleted) "
+		"ON CONFLICT (uuid) DO UPDATE SET "
+			"sitename = excluded.sitename,"
+			"alias    = excluded.alias,"
+			"siteurl  = excluded.siteurl,"
+			"username = excluded.username,"
+			"password = excluded.password,"
+			"modtime  = excluded.modtime;",
+		dst, src, t);
+
+	strbuf_printf(sql,
+		"DELETE FROM %s.account_security WHERE account_id IN "
+			"(SELECT id FROM %s.account WHERE uuid IN "
+				"(SELECT uuid FROM temp.%s "
+				 "WHERE NOT deleted));",
+		dst, dst, t);
+
+	strbuf_printf(sql,
+		"DELETE FROM %s.account_misc WHERE account_id IN "
+			"(SELECT id FROM %s.account WHERE uuid IN "
+				"(SELECT uuid FROM temp.%s "
+				 "WHERE NOT deleted));",
+		dst, dst, t);
+
+	strbuf_printf(sql,
+		"INSERT INTO %s.account_security "
+			"(account_id, guard, recovery, memo) "
+		"SELECT d.id, c.guard, c.recovery, c.memo "
+		"FROM %s.account_security c "
+		"JOIN %s.account s ON s.id = c.account_id "
+		"JOIN %s.account d ON d.uuid = s.uuid "
+		"WHERE s.uuid IN "
+			"(SELECT uuid FROM temp.%s WHERE NOT deleted);",
+		dst, src, src, dst, t);
+
+	strbuf_printf(sql,
+		"INSERT INTO %s.account_misc (account_id, comment) "
+		"SELECT d.id, c.comment "
+		"FROM %s.account_misc c "
+		"JOIN %s.account s ON s.id = c.account_id "
+		"JOIN %s.account d ON d.uuid = s.uuid "
+		"WHERE s.uuid IN "
+			"(SELECT uuid FROM temp.%s WHERE NOT deleted);",
+		dst, src, src, dst, t);
+
+	/**
+	 * rows whose modtime is already right are skipped, or the
+	 * no-op update would be touched by account_touch
+	 */
+	strbuf_printf(sql,
+		"UPDATE %s.account SET modtime = "
+			"(SELECT modtime FROM %s.account s "
+			 "WHERE s.uuid = account.uuid) "
+		"WHERE uuid IN "
+			"(SELECT uuid FROM temp.%s WHERE NOT deleted) "
+		"AND modtime IS NOT "
+			"(SELECT modtime FROM %s.account s "
+			 "WHERE s.uuid = account.uuid);",
+		dst, src, t, src);
+
+	xsqlite3_exec(db, sql->buf, NULL, NULL, NULL);
+
+	strbuf_destroy(sql);
+}
+
+static void save_sync_state(struct sqlite3 *db, const char *schema,
+			    const char *peer)
+{
+	struct strbuf *sql = STRBUF_INIT_PTR;
+
+	strbuf_printf(sql, SAVE_SYNC_STATE_SQLSTR_FMT, schema, peer, peer);
+	xsqlite3_exec(db, sql->buf, NULL, NULL, NULL);
+
+	strbuf_destroy(sql);
+}
+
+int cmd_sync(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey      = 0;
+	int use_peer_cmdkey = 0;
+	const char *peer_cc = NULL;
+
+	const struct option cmd_sync_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_COUNTUP(0, "peer-cmdkey", &use_peer_cmdkey,
+				"read key of the other vault from "
+				 "command line"),
+		OPTION_FILENAME(0, "peer-cc", &peer_cc,
+				"cipher config of the other vault"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_sync_usages[] = {
+		"pk sync [--cmdkey] [--peer-cmdkey] [--peer-cc <file>] "
+		"<vault>",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_sync_options,
+				cmd_sync_usages, 0);
+
+	if (argc != 1)
+	{
+		exit(error(argc == 0 ? "no vault to sync with" :
+					"too many arguments"));
+	}
+
+	struct sqlite3 *db;
+	char *peer_path;
+
+	peer_path = prefix_filename(prefix, argv[0]);
+
+	db = open_cred_db(SQLITE_OPEN_READWRITE, use_cmdkey);
+
+	attach_peer_cred_db(db, peer_path, peer_cc, use_peer_cmdkey,
+			     PEER_SCHEMA, SQLITE_OPEN_READWRITE);
+
+	xsqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION;", NULL, NULL, NULL);
+
+	char *self_uuid, *peer_uuid;
+
+	EOE(query_text(db, "SELECT uuid FROM main.vault_info;",
+			NULL, &self_uuid));
+	EOE(query_text(db, "SELECT uuid FROM " PEER_SCHEMA ".vault_info;",
+			NULL, &peer_uuid));
+
+	/**
+	 * a vault copied as a whole file carries the same uuid, give
+	 * the copy an identity of its own, everything is exchanged on
+	 * the first sync but rows that did not change compare equal
+	 */
+	if (!strcmp(self_uuid, peer_uuid))
+	{
+		note("‘%s’ is a copy of ‘%s’, assigning it a new vault id",
+			peer_path, cred_db_path);
+
+		xsqlite3_exec(db, "UPDATE " PEER_SCHEMA ".vault_info "
+				  "SET uuid = lower(hex(randomblob(16)));",
+				  NULL, NULL, NULL);
+
+		free(peer_uuid);
+		EOE(query_text(db, "SELECT uuid FROM " PEER_SCHEMA
+				   ".vault_info;", NULL, &peer_uuid));
+	}
+
+	int64_t pulled, pushed;
+
+	/* both sets are collected before either side is modified */
+	pulled = collect_changes(db, "sync_pull", PEER_SCHEMA, "main",
+				  get_synced_seq(db, "main", peer_uuid));
+	pushed = collect_changes(db, "sync_push", "main", PEER_SCHEMA,
+				  get_synced_seq(db, PEER_SCHEMA, self_uuid));
+
+	apply_changes(db, "sync_pull", PEER_SCHEMA, "main");
+	apply_changes(db, "sync_push", "main", PEER_SCHEMA);
+
+	/**
+	 * recorded after applying, so the changes we just wrote to the
+	 * other side are not pulled back next time
+	 */
+	save_sync_state(db, "main", PEER_SCHEMA);
+	save_sync_state(db, PEER_SCHEMA, "main");
+
+	xsqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+
+	close_cred_db(db);
+
+	printf("Pulled %"PRId64" and pushed %"PRId64" changes.\n",
+		pulled, pushed);
+
+	free(self_uuid);
+	free(peer_uuid);
+	free(peer_path);
+
+	return 0;
+}
@@ -0,0 +1,191 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "parse-option.h"
+#include "cred-db.h"
+#include "tag.h"
+
+#define LIST_TAG_SQLSTR							\
+	"SELECT name, pk_bitmap_count(bitmap) FROM tag ORDER BY name;"
+
+#define ACCOUNT_EXISTS_SQLSTR "SELECT 1 FROM account WHERE id = ?;"
+
+static int list_tags(struct sqlite3 *db)
+{
+	struct sqlite3_stmt *stmt;
+	int rescode;
+
+	xsqlite3_prepare_v2(db, LIST_TAG_SQLSTR, -1, &stmt, NULL);
+
+	while ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		printf("%s\t%"PRId64"\n", sqlite3_column_text(stmt, 0),
+			(int64_t)sqlite3_column_int64(stmt, 1));
+	}
+
+	if (rescode != SQLITE_DONE)
+	{
+		rescode = report_sqlite_error(sqlite3_step, db);
+	}
+	else
+	{
+		rescode = 0;
+	}
+
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+static int change_tags(struct sqlite3 *db, int64_t rowid,
+		       const struct strlist *add, const struct strlist *remove)
+{
+	size_t i;
+
+	for (i = 0; i < add->size; i++)
+	{
+		if (tag_account(db, rowid, add->elvec[i].str) != 0)
+		{
+			return -1;
+		}
+	}
+
+	for (i = 0; i < remove->size; i++)
+	{
+		if (untag_account(db, rowid, remove->elvec[i].str) != 0)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int cmd_tag(int argc, const char **argv, const char *prefix)
+{
+	int use_cmdkey = 0;
+	struct strlist add = STRLIST_INIT_NODUP;
+	struct strlist remove = STRLIST_INIT_NODUP;
+
+	const struct option cmd_tag_options[] = {
+		OPTION__CMDKEY(&use_cmdkey),
+		OPTION_STRLIST('a', "add", &add, "tag",
+				"tag the records, may be repeated"),
+		OPTION_STRLIST('r', "remove", &remove, "tag",
+				"untag the records, may be repeated"),
+		OPTION_END(),
+	};
+
+	const char *const cmd_tag_usages[] = {
+		"pk tag [--cmdkey]",
+		"pk tag [--cmdkey] [--add <tag>]... [--remove <tag>]... "
+		"<rowid>...",
+		NULL,
+	};
+
+	argc = parse_options(argc, argv, prefix, cmd_tag_options,
+				cmd_tag_usages, 0);
+
+	bool listing;
+
+	if ((listing = add.size == 0 && remove.size == 0) && argc > 0)
+	{
+		exit(error("no tag to add or remove"));
+	}
+	else if (!listing && argc == 0)
+	{
+		exit(error("no record specified"));
+	}
+
+	struct sqlite3 *db;
+
+	db = open_cred_db(listing ? SQLITE_OPEN_READONLY :
+				     SQLITE_OPEN_READWRITE, use_cmdkey);
+
+	if (listing)
+	{
+		int rescode;
+
+		rescode = list_tags(db);
+		close_cred_db(db);
+
+		return rescode;
+	}
+
+	struct sqlite3_stmt *stmt;
+	int64_t rowid;
+	char *end;
+	int i, rescode;
+
+	xsqlite3_begin_transaction(db);
+	xsqlite3_prepare_v2(db, ACCOUNT_EXISTS_SQLSTR, -1, &stmt, NULL);
+
+	/**
+	 * like delete, tags of the records are changed all or nothing
+	 */
+	rescode = 0;
+	for (i = 0; i < argc; i++)
+	{
+		errno = 0;
+		rowid = strtoll(argv[i], &end, 10);
+
+		if (errno != 0 || end == argv[i] || *end != 0)
+		{
+			rescode = error("invalid rowid ‘%s’", argv[i]);
+			break;
+		}
+
+		xsqlite3_bind_int64(stmt, 1, rowid);
+		rescode = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+
+		if (rescode != SQLITE_ROW)
+		{
+			rescode = rescode == SQLITE_DONE ?
+				  error("no record with rowid %"PRId64, rowid) :
+				  report_sqlite_error(sqlite3_step, db);
+			break;
+		}
+
+		if ((rescode = change_tags(db, rowid, &add, &remove)) != 0)
+		{
+			break;
+		}
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (rescode == 0)
+	{
+		xsqlite3_end_transaction(db);
+		printf("Tags of %d record(s) changed.\n", argc);
+	}
+	else
+	{
+		xsqlite3_rollback_transaction(db);
+	}
+
+	close_cred_db(db);
+	strlist_destroy(&add, false);
+	strlist_destroy(&remove, false);
+
+	return rescode;
+}
@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <math.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <sys/stat.h>
@@ -43,10 +44,9 @@
 #include <sqlite3.h>
 #include <signal.h>
 #include <fcntl.h>
-
-#ifdef LINUX
 #include <time.h>
-#else
+
+#ifndef LINUX
 #include <timezoneapi.h>
 #endif
 
@@ -83,6 +83,10 @@
 #define PK_SPINNER "PK_SPINNER"
 #endif
 
+#ifndef PK_COMPLETE_CACHE
+#define PK_COMPLETE_CACHE "PK_COMPLETE_CACHE"
+#endif
+
 #ifndef COMMON_RECORD_MESSAGE
 #define COMMON_RECORD_MESSAGE							\
 "# Please enter the information for your password record. Lines starting\n"	\
@@ -105,6 +109,18 @@
 #define PK_TMP_REC_DEFPATH  ".pk-tmp-rec"
 #endif
 
+/**
+ * key of the completion cache, relative to the home directory
+ */
+#ifndef PK_COMPLETE_KEY_DEFPATH
+#define PK_COMPLETE_KEY_DEFPATH  ".pk-complete-key"
+#endif
+
+/**
+ * use this as the pathname of record file to keep it in memory
+ */
+#define PK_TMP_REC_MEMORY  ":memory:"
+
 #ifdef LINUX
 #define ENV_USERHOME  "HOME"
 #define DIRSEPSTR     "/"
@@ -215,6 +231,20 @@ ssize_t pk_getline(char **restrict lineptr, size_t *restrict n, FILE *restrict s
 #define getline pk_getline
 #endif
 
+#ifdef NO_WRITEV
+struct iovec
+{
+	void *iov_base;
+	size_t iov_len;
+};
+
+ssize_t pk_writev(int fd, const struct iovec *iov, int iovcnt);
+
+#define writev pk_writev
+#else
+#include <sys/uio.h>
+#endif
+
 #ifdef LINUX
 #include <termios.h>
 #else
@@ -20,6 +20,10 @@
 **
 ****************************************************************************/
 
+#include "filesys.h"
+#include "strbuf.h"
+#include <sys/mman.h>
+
 #ifdef test_file_mode
 #undef test_file_mode
 #endif
@@ -63,3 +67,124 @@ int test_file_mode(struct stat *st, int mode)
 
 	return 1;
 }
+
+int replace_file(const char *src, const char *dest)
+{
+	if (rename(src, dest) != 0)
+	{
+		return error_errno("unable to replace ‘%s’ with ‘%s’",
+					dest, src);
+	}
+
+	return 0;
+}
+
+void *map_file(const char *path, size_t *len)
+{
+	struct stat st;
+	void *addr;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &st) != 0)
+	{
+		error_errno("unable to open ‘%s’", path);
+		goto failure;
+	}
+
+	if (st.st_size == 0)
+	{
+		error("‘%s’ is empty", path);
+		goto failure;
+	}
+
+	addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (addr == MAP_FAILED)
+	{
+		error_errno("unable to map ‘%s’", path);
+		goto failure;
+	}
+
+	close(fd);
+
+	*len = st.st_size;
+	return addr;
+
+failure:
+	if (fd != -1)
+	{
+		close(fd);
+	}
+
+	return NULL;
+}
+
+void unmap_file(void *addr, size_t len)
+{
+	munmap(addr, len);
+}
+
+#ifdef MFD_ALLOW_SEALING
+static char *make_memfd_file(const char *name, int *fd)
+{
+	/**
+	 * no MFD_CLOEXEC here, the spawned editor inherits the same
+	 * descriptor so that ‘/proc/self/fd/N’ is valid for both
+	 */
+	if ((*fd = memfd_create(name, MFD_ALLOW_SEALING)) == -1)
+	{
+		return NULL;
+	}
+
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	strbuf_printf(sb, "/proc/self/fd/%d", *fd);
+
+	return sb->buf;
+}
+#endif
+
+char *make_memory_file(const char *name, int *fd)
+{
+	char *path;
+
+#ifdef MFD_ALLOW_SEALING
+	if ((path = make_memfd_file(name, fd)) != NULL)
+	{
+		return path;
+	}
+#endif
+
+	/**
+	 * kernel too old for memfd, a private file on tmpfs is
+	 * the next best thing
+	 */
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	strbuf_printf(sb, "/dev/shm/%s-XXXXXX", name);
+	path = sb->buf;
+
+	if ((*fd = mkstemp(path)) == -1)
+	{
+		error_errno("unable to create memory file ‘%s’", path);
+		free(path);
+
+		return NULL;
+	}
+
+	return path;
+}
+
+int seal_memory_file(int fd)
+{
+#ifdef F_ADD_SEALS
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK |
+				   F_SEAL_GROW | F_SEAL_WRITE) != 0 &&
+	     errno != EINVAL)
+	{
+		return error_errno("unable to seal memory file");
+	}
+#endif
+
+	return 0;
+}
@@ -22,6 +22,12 @@
 
 #include "pkproc.h"
 #include "strlist.h"
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <spawn.h>
+
+extern char **environ;
 
 enum child_errnum
 {
@@ -58,15 +64,6 @@ static void idup2(int fd1, int fd2)
 	}
 }
 
-static inline void set_cloexec(int fd)
-{
-	int flags;
-	if ((flags = fcntl(fd, F_GETFD)) >= 0)
-	{
-		fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
-	}
-}
-
 /**
  * this function should executed BEFORE fork()
  */
@@ -165,57 +162,120 @@ static void after_fork(
 	close(nulfd);
 }
 
-int mkprocl(struct process_info *ctx, const char *arg0, ...)
+/**
+ * make file actions equivalent to redirect_stdio()
+ */
+static int make_spawn_actions(posix_spawn_file_actions_t *actions,
+			      unsigned fildes_flags, int fd)
 {
-	va_list ap;
-	const char *arg;
-	int nulfd, errnot_pipe[2];
 	int errnum;
 
-	va_start(ap, arg0);
+	if ((errnum = posix_spawn_file_actions_init(actions)) != 0)
+	{
+		return errnum;
+	}
 
-	make_process_fildes(&nulfd, errnot_pipe);
+	errnum = 0;
+	if (fildes_flags & NO_STDIN)
+	{
+		errnum = posix_spawn_file_actions_adddup2(actions, fd,
+							   STDIN_FILENO);
+	}
 
-	ctx->pid = fork();
-	errnum = errno;
+	if (!errnum && fildes_flags & NO_STDOUT)
+	{
+		errnum = posix_spawn_file_actions_adddup2(actions, fd,
+							   STDOUT_FILENO);
+	}
 
-	if (ctx->pid == 0)
+	if (!errnum && fildes_flags & NO_STDERR)
 	{
-		close(errnot_pipe[0]);
-		set_cloexec(errnot_pipe[1]);
-		errnot_fd = errnot_pipe[1];
+		errnum = posix_spawn_file_actions_adddup2(actions, fd,
+							   STDERR_FILENO);
+	}
 
-		redirect_stdio(ctx->fildes_flags, nulfd);
+	if (errnum)
+	{
+		posix_spawn_file_actions_destroy(actions);
+	}
 
-		struct strlist *sl = STRLIST_INIT_PTR_NODUP;
-		char **argv;
+	return errnum;
+}
 
-		while ((arg = va_arg(ap, const char *)) != NULL)
-		{
-			strlist_push(sl, arg);
-		}
+/**
+ * posix_spawnp() shares memory with the child until exec (glibc
+ * uses clone with CLONE_VM | CLONE_VFORK), so the cost does not grow
+ * with our RSS like fork() does, and a failed exec comes back as its
+ * return value instead of through errnot pipe
+ */
+int mkprocl(struct process_info *ctx, const char *arg0, ...)
+{
+	va_list ap;
+	const char *arg;
+	posix_spawn_file_actions_t actions;
+	int nulfd, errnum;
 
-		argv = strlist_to_array(sl);
+	nulfd = -1;
+	if (ctx->fildes_flags & (NO_STDIN | NO_STDOUT | NO_STDERR))
+	{
+		nulfd = xopen(NULDEV, O_RDWR | O_CLOEXEC);
+	}
 
-		strlist_destroy(sl, false);
-		va_end(ap);
+	if ((errnum = make_spawn_actions(&actions,
+					  ctx->fildes_flags, nulfd)) != 0)
+	{
+		errno = errnum;
+		warning_errno("cannot prepare to spawn %s", ctx->program);
+		goto failure;
+	}
 
-		execvp(arg0, argv);
+	struct strlist *sl = STRLIST_INIT_PTR_NODUP;
+	char **argv;
 
-		child_die(ERROR_EXEC, arg0);
+	va_start(ap, arg0);
+	while ((arg = va_arg(ap, const char *)) != NULL)
+	{
+		strlist_push(sl, arg);
 	}
+	va_end(ap);
 
-	after_fork(ctx, nulfd, errnot_pipe, &errnum);
+	argv = strlist_to_array(sl);
+	strlist_destroy(sl, false);
 
-	va_end(ap);
+	errnum = posix_spawnp(&ctx->pid, arg0, &actions, NULL, argv, environ);
 
-	if (ctx->pid < 0)
+	posix_spawn_file_actions_destroy(&actions);
+	strarr_free(argv);
+
+	if (errnum != 0)
 	{
-		errno = errnum;
-		return -1;
+		struct child_error errobj = {
+			.chlerr = ERROR_EXEC,
+			.syserr = errnum,
+			.errext = arg0,
+		};
+
+		error_chlerr(&errobj);
+		goto failure;
+	}
+
+	if (nulfd != -1)
+	{
+		close(nulfd);
 	}
 
 	return 0;
+
+failure:
+	if (nulfd != -1)
+	{
+		close(nulfd);
+	}
+
+	ctx->pid = -1;
+	errno = errnum;
+
+	return -1;
 }
 
 int mkprocf(struct process_info *ctx, procfn_t procfn, const void *args)
@@ -300,3 +360,108 @@ int finish_process(struct process_info *ctx, bool raised)
 	errno = errnum;
 	return rescode;
 }
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static void arm_timer(int tfd, useconds_t usec)
+{
+	struct itimerspec its = {
+		.it_value = {
+			.tv_sec  = usec / 1000000,
+			.tv_nsec = (usec % 1000000) * 1000,
+		},
+	};
+
+	timerfd_settime(tfd, 0, &its, NULL);
+}
+
+/**
+ * without a pidfd (kernel older than 5.3), check the child on every
+ * frame instead, WNOWAIT leaves it for finish_process() to reap
+ */
+static bool is_process_exited(struct process_info *ctx)
+{
+	siginfo_t info = { 0 };
+
+	return waitid(P_PID, ctx->pid, &info,
+		      WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid != 0;
+}
+
+int wait_process(struct process_info *ctx, const char *spinner_style)
+{
+	struct spinner sp;
+	struct pollfd pfd[2];
+	int pidfd, tfd;
+	uint64_t expired;
+
+	if (spinner_style == NULL)
+	{
+		goto finish;
+	}
+
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+	{
+		warning_errno("unable to create timer for spinner");
+		goto finish;
+	}
+
+	pidfd = open_pidfd(ctx->pid);
+
+	sp = (struct spinner){
+		.style = find_spinner_style(spinner_style),
+	};
+
+	/* poll() ignores pfd[1] if there's no pidfd */
+	pfd[0] = (struct pollfd){ .fd = tfd, .events = POLLIN };
+	pfd[1] = (struct pollfd){ .fd = pidfd, .events = POLLIN };
+
+	arm_timer(tfd, spin_once(&sp));
+
+	while (39)
+	{
+		if (poll(pfd, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			warning_errno("unable to wait for %s", ctx->program);
+			break;
+		}
+
+		if (pfd[1].revents)
+		{
+			break;
+		}
+
+		if (pfd[0].revents)
+		{
+			read(tfd, &expired, sizeof(expired));
+
+			if (pidfd < 0 && is_process_exited(ctx))
+			{
+				break;
+			}
+
+			arm_timer(tfd, spin_once(&sp));
+		}
+	}
+
+	close(tfd);
+	if (pidfd >= 0)
+	{
+		close(pidfd);
+	}
+
+finish:
+	return finish_process(ctx, false);
+}
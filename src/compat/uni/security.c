@@ -21,6 +21,7 @@
 ****************************************************************************/
 
 #include "security.h"
+#include <sys/mman.h>
 
 int termios_disable_echo(struct termios *term0)
 {
@@ -54,3 +55,57 @@ int termios_restore_config(struct termios *term0)
 
 	return 0;
 }
+
+size_t secure_page_size(void)
+{
+	static size_t page;
+
+	if (page == 0)
+	{
+		page = sysconf(_SC_PAGESIZE);
+	}
+
+	return page;
+}
+
+void *map_secure_pages(size_t len)
+{
+	uint8_t *map;
+	size_t page;
+
+	page = secure_page_size();
+
+	if ((map = mmap(NULL, len + 2 * page, PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	if (mprotect(map + page, len, PROT_READ | PROT_WRITE) != 0)
+	{
+		munmap(map, len + 2 * page);
+		return NULL;
+	}
+
+#ifdef MADV_DONTDUMP
+	madvise(map + page, len, MADV_DONTDUMP);
+#endif
+
+	/**
+	 * RLIMIT_MEMLOCK may be too small, the pages are still guarded
+	 * and wiped, just not pinned
+	 */
+	mlock(map + page, len);
+
+	return map + page;
+}
+
+void unmap_secure_pages(void *addr, size_t len)
+{
+	size_t page;
+
+	page = secure_page_size();
+
+	munlock(addr, len);
+	munmap((uint8_t *)addr - page, len + 2 * page);
+}
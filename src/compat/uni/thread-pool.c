@@ -0,0 +1,74 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "thread-pool.h"
+
+static void *start_worker(void *ctx0)
+{
+	struct worker_info *ctx;
+
+	ctx = ctx0;
+	return (void *)(intptr_t)ctx->fn(ctx->args);
+}
+
+int mkworker(struct worker_info *ctx, int (*fn)(void *), void *args)
+{
+	int errnum;
+
+	ctx->fn = fn;
+	ctx->args = args;
+
+	if ((errnum = pthread_create(&ctx->tid, NULL,
+					start_worker, ctx)) != 0)
+	{
+		errno = errnum;
+		return error_errno("failed to start a new thread");
+	}
+
+	return 0;
+}
+
+int join_worker(struct worker_info *ctx)
+{
+	void *rescode;
+	int errnum;
+
+	if ((errnum = pthread_join(ctx->tid, &rescode)) != 0)
+	{
+		errno = errnum;
+		return error_errno("failed to join thread");
+	}
+
+	return (int)(intptr_t)rescode;
+}
+
+unsigned online_cpu_count(void)
+{
+	long ncpu;
+
+	if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+	{
+		return 1;
+	}
+
+	return ncpu;
+}
@@ -0,0 +1,123 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "filesys.h"
+#include "strbuf.h"
+
+int replace_file(const char *src, const char *dest)
+{
+	if (!MoveFileEx(src, dest,
+		MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		return error_winerr("unable to replace ‘%s’ with ‘%s’",
+					dest, src);
+	}
+
+	return 0;
+}
+
+void *map_file(const char *path, size_t *len)
+{
+	HANDLE file, mapping;
+	LARGE_INTEGER size;
+	void *addr;
+
+	file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+			  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		error_winerr("unable to open ‘%s’", path);
+		return NULL;
+	}
+
+	addr = NULL;
+	mapping = NULL;
+	if (!GetFileSizeEx(file, &size))
+	{
+		error_winerr("unable to get size of ‘%s’", path);
+	}
+	else if (size.QuadPart == 0)
+	{
+		error("‘%s’ is empty", path);
+	}
+	else if ((mapping = CreateFileMapping(file, NULL, PAGE_READONLY,
+					      0, 0, NULL)) == NULL ||
+		  (addr = MapViewOfFile(mapping, FILE_MAP_READ,
+					0, 0, 0)) == NULL)
+	{
+		error_winerr("unable to map ‘%s’", path);
+	}
+
+	if (mapping != NULL)
+	{
+		CloseHandle(mapping);
+	}
+
+	CloseHandle(file);
+
+	*len = size.QuadPart;
+	return addr;
+}
+
+void unmap_file(void *addr, UNUSED size_t len)
+{
+	UnmapViewOfFile(addr);
+}
+
+char *make_memory_file(const char *name, int *fd)
+{
+	char dir[MAX_PATH + 1], path[MAX_PATH + 1];
+	HANDLE file;
+
+	/**
+	 * windows has no anonymous file that can be opened by path, a
+	 * temporary file is kept in the cache by the memory manager as
+	 * long as there's enough memory
+	 */
+	if (GetTempPath(sizeof(dir), dir) == 0 ||
+	     GetTempFileName(dir, name, 0, path) == 0)
+	{
+		error_winerr("unable to create memory file");
+		return NULL;
+	}
+
+	file = CreateFile(path, GENERIC_READ | GENERIC_WRITE,
+			  FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			  NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY,
+			  NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		error_winerr("unable to create memory file ‘%s’", path);
+		return NULL;
+	}
+
+	*fd = _open_osfhandle((intptr_t)file, 0);
+
+	return xstrdup(path);
+}
+
+int seal_memory_file(UNUSED int fd)
+{
+	return 0;
+}
@@ -194,3 +194,29 @@ int finish_process(struct process_info *ctx, UNUSED bool raised)
 	errno = errnum;
 	return rescode;
 }
+
+int wait_process(struct process_info *ctx, const char *spinner_style)
+{
+	struct process_info spinner_ctx = {
+		.program = "spinner",
+	};
+	int rescode;
+
+	/* there's no pollable process handle, so spinner gets a thread */
+	if (spinner_style != NULL &&
+	     mkprocf(&spinner_ctx, run_spinner,
+		      find_spinner_style(spinner_style)) != 0)
+	{
+		spinner_style = NULL;
+	}
+
+	rescode = finish_process(ctx, false);
+
+	if (spinner_style != NULL)
+	{
+		kill_process(&spinner_ctx, SIGTERM);
+		finish_process(&spinner_ctx, true);
+	}
+
+	return rescode;
+}
@@ -63,3 +63,51 @@ int termios_restore_config(struct termios *term0)
 
 	return 0;
 }
+
+size_t secure_page_size(void)
+{
+	static size_t page;
+	SYSTEM_INFO info;
+
+	if (page == 0)
+	{
+		GetSystemInfo(&info);
+		page = info.dwPageSize;
+	}
+
+	return page;
+}
+
+void *map_secure_pages(size_t len)
+{
+	uint8_t *map;
+	size_t page;
+
+	page = secure_page_size();
+
+	if ((map = VirtualAlloc(NULL, len + 2 * page, MEM_RESERVE,
+				PAGE_NOACCESS)) == NULL)
+	{
+		return NULL;
+	}
+
+	if (VirtualAlloc(map + page, len, MEM_COMMIT, PAGE_READWRITE) == NULL)
+	{
+		VirtualFree(map, 0, MEM_RELEASE);
+		return NULL;
+	}
+
+	/**
+	 * the working set quota may be too small, the pages are still
+	 * guarded and wiped, just not pinned
+	 */
+	VirtualLock(map + page, len);
+
+	return map + page;
+}
+
+void unmap_secure_pages(void *addr, size_t len)
+{
+	VirtualUnlock(addr, len);
+	VirtualFree((uint8_t *)addr - secure_page_size(), 0, MEM_RELEASE);
+}
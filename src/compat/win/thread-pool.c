@@ -0,0 +1,70 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "thread-pool.h"
+
+static DWORD WINAPI start_worker(LPVOID ctx0)
+{
+	struct worker_info *ctx;
+
+	ctx = ctx0;
+	return ctx->fn(ctx->args);
+}
+
+int mkworker(struct worker_info *ctx, int (*fn)(void *), void *args)
+{
+	ctx->fn = fn;
+	ctx->args = args;
+
+	if ((ctx->thread_handle = CreateThread(NULL, 0, start_worker,
+						ctx, 0, NULL)) == NULL)
+	{
+		return error_winerr("failed to start a new thread");
+	}
+
+	return 0;
+}
+
+int join_worker(struct worker_info *ctx)
+{
+	DWORD rescode;
+
+	rescode = -1;
+	if (WaitForSingleObject(ctx->thread_handle,
+				 INFINITE) == WAIT_FAILED ||
+	     !GetExitCodeThread(ctx->thread_handle, &rescode))
+	{
+		error_winerr("failed to join thread");
+	}
+
+	CloseHandle(ctx->thread_handle);
+	return rescode;
+}
+
+unsigned online_cpu_count(void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ?
+		info.dwNumberOfProcessors : 1;
+}
@@ -0,0 +1,44 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+ssize_t pk_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	ssize_t nr, total;
+	int i;
+
+	total = 0;
+	for (i = 0; i < iovcnt; i++)
+	{
+		if ((nr = write(fd, iov[i].iov_base, iov[i].iov_len)) < 0)
+		{
+			return total > 0 ? total : -1;
+		}
+
+		total += nr;
+		if ((size_t)nr != iov[i].iov_len)
+		{
+			break;
+		}
+	}
+
+	return total;
+}
@@ -0,0 +1,245 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "completion.h"
+#include "security.h"
+#include "strbuf.h"
+#include "filesys.h"
+
+#define SELECT_SITENAME_SQLSTR \
+	"SELECT DISTINCT sitename FROM account ORDER BY sitename;"
+
+#define CACHE_HMAC_LENGTH 32
+
+static char *cache_path(void)
+{
+	return concat(cred_db_path, "-complete");
+}
+
+static bool is_cache_enabled(void)
+{
+	const char *val;
+
+	return (val = getenv(PK_COMPLETE_CACHE)) != NULL && !strcmp(val, "1");
+}
+
+/**
+ * the key lives in the home directory instead of any vault, so the
+ * cache can be read without unlocking anything
+ */
+static int load_cache_key(uint8_t key[BINKEY_LEN], bool create)
+{
+	const char *home;
+	int fd;
+
+	if ((home = getenv(ENV_USERHOME)) == NULL)
+	{
+		return -1;
+	}
+
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	strbuf_printf(sb, "%s"DIRSEPSTR"%s", home, PK_COMPLETE_KEY_DEFPATH);
+
+	if (create &&
+	     (fd = open(sb->buf, O_WRONLY | O_CREAT | O_EXCL,
+			S_IRUSR | S_IWUSR)) != -1)
+	{
+		if (random_bytes_buffered(&key, BINKEY_LEN) != 0)
+		{
+			close(fd);
+			unlink(sb->buf);
+			strbuf_destroy(sb);
+
+			return -1;
+		}
+
+		xiopath = sb->buf;
+		xwrite(fd, key, BINKEY_LEN);
+		close(fd);
+		strbuf_destroy(sb);
+
+		return 0;
+	}
+
+	if ((fd = open(sb->buf, O_RDONLY)) == -1)
+	{
+		strbuf_destroy(sb);
+		return -1;
+	}
+
+	xiopath = sb->buf;
+	if (xread(fd, key, BINKEY_LEN) != BINKEY_LEN)
+	{
+		close(fd);
+		strbuf_destroy(sb);
+
+		return -1;
+	}
+
+	close(fd);
+	strbuf_destroy(sb);
+
+	return 0;
+}
+
+int update_completion_cache(struct sqlite3 *db)
+{
+	uint8_t key[BINKEY_LEN], *hmac;
+
+	if (!is_cache_enabled())
+	{
+		char *path;
+
+		path = cache_path();
+		unlink(path);
+		free(path);
+
+		return 0;
+	}
+
+	if (load_cache_key(key, true) != 0)
+	{
+		return 0;
+	}
+
+	struct sqlite3_stmt *stmt;
+	const char *name;
+	int len, rescode;
+
+	if (msqlite3_prepare_v2(db, SELECT_SITENAME_SQLSTR,
+				 -1, &stmt, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	while ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		name = (const char *)sqlite3_column_text(stmt, 0);
+		len = sqlite3_column_bytes(stmt, 0);
+
+		/* one name per line, there's no way to complete these */
+		if (name == NULL || memchr(name, '\n', len) != NULL)
+		{
+			continue;
+		}
+
+		strbuf_write(sb, name, len);
+		strbuf_putchar(sb, '\n');
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (rescode != SQLITE_DONE)
+	{
+		strbuf_destroy(sb);
+		return report_sqlite_error(sqlite3_step, db);
+	}
+
+	hmac = hmac_message_sha256(key, BINKEY_LEN,
+				   (uint8_t *)sb->buf, sb->length);
+	strbuf_write(sb, (char *)hmac, CACHE_HMAC_LENGTH);
+
+	clean_digest(hmac);
+	zeromem(key, BINKEY_LEN);
+
+	char *path, *tmp;
+	int fd;
+
+	path = cache_path();
+	tmp = concat(path, ".new");
+
+	/* sitenames are as private as the vault, unlike a record file */
+	xiopath = tmp;
+	fd = xopen(tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	xwrite(fd, sb->buf, sb->length);
+	close(fd);
+
+	rescode = replace_file(tmp, path);
+
+	free(tmp);
+	free(path);
+	strbuf_destroy(sb);
+
+	return rescode;
+}
+
+int read_completion_cache(char **names, size_t *len)
+{
+	uint8_t key[BINKEY_LEN];
+	char *path, *buf;
+	off_t size;
+	int fd;
+
+	if (!is_cache_enabled() || load_cache_key(key, false) != 0)
+	{
+		return -1;
+	}
+
+	path = cache_path();
+	fd = open(path, O_RDONLY);
+	free(path);
+
+	if (fd == -1 || (size = lseek(fd, 0, SEEK_END)) < CACHE_HMAC_LENGTH ||
+	     lseek(fd, 0, SEEK_SET) != 0)
+	{
+		goto failure;
+	}
+
+	buf = xmalloc(size);
+	if (read(fd, buf, size) != size)
+	{
+		free(buf);
+		goto failure;
+	}
+
+	close(fd);
+
+	size -= CACHE_HMAC_LENGTH;
+	if (verify_hmac_sha256(key, BINKEY_LEN, (uint8_t *)buf,
+				size, (uint8_t *)buf + size) != 0)
+	{
+		free(buf);
+		zeromem(key, BINKEY_LEN);
+
+		return -1;
+	}
+
+	zeromem(key, BINKEY_LEN);
+
+	*names = buf;
+	*len = size;
+
+	return 0;
+
+failure:
+	if (fd != -1)
+	{
+		close(fd);
+	}
+
+	zeromem(key, BINKEY_LEN);
+
+	return -1;
+}
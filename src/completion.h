@@ -0,0 +1,43 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+/**
+ * rewrite the completion cache of cred_db_path with sitenames of
+ * ‘db’, the cache is protected by a keyed hash, and the key is
+ * created the first time
+ *
+ * the cache holds sitenames in plain text, so it's kept only if
+ * PK_COMPLETE_CACHE is set to 1, otherwise a cache left from before
+ * is removed
+ */
+int update_completion_cache(struct sqlite3 *db);
+
+/**
+ * read sitenames from the completion cache of cred_db_path, one per
+ * line, a cache that fails the verification is not read at all
+ */
+int read_completion_cache(char **names, size_t *len);
+
+#endif /* COMPLETION_H */
@@ -0,0 +1,859 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "cred-db.h"
+#include "security.h"
+#include "strbuf.h"
+#include "filesys.h"
+#include "completion.h"
+#include "history.h"
+#include "tag.h"
+#include "frecency.h"
+
+#define NOW_SQLSTR "strftime('%Y-%m-%d %H:%M:%f', 'now')"
+
+#define NEW_UUID_SQLSTR "lower(hex(randomblob(16)))"
+
+/**
+ * version 1, tables of the first release; IF NOT EXISTS is there since
+ * cred dbs created before user_version was tracked are still at 0
+ */
+#define CREATE_ACCOUNT_TABLE_SQLSTR					\
+	"CREATE TABLE IF NOT EXISTS account ("				\
+		"id       INTEGER PRIMARY KEY AUTOINCREMENT,"		\
+		"sitename TEXT NOT NULL,"				\
+		"alias    TEXT,"					\
+		"siteurl  TEXT,"					\
+		"username TEXT,"					\
+		"password TEXT NOT NULL,"				\
+		"sqltime  DATETIME DEFAULT (datetime('now')),"		\
+		"modtime  DATETIME"					\
+	");"								\
+									\
+	"CREATE INDEX IF NOT EXISTS idx_sitename "			\
+		"ON account(sitename);"					\
+									\
+	"CREATE TABLE IF NOT EXISTS account_security ("			\
+		"account_id INTEGER PRIMARY KEY,"			\
+		"guard      TEXT,"					\
+		"recovery   TEXT,"					\
+		"memo       BLOB,"					\
+		"FOREIGN KEY (account_id) REFERENCES account(id) "	\
+			"ON DELETE CASCADE"				\
+	");"								\
+									\
+	"CREATE TABLE IF NOT EXISTS account_misc ("			\
+		"account_id INTEGER PRIMARY KEY,"			\
+		"comment    TEXT,"					\
+		"FOREIGN KEY (account_id) REFERENCES account(id) "	\
+			"ON DELETE CASCADE"				\
+	");"
+
+/**
+ * the conflict policy of a statement overrides the one of triggers it
+ * fires, so INSERT OR REPLACE is not used here, an upsert on account
+ * would turn it into ABORT
+ */
+#define LOG_CHANGE_SQLSTR(ref, deleted, modtime)			\
+	"DELETE FROM change_log WHERE uuid = " ref ".uuid;"		\
+	"INSERT INTO change_log (uuid, deleted, modtime) "		\
+		"VALUES (" ref ".uuid, " deleted ", " modtime ");"
+
+#define TOUCH_TRIGGER_SQLSTR(table, op, ref)			\
+	"CREATE TRIGGER " table "_" op " AFTER " op " ON " table " "	\
+	"BEGIN "							\
+		"UPDATE account SET modtime = " NOW_SQLSTR " "		\
+		"WHERE id = " ref ".account_id;"			\
+	"END;"
+
+/**
+ * version 2, every account gets a uuid that identifies it across
+ * vaults, and change_log keeps one entry per uuid holding its last
+ * change, so changes after a given seq are exactly the rows to sync
+ */
+#define CREATE_CHANGE_LOG_SQLSTR					\
+	"ALTER TABLE account ADD COLUMN uuid TEXT;"			\
+									\
+	"UPDATE account SET "						\
+		"uuid = " NEW_UUID_SQLSTR ","				\
+		"modtime = coalesce(modtime, sqltime, " NOW_SQLSTR ");"	\
+									\
+	"CREATE UNIQUE INDEX idx_uuid ON account(uuid);"		\
+									\
+	"CREATE TABLE change_log ("					\
+		"seq     INTEGER PRIMARY KEY AUTOINCREMENT,"		\
+		"uuid    TEXT NOT NULL UNIQUE,"				\
+		"deleted INTEGER NOT NULL DEFAULT 0,"			\
+		"modtime DATETIME NOT NULL"				\
+	");"								\
+									\
+	"INSERT INTO change_log (uuid, modtime) "			\
+		"SELECT uuid, modtime FROM account ORDER BY id;"	\
+									\
+	"CREATE TABLE vault_info ("					\
+		"id   INTEGER PRIMARY KEY CHECK (id = 0),"		\
+		"uuid TEXT NOT NULL"					\
+	");"								\
+									\
+	"INSERT INTO vault_info VALUES (0, " NEW_UUID_SQLSTR ");"	\
+									\
+	"CREATE TABLE sync_state ("					\
+		"peer_uuid TEXT PRIMARY KEY,"				\
+		"seq       INTEGER NOT NULL"				\
+	");"								\
+									\
+	"CREATE TRIGGER account_insert AFTER INSERT ON account "	\
+	"WHEN NEW.uuid IS NULL OR NEW.modtime IS NULL "			\
+	"BEGIN "							\
+		"UPDATE account SET "					\
+			"uuid = coalesce(NEW.uuid, "			\
+					NEW_UUID_SQLSTR "),"		\
+			"modtime = coalesce(NEW.modtime, "		\
+					NOW_SQLSTR ") "			\
+		"WHERE id = NEW.id;"					\
+	"END;"								\
+									\
+	"CREATE TRIGGER account_log_insert AFTER INSERT ON account "	\
+	"WHEN NEW.uuid IS NOT NULL AND NEW.modtime IS NOT NULL "	\
+	"BEGIN "							\
+		LOG_CHANGE_SQLSTR("NEW", "0", "NEW.modtime")		\
+	"END;"								\
+									\
+	"CREATE TRIGGER account_touch AFTER UPDATE ON account "	\
+	"WHEN NEW.modtime IS OLD.modtime "				\
+	"BEGIN "							\
+		"UPDATE account SET modtime = " NOW_SQLSTR " "		\
+		"WHERE id = NEW.id;"					\
+	"END;"								\
+									\
+	"CREATE TRIGGER account_log_update AFTER UPDATE ON account "	\
+	"WHEN NEW.modtime IS NOT OLD.modtime "				\
+	"BEGIN "							\
+		LOG_CHANGE_SQLSTR("NEW", "0", "NEW.modtime")		\
+	"END;"								\
+									\
+	"CREATE TRIGGER account_log_delete AFTER DELETE ON account "	\
+	"BEGIN "							\
+		LOG_CHANGE_SQLSTR("OLD", "1", NOW_SQLSTR)		\
+	"END;"								\
+									\
+	TOUCH_TRIGGER_SQLSTR("account_security", "INSERT", "NEW")	\
+	TOUCH_TRIGGER_SQLSTR("account_security", "UPDATE", "NEW")	\
+	TOUCH_TRIGGER_SQLSTR("account_security", "DELETE", "OLD")	\
+	TOUCH_TRIGGER_SQLSTR("account_misc", "INSERT", "NEW")	\
+	TOUCH_TRIGGER_SQLSTR("account_misc", "UPDATE", "NEW")	\
+	TOUCH_TRIGGER_SQLSTR("account_misc", "DELETE", "OLD")
+
+/**
+ * version 3, digest of each live account keyed by uuid, and a merkle
+ * tree over them (see merkle.h), both are refreshed lazily from
+ * change_log up to merkle_seq
+ */
+#define CREATE_MERKLE_TREE_SQLSTR					\
+	"CREATE TABLE row_digest ("					\
+		"uuid   TEXT PRIMARY KEY,"				\
+		"digest BLOB NOT NULL"					\
+	") WITHOUT ROWID;"						\
+									\
+	"CREATE TABLE merkle_node ("					\
+		"prefix TEXT PRIMARY KEY,"				\
+		"digest BLOB NOT NULL"					\
+	") WITHOUT ROWID;"						\
+									\
+	"ALTER TABLE vault_info "					\
+		"ADD COLUMN merkle_seq INTEGER NOT NULL DEFAULT 0;"
+
+#define ACCOUNT_CHANGED_SQLSTR						\
+	"OLD.sitename IS NOT NEW.sitename OR "				\
+	"OLD.alias IS NOT NEW.alias OR "				\
+	"OLD.siteurl IS NOT NEW.siteurl OR "				\
+	"OLD.username IS NOT NEW.username OR "				\
+	"OLD.password IS NOT NEW.password"
+
+#define SECURITY_CHANGED_SQLSTR						\
+	"OLD.guard IS NOT NEW.guard OR "				\
+	"OLD.recovery IS NOT NEW.recovery OR "				\
+	"OLD.memo IS NOT NEW.memo"
+
+#define MISC_CHANGED_SQLSTR "OLD.comment IS NOT NEW.comment"
+
+#define ACCOUNT_FIELDS_SQLSTR(ref)					\
+	ref ".sitename, " ref ".alias, " ref ".siteurl, "		\
+	ref ".username, " ref ".password"
+
+#define SECURITY_FIELDS_SQLSTR(ref)					\
+	ref ".guard, " ref ".recovery, " ref ".memo"
+
+#define MISC_FIELDS_SQLSTR(ref) ref ".comment"
+
+#define HISTORY_UPDATE_SQLSTR(table, id, old, new)			\
+	"SELECT pk_history_update((SELECT uuid FROM vault_info), "	\
+		"'" table "', " id ", " old ", " new ");"
+
+/**
+ * an insert into a child table is recorded only if the account has
+ * history, which is not the case for a new account, nor for one just
+ * brought back by pk restore
+ */
+#define HISTORY_CHILD_TRIGGERS_SQLSTR(table, changed, fields, nulls)	\
+	"CREATE TRIGGER " table "_history_update "			\
+	"BEFORE UPDATE ON " table " "					\
+	"WHEN " changed " "						\
+	"BEGIN "							\
+		HISTORY_UPDATE_SQLSTR(table, "OLD.account_id",		\
+				      fields("OLD"), fields("NEW"))	\
+	"END;"								\
+									\
+	"CREATE TRIGGER " table "_history_delete "			\
+	"BEFORE DELETE ON " table " "					\
+	"WHEN EXISTS (SELECT 1 FROM account "				\
+		     "WHERE id = OLD.account_id) "			\
+	"BEGIN "							\
+		HISTORY_UPDATE_SQLSTR(table, "OLD.account_id",		\
+				      fields("OLD"), nulls)		\
+	"END;"								\
+									\
+	"CREATE TRIGGER " table "_history_insert "			\
+	"AFTER INSERT ON " table " "					\
+	"WHEN (SELECT kind FROM history "				\
+	      "WHERE account_id = NEW.account_id "			\
+	      "ORDER BY version DESC LIMIT 1) IN (0, 1) "		\
+	"BEGIN "							\
+		HISTORY_UPDATE_SQLSTR(table, "NEW.account_id",		\
+				      nulls, fields("NEW"))		\
+	"END;"
+
+/**
+ * version 4, prior versions of accounts (see history.h), a version
+ * of kind 0 holds the fields that differ from the version after it,
+ * kind 1 and 2 hold all fields, 2 is taken before a deletion; the
+ * triggers call functions registered by connect_cred_db()
+ */
+#define CREATE_HISTORY_SQLSTR						\
+	"CREATE TABLE history ("					\
+		"account_id INTEGER NOT NULL,"				\
+		"version    INTEGER NOT NULL,"				\
+		"kind       INTEGER NOT NULL,"				\
+		"modtime    DATETIME,"					\
+		"data       BLOB NOT NULL,"				\
+		"PRIMARY KEY (account_id, version)"			\
+	") WITHOUT ROWID;"						\
+									\
+	"CREATE TRIGGER account_history_update "			\
+	"BEFORE UPDATE ON account "					\
+	"WHEN " ACCOUNT_CHANGED_SQLSTR " "				\
+	"BEGIN "							\
+		HISTORY_UPDATE_SQLSTR("account", "OLD.id",		\
+				      ACCOUNT_FIELDS_SQLSTR("OLD"),	\
+				      ACCOUNT_FIELDS_SQLSTR("NEW"))	\
+	"END;"								\
+									\
+	"CREATE TRIGGER account_history_delete "			\
+	"BEFORE DELETE ON account "					\
+	"BEGIN "							\
+		"SELECT pk_history_delete("				\
+			"(SELECT uuid FROM vault_info), OLD.id);"	\
+	"END;"								\
+									\
+	HISTORY_CHILD_TRIGGERS_SQLSTR("account_security",		\
+				      SECURITY_CHANGED_SQLSTR,		\
+				      SECURITY_FIELDS_SQLSTR,		\
+				      "NULL, NULL, NULL")		\
+	HISTORY_CHILD_TRIGGERS_SQLSTR("account_misc",			\
+				      MISC_CHANGED_SQLSTR,		\
+				      MISC_FIELDS_SQLSTR, "NULL")
+
+/**
+ * version 5, tags of accounts, see tag.h; a deleted account leaves
+ * every tag it had, and a tag left empty is dropped
+ */
+#define CREATE_TAG_SQLSTR						\
+	"CREATE TABLE tag ("						\
+		"id     INTEGER PRIMARY KEY,"				\
+		"name   TEXT NOT NULL UNIQUE,"				\
+		"bitmap BLOB NOT NULL DEFAULT x''"			\
+	");"								\
+									\
+	"CREATE TRIGGER account_tag_delete "				\
+	"AFTER DELETE ON account "					\
+	"BEGIN "							\
+		"UPDATE tag SET bitmap = pk_bitmap_remove(bitmap, OLD.id) " \
+		"WHERE pk_bitmap_contains(bitmap, OLD.id);"		\
+		"DELETE FROM tag WHERE length(bitmap) = 0;"		\
+	"END;"
+
+/**
+ * version 6, how often and how lately each account is looked up, see
+ * frecency.h; rows are written only by fold_access_log()
+ */
+#define CREATE_ACCOUNT_ACCESS_SQLSTR					\
+	"CREATE TABLE account_access ("					\
+		"account_id  INTEGER PRIMARY KEY,"			\
+		"nr_access   INTEGER NOT NULL,"				\
+		"last_access INTEGER NOT NULL,"				\
+		"frecency    REAL NOT NULL,"				\
+		"FOREIGN KEY (account_id) REFERENCES account(id) "	\
+			"ON DELETE CASCADE"				\
+	");"
+
+/**
+ * version 7, key that seals the access log, see frecency.h
+ */
+#define CREATE_ACCESS_KEY_SQLSTR					\
+	"CREATE TABLE access_key (key BLOB NOT NULL);"			\
+	"INSERT INTO access_key (key) VALUES (randomblob(32));"
+
+/**
+ * migrations[i] brings cred db from version i to i + 1, append new
+ * migrations to the end and never modify existing ones
+ */
+static const char *const migrations[] = {
+	CREATE_ACCOUNT_TABLE_SQLSTR,
+	CREATE_CHANGE_LOG_SQLSTR,
+	CREATE_MERKLE_TREE_SQLSTR,
+	CREATE_HISTORY_SQLSTR,
+	CREATE_TAG_SQLSTR,
+	CREATE_ACCOUNT_ACCESS_SQLSTR,
+	CREATE_ACCESS_KEY_SQLSTR,
+	NULL,
+};
+
+int resolve_cred_key(
+	struct cred_key *key, const char *cc_path, bool use_cmdkey)
+{
+	char *cmdkey;
+	size_t cmdkey_len;
+
+	*key = (struct cred_key)CRED_KEY_INIT;
+
+	cmdkey = NULL;
+	cmdkey_len = 0;
+	if (use_cmdkey &&
+	     (cmdkey_len = read_cmdkey(&cmdkey,
+				"[pk] key for decryption: ")) == 0)
+	{
+		return error("Empty keys are illegal.");
+	}
+
+	if (cc_path != NULL)
+	{
+		uint8_t *buf;
+		off_t len;
+
+		if (resolve_cipher_config(cc_path, &buf, &len) != 0)
+		{
+			return error_errno("cannot resolve cipher config "
+					    "‘%s’", cc_path);
+		}
+
+		if (deserialize_cipher_config(&key->cc, &key->ck,
+						buf, len) != 0)
+		{
+			return error_errno("cannot deserialize cipher config "
+					    "‘%s’", cc_path);
+		}
+	}
+
+	if (cmdkey != NULL)
+	{
+		key->keystr = cmdkey;
+		key->keylen = cmdkey_len;
+	}
+	else if (key->ck.buf == NULL)
+	{
+		if (cc_path != NULL)
+		{
+			warning("cipher config file at ‘%s’ affects nothing "
+				 "without a key.", cc_path);
+		}
+	}
+	else if (!key->ck.is_binary)
+	{
+		key->keystr = secure_memdup(key->ck.buf, key->ck.len);
+		key->keylen = key->ck.len;
+	}
+	else
+	{
+		key->keylen = bin2blob_secure(&key->keystr,
+					       key->ck.buf, key->ck.len);
+	}
+
+	return 0;
+}
+
+void free_cred_key(struct cred_key *key)
+{
+	free_cipher_config(&key->cc, &key->ck);
+
+	/* key->keystr lives in the secure arena */
+}
+
+static int apply_cipher_config(
+	struct sqlite3 *db, const char *schema, const struct cred_key *key)
+{
+	char *sqlstr;
+	int rescode;
+
+	rescode = SQLITE_OK;
+	if ((sqlstr = format_apply_cc_sqlstr_routine(&key->cc,
+							schema)) != NULL)
+	{
+		rescode = msqlite3_exec(db, sqlstr, NULL, NULL, NULL);
+		free(sqlstr);
+	}
+
+	return rescode;
+}
+
+/**
+ * set when a write is committed through connect_cred_db(), derived
+ * files such as the completion cache are refreshed on the next
+ * flush_cred_db()
+ */
+static bool have_commit;
+
+static int note_commit(UNUSED void *data)
+{
+	have_commit = true;
+	end_history_txn();
+
+	return 0;
+}
+
+static void note_rollback(UNUSED void *data)
+{
+	end_history_txn();
+}
+
+int connect_cred_db(
+	struct sqlite3 **db, const char *pathname,
+	int flags, const struct cred_key *key)
+{
+	msqlite3_pathname = pathname;
+
+	if (msqlite3_open_v2(pathname, db, flags, NULL) != SQLITE_OK)
+	{
+		goto failure;
+	}
+
+	if (key->keystr != NULL &&
+	     (msqlite3_key(*db, key->keystr, key->keylen) != SQLITE_OK ||
+	      apply_cipher_config(*db, NULL, key) != SQLITE_OK))
+	{
+		goto failure;
+	}
+
+	if (msqlite3_avail(*db) != SQLITE_OK)
+	{
+		goto failure;
+	}
+
+	/* account_security and account_misc rely on ON DELETE CASCADE */
+	if (msqlite3_exec(*db, "PRAGMA foreign_keys = ON;",
+			   NULL, NULL, NULL) != SQLITE_OK)
+	{
+		goto failure;
+	}
+
+	if (register_history_functions(*db) != 0 ||
+	     register_tag_functions(*db) != 0 ||
+	     register_frecency_functions(*db) != 0)
+	{
+		goto failure;
+	}
+
+	sqlite3_commit_hook(*db, note_commit, NULL);
+	sqlite3_rollback_hook(*db, note_rollback, NULL);
+
+	return 0;
+
+failure:
+	sqlite3_close(*db);
+	*db = NULL;
+
+	return -1;
+}
+
+int attach_cred_db(
+	struct sqlite3 *db, const char *pathname,
+	const char *schema, const struct cred_key *key)
+{
+	struct sqlite3_stmt *stmt;
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	int rescode;
+
+	/**
+	 * an attached db inherits the key of main db if there's no
+	 * KEY clause, so we always pass a key (an empty key means
+	 * plaintext db)
+	 */
+	strbuf_printf(sql, "ATTACH DATABASE ? AS %s KEY ?;", schema);
+
+	rescode = msqlite3_prepare_v2(db, sql->buf, -1, &stmt, NULL);
+	strbuf_destroy(sql);
+
+	if (rescode != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	if (msqlite3_bind_text(stmt, 1, pathname, -1, SQLITE_STATIC) ||
+	     msqlite3_bind_text(stmt, 2,
+				key && key->keystr ? key->keystr : "",
+				 key && key->keystr ? (int)key->keylen : 0,
+				  SQLITE_STATIC) ||
+	      msqlite3_step(stmt) != SQLITE_DONE)
+	{
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (key != NULL && key->keystr != NULL &&
+	     apply_cipher_config(db, schema, key) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+static int get_user_version(struct sqlite3 *db, int *version)
+{
+	struct sqlite3_stmt *stmt;
+
+	if (msqlite3_prepare_v2(db, "PRAGMA user_version;",
+				 -1, &stmt, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	if (sqlite3_step(stmt) != SQLITE_ROW)
+	{
+		sqlite3_finalize(stmt);
+		return report_sqlite_error(sqlite3_step, db);
+	}
+
+	*version = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+
+	return 0;
+}
+
+int query_pragma(struct sqlite3 *db, const char *pragma, int64_t *val)
+{
+	struct sqlite3_stmt *stmt;
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	int rescode;
+
+	strbuf_printf(sql, "PRAGMA %s;", pragma);
+
+	rescode = msqlite3_prepare_v2(db, sql->buf, -1, &stmt, NULL);
+	strbuf_destroy(sql);
+
+	if (rescode != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	if (sqlite3_step(stmt) != SQLITE_ROW)
+	{
+		sqlite3_finalize(stmt);
+		return report_sqlite_error(sqlite3_step, db);
+	}
+
+	*val = sqlite3_column_int64(stmt, 0);
+	sqlite3_finalize(stmt);
+
+	return 0;
+}
+
+int convert_auto_vacuum(struct sqlite3 *db)
+{
+	return msqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL;"
+				 "VACUUM;", NULL, NULL, NULL) == SQLITE_OK ?
+		0 : -1;
+}
+
+/**
+ * cred dbs created before pk init turned on incremental vacuum are
+ * converted as they're opened if it's cheap, the rest is left to
+ * pk gc
+ */
+static int upgrade_auto_vacuum(struct sqlite3 *db)
+{
+	int64_t mode, pages;
+
+	if (query_pragma(db, "auto_vacuum", &mode) != 0 ||
+	     query_pragma(db, "page_count", &pages) != 0)
+	{
+		return -1;
+	}
+
+	if (mode != AUTO_VACUUM_NONE || pages > AUTO_VACUUM_CONVERT_PAGES)
+	{
+		return 0;
+	}
+
+	return convert_auto_vacuum(db);
+}
+
+/**
+ * get the schema version of ‘db’ and the latest one, fail if ‘db’ is
+ * newer than this pk knows
+ */
+static int check_cred_db_version(struct sqlite3 *db, int *version,
+				 int *latest)
+{
+	*version = 0;
+	if (get_user_version(db, version) != 0)
+	{
+		return -1;
+	}
+
+	for (*latest = 0; migrations[*latest] != NULL; (*latest)++);
+
+	if (*version > *latest)
+	{
+		return error("cred db ‘%s’ was created by a newer pk "
+			      "(version %d, expected at most %d)",
+			      msqlite3_pathname, *version, *latest);
+	}
+
+	return 0;
+}
+
+int migrate_cred_db(struct sqlite3 *db)
+{
+	int version, latest;
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	if (check_cred_db_version(db, &version, &latest) != 0)
+	{
+		return -1;
+	}
+
+	for ( ; version < latest; version++)
+	{
+		strbuf_trunc(sb);
+		strbuf_printf(sb, "BEGIN TRANSACTION;%s"
+				  "PRAGMA user_version = %d;"
+				  "END TRANSACTION;",
+				  migrations[version], version + 1);
+
+		if (msqlite3_exec(db, sb->buf, NULL, NULL, NULL) != SQLITE_OK)
+		{
+			sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+			strbuf_destroy(sb);
+
+			return -1;
+		}
+	}
+
+	strbuf_destroy(sb);
+	return upgrade_auto_vacuum(db);
+}
+
+static struct sqlite3 *shared_db;
+
+void share_cred_db(struct sqlite3 *db)
+{
+	shared_db = db;
+}
+
+struct sqlite3 *shared_cred_db(void)
+{
+	return shared_db;
+}
+
+void flush_cred_db(struct sqlite3 *db)
+{
+	if (have_commit)
+	{
+		have_commit = false;
+		update_completion_cache(db);
+	}
+}
+
+void close_cred_db(struct sqlite3 *db)
+{
+	flush_cred_db(db);
+
+	if (db != shared_db)
+	{
+		sqlite3_close(db);
+	}
+}
+
+struct sqlite3 *open_cred_db(int flags, bool use_cmdkey)
+{
+	struct sqlite3 *db;
+	struct cred_key key;
+	const char *cc_path;
+
+	if (shared_db != NULL)
+	{
+		return shared_db;
+	}
+
+	cc_path = cred_cc_path;
+	if (find_cipher_config(&cc_path) != 0)
+	{
+		exit(error_errno("failed to find cipher config "
+				  "‘%s’", cred_cc_path));
+	}
+
+	EOE(resolve_cred_key(&key, cc_path, use_cmdkey));
+
+	if (connect_cred_db(&db, cred_db_path, flags, &key) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	free_cred_key(&key);
+
+	if (flags & SQLITE_OPEN_READWRITE)
+	{
+		EOE(migrate_cred_db(db));
+	}
+
+	return db;
+}
+
+/**
+ * a read-only peer is attached by URI, which takes ‘%’, ‘?’ and ‘#’
+ * escaped
+ */
+static char *make_readonly_uri(const char *pathname)
+{
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	strbuf_concat(sb, "file:");
+
+	for ( ; *pathname; pathname++)
+	{
+		if (*pathname == '%' || *pathname == '?' || *pathname == '#')
+		{
+			strbuf_printf(sb, "%%%02X", *pathname);
+		}
+		else
+		{
+			strbuf_putchar(sb, *pathname);
+		}
+	}
+
+	strbuf_concat(sb, "?mode=ro");
+
+	return sb->buf;
+}
+
+void attach_peer_cred_db(
+	struct sqlite3 *db, const char *pathname, const char *cc_path,
+	bool use_cmdkey, const char *schema, int flags)
+{
+	struct sqlite3 *peer;
+	struct cred_key key;
+	const char *cc_path1, *main_path;
+	char *uri;
+	int version, latest;
+	bool readonly;
+
+	readonly = !(flags & SQLITE_OPEN_READWRITE);
+
+	if (access_regular(pathname, readonly ? R_OK : R_OK | W_OK) != 0)
+	{
+		exit(error_errno("cannot access cred db ‘%s’", pathname));
+	}
+
+	cc_path1 = cc_path;
+	if (cc_path1 != NULL && find_cipher_config(&cc_path1) != 0)
+	{
+		exit(error_errno("failed to find cipher config ‘%s’",
+				  cc_path));
+	}
+
+	EOE(resolve_cred_key(&key, cc_path1, use_cmdkey));
+
+	main_path = msqlite3_pathname;
+
+	/**
+	 * migrate it on a connection of its own, statements of a
+	 * migration are not schema-qualified; a read-only peer is
+	 * never migrated, it has to be up to date already
+	 */
+	if (connect_cred_db(&peer, pathname, flags, &key) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	if (!readonly)
+	{
+		EOE(migrate_cred_db(peer));
+	}
+	else if (check_cred_db_version(peer, &version, &latest) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+	else if (version < latest)
+	{
+		exit(error("cred db ‘%s’ was created by an older pk "
+			    "(version %d, expected %d), a pk command that "
+			    "writes it migrates it", pathname, version,
+			    latest));
+	}
+
+	sqlite3_close(peer);
+
+	uri = readonly ? make_readonly_uri(pathname) : NULL;
+
+	if (attach_cred_db(db, readonly ? uri : pathname,
+			    schema, &key) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	msqlite3_pathname = main_path;
+	free_cred_key(&key);
+	free(uri);
+}
+
+char *make_like_pattern(const char *str)
+{
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	strbuf_putchar(sb, '%');
+
+	for ( ; str != NULL && *str; str++)
+	{
+		if (*str == '%' || *str == '_' || *str == '\\')
+		{
+			strbuf_putchar(sb, '\\');
+		}
+
+		strbuf_putchar(sb, *str);
+	}
+
+	strbuf_putchar(sb, '%');
+
+	return sb->buf;
+}
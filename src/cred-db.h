@@ -0,0 +1,140 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef CRED_DB_H
+#define CRED_DB_H
+
+#include "cipher-config.h"
+
+struct cred_key
+{
+	struct cipher_config cc;
+	struct cipher_key ck;
+
+	/**
+	 * null-terminated key string passed to sqlite3_key(), this
+	 * field is NULL if cred db is not encrypted
+	 */
+	char  *keystr;
+	size_t keylen;
+};
+
+#define CRED_KEY_INIT { .cc = CC_INIT, .ck = CK_INIT }
+
+/**
+ * resolve the key of cred db, the key comes from cipher config at
+ * ‘cc_path’ (which can be NULL), a key read from the command line
+ * (if ‘use_cmdkey’ is set) takes precedence over the stored one
+ */
+int resolve_cred_key(struct cred_key *key, const char *cc_path, bool use_cmdkey);
+
+void free_cred_key(struct cred_key *key);
+
+/**
+ * open cred db at ‘pathname’ and apply ‘key’ to it, this function
+ * makes sure the key is correct before returning
+ */
+int connect_cred_db(struct sqlite3 **db, const char *pathname, int flags, const struct cred_key *key);
+
+/**
+ * attach cred db at ‘pathname’ to ‘db’ as ‘schema’, and apply ‘key’
+ * to it, a NULL ‘key’ or a key without keystr attaches plaintext db
+ */
+int attach_cred_db(struct sqlite3 *db, const char *pathname, const char *schema, const struct cred_key *key);
+
+/**
+ * bring the schema of ‘db’ up to date, this is how a new cred db
+ * gets its tables as well; a small cred db without incremental
+ * vacuum is converted here too
+ */
+int migrate_cred_db(struct sqlite3 *db);
+
+/**
+ * values of PRAGMA auto_vacuum
+ */
+#define AUTO_VACUUM_NONE        0
+#define AUTO_VACUUM_FULL        1
+#define AUTO_VACUUM_INCREMENTAL 2
+
+/**
+ * pages up to which migrate_cred_db() converts a cred db to
+ * incremental vacuum, this rewrites the whole file
+ */
+#define AUTO_VACUUM_CONVERT_PAGES 2048
+
+/**
+ * turn on incremental vacuum for an existing cred db by a full VACUUM,
+ * cannot be called inside a transaction
+ */
+int convert_auto_vacuum(struct sqlite3 *db);
+
+/**
+ * read the integer value of ‘pragma’ into ‘val’, ‘pragma’ may be
+ * schema-qualified
+ */
+int query_pragma(struct sqlite3 *db, const char *pragma, int64_t *val);
+
+/**
+ * open cred_db_path with key resolved from cred_cc_path, a writable
+ * db is migrated to the latest schema, exit on failure
+ */
+struct sqlite3 *open_cred_db(int flags, bool use_cmdkey);
+
+/**
+ * make open_cred_db() return ‘db’ until NULL is shared, so that
+ * commands run in a session reuse one keyed connection
+ */
+void share_cred_db(struct sqlite3 *db);
+
+/**
+ * the connection shared by share_cred_db(), or NULL
+ */
+struct sqlite3 *shared_cred_db(void);
+
+/**
+ * refresh files derived from ‘db’ if it has committed any change
+ * since the last flush
+ */
+void flush_cred_db(struct sqlite3 *db);
+
+/**
+ * flush and close ‘db’ returned by open_cred_db(), a shared one is
+ * kept open
+ */
+void close_cred_db(struct sqlite3 *db);
+
+/**
+ * turn ‘str’ into a LIKE pattern matching any text containing ‘str’,
+ * use it with ESCAPE '\'
+ */
+char *make_like_pattern(const char *str);
+
+/**
+ * migrate cred db at ‘pathname’ and attach it to ‘db’ as ‘schema’,
+ * its key is resolved from ‘cc_path’ (which can be NULL), exit on
+ * failure; with SQLITE_OPEN_READONLY in ‘flags’ it's attached
+ * read-only and refused if it's not migrated yet, which needs ‘db’ to
+ * be opened with SQLITE_OPEN_URI
+ */
+void attach_peer_cred_db(struct sqlite3 *db, const char *pathname, const char *cc_path, bool use_cmdkey, const char *schema, int flags);
+
+#endif /* CRED_DB_H */
@@ -46,13 +46,9 @@ int edit_file(const char *pathname)
 				"EDITOR or PK_EDITOR is set in env");
 	}
 
-	struct process_info
-		editor_ctx = {
-			.program = ext_editor,
-		},
-		spinner_ctx = {
-			.program = "spinner",
-		};
+	struct process_info editor_ctx = {
+		.program = ext_editor,
+	};
 
 	signal(SIGINT, SIG_IGN);
 	signal(SIGQUIT, SIG_IGN);
@@ -69,21 +65,7 @@ int edit_file(const char *pathname)
 			  /* this case, user specified a value */
 			   spinner_style != (void *)-1);
 
-	if (show_spinner && run_spinner(&spinner_ctx, spinner_style) != 0)
-	{
-		note("something terrible happened, but it's harmless, "
-			"and the program will continue");
-
-		show_spinner = false;
-	}
-
-	finish_process(&editor_ctx, false);
-
-	if (show_spinner)
-	{
-		kill_process(&spinner_ctx, SIGTERM);
-		finish_process(&spinner_ctx, true);
-	}
+	wait_process(&editor_ctx, show_spinner ? spinner_style : NULL);
 
 	signal(SIGINT, SIG_DFL);
 	signal(SIGQUIT, SIG_DFL);
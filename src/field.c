@@ -0,0 +1,204 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "field.h"
+#include "strbuf.h"
+#include "strlist.h"
+#include "hex.h"
+
+#define LAZY_BLOB_CHUNK 4096
+
+static const struct
+{
+	const char *name;
+	const char *column;
+} fields[] = {
+	[FIELD_ID]       = { "id",       "a.id"             },
+	[FIELD_UUID]     = { "uuid",     "a.uuid"           },
+	[FIELD_SITENAME] = { "sitename", "a.sitename"       },
+	[FIELD_ALIAS]    = { "alias",    "a.alias"          },
+	[FIELD_SITEURL]  = { "siteurl",  "a.siteurl"        },
+	[FIELD_USERNAME] = { "username", "a.username"       },
+	[FIELD_PASSWORD] = { "password", "a.password"       },
+	[FIELD_GUARD]    = { "guard",    "s.guard"          },
+	[FIELD_RECOVERY] = { "recovery", "s.recovery"       },
+	/* length() of a blob reads the record header only */
+	[FIELD_MEMO]     = { "memo",     "length(s.memo)"   },
+	[FIELD_COMMENT]  = { "comment",  "m.comment"        },
+	[FIELD_SQLTIME]  = { "sqltime",  "a.sqltime"        },
+	[FIELD_MODTIME]  = { "modtime",  "a.modtime"        },
+};
+
+int parse_field_list(struct field_list *list, const char *spec)
+{
+	struct strlist *sl = STRLIST_INIT_PTR_DUPSTR;
+	bool seen[FIELD_NR] = { 0 };
+	const char *name;
+	size_t i;
+	int id, rescode;
+
+	strlist_split(sl, spec, ',', -1);
+
+	list->nr = 0;
+	rescode = 0;
+	for (i = 0; i < sl->size; i++)
+	{
+		name = sl->elvec[i].str;
+		for (id = 0; id < FIELD_NR && strcmp(name, fields[id].name);
+		     id++);
+
+		if (id == FIELD_NR)
+		{
+			rescode = error("unknown field ‘%s’", name);
+			break;
+		}
+		else if (seen[id])
+		{
+			rescode = error("field ‘%s’ given twice", name);
+			break;
+		}
+
+		seen[id] = true;
+		list->ids[list->nr++] = id;
+	}
+
+	if (rescode == 0 && list->nr == 0)
+	{
+		rescode = error("no field specified");
+	}
+
+	strlist_destroy(sl, false);
+	return rescode;
+}
+
+const char *field_name(enum field_id id)
+{
+	return fields[id].name;
+}
+
+char *build_field_query(const struct field_list *list, const char *tail)
+{
+	struct strbuf *sb = STRBUF_INIT_PTR;
+	bool security, misc;
+	size_t i;
+
+	security = false;
+	misc = false;
+
+	strbuf_concat(sb, "SELECT a.id");
+	for (i = 0; i < list->nr; i++)
+	{
+		strbuf_printf(sb, ", %s", fields[list->ids[i]].column);
+
+		security |= list->ids[i] == FIELD_GUARD ||
+			    list->ids[i] == FIELD_RECOVERY ||
+			    list->ids[i] == FIELD_MEMO;
+		misc |= list->ids[i] == FIELD_COMMENT;
+	}
+
+	strbuf_concat(sb, " FROM account AS a");
+	if (security)
+	{
+		strbuf_concat(sb, " LEFT JOIN account_security AS s "
+				  "ON s.account_id = a.id");
+	}
+	if (misc)
+	{
+		strbuf_concat(sb, " LEFT JOIN account_misc AS m "
+				  "ON m.account_id = a.id");
+	}
+
+	strbuf_printf(sb, " %s", tail);
+
+	return sb->buf;
+}
+
+static int open_lazy_blob(struct lazy_blob *lb, int64_t rowid)
+{
+	int rescode;
+
+	if (lb->blob != NULL)
+	{
+		rescode = sqlite3_blob_reopen(lb->blob, rowid);
+	}
+	else
+	{
+		rescode = sqlite3_blob_open(lb->db, "main", lb->table,
+					    lb->column, rowid, 0, &lb->blob);
+	}
+
+	if (rescode != SQLITE_OK)
+	{
+		return error_sqlerr(lb->db, "cannot open %s of row %"PRId64
+					     " in table %s", lb->column,
+				     rowid, lb->table);
+	}
+
+	return 0;
+}
+
+int lazy_blob_hex(struct lazy_blob *lb, int64_t rowid,
+		  void (*write)(void *, const char *, size_t), void *data)
+{
+	uint8_t buf[LAZY_BLOB_CHUNK];
+	char hex[LAZY_BLOB_CHUNK * 2];
+	int size, offset, n, rescode;
+
+	if (open_lazy_blob(lb, rowid) != 0)
+	{
+		return -1;
+	}
+
+	size = sqlite3_blob_bytes(lb->blob);
+	rescode = 0;
+
+	for (offset = 0; offset < size; offset += n)
+	{
+		n = size - offset < LAZY_BLOB_CHUNK ?
+			size - offset : LAZY_BLOB_CHUNK;
+
+		if (sqlite3_blob_read(lb->blob, buf, n, offset) != SQLITE_OK)
+		{
+			rescode = error_sqlerr(lb->db, "cannot read %s of row "
+							"%"PRId64, lb->column,
+					       rowid);
+			break;
+		}
+
+		hex_encode(hex, buf, n);
+		write(data, hex, n * 2);
+	}
+
+	zeromem(buf, sizeof(buf));
+	zeromem(hex, sizeof(hex));
+
+	return rescode;
+}
+
+void lazy_blob_close(struct lazy_blob *lb)
+{
+	if (lb->blob != NULL)
+	{
+		sqlite3_blob_close(lb->blob);
+		lb->blob = NULL;
+	}
+}
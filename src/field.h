@@ -0,0 +1,96 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef FIELD_H
+#define FIELD_H
+
+/**
+ * fields of a record as reads and exports see them, a list of them is
+ * turned into a query that selects only those columns and joins only
+ * the tables they live in; memo is never selected, a query gives its
+ * length instead and the blob is read through a lazy_blob, so pages
+ * of a memo are decrypted only if it's written out
+ */
+enum field_id
+{
+	FIELD_ID,
+	FIELD_UUID,
+	FIELD_SITENAME,
+	FIELD_ALIAS,
+	FIELD_SITEURL,
+	FIELD_USERNAME,
+	FIELD_PASSWORD,
+	FIELD_GUARD,
+	FIELD_RECOVERY,
+	FIELD_MEMO,
+	FIELD_COMMENT,
+	FIELD_SQLTIME,
+	FIELD_MODTIME,
+	FIELD_NR,
+};
+
+struct field_list
+{
+	enum field_id ids[FIELD_NR];
+	size_t nr;
+};
+
+/**
+ * ‘spec’ is names separated by commas, each at most once
+ */
+int parse_field_list(struct field_list *list, const char *spec);
+
+const char *field_name(enum field_id id);
+
+/**
+ * ‘SELECT a.id, <fields> FROM account AS a <joins> <tail>’, column i
+ * + 1 is field i of ‘list’; tables are aliased a, s and m
+ */
+char *build_field_query(const struct field_list *list, const char *tail);
+
+/**
+ * a blob column that's opened only once it's read, and moved between
+ * rows with sqlite3_blob_reopen() afterwards
+ */
+struct lazy_blob
+{
+	struct sqlite3 *db;
+	const char *table;
+	const char *column;
+
+	struct sqlite3_blob *blob;
+};
+
+#define LAZY_BLOB_INIT(db, table, column) { (db), (table), (column), NULL }
+
+#define MEMO_BLOB_INIT(db) LAZY_BLOB_INIT(db, "account_security", "memo")
+
+/**
+ * write the blob of row ‘rowid’ in hex through ‘write’, a chunk at a
+ * time; the chunks are wiped afterwards
+ */
+int lazy_blob_hex(struct lazy_blob *lb, int64_t rowid,
+		  void (*write)(void *, const char *, size_t), void *data);
+
+void lazy_blob_close(struct lazy_blob *lb);
+
+#endif /* FIELD_H */
@@ -25,7 +25,7 @@
 #include "security.h"
 #include "pkerrno.h"
 
-const char *xiopath = NULL;
+_Thread_local const char *xiopath = NULL;
 
 void get_working_dir_routine(const char **out, bool force_get)
 {
@@ -67,7 +67,7 @@ finish:
 
 char *prefix_filename(const char *prefix, const char *filename)
 {
-	if (is_abs_path(filename))
+	if (is_abs_path(filename) || !strcmp(filename, PK_TMP_REC_MEMORY))
 	{
 		return strdup(filename);
 	}
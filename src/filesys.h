@@ -71,4 +71,32 @@ void populate_file(const char *path, const void *buf, size_t len);
 
 int access_regular(const char *name, int type);
 
+/**
+ * atomically replace ‘dest’ with ‘src’, an error message is
+ * printed on failure
+ */
+int replace_file(const char *src, const char *dest);
+
+/**
+ * map the whole file at ‘path’ read-only and set ‘*len’ to its size,
+ * an error message is printed and NULL is returned on failure
+ */
+void *map_file(const char *path, size_t *len);
+
+void unmap_file(void *addr, size_t len);
+
+/**
+ * create a file backed by memory instead of a block device, the
+ * returned path can be opened by this process and the children
+ * it spawns, and the file lives as long as ‘*fd’ is open. an error
+ * message is printed and NULL is returned on failure
+ */
+char *make_memory_file(const char *name, int *fd);
+
+/**
+ * forbid any further modification to a file that created by
+ * make_memory_file(), do nothing if it's not supported
+ */
+int seal_memory_file(int fd);
+
 #endif /* FILESYS_H */
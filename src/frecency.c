@@ -0,0 +1,413 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "frecency.h"
+#include "strbuf.h"
+
+#define UPSERT_ACCESS_SQLSTR						\
+	"INSERT INTO account_access "					\
+		"(account_id, nr_access, last_access, frecency) "	\
+	"SELECT id, ?2, ?3, ?4 FROM account WHERE id = ?1 "		\
+	"ON CONFLICT (account_id) DO UPDATE SET "			\
+		"nr_access = nr_access + excluded.nr_access,"		\
+		"last_access = max(last_access, excluded.last_access),"	\
+		"frecency = pk_frecency_merge(frecency, excluded.frecency);"
+
+#define SELECT_ACCESS_KEY_SQLSTR "SELECT key FROM access_key;"
+
+/**
+ * an access, in the byte order of this machine, the log never
+ * leaves it
+ */
+struct access_record
+{
+	int64_t id;
+	int64_t time;
+};
+
+/**
+ * each append to the log is a header, ‘nr’ sealed access records, and
+ * the tag; the header is authenticated as well
+ */
+struct access_header
+{
+	uint8_t nonce[SEAL_NONCE_LEN];
+	uint32_t nr;
+};
+
+double frecency_merge(double a, double b)
+{
+	double hi, lo;
+
+	hi = a > b ? a : b;
+	lo = a > b ? b : a;
+
+	if (lo == -INFINITY)
+	{
+		return hi;
+	}
+
+	/* log2(2^a + 2^b), without 2^a overflowing */
+	return hi + log2(1 + exp2(lo - hi));
+}
+
+static void frecency_merge_fn(struct sqlite3_context *ctx, UNUSED int argc,
+			      struct sqlite3_value **argv)
+{
+	double a, b;
+
+	a = sqlite3_value_type(argv[0]) == SQLITE_NULL ?
+		-INFINITY : sqlite3_value_double(argv[0]);
+	b = sqlite3_value_type(argv[1]) == SQLITE_NULL ?
+		-INFINITY : sqlite3_value_double(argv[1]);
+
+	sqlite3_result_double(ctx, frecency_merge(a, b));
+}
+
+int register_frecency_functions(struct sqlite3 *db)
+{
+	if (sqlite3_create_function(db, "pk_frecency_merge", 2,
+				     SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+				     NULL, frecency_merge_fn,
+				     NULL, NULL) != SQLITE_OK)
+	{
+		return error_sqlerr(db, "cannot register frecency functions "
+					 "on db ‘%s’", msqlite3_pathname);
+	}
+
+	return 0;
+}
+
+int open_access_log(struct access_log *log, struct sqlite3 *db,
+		    const char *db_path)
+{
+	struct sqlite3_stmt *stmt;
+	int rescode;
+
+	log->db_path = db_path;
+
+	/* a vault before version 7 has no table access_key */
+	if (sqlite3_prepare_v2(db, SELECT_ACCESS_KEY_SQLSTR,
+				-1, &stmt, NULL) != SQLITE_OK)
+	{
+		return 1;
+	}
+
+	if ((rescode = sqlite3_step(stmt)) != SQLITE_ROW)
+	{
+		sqlite3_finalize(stmt);
+		return rescode == SQLITE_DONE ? 1 :
+			report_sqlite_error(sqlite3_step, db);
+	}
+
+	rescode = 0;
+	if (sqlite3_column_bytes(stmt, 0) != sizeof(log->key))
+	{
+		rescode = error("key of access log ‘%s-access’ is corrupted",
+				db_path);
+	}
+	else
+	{
+		memcpy(log->key, sqlite3_column_blob(stmt, 0),
+		       sizeof(log->key));
+	}
+
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+void close_access_log(struct access_log *log)
+{
+	zeromem(log->key, sizeof(log->key));
+}
+
+bool is_access_log_due(const char *db_path)
+{
+	struct stat st;
+	char *path;
+	bool due;
+
+	path = concat(db_path, "-access.fold");
+	due = access(path, F_OK) == 0;
+	free(path);
+
+	if (!due)
+	{
+		path = concat(db_path, "-access");
+		due = stat(path, &st) == 0 && (size_t)st.st_size >=
+			ACCESS_LOG_BATCH * sizeof(struct access_record);
+		free(path);
+	}
+
+	return due;
+}
+
+int record_access(const struct access_log *log,
+		  const int64_t *ids, size_t nr)
+{
+	struct access_header *header;
+	struct access_record *recs;
+	uint8_t *buf, *nonce;
+	char *path;
+	int64_t now;
+	size_t i, len;
+	int fd, rescode;
+
+	if (nr == 0)
+	{
+		return 0;
+	}
+	else if (nr > ACCESS_LOOKUP_MAX)
+	{
+		bug("cannot log %zu accesses at once", nr);
+	}
+
+	len = st_add3(sizeof(*header), st_mult(nr, sizeof(*recs)),
+		      SEAL_TAG_LEN);
+	buf = xmalloc(len);
+	header = (struct access_header *)buf;
+	recs = (struct access_record *)(header + 1);
+
+	nonce = header->nonce;
+	if (random_bytes_buffered(&nonce, sizeof(header->nonce)))
+	{
+		free(buf);
+		return -1;
+	}
+	header->nr = nr;
+
+	now = time(NULL);
+	for (i = 0; i < nr; i++)
+	{
+		recs[i] = (struct access_record){ ids[i], now };
+	}
+
+	seal_message(log->key, header->nonce, buf, sizeof(*header),
+		     (uint8_t *)recs, nr * sizeof(*recs), (uint8_t *)recs,
+		     (uint8_t *)(recs + nr));
+
+	path = concat(log->db_path, "-access");
+	rescode = 0;
+
+	/* an append this small is never torn by concurrent lookups */
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_APPEND,
+			S_IRUSR | S_IWUSR)) == -1)
+	{
+		rescode = error_errno("cannot open access log ‘%s’", path);
+	}
+	else
+	{
+		xiopath = path;
+		xwrite(fd, buf, len);
+		close(fd);
+	}
+
+	free(path);
+	free(buf);
+
+	return rescode;
+}
+
+static void add_access(struct access_map *map,
+		       const struct access_record *rec)
+{
+	struct access_map_entry *entry;
+	bool found;
+
+	entry = access_map_insert(map, rec->id, &found);
+	if (!found)
+	{
+		entry->value = (struct access_stat){ 0, 0, -INFINITY };
+	}
+
+	entry->value.nr++;
+	if (rec->time > entry->value.last)
+	{
+		entry->value.last = rec->time;
+	}
+	entry->value.frecency = frecency_merge(entry->value.frecency,
+					       access_frecency(rec->time));
+}
+
+static ssize_t read_access_log(const struct access_log *log,
+			       const char *path, struct access_map *map)
+{
+	struct access_header header;
+	struct access_record recs[ACCESS_LOOKUP_MAX];
+	uint8_t tag[SEAL_TAG_LEN];
+	size_t len, i;
+	ssize_t nr;
+	FILE *stream;
+
+	if ((stream = fopen(path, "r")) == NULL)
+	{
+		return errno == ENOENT ? 0 :
+			error_errno("cannot open access log ‘%s’", path);
+	}
+
+	/* an append cut short by a crash is dropped */
+	nr = 0;
+	while (fread(&header, sizeof(header), 1, stream) == 1)
+	{
+		len = header.nr * sizeof(*recs);
+
+		if (header.nr == 0 || header.nr > ACCESS_LOOKUP_MAX ||
+		     fread(recs, 1, len, stream) != len ||
+		     fread(tag, sizeof(tag), 1, stream) != 1)
+		{
+			break;
+		}
+
+		if (open_message(log->key, header.nonce,
+				  (uint8_t *)&header, sizeof(header),
+				  (uint8_t *)recs, len,
+				  (uint8_t *)recs, tag) != 0)
+		{
+			warning("access log ‘%s’ is corrupted, the rest of "
+				"it is ignored", path);
+			break;
+		}
+
+		for (i = 0; i < header.nr; i++)
+		{
+			add_access(map, &recs[i]);
+		}
+		nr += header.nr;
+	}
+
+	zeromem(recs, sizeof(recs));
+	fclose(stream);
+
+	return nr;
+}
+
+ssize_t load_access_log(const struct access_log *log,
+			struct access_map *map)
+{
+	char *path;
+	ssize_t nr, nr_fold;
+
+	path = concat(log->db_path, "-access");
+	nr = read_access_log(log, path, map);
+	free(path);
+
+	path = concat(log->db_path, "-access.fold");
+	nr_fold = read_access_log(log, path, map);
+	free(path);
+
+	return nr == -1 || nr_fold == -1 ? -1 : nr + nr_fold;
+}
+
+static int store_access(struct sqlite3 *db, const struct access_map *map)
+{
+	struct sqlite3_stmt *stmt;
+	const struct access_stat *stat;
+	size_t i;
+	int rescode;
+
+	if (msqlite3_prepare_v2(db, UPSERT_ACCESS_SQLSTR,
+				 -1, &stmt, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	/* accounts deleted since their accesses are skipped */
+	rescode = 0;
+	hashmap_for_each(i, map)
+	{
+		stat = &map->entries[i].value;
+
+		xsqlite3_bind_int64(stmt, 1, map->entries[i].key);
+		xsqlite3_bind_int64(stmt, 2, stat->nr);
+		xsqlite3_bind_int64(stmt, 3, stat->last);
+		sqlite3_bind_double(stmt, 4, stat->frecency);
+
+		if (msqlite3_step(stmt) != SQLITE_DONE)
+		{
+			rescode = -1;
+			break;
+		}
+
+		sqlite3_reset(stmt);
+	}
+
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+int fold_access_log(struct sqlite3 *db, const struct access_log *log)
+{
+	struct access_map map = HASHMAP_INIT;
+	char *path, *fold;
+	int rescode;
+
+	path = concat(log->db_path, "-access");
+	fold = concat(log->db_path, "-access.fold");
+
+	/**
+	 * the log is renamed before it's read, lookups meanwhile start a
+	 * new one; a fold left behind by a failure goes first
+	 */
+	rescode = 0;
+	if (access(fold, F_OK) != 0 && rename(path, fold) != 0)
+	{
+		if (errno != ENOENT)
+		{
+			rescode = error_errno("cannot rename access log ‘%s’",
+					       path);
+		}
+		goto finish;
+	}
+
+	if ((rescode = read_access_log(log, fold, &map)) == -1)
+	{
+		goto finish;
+	}
+
+	if (msqlite3_begin_transaction(db) != SQLITE_OK)
+	{
+		rescode = -1;
+		goto finish;
+	}
+
+	if ((rescode = store_access(db, &map)) != 0)
+	{
+		msqlite3_rollback_transaction(db);
+		goto finish;
+	}
+
+	if (msqlite3_end_transaction(db) != SQLITE_OK)
+	{
+		rescode = -1;
+		goto finish;
+	}
+
+	rescode = 0;
+	unlink(fold);
+
+finish:
+	access_map_destroy(&map);
+	free(path);
+	free(fold);
+
+	return rescode;
+}
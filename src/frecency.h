@@ -0,0 +1,113 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef FRECENCY_H
+#define FRECENCY_H
+
+#include "hashmap.h"
+#include "security.h"
+
+/**
+ * frecency of an account is the sum of 2^(-age / FRECENCY_HALF_LIFE)
+ * over its accesses; what's stored is its log2 plus now / half life,
+ * which no longer depends on the time, so nothing is ever rescanned to
+ * decay scores, and an access at ‘t’ folds in as access_frecency(t)
+ */
+#define FRECENCY_HALF_LIFE (14 * 24 * 60 * 60)
+
+#define access_frecency(t) ((double)(t) / FRECENCY_HALF_LIFE)
+
+/**
+ * accesses are appended to a log next to the cred db, and folded into
+ * table account_access once the log holds about this many of them, so
+ * that lookups don't each pay a write transaction
+ */
+#define ACCESS_LOG_BATCH 256
+
+/**
+ * a lookup showing more records than this is browsing rather than
+ * using them, and none of them is logged
+ */
+#define ACCESS_LOOKUP_MAX 16
+
+struct access_stat
+{
+	int64_t nr;
+	int64_t last;
+	double frecency;
+};
+
+DEFINE_U64MAP(access_map, struct access_stat)
+
+/**
+ * combine two frecencies, either may be -INFINITY for no access
+ */
+double frecency_merge(double a, double b);
+
+int register_frecency_functions(struct sqlite3 *db);
+
+/**
+ * the log is sealed under a key kept in table access_key of the vault
+ * (version 7), so which accounts are looked up, and when, is as secret
+ * as the vault itself
+ */
+struct access_log
+{
+	const char *db_path;
+	uint8_t key[BINKEY_LEN];
+};
+
+/**
+ * read the key of the access log of ‘db’, returns 1 if the vault is
+ * too old to have one, in which case accesses are not logged
+ */
+int open_access_log(struct access_log *log, struct sqlite3 *db,
+		    const char *db_path);
+
+void close_access_log(struct access_log *log);
+
+/**
+ * judged by the size of the log, so that it's known before the vault
+ * is unlocked whether it has to be opened for writing
+ */
+bool is_access_log_due(const char *db_path);
+
+/**
+ * log an access to each account of ‘ids’ made now
+ */
+int record_access(const struct access_log *log,
+		  const int64_t *ids, size_t nr);
+
+/**
+ * add accesses logged but not folded yet to ‘map’, returns how many
+ * there are or -1 on error
+ */
+ssize_t load_access_log(const struct access_log *log,
+			struct access_map *map);
+
+/**
+ * move logged accesses into table account_access of ‘db’ in a single
+ * transaction
+ */
+int fold_access_log(struct sqlite3 *db, const struct access_log *log);
+
+#endif /* FRECENCY_H */
@@ -24,6 +24,7 @@
 #include "strbuf.h"
 #include "strlist.h"
 #include "filesys.h"
+#include "security.h"
 
 #define SITENAME_ID ":sitename:"
 #define SITEURL_ID  ":siteurl:"
@@ -134,7 +135,7 @@ static void reassign_record(struct record *rec, struct strlist *lines)
 
 		{ NULL },
 	}, *fmap;
-	struct strbuf *field = STRBUF_INIT_PTR;
+	struct strbuf *field = STRBUF_INIT_PTR_REGION(lines->region);
 
 	for (i = 0; i < lines->size; )
 	{
@@ -190,8 +191,10 @@ static void reassign_record(struct record *rec, struct strlist *lines)
 		}
 
 		i = ii;
-		*fmap->value = strbuf_detach(field);
+		*fmap->value = secure_memdup(field->buf, field->length);
 
+		zeromem(field->buf, field->length);
+		strbuf_trunc(field);
 	}
 
 	strbuf_destroy(field);
@@ -249,6 +252,13 @@ int read_record_file(struct record *rec, const char *rec_path)
 	char *rec_buf;
 	off_t rec_bufsz;
 
+	/**
+	 * lines of the record file are decrypted secrets, they are
+	 * wiped along with the region when this function returns
+	 */
+	struct region secrets = REGION_INIT_SECURE;
+	struct strlist *rec_line = STRLIST_INIT_PTR_REGION(&secrets);
+
 	xiopath = rec_path;
 	rec_fd = xopen(rec_path, O_RDONLY);
 
@@ -260,7 +270,7 @@ int read_record_file(struct record *rec, const char *rec_path)
 
 	xlseek(rec_fd, 0, SEEK_SET);
 
-	rec_buf = xmalloc(rec_bufsz + 1);
+	rec_buf = secure_alloc(rec_bufsz + 1);
 	rec_buf[rec_bufsz] = 0;
 
 	if (xread(rec_fd, rec_buf, rec_bufsz) == 0)
@@ -271,10 +281,8 @@ int read_record_file(struct record *rec, const char *rec_path)
 
 	close(rec_fd);
 
-	struct strlist *rec_line = STRLIST_INIT_PTR_DUPSTR;
-
 	strlist_split(rec_line, rec_buf, '\n', -1);
-	free(rec_buf);
+	secure_trim(rec_buf, 0);
 
 	strlist_filter(rec_line, recfile_line_filter, false);
 
@@ -296,16 +304,19 @@ int read_record_file(struct record *rec, const char *rec_path)
 		else
 		{
 			strlist_destroy(rec_line, false);
+			region_destroy(&secrets);
 			return error("%s missing in the required fields",
 					format_missing_field(rec));
 		}
 	}
 
 	strlist_destroy(rec_line, false);
+	region_destroy(&secrets);
 	return 0;
 
 cancelled:
 	strlist_destroy(rec_line, false);
+	region_destroy(&secrets);
 	puts("creation is aborted due to empty record.");
 	return 1;
 }
@@ -385,9 +396,10 @@ void rm_journal_file(void)
 {
 	if (cred_db_path != NULL)
 	{
-		static char *pathname;
+		struct strbuf *sb = STRBUF_INIT_PTR;
 
-		pathname = concat(cred_db_path, "-journal");
-		unlink(pathname);
+		strbuf_printf(sb, "%s-journal", cred_db_path);
+		unlink(sb->buf);
+		strbuf_destroy(sb);
 	}
 }
@@ -0,0 +1,53 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "hashmap.h"
+
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+/**
+ * eight bytes are folded in at a time and the state is mixed by
+ * hash_u64() once at the end, which is enough for table indexing but
+ * not meant to withstand chosen keys
+ */
+uint64_t hash_bytes(const void *buf, size_t len)
+{
+	const uint8_t *ptr = buf;
+	uint64_t state, word;
+
+	state = len * HASH_MULTIPLIER;
+	for (; len >= sizeof(word); ptr += sizeof(word), len -= sizeof(word))
+	{
+		memcpy(&word, ptr, sizeof(word));
+		state = (state ^ word) * HASH_MULTIPLIER;
+		state ^= state >> 29;
+	}
+
+	if (len > 0)
+	{
+		word = 0;
+		memcpy(&word, ptr, len);
+		state = (state ^ word) * HASH_MULTIPLIER;
+	}
+
+	return hash_u64(state);
+}
@@ -0,0 +1,342 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+/**
+ * open-addressing hash tables with Robin Hood probing, generated per
+ * key type by DEFINE_HASHMAP() and DEFINE_HASHSET()
+ *
+ * slots are kept in two arrays, one 32-bit word of metadata per slot
+ * (probe distance in the low half, high bits of the hash above it)
+ * and the entries themselves, so a probe walks a few bytes of metadata
+ * and compares keys only when the hash bits already match; removal
+ * shifts the following entries back, there are no tombstones
+ */
+
+/**
+ * tables start this large and grow by doubling once they're
+ * HASHMAP_LOAD_NUM / HASHMAP_LOAD_DEN full
+ */
+#define HASHMAP_MIN_SIZE 16
+#define HASHMAP_LOAD_NUM 7
+#define HASHMAP_LOAD_DEN 8
+
+/**
+ * probe distances are kept in 16 bits, a table grows before any entry
+ * gets this far from its home slot
+ */
+#define HASHMAP_MAX_DIST 0xFFFF
+
+#define HASHMAP_INIT { 0 }
+
+#define hashmap_meta(hash, dist)\
+	( ((uint32_t)((hash) >> 32) & ~(uint32_t)0xFFFF) | (dist) )
+
+#define hashmap_dist(meta) ((meta) & 0xFFFF)
+
+/**
+ * iterate over the occupied slots of a table, ‘i’ is the slot index
+ * and ‘(map)->entries[i]’ the entry; the table must not be changed
+ * during the walk
+ */
+#define hashmap_for_each(i, map)				\
+	for (i = 0; i < (map)->size; i++)			\
+		if ((map)->meta[i] != 0)
+
+/**
+ * hash functions of the ready-made string and 64-bit key variants, and
+ * of any key made of bytes
+ */
+uint64_t hash_bytes(const void *buf, size_t len);
+
+static inline uint64_t hash_u64(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ULL;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBULL;
+	x ^= x >> 31;
+
+	return x;
+}
+
+static inline uint64_t hash_str(const char *str)
+{
+	return hash_bytes(str, strlen(str));
+}
+
+#define hash_str_eq(s1, s2) (!strcmp(s1, s2))
+#define hash_u64_eq(x1, x2) ((x1) == (x2))
+
+#define HASH_TABLE_STRUCT(name)						\
+struct name								\
+{									\
+	struct name##_entry *entries;					\
+	uint32_t *meta;							\
+	size_t size;							\
+	size_t nr;							\
+}
+
+/**
+ * the functions shared by maps and sets, ‘hash(key)’ gives a uint64_t
+ * and ‘eq(k1, k2)’ is true if the keys are equal, both are expanded
+ * inline
+ */
+#define HASH_TABLE_FUNCTIONS(name, ktype, hash, eq)			\
+static UNUSED void name##_destroy(struct name *map)			\
+{									\
+	free(map->entries);						\
+	free(map->meta);						\
+	*map = (struct name)HASHMAP_INIT;				\
+}									\
+									\
+static UNUSED struct name##_entry *name##_find(const struct name *map,	\
+					       ktype key)		\
+{									\
+	size_t mask, i;							\
+	uint32_t meta;							\
+	uint64_t h;							\
+									\
+	if (map->nr == 0)						\
+	{								\
+		return NULL;						\
+	}								\
+									\
+	h = hash(key);							\
+	mask = map->size - 1;						\
+	meta = hashmap_meta(h, 1);					\
+	for (i = h & mask; hashmap_dist(map->meta[i]) >= hashmap_dist(meta); \
+	     i = (i + 1) & mask, meta++)				\
+	{								\
+		if (map->meta[i] == meta && eq(map->entries[i].key, key)) \
+		{							\
+			return &map->entries[i];			\
+		}							\
+	}								\
+									\
+	return NULL;							\
+}									\
+									\
+/**									\
+ * place an entry known to be absent, returns the slot it ends up in;	\
+ * if some entry would be pushed HASHMAP_MAX_DIST from home, returns	\
+ * SIZE_MAX with that entry, still to be placed, left in ‘entry’	\
+ */									\
+static size_t name##_place(struct name *map, struct name##_entry *entry, \
+			   uint64_t h)					\
+{									\
+	struct name##_entry tmp_entry;					\
+	size_t mask, i, pos;						\
+	uint32_t meta, tmp_meta;					\
+									\
+	mask = map->size - 1;						\
+	meta = hashmap_meta(h, 1);					\
+	pos = SIZE_MAX;							\
+	for (i = h & mask; ; i = (i + 1) & mask, meta++)		\
+	{								\
+		if (hashmap_dist(meta) == HASHMAP_MAX_DIST)		\
+		{							\
+			return SIZE_MAX;				\
+		}							\
+		else if (map->meta[i] == 0)				\
+		{							\
+			break;						\
+		}							\
+		else if (hashmap_dist(map->meta[i]) < hashmap_dist(meta)) \
+		{							\
+			tmp_meta = map->meta[i];			\
+			map->meta[i] = meta;				\
+			meta = tmp_meta;				\
+									\
+			tmp_entry = map->entries[i];			\
+			map->entries[i] = *entry;			\
+			*entry = tmp_entry;				\
+									\
+			pos = pos == SIZE_MAX ? i : pos;		\
+		}							\
+	}								\
+									\
+	map->meta[i] = meta;						\
+	map->entries[i] = *entry;					\
+									\
+	return pos == SIZE_MAX ? i : pos;				\
+}									\
+									\
+static void name##_resize(struct name *map, size_t size)		\
+{									\
+	struct name##_entry *entries;					\
+	uint32_t *meta;							\
+	size_t old_size, i;						\
+									\
+	entries = map->entries;						\
+	meta = map->meta;						\
+	old_size = map->size;						\
+									\
+retry:									\
+	map->size = size;						\
+	MALLOC_ARRAY(map->entries, size);				\
+	CALLOC_ARRAY(map->meta, size);					\
+									\
+	for (i = 0; i < old_size; i++)					\
+	{								\
+		struct name##_entry entry = entries[i];			\
+									\
+		if (meta[i] != 0 &&					\
+		    name##_place(map, &entry, hash(entry.key)) == SIZE_MAX) \
+		{							\
+			free(map->entries);				\
+			free(map->meta);				\
+			size *= 2;					\
+			goto retry;					\
+		}							\
+	}								\
+									\
+	free(entries);							\
+	free(meta);							\
+}									\
+									\
+/**									\
+ * find ‘key’ or add it, ‘*found’ tells which happened; a new entry	\
+ * has its key set and anything else left for the caller to fill in;	\
+ * the pointer is good until the table is next changed			\
+ */									\
+static UNUSED struct name##_entry *name##_insert(struct name *map,	\
+						 ktype key, bool *found) \
+{									\
+	struct name##_entry *entry, new_entry;				\
+	size_t pos;							\
+									\
+	if ((entry = name##_find(map, key)) != NULL)			\
+	{								\
+		*found = true;						\
+		return entry;						\
+	}								\
+									\
+	*found = false;							\
+	if (map->size == 0)						\
+	{								\
+		name##_resize(map, HASHMAP_MIN_SIZE);			\
+	}								\
+	else if ((map->nr + 1) * HASHMAP_LOAD_DEN >			\
+		 map->size * HASHMAP_LOAD_NUM)				\
+	{								\
+		name##_resize(map, map->size * 2);			\
+	}								\
+									\
+	memset(&new_entry, 0, sizeof(new_entry));			\
+	new_entry.key = key;						\
+	map->nr++;							\
+	if ((pos = name##_place(map, &new_entry, hash(key))) != SIZE_MAX) \
+	{								\
+		return &map->entries[pos];				\
+	}								\
+									\
+	/* some other entry may be the one left over, place it anew */	\
+	do								\
+	{								\
+		name##_resize(map, map->size * 2);			\
+	}								\
+	while (name##_place(map, &new_entry,				\
+			    hash(new_entry.key)) == SIZE_MAX);		\
+									\
+	return name##_find(map, key);					\
+}									\
+									\
+/**									\
+ * remove ‘key’, returns false if it wasn't there			\
+ */									\
+static UNUSED bool name##_remove(struct name *map, ktype key)		\
+{									\
+	struct name##_entry *entry;					\
+	size_t mask, i, next;						\
+									\
+	if ((entry = name##_find(map, key)) == NULL)			\
+	{								\
+		return false;						\
+	}								\
+									\
+	mask = map->size - 1;						\
+	i = entry - map->entries;					\
+	for (next = (i + 1) & mask; hashmap_dist(map->meta[next]) > 1;	\
+	     i = next, next = (next + 1) & mask)			\
+	{								\
+		map->meta[i] = map->meta[next] - 1;			\
+		map->entries[i] = map->entries[next];			\
+	}								\
+									\
+	map->meta[i] = 0;						\
+	map->nr--;							\
+									\
+	return true;							\
+}
+
+/**
+ * DEFINE_HASHMAP(name, ktype, vtype, hash, eq) defines ‘struct name’,
+ * a map from ‘ktype’ to ‘vtype’ with entries ‘struct name##_entry’
+ * holding ‘key’ and ‘value’, and
+ *
+ *	struct name##_entry *name##_find(const struct name *, ktype);
+ *	struct name##_entry *name##_insert(struct name *, ktype, bool *);
+ *	bool name##_remove(struct name *, ktype);
+ *	void name##_destroy(struct name *);
+ *
+ * a table starts as HASHMAP_INIT; keys are stored as given, the table
+ * does not own what a pointer key points to
+ */
+#define DEFINE_HASHMAP(name, ktype, vtype, hash, eq)			\
+struct name##_entry							\
+{									\
+	ktype key;							\
+	vtype value;							\
+};									\
+									\
+HASH_TABLE_STRUCT(name);						\
+HASH_TABLE_FUNCTIONS(name, ktype, hash, eq)
+
+/**
+ * DEFINE_HASHSET(name, ktype, hash, eq) is DEFINE_HASHMAP() without
+ * the value
+ */
+#define DEFINE_HASHSET(name, ktype, hash, eq)				\
+struct name##_entry							\
+{									\
+	ktype key;							\
+};									\
+									\
+HASH_TABLE_STRUCT(name);						\
+HASH_TABLE_FUNCTIONS(name, ktype, hash, eq)
+
+#define DEFINE_STRMAP(name, vtype)\
+	DEFINE_HASHMAP(name, const char *, vtype, hash_str, hash_str_eq)
+
+#define DEFINE_STRSET(name)\
+	DEFINE_HASHSET(name, const char *, hash_str, hash_str_eq)
+
+#define DEFINE_U64MAP(name, vtype)\
+	DEFINE_HASHMAP(name, uint64_t, vtype, hash_u64, hash_u64_eq)
+
+#define DEFINE_U64SET(name)\
+	DEFINE_HASHSET(name, uint64_t, hash_u64, hash_u64_eq)
+
+#endif /* HASHMAP_H */
@@ -0,0 +1,221 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "hex.h"
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+#define BYTES(c__) ((uint64_t)(c__) * ONES)
+
+static inline FORCEINLINE uint64_t load_le64(const void *ptr)
+{
+	uint64_t v;
+
+	memcpy(&v, ptr, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline FORCEINLINE void store_le64(void *ptr, uint64_t v)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	memcpy(ptr, &v, sizeof(v));
+}
+
+static inline FORCEINLINE uint32_t load_le32(const void *ptr)
+{
+	uint32_t v;
+
+	memcpy(&v, ptr, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline FORCEINLINE void store_le32(void *ptr, uint32_t v)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	memcpy(ptr, &v, sizeof(v));
+}
+
+/**
+ * set the high bit of each byte that is >= ‘n’, bytes must be
+ * below 0x80
+ */
+#define BYTES_GE(x__, n__) ( ((x__) + BYTES(0x80 - (n__))) & HIGHS )
+
+/**
+ * 4 bytes to 8 hex digits
+ */
+static inline FORCEINLINE uint64_t encode_word(uint32_t v)
+{
+	uint64_t x, n, letter;
+
+	/* spread byte k to 16-bit lane k */
+	x = v;
+	x = (x | x << 16) & 0x0000FFFF0000FFFFULL;
+	x = (x | x << 8)  & 0x00FF00FF00FF00FFULL;
+
+	/* high nibble first, as it's written first */
+	n = (x >> 4 & BYTES(0x0F) & 0x00FF00FF00FF00FFULL) |
+	    (x & 0x000F000F000F000FULL) << 8;
+
+	letter = (n + BYTES(0x80 - 10)) >> 7 & ONES;
+
+	return n + BYTES('0') + letter * 7;
+}
+
+/**
+ * 8 hex digits to 4 bytes
+ */
+static inline FORCEINLINE uint32_t decode_word(uint64_t x)
+{
+	uint64_t n, p;
+
+	/* letters have 0x40 set, and their low nibble is 9 short */
+	n = (x & BYTES(0x0F)) + (x >> 6 & ONES) * 9;
+
+	/* join the nibble pairs in 16-bit lanes, then pack the lanes */
+	n = (n & 0x000F000F000F000FULL) << 4 | (n >> 8 & 0x000F000F000F000FULL);
+	p = n | n >> 8;
+
+	return (p & 0xFFFF) | (p >> 16 & 0xFFFF0000);
+}
+
+static inline FORCEINLINE int hexdigit(int c)
+{
+	return (c & 0x0F) + (c >> 6) * 9;
+}
+
+void hex_encode(char *hex, const uint8_t *bin, size_t len)
+{
+	size_t i;
+
+	/**
+	 * go from the tail, every block is loaded before its output is
+	 * stored, the output never overruns input not yet loaded
+	 */
+	for (i = len; i % 4; )
+	{
+		i--;
+		hex[2 * i + 1] = "0123456789ABCDEF"[bin[i] & 0x0F];
+		hex[2 * i]     = "0123456789ABCDEF"[bin[i] >> 4];
+	}
+
+	while (i > 0)
+	{
+		i -= 4;
+		store_le64(hex + 2 * i, encode_word(load_le32(bin + i)));
+	}
+}
+
+void hex_decode(uint8_t *bin, const char *hex, size_t hex_len)
+{
+	size_t i, len;
+
+	len = hex_len / 2;
+
+	for (i = 0; i + 4 <= len; i += 4)
+	{
+		store_le32(bin + i, decode_word(load_le64(hex + 2 * i)));
+	}
+
+	for (; i < len; i++)
+	{
+		bin[i] = hexdigit(hex[2 * i]) << 4 | hexdigit(hex[2 * i + 1]);
+	}
+}
+
+static inline FORCEINLINE bool is_hex_word(uint64_t x)
+{
+	uint64_t lower, digit, alpha;
+
+	if (x & HIGHS)
+	{
+		return false;
+	}
+
+	lower = x | BYTES(0x20);
+	digit = BYTES_GE(x, '0') & ~BYTES_GE(x, '9' + 1);
+	alpha = BYTES_GE(lower, 'a') & ~BYTES_GE(lower, 'f' + 1);
+
+	return (digit | alpha) == HIGHS;
+}
+
+bool is_hex_string(const char *str, size_t len)
+{
+	uint64_t tail;
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		if (!is_hex_word(load_le64(str + i)))
+		{
+			return false;
+		}
+	}
+
+	if (i == len)
+	{
+		return true;
+	}
+
+	/* pad the tail with a valid digit */
+	tail = BYTES('0');
+	memcpy(&tail, str + i, len - i);
+
+	return is_hex_word(tail);
+}
+
+bool is_bit_string(const char *str, size_t len)
+{
+	uint64_t x;
+	size_t i;
+
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		memcpy(&x, str + i, sizeof(x));
+
+		if ((x & ~ONES) != BYTES('0'))
+		{
+			return false;
+		}
+	}
+
+	for (; i < len; i++)
+	{
+		if ((str[i] & ~1) != '0')
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,52 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef HEX_H
+#define HEX_H
+
+/**
+ * kernels behind the hex and blob key conversions, they work on 8
+ * bytes at a time in a general purpose register, so they're as fast
+ * on any target and need no instruction set dispatch
+ */
+
+/**
+ * write the uppercase hex form of ‘len’ bytes at ‘bin’ to ‘hex’, no
+ * NUL is appended; ‘hex’ may start at ‘bin’ to convert in place
+ */
+void hex_encode(char *hex, const uint8_t *bin, size_t len);
+
+/**
+ * write the ‘hex_len’ / 2 bytes that ‘hex’ stands for to ‘bin’, the
+ * input must be valid; ‘bin’ may start at or before ‘hex’ to convert
+ * in place
+ */
+void hex_decode(uint8_t *bin, const char *hex, size_t hex_len);
+
+bool is_hex_string(const char *str, size_t len);
+
+/**
+ * all characters are ‘0’ or ‘1’
+ */
+bool is_bit_string(const char *str, size_t len);
+
+#endif /* HEX_H */
@@ -0,0 +1,1080 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "history.h"
+#include "strbuf.h"
+
+#define SELECT_ROW_SQLSTR_FMT						\
+	"SELECT a.sitename, a.alias, a.siteurl, a.username, "		\
+		"a.password, s.guard, s.recovery, s.memo, "		\
+		"m.comment, a.modtime "					\
+	"FROM \"%s\".account a "					\
+	"LEFT JOIN \"%s\".account_security s ON s.account_id = a.id "	\
+	"LEFT JOIN \"%s\".account_misc m ON m.account_id = a.id "	\
+	"WHERE a.id = ?;"
+
+#define SELECT_LATEST_SQLSTR_FMT					\
+	"SELECT version, kind, modtime, data FROM \"%s\".history "	\
+	"WHERE account_id = ? ORDER BY version DESC LIMIT 1;"
+
+#define INSERT_VERSION_SQLSTR_FMT					\
+	"INSERT OR REPLACE INTO \"%s\".history "			\
+		"(account_id, version, kind, modtime, data) "		\
+	"VALUES (?, ?, ?, ?, ?);"
+
+#define PRUNE_VERSIONS_SQLSTR_FMT					\
+	"DELETE FROM \"%s\".history "					\
+	"WHERE account_id = ? AND version <= ?;"
+
+/**
+ * the snapshot a rebuild starts from, if there's none, it starts
+ * from the live row
+ */
+#define SELECT_SNAPSHOT_SQLSTR						\
+	"SELECT version, modtime, data FROM history "			\
+	"WHERE account_id = ? AND version >= ? AND kind != 0 "		\
+	"ORDER BY version LIMIT 1;"
+
+#define SELECT_CHAIN_SQLSTR						\
+	"SELECT version, modtime, data FROM history "			\
+	"WHERE account_id = ? AND version >= ? AND version < ? "	\
+	"ORDER BY version DESC;"
+
+/* versions newer than a snapshot, to carry the fields it left out */
+#define SELECT_NEWER_SQLSTR						\
+	"SELECT data FROM history "					\
+	"WHERE account_id = ? AND version > ? ORDER BY version;"
+
+#define SELECT_HISTORY_SQLSTR						\
+	"SELECT version, kind, modtime, data FROM history "		\
+	"WHERE account_id = ? ORDER BY version DESC;"
+
+const char *const history_field_names[HISTORY_NR_FIELDS] = {
+	"sitename", "alias", "siteurl", "username", "password",
+	"guard", "recovery", "memo", "comment",
+};
+
+struct history_table
+{
+	const char *name;
+	unsigned first;
+	unsigned nr;
+};
+
+static const struct history_table tables[] = {
+	{ "account",          0, 5 },
+	{ "account_security", 5, 3 },
+	{ "account_misc",     8, 1 },
+};
+
+#define ALL_FIELDS ((1U << HISTORY_NR_FIELDS) - 1)
+
+/**
+ * versions written by the current transaction, a later change to the
+ * same account updates its version instead of adding one
+ */
+struct txn_version
+{
+	int schema;
+	int64_t id;
+	int64_t version;
+};
+
+static struct txn_version *txn_versions;
+static size_t txn_nr, txn_cap;
+
+void end_history_txn(void)
+{
+	txn_nr = 0;
+}
+
+static struct txn_version *find_txn_version(int schema, int64_t id)
+{
+	size_t i;
+
+	for (i = 0; i < txn_nr; i++)
+	{
+		if (txn_versions[i].schema == schema &&
+		     txn_versions[i].id == id)
+		{
+			return &txn_versions[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void put_varint(struct strbuf *sb, uint64_t val)
+{
+	while (val >= 0x80)
+	{
+		strbuf_putchar(sb, (char)(val | 0x80));
+		val >>= 7;
+	}
+
+	strbuf_putchar(sb, (char)val);
+}
+
+static int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *val)
+{
+	unsigned shift;
+
+	*val = 0;
+	for (shift = 0; *p < end && shift < 64; shift += 7)
+	{
+		*val |= (uint64_t)(**p & 0x7f) << shift;
+
+		if ((*(*p)++ & 0x80) == 0)
+		{
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * values are passwords and memos as often as not, so they're wiped
+ * before they're freed
+ */
+static void free_value(struct history_value *val)
+{
+	if (val->buf != NULL)
+	{
+		sfree(val->buf, val->len);
+	}
+}
+
+static void set_value(struct history_value *val, int type,
+		      const void *buf, size_t len)
+{
+	free_value(val);
+
+	val->type = type;
+	val->buf = NULL;
+	val->len = 0;
+
+	if (type != SQLITE_NULL)
+	{
+		/* an empty BLOB comes as NULL pointer */
+		val->buf = xmalloc(len + 1);
+		memcpy(val->buf, len ? buf : "", len);
+		val->buf[len] = 0;
+		val->len = len;
+	}
+}
+
+/**
+ * numbers are kept as text, which is what they read back as
+ */
+static void set_sqlite_value(struct history_value *val,
+			     struct sqlite3_value *sv)
+{
+	switch (sqlite3_value_type(sv))
+	{
+	case SQLITE_NULL:
+		set_value(val, SQLITE_NULL, NULL, 0);
+		break;
+	case SQLITE_BLOB:
+		set_value(val, SQLITE_BLOB, sqlite3_value_blob(sv),
+			   sqlite3_value_bytes(sv));
+		break;
+	default:
+		set_value(val, SQLITE_TEXT, sqlite3_value_text(sv),
+			   sqlite3_value_bytes(sv));
+	}
+}
+
+static bool value_equal(const struct history_value *a,
+			const struct history_value *b)
+{
+	return a->type == b->type && a->len == b->len &&
+		(a->len == 0 || memcmp(a->buf, b->buf, a->len) == 0);
+}
+
+static void copy_row(struct history_row *dst, const struct history_row *src)
+{
+	unsigned i;
+
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		set_value(&dst->field[i], src->field[i].type,
+			   src->field[i].buf, src->field[i].len);
+	}
+
+	free(dst->modtime);
+	dst->modtime = src->modtime == NULL ? NULL : xstrdup(src->modtime);
+}
+
+static unsigned diff_row(const struct history_row *a,
+			 const struct history_row *b)
+{
+	unsigned i, mask;
+
+	mask = 0;
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		if (!value_equal(&a->field[i], &b->field[i]))
+		{
+			mask |= 1U << i;
+		}
+	}
+
+	return mask;
+}
+
+/**
+ * a large memo is then stored once, rather than in every snapshot
+ */
+static unsigned blob_fields(const struct history_row *row)
+{
+	unsigned i, mask;
+
+	mask = 0;
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		if (row->field[i].type == SQLITE_BLOB)
+		{
+			mask |= 1U << i;
+		}
+	}
+
+	return mask;
+}
+
+void free_history_row(struct history_row *row)
+{
+	unsigned i;
+
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		free_value(&row->field[i]);
+	}
+
+	free(row->modtime);
+	memset(row, 0, sizeof(*row));
+}
+
+/**
+ * a version is three masks, fields stored, fields being NULL and
+ * fields being BLOB, then the length and bytes of each stored field
+ * that is not NULL
+ */
+static void encode_version(struct strbuf *sb,
+			   const struct history_row *row, unsigned mask)
+{
+	unsigned i, null, blob;
+
+	null = 0;
+	blob = 0;
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		if (row->field[i].type == SQLITE_NULL)
+		{
+			null |= 1U << i;
+		}
+		else if (row->field[i].type == SQLITE_BLOB)
+		{
+			blob |= 1U << i;
+		}
+	}
+
+	put_varint(sb, mask);
+	put_varint(sb, null & mask);
+	put_varint(sb, blob & mask);
+
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		if ((mask & ~null) & (1U << i))
+		{
+			put_varint(sb, row->field[i].len);
+			strbuf_write(sb, (const char *)row->field[i].buf,
+					row->field[i].len);
+		}
+	}
+}
+
+/**
+ * apply a version to ‘row’, so that it becomes that version, the
+ * mask of fields stored in it is returned, or -1 if it's corrupted
+ */
+static int apply_version(struct history_row *row,
+			 const uint8_t *data, size_t len)
+{
+	const uint8_t *p, *end;
+	uint64_t mask, null, blob, flen;
+	unsigned i;
+
+	p = data;
+	end = data + len;
+
+	if (get_varint(&p, end, &mask) != 0 ||
+	     get_varint(&p, end, &null) != 0 ||
+	     get_varint(&p, end, &blob) != 0 ||
+	     (mask & ~ALL_FIELDS) != 0)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		if (!(mask & (1U << i)))
+		{
+			continue;
+		}
+
+		if (null & (1U << i))
+		{
+			set_value(&row->field[i], SQLITE_NULL, NULL, 0);
+			continue;
+		}
+
+		if (get_varint(&p, end, &flen) != 0 ||
+		     flen > (uint64_t)(end - p))
+		{
+			return -1;
+		}
+
+		set_value(&row->field[i], blob & (1U << i) ?
+				SQLITE_BLOB : SQLITE_TEXT, p, flen);
+		p += flen;
+	}
+
+	return p == end ? (int)mask : -1;
+}
+
+static int apply_column(struct history_row *row, struct sqlite3_stmt *stmt,
+			int col, int64_t id)
+{
+	if (apply_version(row, sqlite3_column_blob(stmt, col),
+			   sqlite3_column_bytes(stmt, col)) == -1)
+	{
+		return error("history of account %"PRId64" is corrupted", id);
+	}
+
+	return 0;
+}
+
+static void set_modtime(struct history_row *row, struct sqlite3_stmt *stmt,
+			int col)
+{
+	const unsigned char *modtime;
+
+	free(row->modtime);
+	modtime = sqlite3_column_text(stmt, col);
+	row->modtime = modtime == NULL ? NULL : xstrdup((const char *)modtime);
+}
+
+static int load_row(struct sqlite3 *db, const char *schema,
+		    int64_t id, struct history_row *row)
+{
+	struct sqlite3_stmt *stmt;
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	unsigned i;
+	int rescode;
+
+	strbuf_printf(sql, SELECT_ROW_SQLSTR_FMT, schema, schema, schema);
+
+	rescode = msqlite3_prepare_v2(db, sql->buf, -1, &stmt, NULL);
+	strbuf_destroy(sql);
+
+	if (rescode != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	if (msqlite3_bind_int64(stmt, 1, id) != SQLITE_OK)
+	{
+		rescode = -1;
+		goto finalize;
+	}
+
+	if ((rescode = sqlite3_step(stmt)) != SQLITE_ROW)
+	{
+		rescode = rescode == SQLITE_DONE ? 1 :
+			  report_sqlite_error(sqlite3_step, db);
+		goto finalize;
+	}
+
+	for (i = 0; i < HISTORY_NR_FIELDS; i++)
+	{
+		set_sqlite_value(&row->field[i],
+				  sqlite3_column_value(stmt, i));
+	}
+
+	set_modtime(row, stmt, HISTORY_NR_FIELDS);
+	rescode = 0;
+
+finalize:
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+int load_history_row(struct sqlite3 *db, int64_t id, struct history_row *row)
+{
+	return load_row(db, "main", id, row);
+}
+
+/**
+ * triggers pass the uuid of their vault, as this is the only way to
+ * tell which of the attached dbs fired them
+ */
+static int find_schema(struct sqlite3 *db, const char *uuid,
+		       struct strbuf *schema)
+{
+	struct sqlite3_stmt *list, *stmt;
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	const char *name;
+	int seq;
+
+	if (msqlite3_prepare_v2(db, "PRAGMA database_list;",
+				 -1, &list, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	seq = -1;
+	while (seq == -1 && sqlite3_step(list) == SQLITE_ROW)
+	{
+		name = (const char *)sqlite3_column_text(list, 1);
+
+		strbuf_trunc(sql);
+		strbuf_printf(sql, "SELECT 1 FROM \"%s\".vault_info "
+				   "WHERE uuid = ?;", name);
+
+		/* dbs without vault_info are not cred dbs */
+		if (sqlite3_prepare_v2(db, sql->buf, -1,
+					&stmt, NULL) != SQLITE_OK)
+		{
+			continue;
+		}
+
+		sqlite3_bind_text(stmt, 1, uuid, -1, SQLITE_STATIC);
+
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			seq = sqlite3_column_int(list, 0);
+			strbuf_concat(schema, name);
+		}
+
+		sqlite3_finalize(stmt);
+	}
+
+	sqlite3_finalize(list);
+	strbuf_destroy(sql);
+
+	return seq == -1 ? error("no cred db with uuid ‘%s’", uuid) : seq;
+}
+
+struct latest_version
+{
+	int64_t version;
+	enum history_kind kind;
+	char *modtime;
+	uint8_t *data;
+	size_t len;
+};
+
+static int get_latest_version(struct sqlite3 *db, const char *schema,
+			      int64_t id, struct latest_version *latest)
+{
+	struct sqlite3_stmt *stmt;
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	int rescode;
+
+	strbuf_printf(sql, SELECT_LATEST_SQLSTR_FMT, schema);
+
+	rescode = msqlite3_prepare_v2(db, sql->buf, -1, &stmt, NULL);
+	strbuf_destroy(sql);
+
+	if (rescode != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	sqlite3_bind_int64(stmt, 1, id);
+
+	if ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		latest->version = sqlite3_column_int64(stmt, 0);
+		latest->kind = sqlite3_column_int(stmt, 1);
+		latest->len = sqlite3_column_bytes(stmt, 3);
+		latest->data = xmalloc(latest->len + 1);
+		memcpy(latest->data, sqlite3_column_blob(stmt, 3),
+			latest->len);
+
+		if (sqlite3_column_type(stmt, 2) != SQLITE_NULL)
+		{
+			latest->modtime = xstrdup((const char *)
+					sqlite3_column_text(stmt, 2));
+		}
+	}
+	else if (rescode != SQLITE_DONE)
+	{
+		report_sqlite_error(sqlite3_step, db);
+	}
+
+	sqlite3_finalize(stmt);
+
+	return rescode == SQLITE_ROW || rescode == SQLITE_DONE ? 0 : -1;
+}
+
+static int write_version(struct sqlite3 *db, const char *schema,
+			 int64_t id, int64_t version, enum history_kind kind,
+			 const char *modtime, const struct strbuf *data)
+{
+	struct sqlite3_stmt *insert, *prune;
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	const char *tail;
+	int rescode;
+
+	strbuf_printf(sql, INSERT_VERSION_SQLSTR_FMT, schema);
+	strbuf_printf(sql, PRUNE_VERSIONS_SQLSTR_FMT, schema);
+
+	rescode = -1;
+	insert = NULL;
+	prune = NULL;
+	if (msqlite3_prepare_v2(db, sql->buf, -1,
+				 &insert, &tail) != SQLITE_OK ||
+	     msqlite3_prepare_v2(db, tail, -1, &prune, NULL) != SQLITE_OK)
+	{
+		goto finish;
+	}
+
+	sqlite3_bind_int64(insert, 1, id);
+	sqlite3_bind_int64(insert, 2, version);
+	sqlite3_bind_int(insert, 3, kind);
+	sqlite3_bind_text(insert, 4, modtime, -1, SQLITE_STATIC);
+	sqlite3_bind_blob(insert, 5, data->buf, data->length, SQLITE_STATIC);
+
+	sqlite3_bind_int64(prune, 1, id);
+	sqlite3_bind_int64(prune, 2, version - HISTORY_MAX_VERSIONS);
+
+	if (msqlite3_step(insert) == SQLITE_DONE &&
+	     msqlite3_step(prune) == SQLITE_DONE)
+	{
+		rescode = 0;
+	}
+
+finish:
+	sqlite3_finalize(insert);
+	sqlite3_finalize(prune);
+	strbuf_destroy(sql);
+
+	return rescode;
+}
+
+/**
+ * record ‘old’, the state of account ‘id’ before a change that turns
+ * it into ‘new’
+ */
+static int record_version(struct sqlite3 *db, const char *schema, int seq,
+			  int64_t id, struct history_row *old,
+			  const struct history_row *new,
+			  enum history_kind kind)
+{
+	struct region secrets = REGION_INIT_SECURE;
+	struct strbuf *data = STRBUF_INIT_PTR_REGION(&secrets);
+	struct latest_version latest = { 0 };
+	struct txn_version *txn;
+	const char *modtime;
+	unsigned mask;
+	int rescode;
+
+	rescode = -1;
+	if (get_latest_version(db, schema, id, &latest) != 0)
+	{
+		goto finish;
+	}
+
+	modtime = old->modtime;
+	txn = find_txn_version(seq, id);
+
+	if (txn != NULL && latest.data != NULL &&
+	     txn->version == latest.version)
+	{
+		/**
+		 * ‘old’ is not what the account looked like before this
+		 * transaction, the version written earlier turns it back
+		 */
+		if (apply_version(old, latest.data, latest.len) == -1)
+		{
+			error("history of account %"PRId64" is corrupted", id);
+			goto finish;
+		}
+
+		modtime = latest.modtime;
+		if (latest.kind > kind)
+		{
+			kind = latest.kind;
+		}
+	}
+	else
+	{
+		latest.version++;
+
+		if (latest.version % HISTORY_SNAPSHOT_INTERVAL == 0 &&
+		     kind == HISTORY_DELTA)
+		{
+			kind = HISTORY_SNAPSHOT;
+		}
+
+		if (txn == NULL)
+		{
+			CAPACITY_GROW(txn_versions, txn_nr + 1, txn_cap);
+			txn = &txn_versions[txn_nr++];
+			txn->schema = seq;
+			txn->id = id;
+		}
+
+		txn->version = latest.version;
+	}
+
+	mask = diff_row(old, new);
+	if (kind != HISTORY_DELTA)
+	{
+		mask |= ALL_FIELDS & ~blob_fields(old);
+	}
+	encode_version(data, old, mask);
+
+	rescode = write_version(db, schema, id, latest.version,
+				kind, modtime, data);
+
+finish:
+	free(latest.modtime);
+	if (latest.data != NULL)
+	{
+		sfree(latest.data, latest.len);
+	}
+	region_destroy(&secrets);
+
+	return rescode;
+}
+
+static const struct history_table *find_table(const char *name)
+{
+	size_t i;
+
+	for (i = 0; name != NULL && i < sizeof(tables) / sizeof(*tables); i++)
+	{
+		if (strcmp(tables[i].name, name) == 0)
+		{
+			return &tables[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * pk_history_update(uuid, table, id, old..., new...), called by
+ * triggers before a row of ‘table’ changes, or after it's inserted,
+ * the other two tables are read from the db
+ */
+static void history_update(struct sqlite3_context *ctx,
+			   int argc, struct sqlite3_value **argv)
+{
+	const struct history_table *table;
+	struct history_row old = { 0 }, new = { 0 };
+	struct strbuf *schema = STRBUF_INIT_PTR;
+	struct sqlite3 *db;
+	const char *uuid;
+	int64_t id;
+	unsigned i;
+	int seq, rescode;
+
+	db = sqlite3_context_db_handle(ctx);
+	uuid = (const char *)sqlite3_value_text(argv[0]);
+	table = find_table((const char *)sqlite3_value_text(argv[1]));
+	id = sqlite3_value_int64(argv[2]);
+
+	if (uuid == NULL || table == NULL || argc != 3 + 2 * (int)table->nr)
+	{
+		sqlite3_result_error(ctx, "pk_history_update() called "
+					  "with bad arguments", -1);
+		return;
+	}
+
+	rescode = -1;
+	if ((seq = find_schema(db, uuid, schema)) == -1 ||
+	     (rescode = load_row(db, schema->buf, id, &old)) != 0)
+	{
+		goto finish;
+	}
+
+	copy_row(&new, &old);
+
+	for (i = 0; i < table->nr; i++)
+	{
+		set_sqlite_value(&old.field[table->first + i], argv[3 + i]);
+		set_sqlite_value(&new.field[table->first + i],
+				  argv[3 + table->nr + i]);
+	}
+
+	rescode = record_version(db, schema->buf, seq, id,
+				 &old, &new, HISTORY_DELTA);
+
+finish:
+	if (rescode == -1)
+	{
+		sqlite3_result_error(ctx, "cannot record history", -1);
+	}
+
+	free_history_row(&old);
+	free_history_row(&new);
+	strbuf_destroy(schema);
+}
+
+/**
+ * pk_history_delete(uuid, id), called by trigger before an account
+ * is deleted
+ */
+static void history_delete(struct sqlite3_context *ctx,
+			   UNUSED int argc, struct sqlite3_value **argv)
+{
+	struct history_row old = { 0 }, new = { 0 };
+	struct strbuf *schema = STRBUF_INIT_PTR;
+	struct sqlite3 *db;
+	const char *uuid;
+	int64_t id;
+	int seq, rescode;
+
+	db = sqlite3_context_db_handle(ctx);
+	uuid = (const char *)sqlite3_value_text(argv[0]);
+	id = sqlite3_value_int64(argv[1]);
+
+	if (uuid == NULL)
+	{
+		sqlite3_result_error(ctx, "pk_history_delete() called "
+					  "with bad arguments", -1);
+		return;
+	}
+
+	rescode = -1;
+	if ((seq = find_schema(db, uuid, schema)) != -1 &&
+	     (rescode = load_row(db, schema->buf, id, &old)) == 0)
+	{
+		rescode = record_version(db, schema->buf, seq, id,
+					 &old, &new, HISTORY_DELETED);
+	}
+
+	if (rescode == -1)
+	{
+		sqlite3_result_error(ctx, "cannot record history", -1);
+	}
+
+	free_history_row(&old);
+	strbuf_destroy(schema);
+}
+
+int register_history_functions(struct sqlite3 *db)
+{
+	if (sqlite3_create_function(db, "pk_history_update", -1,
+				     SQLITE_UTF8, NULL, history_update,
+				     NULL, NULL) != SQLITE_OK ||
+	     sqlite3_create_function(db, "pk_history_delete", 2,
+				     SQLITE_UTF8, NULL, history_delete,
+				     NULL, NULL) != SQLITE_OK)
+	{
+		return error_sqlerr(db, "cannot register history functions "
+					 "on db ‘%s’", msqlite3_pathname);
+	}
+
+	return 0;
+}
+
+/**
+ * fields ‘missing’ from snapshot ‘version’ are the same as in the
+ * first newer version that stores them, or else in the live row
+ */
+static int carry_fields(struct sqlite3 *db, int64_t id, int64_t version,
+			unsigned missing, struct history_row *row)
+{
+	struct history_row newer = { 0 };
+	struct sqlite3_stmt *stmt;
+	unsigned i, found;
+	int rescode, mask;
+
+	xsqlite3_prepare_v2(db, SELECT_NEWER_SQLSTR, -1, &stmt, NULL);
+	xsqlite3_bind_int64(stmt, 1, id);
+	xsqlite3_bind_int64(stmt, 2, version);
+
+	while (missing != 0 && (rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		if ((mask = apply_version(&newer, sqlite3_column_blob(stmt, 0),
+					   sqlite3_column_bytes(stmt, 0))) == -1)
+		{
+			break;
+		}
+
+		found = missing & (unsigned)mask;
+		missing &= ~found;
+
+		for (i = 0; i < HISTORY_NR_FIELDS; i++)
+		{
+			if (found & (1U << i))
+			{
+				set_value(&row->field[i], newer.field[i].type,
+					   newer.field[i].buf,
+					   newer.field[i].len);
+			}
+		}
+	}
+
+	if (missing == 0)
+	{
+		rescode = 0;
+	}
+	else if (rescode == SQLITE_ROW)
+	{
+		rescode = error("history of account %"PRId64" is corrupted",
+				id);
+	}
+	else if (rescode != SQLITE_DONE)
+	{
+		rescode = report_sqlite_error(sqlite3_step, db);
+	}
+	/* an account that's gone would have a snapshot storing them */
+	else if ((rescode = load_row(db, "main", id, &newer)) == 1)
+	{
+		rescode = error("history of account %"PRId64" is corrupted",
+				id);
+	}
+	else if (rescode == 0)
+	{
+		for (i = 0; i < HISTORY_NR_FIELDS; i++)
+		{
+			if (missing & (1U << i))
+			{
+				set_value(&row->field[i], newer.field[i].type,
+					   newer.field[i].buf,
+					   newer.field[i].len);
+			}
+		}
+	}
+
+	sqlite3_finalize(stmt);
+	free_history_row(&newer);
+
+	return rescode;
+}
+
+int rebuild_history_row(struct sqlite3 *db, int64_t id, int64_t version,
+			struct history_row *row)
+{
+	struct sqlite3_stmt *stmt;
+	int64_t top, last;
+	int rescode, mask;
+
+	xsqlite3_prepare_v2(db, SELECT_SNAPSHOT_SQLSTR, -1, &stmt, NULL);
+	xsqlite3_bind_int64(stmt, 1, id);
+	xsqlite3_bind_int64(stmt, 2, version);
+
+	top = INT64_MAX;
+	if ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		top = sqlite3_column_int64(stmt, 0);
+		set_modtime(row, stmt, 1);
+
+		if ((mask = apply_version(row, sqlite3_column_blob(stmt, 2),
+					   sqlite3_column_bytes(stmt, 2))) == -1)
+		{
+			rescode = error("history of account %"PRId64" is "
+					"corrupted", id);
+		}
+		else
+		{
+			rescode = carry_fields(db, id, top,
+					ALL_FIELDS & ~(unsigned)mask, row);
+		}
+	}
+	else if (rescode == SQLITE_DONE)
+	{
+		rescode = load_row(db, "main", id, row);
+	}
+	else
+	{
+		rescode = report_sqlite_error(sqlite3_step, db);
+	}
+
+	sqlite3_finalize(stmt);
+
+	if (rescode != 0 || top == version)
+	{
+		return rescode;
+	}
+
+	xsqlite3_prepare_v2(db, SELECT_CHAIN_SQLSTR, -1, &stmt, NULL);
+	xsqlite3_bind_int64(stmt, 1, id);
+	xsqlite3_bind_int64(stmt, 2, version);
+	xsqlite3_bind_int64(stmt, 3, top);
+
+	last = -1;
+	while ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		last = sqlite3_column_int64(stmt, 0);
+
+		if (apply_column(row, stmt, 2, id) != 0)
+		{
+			break;
+		}
+
+		set_modtime(row, stmt, 1);
+	}
+
+	if (rescode == SQLITE_DONE)
+	{
+		rescode = last == version ? 0 : 1;
+	}
+	else if (rescode == SQLITE_ROW)
+	{
+		rescode = -1;
+	}
+	else
+	{
+		rescode = report_sqlite_error(sqlite3_step, db);
+	}
+
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+ssize_t list_history(struct sqlite3 *db, int64_t id,
+		     struct history_entry **entries)
+{
+	struct history_row row = { 0 }, prev = { 0 };
+	struct sqlite3_stmt *stmt;
+	struct history_entry *entry;
+	size_t nr, cap;
+	unsigned i;
+	int rescode, mask;
+
+	switch (load_history_row(db, id, &row))
+	{
+	case -1:
+		return -1;
+	case 1:
+		/* a deleted account, its newest version is a snapshot */
+		for (i = 0; i < HISTORY_NR_FIELDS; i++)
+		{
+			row.field[i].type = SQLITE_NULL;
+		}
+	}
+
+	xsqlite3_prepare_v2(db, SELECT_HISTORY_SQLSTR, -1, &stmt, NULL);
+	xsqlite3_bind_int64(stmt, 1, id);
+
+	*entries = NULL;
+	nr = 0;
+	cap = 0;
+	while ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		CAPACITY_GROW(*entries, nr + 1, cap);
+		entry = &(*entries)[nr++];
+
+		entry->version = sqlite3_column_int64(stmt, 0);
+		entry->kind = sqlite3_column_int(stmt, 1);
+		entry->modtime = sqlite3_column_type(stmt, 2) == SQLITE_NULL ?
+			NULL : xstrdup((const char *)
+					sqlite3_column_text(stmt, 2));
+
+		/**
+		 * a snapshot stores every field but unchanged BLOBs, so
+		 * what changed is found by comparing it with the version
+		 * after it
+		 */
+		copy_row(&prev, &row);
+		if ((mask = apply_version(&row, sqlite3_column_blob(stmt, 3),
+					   sqlite3_column_bytes(stmt, 3))) == -1)
+		{
+			error("history of account %"PRId64" is corrupted", id);
+			break;
+		}
+
+		entry->changed = entry->kind == HISTORY_DELTA ?
+				 (unsigned)mask : diff_row(&row, &prev);
+	}
+
+	if (rescode == SQLITE_ROW)
+	{
+		rescode = -1;
+	}
+	else if (rescode != SQLITE_DONE)
+	{
+		rescode = report_sqlite_error(sqlite3_step, db);
+	}
+	else
+	{
+		rescode = 0;
+	}
+
+	sqlite3_finalize(stmt);
+	free_history_row(&row);
+	free_history_row(&prev);
+
+	if (rescode != 0)
+	{
+		free_history_list(*entries, nr);
+		return -1;
+	}
+
+	return nr;
+}
+
+void free_history_list(struct history_entry *entries, size_t nr)
+{
+	size_t i;
+
+	for (i = 0; i < nr; i++)
+	{
+		free(entries[i].modtime);
+	}
+
+	free(entries);
+}
+
+int parse_history_ref(const char *str, int64_t *id, int64_t *version)
+{
+	char *end;
+
+	errno = 0;
+	*id = strtoll(str, &end, 10);
+	*version = 0;
+
+	if (errno == 0 && end != str && *end == '@')
+	{
+		str = end + 1;
+		*version = strtoll(str, &end, 10);
+
+		if (*version <= 0)
+		{
+			errno = EINVAL;
+		}
+	}
+
+	if (errno != 0 || end == str || *end != 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
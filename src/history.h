@@ -0,0 +1,120 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/**
+ * prior versions of an account live in table history, each holds the
+ * fields that differ from the version right after it, so versions are
+ * rebuilt by walking down from the live row; every
+ * HISTORY_SNAPSHOT_INTERVAL versions a full copy is kept instead, which
+ * bounds the walk, and only the last HISTORY_MAX_VERSIONS versions of
+ * an account are kept
+ *
+ * a snapshot leaves out the BLOB fields it doesn't change, i.e. memos,
+ * those are carried from the first newer version storing them
+ */
+#define HISTORY_SNAPSHOT_INTERVAL 8
+#define HISTORY_MAX_VERSIONS      64
+
+/**
+ * fields of account, account_security and account_misc, in this order
+ */
+#define HISTORY_NR_FIELDS 9
+
+extern const char *const history_field_names[HISTORY_NR_FIELDS];
+
+enum history_kind
+{
+	HISTORY_DELTA,
+	HISTORY_SNAPSHOT,
+	/* a snapshot taken right before the account was deleted */
+	HISTORY_DELETED,
+};
+
+struct history_value
+{
+	/* SQLITE_NULL, SQLITE_TEXT or SQLITE_BLOB */
+	int type;
+	uint8_t *buf;
+	size_t len;
+};
+
+struct history_row
+{
+	struct history_value field[HISTORY_NR_FIELDS];
+	char *modtime;
+};
+
+struct history_entry
+{
+	int64_t version;
+	enum history_kind kind;
+	char *modtime;
+
+	/* fields that differ from the version after it */
+	unsigned changed;
+};
+
+/**
+ * parse ‘<rowid>[@<version>]’, ‘version’ is set to 0 if it's not
+ * given
+ */
+int parse_history_ref(const char *str, int64_t *id, int64_t *version);
+
+/**
+ * register SQL functions called by the history triggers, every
+ * connection writing to a cred db needs them
+ */
+int register_history_functions(struct sqlite3 *db);
+
+/**
+ * forget versions recorded by the transaction that just ended,
+ * changes made to an account within one transaction are folded into
+ * a single version
+ */
+void end_history_txn(void);
+
+/**
+ * load the live row of account ‘id’, return 1 if there's no such
+ * account
+ */
+int load_history_row(struct sqlite3 *db, int64_t id, struct history_row *row);
+
+/**
+ * rebuild ‘version’ of account ‘id’, return 1 if there's no such
+ * version
+ */
+int rebuild_history_row(struct sqlite3 *db, int64_t id, int64_t version, struct history_row *row);
+
+void free_history_row(struct history_row *row);
+
+/**
+ * list versions of account ‘id’ from the newest one, the number of
+ * entries is returned, or -1 on error
+ */
+ssize_t list_history(struct sqlite3 *db, int64_t id, struct history_entry **entries);
+
+void free_history_list(struct history_entry *entries, size_t nr);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,604 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "merkle.h"
+#include "strbuf.h"
+#include "security.h"
+
+#define SELECT_CHANGES_SQLSTR_FMT					\
+	"SELECT c.seq, c.uuid, a.sitename, a.alias, a.siteurl, "	\
+		"a.username, a.password, s.guard, s.recovery, "		\
+		"s.memo, m.comment "					\
+	"FROM %s.change_log c "						\
+	"LEFT JOIN %s.account a ON a.uuid = c.uuid AND NOT c.deleted "	\
+	"LEFT JOIN %s.account_security s ON s.account_id = a.id "	\
+	"LEFT JOIN %s.account_misc m ON m.account_id = a.id "		\
+	"WHERE c.seq > (SELECT merkle_seq FROM %s.vault_info) "		\
+	"ORDER BY c.seq;"
+
+#define SELECT_STALE_SQLSTR_FMT						\
+	"SELECT EXISTS (SELECT 1 FROM %s.change_log "			\
+		"WHERE seq > (SELECT merkle_seq FROM %s.vault_info));"
+
+/* same tables as version 3 of cred db, vault_info keeps merkle_seq */
+#define COPY_TREE_SQLSTR_FMT						\
+	"CREATE TABLE %s.row_digest ("					\
+		"uuid   TEXT PRIMARY KEY,"				\
+		"digest BLOB NOT NULL"					\
+	") WITHOUT ROWID;"						\
+									\
+	"CREATE TABLE %s.merkle_node ("					\
+		"prefix TEXT PRIMARY KEY,"				\
+		"digest BLOB NOT NULL"					\
+	") WITHOUT ROWID;"						\
+									\
+	"CREATE TABLE %s.vault_info ("					\
+		"merkle_seq INTEGER NOT NULL"				\
+	");"								\
+									\
+	"INSERT INTO %s.row_digest SELECT uuid, digest "		\
+		"FROM %s.row_digest;"					\
+	"INSERT INTO %s.merkle_node SELECT prefix, digest "		\
+		"FROM %s.merkle_node;"					\
+	"INSERT INTO %s.vault_info SELECT merkle_seq "			\
+		"FROM %s.vault_info;"
+
+/* number of columns digested, starting from uuid */
+#define DIGEST_COLUMNS 10
+
+#define NR_LEAF (1 << (4 * MERKLE_DEPTH))
+
+struct merkle_stmts
+{
+	struct sqlite3_stmt *put_row;
+	struct sqlite3_stmt *del_row;
+	struct sqlite3_stmt *get_rows;
+	struct sqlite3_stmt *get_node;
+	struct sqlite3_stmt *put_node;
+	struct sqlite3_stmt *del_node;
+};
+
+static void prepare_fmt(struct sqlite3 *db, struct sqlite3_stmt **stmt,
+			const char *fmt, const char *schema)
+{
+	struct strbuf *sql = STRBUF_INIT_PTR;
+
+	strbuf_printf(sql, fmt, schema);
+	xsqlite3_prepare_v2(db, sql->buf, -1, stmt, NULL);
+
+	strbuf_destroy(sql);
+}
+
+static void prepare_stmts(struct sqlite3 *db, struct merkle_stmts *st,
+			  const char *schema)
+{
+	prepare_fmt(db, &st->put_row, "INSERT OR REPLACE INTO "
+			"%s.row_digest (uuid, digest) VALUES (?, ?);", schema);
+	prepare_fmt(db, &st->del_row, "DELETE FROM %s.row_digest "
+			"WHERE uuid = ?;", schema);
+	prepare_fmt(db, &st->get_rows, "SELECT uuid, digest FROM "
+			"%s.row_digest WHERE uuid >= ?1 AND uuid < ?1 || 'g' "
+			"ORDER BY uuid;", schema);
+	prepare_fmt(db, &st->get_node, "SELECT digest FROM "
+			"%s.merkle_node WHERE prefix = ?;", schema);
+	prepare_fmt(db, &st->put_node, "INSERT OR REPLACE INTO "
+			"%s.merkle_node (prefix, digest) VALUES (?, ?);",
+			schema);
+	prepare_fmt(db, &st->del_node, "DELETE FROM %s.merkle_node "
+			"WHERE prefix = ?;", schema);
+}
+
+static void finalize_stmts(struct merkle_stmts *st)
+{
+	sqlite3_finalize(st->put_row);
+	sqlite3_finalize(st->del_row);
+	sqlite3_finalize(st->get_rows);
+	sqlite3_finalize(st->get_node);
+	sqlite3_finalize(st->put_node);
+	sqlite3_finalize(st->del_node);
+}
+
+static void run_stmt(struct sqlite3_stmt *stmt)
+{
+	xsqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+}
+
+static inline void format_prefix(char *buf, int level, unsigned idx)
+{
+	int i;
+
+	buf[level] = 0;
+	for (i = level - 1; i >= 0; i--, idx >>= 4)
+	{
+		buf[i] = "0123456789abcdef"[idx & 0xF];
+	}
+}
+
+static int parse_leaf_idx(const char *uuid, unsigned *idx)
+{
+	int i, val;
+
+	*idx = 0;
+	for (i = 0; i < MERKLE_DEPTH; i++)
+	{
+		if (in_range_i(uuid[i], '0', '9'))
+		{
+			val = uuid[i] - '0';
+		}
+		else if (in_range_i(uuid[i], 'a', 'f'))
+		{
+			val = uuid[i] - 'a' + 10;
+		}
+		else
+		{
+			return error("malformed uuid ‘%s’ in ‘%s’",
+					uuid, msqlite3_pathname);
+		}
+
+		*idx = (*idx << 4) | val;
+	}
+
+	return 0;
+}
+
+/**
+ * each column is digested as a one-byte NULL flag followed by its
+ * length and bytes, so that adjacent columns can never be confused
+ */
+static void digest_row(struct sqlite3_stmt *stmt, uint8_t *out)
+{
+	struct strbuf *sb = STRBUF_INIT_PTR;
+	uint8_t *digest;
+	int col;
+
+	for (col = 1; col < DIGEST_COLUMNS + 1; col++)
+	{
+		uint32_t len;
+
+		if (sqlite3_column_type(stmt, col) == SQLITE_NULL)
+		{
+			strbuf_putchar(sb, 0);
+			continue;
+		}
+
+		strbuf_putchar(sb, 1);
+
+		len = sqlite3_column_bytes(stmt, col);
+		strbuf_write(sb, (const char *)&len, sizeof(len));
+		strbuf_write(sb, sqlite3_column_blob(stmt, col), len);
+	}
+
+	digest = digest_message_sha256((uint8_t *)sb->buf, sb->length);
+	memcpy(out, digest, MERKLE_DIGEST_LENGTH);
+
+	clean_digest(digest);
+	strbuf_destroy(sb);
+}
+
+static void save_node(struct merkle_stmts *st, const char *prefix,
+		      const struct strbuf *content)
+{
+	uint8_t *digest;
+
+	if (content->length == 0)
+	{
+		xsqlite3_bind_text(st->del_node, 1, prefix, -1, SQLITE_STATIC);
+		run_stmt(st->del_node);
+		return;
+	}
+
+	digest = digest_message_sha256((uint8_t *)content->buf,
+					content->length);
+
+	xsqlite3_bind_text(st->put_node, 1, prefix, -1, SQLITE_STATIC);
+	xsqlite3_bind_blob(st->put_node, 2, digest, MERKLE_DIGEST_LENGTH,
+				SQLITE_STATIC);
+	run_stmt(st->put_node);
+
+	clean_digest(digest);
+}
+
+static void rebuild_leaf(struct merkle_stmts *st, const char *prefix)
+{
+	struct strbuf *sb = STRBUF_INIT_PTR;
+
+	xsqlite3_bind_text(st->get_rows, 1, prefix, -1, SQLITE_STATIC);
+	while (sqlite3_step(st->get_rows) == SQLITE_ROW)
+	{
+		strbuf_write(sb, sqlite3_column_blob(st->get_rows, 1),
+				MERKLE_DIGEST_LENGTH);
+	}
+	sqlite3_reset(st->get_rows);
+
+	save_node(st, prefix, sb);
+	strbuf_destroy(sb);
+}
+
+static void rebuild_inner(struct merkle_stmts *st, int level, unsigned idx)
+{
+	struct strbuf *sb = STRBUF_INIT_PTR;
+	char prefix[MERKLE_DEPTH + 1];
+	unsigned i;
+
+	for (i = 0; i < MERKLE_FANOUT; i++)
+	{
+		format_prefix(prefix, level + 1, idx * MERKLE_FANOUT + i);
+
+		xsqlite3_bind_text(st->get_node, 1, prefix, -1, SQLITE_STATIC);
+		if (sqlite3_step(st->get_node) == SQLITE_ROW)
+		{
+			strbuf_putchar(sb, i);
+			strbuf_write(sb, sqlite3_column_blob(st->get_node, 0),
+					MERKLE_DIGEST_LENGTH);
+		}
+		sqlite3_reset(st->get_node);
+	}
+
+	format_prefix(prefix, level, idx);
+	save_node(st, prefix, sb);
+
+	strbuf_destroy(sb);
+}
+
+/**
+ * dirty[level] is a bitmap of nodes at ‘level’ to be rebuilt, leaves
+ * are rebuilt first, then their parents level by level up to root
+ */
+static void rebuild_dirty(struct merkle_stmts *st, uint8_t **dirty)
+{
+	char prefix[MERKLE_DEPTH + 1];
+	unsigned idx, nr;
+	int level;
+
+	for (level = MERKLE_DEPTH; level >= 0; level--)
+	{
+		nr = 1U << (4 * level);
+
+		for (idx = 0; idx < nr; idx++)
+		{
+			if (!(dirty[level][idx / 8] & (1 << (idx % 8))))
+			{
+				continue;
+			}
+
+			if (level == MERKLE_DEPTH)
+			{
+				format_prefix(prefix, level, idx);
+				rebuild_leaf(st, prefix);
+			}
+			else
+			{
+				rebuild_inner(st, level, idx);
+			}
+
+			if (level > 0)
+			{
+				dirty[level - 1][idx / MERKLE_FANOUT / 8] |=
+					1 << (idx / MERKLE_FANOUT % 8);
+			}
+		}
+	}
+}
+
+int refresh_merkle_tree(struct sqlite3 *db, const char *schema,
+			const char *tree)
+{
+	struct merkle_stmts st;
+	struct sqlite3_stmt *stmt;
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	uint8_t *dirty[MERKLE_DEPTH + 1];
+	uint8_t digest[MERKLE_DIGEST_LENGTH];
+	int64_t seq;
+	unsigned idx;
+	int level, rescode;
+
+	for (level = 0; level <= MERKLE_DEPTH; level++)
+	{
+		dirty[level] = xcalloc(((1U << (4 * level)) + 7) / 8, 1);
+	}
+
+	prepare_stmts(db, &st, tree);
+
+	strbuf_printf(sql, SELECT_CHANGES_SQLSTR_FMT,
+			schema, schema, schema, schema, tree);
+	xsqlite3_prepare_v2(db, sql->buf, -1, &stmt, NULL);
+
+	seq = -1;
+	while ((rescode = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		const char *uuid;
+
+		seq = sqlite3_column_int64(stmt, 0);
+		uuid = (const char *)sqlite3_column_text(stmt, 1);
+
+		if (parse_leaf_idx(uuid, &idx) != 0)
+		{
+			rescode = SQLITE_ERROR;
+			goto finish;
+		}
+
+		dirty[MERKLE_DEPTH][idx / 8] |= 1 << (idx % 8);
+
+		/* no sitename means the account is gone */
+		if (sqlite3_column_type(stmt, 2) == SQLITE_NULL)
+		{
+			xsqlite3_bind_text(st.del_row, 1, uuid,
+						-1, SQLITE_STATIC);
+			run_stmt(st.del_row);
+			continue;
+		}
+
+		digest_row(stmt, digest);
+
+		xsqlite3_bind_text(st.put_row, 1, uuid, -1, SQLITE_STATIC);
+		xsqlite3_bind_blob(st.put_row, 2, digest,
+					MERKLE_DIGEST_LENGTH, SQLITE_STATIC);
+		run_stmt(st.put_row);
+	}
+
+	if (rescode != SQLITE_DONE)
+	{
+		report_sqlite_error(sqlite3_step, db);
+		goto finish;
+	}
+
+	if (seq != -1)
+	{
+		rebuild_dirty(&st, dirty);
+
+		strbuf_trunc(sql);
+		strbuf_printf(sql, "UPDATE %s.vault_info SET merkle_seq = "
+				   "%"PRId64";", tree, seq);
+		xsqlite3_exec(db, sql->buf, NULL, NULL, NULL);
+	}
+
+finish:
+	sqlite3_finalize(stmt);
+	finalize_stmts(&st);
+	strbuf_destroy(sql);
+
+	for (level = 0; level <= MERKLE_DEPTH; level++)
+	{
+		free(dirty[level]);
+	}
+
+	return rescode == SQLITE_DONE ? 0 : -1;
+}
+
+int is_merkle_tree_stale(struct sqlite3 *db, const char *schema)
+{
+	struct sqlite3_stmt *stmt;
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	int rescode;
+
+	strbuf_printf(sql, SELECT_STALE_SQLSTR_FMT, schema, schema);
+
+	rescode = msqlite3_prepare_v2(db, sql->buf, -1, &stmt, NULL);
+	strbuf_destroy(sql);
+
+	if (rescode != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	if ((rescode = sqlite3_step(stmt)) != SQLITE_ROW)
+	{
+		sqlite3_finalize(stmt);
+		return report_sqlite_error(sqlite3_step, db);
+	}
+
+	rescode = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+
+	return rescode;
+}
+
+int copy_merkle_tree(struct sqlite3 *db, const char *schema,
+		     const char *copy)
+{
+	struct strbuf *sql = STRBUF_INIT_PTR;
+	int rescode;
+
+	strbuf_printf(sql, COPY_TREE_SQLSTR_FMT, copy, copy, copy,
+			copy, schema, copy, schema, copy, schema);
+
+	rescode = msqlite3_exec(db, sql->buf, NULL, NULL, NULL);
+	strbuf_destroy(sql);
+
+	return rescode == SQLITE_OK ? 0 : -1;
+}
+
+struct diff_context
+{
+	struct merkle_stmts left;
+	struct merkle_stmts right;
+
+	merkle_diff_fn fn;
+	void *data;
+
+	bool differ;
+};
+
+static bool node_equal(struct diff_context *ctx, const char *prefix)
+{
+	struct sqlite3_stmt *l, *r;
+	bool equal;
+	int lrc, rrc;
+
+	l = ctx->left.get_node;
+	r = ctx->right.get_node;
+
+	xsqlite3_bind_text(l, 1, prefix, -1, SQLITE_STATIC);
+	xsqlite3_bind_text(r, 1, prefix, -1, SQLITE_STATIC);
+
+	lrc = sqlite3_step(l);
+	rrc = sqlite3_step(r);
+
+	if (lrc != rrc)
+	{
+		equal = false;
+	}
+	else if (lrc != SQLITE_ROW)
+	{
+		equal = true;
+	}
+	else
+	{
+		equal = !memcmp(sqlite3_column_blob(l, 0),
+				sqlite3_column_blob(r, 0),
+				 MERKLE_DIGEST_LENGTH);
+	}
+
+	sqlite3_reset(l);
+	sqlite3_reset(r);
+
+	return equal;
+}
+
+/**
+ * both sides are sorted by uuid, walk them like merging two lists
+ */
+static int diff_leaf(struct diff_context *ctx, const char *prefix)
+{
+	struct sqlite3_stmt *l, *r;
+	int lrc, rrc, cmp, rescode;
+
+	l = ctx->left.get_rows;
+	r = ctx->right.get_rows;
+
+	xsqlite3_bind_text(l, 1, prefix, -1, SQLITE_STATIC);
+	xsqlite3_bind_text(r, 1, prefix, -1, SQLITE_STATIC);
+
+	lrc = sqlite3_step(l);
+	rrc = sqlite3_step(r);
+
+	rescode = 0;
+	while (rescode == 0 && (lrc == SQLITE_ROW || rrc == SQLITE_ROW))
+	{
+		if (lrc != SQLITE_ROW)
+		{
+			cmp = 1;
+		}
+		else if (rrc != SQLITE_ROW)
+		{
+			cmp = -1;
+		}
+		else
+		{
+			cmp = strcmp((const char *)sqlite3_column_text(l, 0),
+				     (const char *)sqlite3_column_text(r, 0));
+		}
+
+		if (cmp < 0)
+		{
+			rescode = ctx->fn((const char *)
+					   sqlite3_column_text(l, 0),
+					   MERKLE_ONLY_LEFT, ctx->data);
+			lrc = sqlite3_step(l);
+		}
+		else if (cmp > 0)
+		{
+			rescode = ctx->fn((const char *)
+					   sqlite3_column_text(r, 0),
+					   MERKLE_ONLY_RIGHT, ctx->data);
+			rrc = sqlite3_step(r);
+		}
+		else
+		{
+			if (memcmp(sqlite3_column_blob(l, 1),
+				   sqlite3_column_blob(r, 1),
+				    MERKLE_DIGEST_LENGTH))
+			{
+				rescode = ctx->fn((const char *)
+						   sqlite3_column_text(l, 0),
+						   MERKLE_CHANGED, ctx->data);
+			}
+
+			lrc = sqlite3_step(l);
+			rrc = sqlite3_step(r);
+		}
+	}
+
+	sqlite3_reset(l);
+	sqlite3_reset(r);
+
+	return rescode;
+}
+
+static int diff_subtree(struct diff_context *ctx, int level, unsigned idx)
+{
+	char prefix[MERKLE_DEPTH + 1];
+	unsigned i;
+
+	format_prefix(prefix, level, idx);
+
+	if (node_equal(ctx, prefix))
+	{
+		return 0;
+	}
+
+	ctx->differ = true;
+
+	if (level == MERKLE_DEPTH)
+	{
+		return diff_leaf(ctx, prefix);
+	}
+
+	for (i = 0; i < MERKLE_FANOUT; i++)
+	{
+		if (diff_subtree(ctx, level + 1,
+				  idx * MERKLE_FANOUT + i) != 0)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int diff_merkle_tree(
+	struct sqlite3 *db, const char *left, const char *right,
+	merkle_diff_fn fn, void *data)
+{
+	struct diff_context ctx = {
+		.fn   = fn,
+		.data = data,
+	};
+	int rescode;
+
+	prepare_stmts(db, &ctx.left, left);
+	prepare_stmts(db, &ctx.right, right);
+
+	rescode = diff_subtree(&ctx, 0, 0);
+
+	finalize_stmts(&ctx.left);
+	finalize_stmts(&ctx.right);
+
+	if (rescode != 0)
+	{
+		return -1;
+	}
+
+	return ctx.differ;
+}
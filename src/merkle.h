@@ -0,0 +1,73 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef MERKLE_H
+#define MERKLE_H
+
+/**
+ * records are bucketed by the first MERKLE_DEPTH hex digits of their
+ * uuid, each level of the tree consumes one digit, so a node at
+ * level n is keyed by an n-digit prefix and the root by ""
+ */
+#define MERKLE_FANOUT 16
+#define MERKLE_DEPTH  4
+
+#define MERKLE_DIGEST_LENGTH 32
+
+enum merkle_diff
+{
+	MERKLE_ONLY_LEFT,
+	MERKLE_ONLY_RIGHT,
+	MERKLE_CHANGED,
+};
+
+typedef int (*merkle_diff_fn)(const char *uuid, enum merkle_diff kind, void *data);
+
+/**
+ * fold changes recorded in change_log of ‘schema’ since the last
+ * refresh into the row digests and merkle tree kept in ‘tree’, which
+ * is ‘schema’ itself or a copy made by copy_merkle_tree(), the cost
+ * is bounded by the number of changes
+ */
+int refresh_merkle_tree(struct sqlite3 *db, const char *schema, const char *tree);
+
+/**
+ * return 1 if change_log of ‘schema’ has changes not folded into its
+ * tree yet, 0 if it has none and -1 on error
+ */
+int is_merkle_tree_stale(struct sqlite3 *db, const char *schema);
+
+/**
+ * copy the tree of ‘schema’ into empty schema ‘copy’, so that a
+ * read-only ‘schema’ can be refreshed there
+ */
+int copy_merkle_tree(struct sqlite3 *db, const char *schema, const char *copy);
+
+/**
+ * compare merkle trees of schema ‘left’ and ‘right’, descending only
+ * into subtrees whose digests differ, ‘fn’ is called for each record
+ * that differs; return 0 if both are equal, 1 if they differ and -1
+ * on error
+ */
+int diff_merkle_tree(struct sqlite3 *db, const char *left, const char *right, merkle_diff_fn fn, void *data);
+
+#endif /* MERKLE_H */
@@ -73,7 +73,7 @@ void die_winerr(const char *format, ...)
 	__attribute__((format(printf, 1, 2), noreturn));
 #endif
 
-extern const char *msqlite3_pathname;
+extern _Thread_local const char *msqlite3_pathname;
 
 int report_sqlite_error(void *sqlite3_fn, struct sqlite3 *db, ...);
 
@@ -81,7 +81,7 @@ int report_sqlite_error(void *sqlite3_fn, struct sqlite3 *db, ...);
  * xio_die() print this variable if it's not NULL, otherwise
  * fallback to fd number
  */
-extern const char *xiopath;
+extern _Thread_local const char *xiopath;
 
 /**
  * printed message will be ‘__PREFIX__ file/fd xxx’
@@ -0,0 +1,204 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "output.h"
+#include "security.h"
+#include "atexit-chain.h"
+
+static void alloc_buffer(struct output_sink *out)
+{
+	size_t page;
+
+	page = secure_page_size();
+	out->cap = (OUTPUT_BUFSIZE + page - 1) / page * page;
+
+	if ((out->buf = map_secure_pages(out->cap)) != NULL)
+	{
+		out->mapped = true;
+		return;
+	}
+
+	out->buf = xmalloc(out->cap);
+	out->mapped = false;
+}
+
+/**
+ * write the buffer followed by ‘len’ bytes at ‘buf’ on one writev()
+ */
+static void flush_with(struct output_sink *out, const void *buf, size_t len)
+{
+	struct iovec iov[2];
+	int iovcnt;
+
+	iovcnt = 0;
+	if (out->len > 0)
+	{
+		iov[iovcnt++] = (struct iovec){
+			.iov_base = out->buf,
+			.iov_len = out->len,
+		};
+	}
+
+	if (len > 0)
+	{
+		iov[iovcnt++] = (struct iovec){
+			.iov_base = (void *)buf,
+			.iov_len = len,
+		};
+	}
+
+	if (iovcnt > 0)
+	{
+		xwritev(out->fd, iov, iovcnt);
+	}
+
+	if (out->len > 0)
+	{
+		zeromem(out->buf, out->len);
+		out->len = 0;
+	}
+}
+
+void output_write(struct output_sink *out, const void *buf, size_t len)
+{
+	if (out->buf == NULL)
+	{
+		alloc_buffer(out);
+	}
+
+	if (len >= OUTPUT_DIRECT_MIN)
+	{
+		flush_with(out, buf, len);
+		return;
+	}
+	else if (out->len + len > out->cap)
+	{
+		flush_with(out, NULL, 0);
+	}
+
+	memcpy(out->buf + out->len, buf, len);
+	out->len += len;
+}
+
+void output_putchar(struct output_sink *out, char c)
+{
+	if (out->buf != NULL && out->len < out->cap)
+	{
+		out->buf[out->len++] = c;
+		return;
+	}
+
+	output_write(out, &c, 1);
+}
+
+void output_printf(struct output_sink *out, const char *fmt, ...)
+{
+	va_list ap;
+	size_t avail;
+	char *tmp;
+	int len;
+
+	if (out->buf == NULL)
+	{
+		alloc_buffer(out);
+	}
+
+	avail = out->cap - out->len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(out->buf + out->len, avail, fmt, ap);
+	va_end(ap);
+
+	if (len < 0)
+	{
+		die("cannot format output");
+	}
+	else if ((size_t)len < avail)
+	{
+		out->len += len;
+		return;
+	}
+
+	/* didn't fit, the partly written tail is dropped */
+	zeromem(out->buf + out->len, avail);
+
+	tmp = xmalloc(len + 1);
+	va_start(ap, fmt);
+	vsnprintf(tmp, len + 1, fmt, ap);
+	va_end(ap);
+
+	output_write(out, tmp, len);
+
+	zeromem(tmp, len);
+	free(tmp);
+}
+
+void output_flush(struct output_sink *out)
+{
+	if (out->len > 0)
+	{
+		flush_with(out, NULL, 0);
+	}
+}
+
+void output_destroy(struct output_sink *out)
+{
+	if (out->buf == NULL)
+	{
+		return;
+	}
+
+	output_flush(out);
+
+	if (out->mapped)
+	{
+		unmap_secure_pages(out->buf, out->cap);
+	}
+	else
+	{
+		free(out->buf);
+	}
+
+	out->buf = NULL;
+	out->cap = 0;
+}
+
+static struct output_sink cmd_output = OUTPUT_SINK_INIT(STDOUT_FILENO);
+
+static bool cmd_output_registered;
+
+static void destroy_command_output(void)
+{
+	output_destroy(&cmd_output);
+	cmd_output_registered = false;
+}
+
+struct output_sink *command_output(void)
+{
+	if (!cmd_output_registered)
+	{
+		atexit_chain_push(destroy_command_output);
+		cmd_output_registered = true;
+	}
+
+	return &cmd_output;
+}
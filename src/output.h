@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+/**
+ * output is gathered in this large a buffer and written when it's
+ * full or at a flush point, instead of one write() per piece
+ */
+#define OUTPUT_BUFSIZE (64 * 1024)
+
+/**
+ * pieces at least this long are not copied, they go out on the same
+ * writev() as whatever is buffered before them
+ */
+#define OUTPUT_DIRECT_MIN (8 * 1024)
+
+/**
+ * the buffer is taken from locked pages when it can be and wiped after
+ * every flush, as what goes through it is often a password
+ */
+struct output_sink
+{
+	int fd;
+
+	char *buf;
+	size_t len;
+	size_t cap;
+
+	bool mapped;
+};
+
+#define OUTPUT_SINK_INIT(fd__) { .fd = (fd__) }
+
+void output_write(struct output_sink *out, const void *buf, size_t len);
+
+#define output_puts(out__, str__) output_write(out__, str__, strlen(str__))
+
+void output_putchar(struct output_sink *out, char c);
+
+void output_printf(struct output_sink *out, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/**
+ * write out what's buffered, dies if it can't be written
+ */
+void output_flush(struct output_sink *out);
+
+/**
+ * flush and release the buffer, the sink can be written to again
+ */
+void output_destroy(struct output_sink *out);
+
+/**
+ * stdout sink of the running command, it's flushed and wiped when the
+ * command returns (by the atexit chain, so once per command in a
+ * session), so that a response is written at once; the command should
+ * not print to stdout by stdio meanwhile
+ */
+struct output_sink *command_output(void);
+
+#endif /* OUTPUT_H */
@@ -27,6 +27,7 @@
 
 enum parse_result
 {
+	PARSING_HELPER   = -4,
 	PARSING_COMPLETE = -3,
 	PARSING_HELP     = -2,
 	PARSING_ERROR    = -1, /**
@@ -147,7 +148,7 @@ static enum parse_result get_arg_uint(
 		return error("%s requires a value", optname);
 	}
 
-	if (strtou(arg, res) == 0)
+	if (strtou(arg, res) != 0)
 	{
 		if (errno == ERANGE)
 		{
@@ -175,6 +176,7 @@ static enum parse_result get_arg_routine(
 	bool unset;
 	char optname[64];
 	const char **strval;
+	const char *val;
 
 	unset = category & UNSET_OPTION;
 	if (unset && ctx->optstr)
@@ -240,6 +242,20 @@ static enum parse_result get_arg_routine(
 		}
 		*strval = prefix_filename(ctx->prefix, *strval);
 
+		return 0;
+	case OPTION_STRLIST:
+		if (unset)
+		{
+			strlist_trunc((struct strlist *)opt->value, false);
+			return 0;
+		}
+
+		if ((rescode = get_arg_str(ctx, opt, category, &val)) != 0)
+		{
+			return rescode;
+		}
+		strlist_push((struct strlist *)opt->value, val);
+
 		return 0;
 	default:
 		bug("opt->type shall not be ‘%d’", opt->type);
@@ -525,8 +541,8 @@ static enum parse_result parse_option_next(
 		return PARSING_COMPLETE;
 	}
 
-	/* check non options */
-	if (*argstr != '-')
+	/* check non options, a lone ‘-’ stands for stdin or stdout */
+	if (*argstr != '-' || argstr[1] == 0)
 	{
 		if (ctx->flags & PARSER_ABORT_NON_OPTION)
 		{
@@ -596,6 +612,11 @@ static enum parse_result parse_option_next(
 		return PARSING_HELP;
 	}
 
+	if (!strcmp(argstr + 2, "pk-completion-helper"))
+	{
+		return PARSING_HELPER;
+	}
+
 	/* check long options */
 	rescode = parse_long_option(ctx, argstr + 2, options, &parsed);
 
@@ -687,7 +708,7 @@ static enum parse_result usage_with_options(
 {
 	FILE *stream;
 	const char *next_prefix, *usage_prefix, *or_prefix;
-	struct strlist *sl = STRLIST_INIT_PTR_DUPSTR;
+	struct strlist *sl = STRLIST_INIT_PTR_REGION(command_region());
 	size_t usage_length;
 	bool need_newline;
 	const struct option *iter;
@@ -832,6 +853,28 @@ static enum parse_result usage_with_options(
 	return PARSING_HELP;
 }
 
+/**
+ * print long options one per line, for shell completion
+ */
+static void list_long_options(const struct option *opts)
+{
+	for ( ; opts->type != OPTION_END; opts++)
+	{
+		if (opts->type == OPTION_GROUP ||
+		     opts->flags & (OPTION_HIDDEN | OPTION_NOEMDASH))
+		{
+			continue;
+		}
+
+		printf("--%s\n", opts->name);
+
+		if (opts->flags & OPTION_ALLONEG)
+		{
+			printf("--no-%s\n", opts->name);
+		}
+	}
+}
+
 static void make_cmdmode_list(struct parser_context *ctx, const struct option *iter)
 {
 	struct command_mode *el;
@@ -847,7 +890,8 @@ static void make_cmdmode_list(struct parser_context *ctx, const struct option *i
 
 		while (el && (el = el->next));
 
-		el = xmalloc(sizeof(struct command_mode));
+		el = region_alloc(command_region(),
+				  sizeof(struct command_mode));
 
 		el->valptr = iter->value;
 		el->val = *(int *)iter->value;
@@ -856,19 +900,6 @@ static void make_cmdmode_list(struct parser_context *ctx, const struct option *i
 	}
 }
 
-static void clean_cmdmode_list(struct parser_context *ctx)
-{
-	struct command_mode *prev;
-
-	while (ctx->cmdmode)
-	{
-		prev = ctx->cmdmode;
-		ctx->cmdmode = ctx->cmdmode->next;
-
-		free(prev);
-	}
-}
-
 int parse_options(
 	int argc, const char **argv,
 	const char *prefix,
@@ -897,6 +928,9 @@ int parse_options(
 			goto finish;
 		case PARSING_NON_OPTION:
 			exit(error("unknown argument ‘%s’", *ctx.argv));
+		case PARSING_HELPER:
+			list_long_options(options);
+			exit(0);
 		case PARSING_HELP:
 			usage_with_options(usages, options, false);
 			/* FALLTHRU */
@@ -926,8 +960,6 @@ int parse_options(
 	}
 
 finish:
-	clean_cmdmode_list(&ctx);
-
 	if (ctx.argc)
 	{
 		MOVE_ARRAY(ctx.out + ctx.idx, ctx.argv, ctx.argc);
@@ -34,6 +34,8 @@ enum option_type
 	/* options with arguments */
 	OPTION_STRING,
 	OPTION_FILENAME,
+	/* option may be repeated, each argument is pushed to a strlist */
+	OPTION_STRLIST,
 };
 
 enum option_flag
@@ -127,6 +129,17 @@ enum command_parser_flag
 	.flags = (f),					\
 }
 
+#define OPTION_STRLIST_F(s, l, v, a, h, f)		\
+{							\
+	.type  = OPTION_STRLIST,			\
+	.alias = (s),					\
+	.name  = (l),					\
+	.value = (v),					\
+	.argh  = (a),					\
+	.help  = (h),					\
+	.flags = (f),					\
+}
+
 #define OPTION_INTEGER_F(s, l, v, a, h, d, f)		\
 {							\
 	.type   = OPTION_INTEGER,			\
@@ -204,6 +217,9 @@ enum command_parser_flag
 #define OPTION_PATHNAME(s, l, v, h)\
 	OPTION_FILENAME_F((s), (l), (v), "file", (h), OPTION_REALPATH | OPTION_SHOWARGH)
 
+#define OPTION_STRLIST(s, l, v, a, h)\
+	OPTION_STRLIST_F((s), (l), (v), (a), (h), OPTION_SHOWARGH)
+
 #define OPTION_OPTARG(s, l, v, d, a, h)\
 	OPTION_OPTARG_F((s), (l), (v), (d), (a), (h), OPTION_SHOWARGH)
 
@@ -93,7 +93,7 @@ static bool skip_precheck(int argc, const char *const *argv)
 
 static void precheck_command(enum cmdreq reqs)
 {
-	if (reqs & USE_RECFILE)
+	if (reqs & USE_RECFILE && strcmp(tmp_rec_path, PK_TMP_REC_MEMORY))
 	{
 		avail_file_dir_or_die(tmp_rec_path);
 	}
@@ -123,10 +123,33 @@ static int parse_main_option(int argc, const char **argv, const char *prefix)
 		OPTION_COMMAND("update",  "Update a record"),
 		OPTION_COMMAND("delete",  "Delete a record"),
 		OPTION_COMMAND("count",   "Count the number of records"),
+		OPTION_COMMAND("export",  "Write all records as tab-separated "
+					  "values"),
+		OPTION_COMMAND("tag",     "Tag records or list tags"),
+		OPTION_COMMAND("history", "List prior versions of a record"),
+		OPTION_COMMAND("restore", "Bring a record back to a prior "
+					  "version"),
+		OPTION_COMMAND("audit",   "Find reused, weak and stale "
+					  "passwords"),
+		OPTION_COMMAND("rekey",   "Change the key or cipher config "
+					  "of database"),
+		OPTION_COMMAND("sync",    "Exchange changes with another "
+					  "database"),
+		OPTION_COMMAND("diff",    "Show records that differ from "
+					  "another database"),
+		OPTION_COMMAND("backup",  "Copy database while it's in use"),
+		OPTION_COMMAND("snapshot", "Keep deduplicated snapshots of "
+					   "database"),
+		OPTION_COMMAND("gc",      "Reclaim free pages of database "
+					  "in small slices"),
+		OPTION_COMMAND("session", "Run many commands with the "
+					  "database unlocked once"),
 
 		OPTION_GROUP("utility"),
 		OPTION_COMMAND("makekey", "Generate random bytes using "
 					  "a CSPRNG"),
+		OPTION_COMMAND("breach-index", "Index a Pwned Passwords "
+					       "corpus for pk audit"),
 
 		OPTION_GROUP("helper"),
 		OPTION_COMMAND("help",    "Display help information "
@@ -0,0 +1,334 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "password-strength.h"
+#include "filesys.h"
+#include "security.h"
+#include "algorithm.h"
+
+/**
+ * the most common passwords, sorted, a guesser tries them first
+ */
+static const char *const common_passwords[] = {
+	"111111", "123123", "12345", "123456", "1234567", "12345678",
+	"123456789", "1234567890", "abc123", "admin", "baseball",
+	"dragon", "football", "iloveyou", "letmein", "master", "monkey",
+	"passw0rd", "password", "princess", "qwerty", "shadow",
+	"sunshine", "superman", "trustno1", "welcome",
+};
+
+#define NR_COMMON_PASSWORD \
+	( sizeof(common_passwords) / sizeof(*common_passwords) )
+
+static const char *const keyboard_rows[] = {
+	"1234567890",
+	"qwertyuiop",
+	"asdfghjkl",
+	"zxcvbnm",
+	NULL,
+};
+
+static int compare_word(const char *s1, size_t l1, const char *s2, size_t l2)
+{
+	int rescode;
+
+	if ((rescode = strncasecmp(s1, s2, l1 < l2 ? l1 : l2)) != 0)
+	{
+		return rescode;
+	}
+
+	return (l1 > l2) - (l1 < l2);
+}
+
+static int dict_word_compar(const void *o1, const void *o2)
+{
+	const struct dict_word *w1, *w2;
+
+	w1 = o1;
+	w2 = o2;
+
+	return compare_word(w1->str, w1->len, w2->str, w2->len);
+}
+
+#define dict_word_less(w1, w2)\
+	( compare_word((w1)->str, (w1)->len, (w2)->str, (w2)->len) < 0 )
+
+DEFINE_PARALLEL_MERGE_SORT(sort_dict_words, struct dict_word, dict_word_less)
+
+int load_dictionary(struct dictionary *dict, const char *pathname)
+{
+	const char *map, *line, *eol, *end;
+	size_t cap;
+
+	if ((dict->map = map_file(pathname, &dict->map_len)) == NULL)
+	{
+		return -1;
+	}
+
+	map = dict->map;
+	cap = 0;
+	for (line = map; line < map + dict->map_len; line = eol + 1)
+	{
+		if ((eol = memchr(line, '\n',
+				  map + dict->map_len - line)) == NULL)
+		{
+			eol = map + dict->map_len;
+		}
+
+		for (end = eol; end > line && isspace(end[-1]); end--);
+
+		if (end == line)
+		{
+			continue;
+		}
+
+		CAPACITY_GROW(dict->words, dict->nr + 1, cap);
+		dict->words[dict->nr++] = (struct dict_word){
+			.str = line,
+			.len = end - line,
+		};
+	}
+
+	sort_dict_words(dict->words, dict->nr, 0);
+
+	return 0;
+}
+
+void free_dictionary(struct dictionary *dict)
+{
+	free(dict->words);
+
+	if (dict->map != NULL)
+	{
+		unmap_file(dict->map, dict->map_len);
+	}
+}
+
+static bool is_common_password(const char *str, size_t len)
+{
+	size_t lo, hi, mid;
+	int rescode;
+
+	lo = 0;
+	hi = NR_COMMON_PASSWORD;
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		rescode = compare_word(str, len, common_passwords[mid],
+					strlen(common_passwords[mid]));
+
+		if (rescode == 0)
+		{
+			return true;
+		}
+		else if (rescode < 0)
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
+
+	return false;
+}
+
+static bool is_dict_word(const struct dictionary *dict,
+			 const char *str, size_t len)
+{
+	struct dict_word key = {
+		.str = str,
+		.len = len,
+	};
+
+	if (is_common_password(str, len))
+	{
+		return true;
+	}
+
+	return dict != NULL && bsearch(&key, dict->words, dict->nr,
+				sizeof(*dict->words), dict_word_compar);
+}
+
+static bool is_keyboard_adjacent(char c1, char c2)
+{
+	const char *const *row;
+	const char *p1, *p2;
+
+	c1 = tolower(c1);
+	c2 = tolower(c2);
+
+	for (row = keyboard_rows; *row != NULL; row++)
+	{
+		if ((p1 = strchr(*row, c1)) != NULL &&
+		     (p2 = strchr(*row, c2)) != NULL &&
+		      (p1 - p2 == 1 || p2 - p1 == 1))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * a character repeating, continuing a sequence or walking along
+ * a keyboard row from the previous one is nearly free to guess
+ */
+static bool is_predictable(const char *pw, size_t i)
+{
+	char prev, c;
+
+	if (i == 0)
+	{
+		return false;
+	}
+
+	prev = pw[i - 1];
+	c = pw[i];
+
+	return c == prev || c == prev + 1 || c == prev - 1 ||
+		is_keyboard_adjacent(prev, c);
+}
+
+static double charset_bits(const char *pw, size_t len)
+{
+	bool lower, upper, digit, other;
+	unsigned pool;
+	size_t i;
+
+	lower = upper = digit = other = false;
+	for (i = 0; i < len; i++)
+	{
+		if (islower(pw[i]))
+		{
+			lower = true;
+		}
+		else if (isupper(pw[i]))
+		{
+			upper = true;
+		}
+		else if (isdigit(pw[i]))
+		{
+			digit = true;
+		}
+		else
+		{
+			other = true;
+		}
+	}
+
+	pool = lower * 26 + upper * 26 + digit * 10 + other * 33;
+
+	return pool > 1 ? log2(pool) : 1;
+}
+
+static double pattern_bits(const char *pw, size_t len, double per_char)
+{
+	double bits;
+	size_t i;
+
+	bits = 0;
+	for (i = 0; i < len; i++)
+	{
+		bits += is_predictable(pw, i) ? 1 : per_char;
+	}
+
+	return bits;
+}
+
+/**
+ * undo common substitutions, so ‘P@ssw0rd’ is found as ‘password’
+ */
+static char unleet(char c)
+{
+	switch (c)
+	{
+	case '0':
+		return 'o';
+	case '1':
+	case '!':
+		return 'i';
+	case '3':
+		return 'e';
+	case '4':
+	case '@':
+		return 'a';
+	case '5':
+	case '$':
+		return 's';
+	case '7':
+		return 't';
+	default:
+		return tolower(c);
+	}
+}
+
+unsigned estimate_strength(const char *pw, size_t len,
+			   const struct dictionary *dict)
+{
+	double per_char, bits, word_bits, nr_words;
+	size_t base_len;
+	char *base;
+
+	if (len == 0)
+	{
+		return 0;
+	}
+
+	per_char = charset_bits(pw, len);
+	bits = pattern_bits(pw, len, per_char);
+
+	/**
+	 * a word followed by digits or symbols, costs guessing the
+	 * word (and its capitalization) plus the suffix
+	 */
+	for (base_len = len; base_len > 0 &&
+	      !isalpha(pw[base_len - 1]); base_len--);
+
+	if (base_len < 3)
+	{
+		return bits;
+	}
+
+	base = xmemdup(pw, base_len);
+	for (size_t i = 0; i < base_len; i++)
+	{
+		base[i] = unleet(base[i]);
+	}
+
+	if (is_dict_word(dict, pw, base_len) ||
+	     is_dict_word(dict, base, base_len))
+	{
+		nr_words = NR_COMMON_PASSWORD + (dict ? dict->nr : 0);
+		word_bits = log2(nr_words) + 1 +
+			pattern_bits(pw + base_len, len - base_len, per_char);
+
+		bits = word_bits < bits ? word_bits : bits;
+	}
+
+	zeromem(base, base_len);
+	free(base);
+
+	return bits;
+}
@@ -0,0 +1,62 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef PASSWORD_STRENGTH_H
+#define PASSWORD_STRENGTH_H
+
+struct dict_word
+{
+	const char *str;
+	size_t len;
+};
+
+/**
+ * words that passwords are commonly made of, they are compared
+ * case-insensitively
+ */
+struct dictionary
+{
+	struct dict_word *words;
+	size_t nr;
+
+	void *map;
+	size_t map_len;
+};
+
+#define DICTIONARY_INIT { 0 }
+
+/**
+ * load a word list at ‘pathname’, one word per line, the file is
+ * mapped rather than copied, an error message is printed on failure
+ */
+int load_dictionary(struct dictionary *dict, const char *pathname);
+
+void free_dictionary(struct dictionary *dict);
+
+/**
+ * estimate how many bits of entropy ‘pw’ has against a guesser that
+ * knows common passwords, words in ‘dict’ (which can be NULL), runs,
+ * sequences and keyboard walks
+ */
+unsigned estimate_strength(const char *pw, size_t len, const struct dictionary *dict);
+
+#endif /* PASSWORD_STRENGTH_H */
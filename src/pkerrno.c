@@ -32,7 +32,7 @@ static void strcpy_errmsg(char *buf, const char *msg)
 {
 	size_t len;
 
-	if ((len = strlen(msg) >= EBUF_SIZE))
+	if ((len = strlen(msg)) >= EBUF_SIZE)
 	{
 		bug("error message length(‘%"PRIuMAX"’) is more than %d "
 			"characters", len, EBUF_SIZE);
@@ -43,7 +43,7 @@ static void strcpy_errmsg(char *buf, const char *msg)
 
 char *pk_strerror(int errnum)
 {
-	static char buf[EBUF_SIZE];
+	static _Thread_local char buf[EBUF_SIZE];
 
 	if (errnum >= 0)
 	{
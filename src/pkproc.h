@@ -74,8 +74,52 @@ int finish_process(struct process_info *ctx, bool raised);
 
 int edit_file(const char *pathname);
 
+/**
+ * wait for the process to terminate, a spinner of ‘spinner_style’
+ * is drawn meanwhile unless it's NULL
+ */
+int wait_process(struct process_info *ctx, const char *spinner_style);
+
 #define DEFAULT_SPINNER_PERIOD 1000 * 10 /* in 10 milliseconds */
 
-int run_spinner(struct process_info *ctx, const char *style);
+struct spinner_frame
+{
+	const char *str;
+
+	/* how many periods this frame stays */
+	unsigned ticks;
+};
+
+struct spinner_style
+{
+	const char *name;
+	useconds_t period;
+
+	/* terminated by a frame with NULL str */
+	const struct spinner_frame *frames;
+
+	/* index of frame to restart from after the last one */
+	size_t loop;
+};
+
+struct spinner
+{
+	const struct spinner_style *style;
+	size_t next;
+};
+
+const struct spinner_style *find_spinner_style(const char *name);
+
+/**
+ * draw next frame of ‘sp’, and return the time in microseconds
+ * before the next frame is due
+ */
+useconds_t spin_once(struct spinner *sp);
+
+/**
+ * draw spinner of ‘style’ (a struct spinner_style) forever, this is a
+ * procfn_t for platforms without an event loop in wait_process()
+ */
+int run_spinner(const void *style);
 
 #endif /* PKPROC_H */
@@ -0,0 +1,164 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "region.h"
+#include "atexit-chain.h"
+#include "security.h"
+
+#define REGION_CHUNK_MIN (16 * 1024)
+#define REGION_CHUNK_MAX (1024 * 1024)
+#define REGION_ALIGN     sizeof(void *)
+
+struct region_chunk
+{
+	struct region_chunk *prev;
+	size_t used;
+	size_t cap;
+
+	uint8_t data[FLEX_ARRAY];
+};
+
+/**
+ * the mapping is rounded up to whole pages, and the slack is made
+ * part of the chunk
+ */
+static struct region_chunk *push_secure_chunk(size_t cap)
+{
+	struct region_chunk *chunk;
+	size_t page, map_len;
+
+	page = secure_page_size();
+	map_len = st_add(sizeof(*chunk), cap);
+	map_len = st_add(map_len, page - 1) / page * page;
+
+	if ((chunk = map_secure_pages(map_len)) == NULL)
+	{
+		die_errno("Unable to map pages for secrets");
+	}
+
+	chunk->cap = map_len - sizeof(*chunk);
+
+	return chunk;
+}
+
+static struct region_chunk *push_chunk(struct region *rg, size_t size)
+{
+	struct region_chunk *chunk;
+	size_t cap;
+
+	/**
+	 * chunks double as the region grows so that a large region is
+	 * still a handful of mallocs, oversized requests get a chunk
+	 * of their own
+	 */
+	cap = rg->top ? rg->top->cap * 2 : REGION_CHUNK_MIN;
+	cap = cap > REGION_CHUNK_MAX ? REGION_CHUNK_MAX : cap;
+	cap = cap < size ? size : cap;
+
+	if (rg->secure)
+	{
+		chunk = push_secure_chunk(cap);
+	}
+	else
+	{
+		chunk = xmalloc(st_add(sizeof(*chunk), cap));
+		chunk->cap = cap;
+	}
+
+	chunk->prev = rg->top;
+	chunk->used = 0;
+
+	rg->top = chunk;
+
+	return chunk;
+}
+
+void *region_alloc(struct region *rg, size_t size)
+{
+	struct region_chunk *chunk;
+	void *ptr;
+
+	size = st_add(size, REGION_ALIGN - 1) & ~(REGION_ALIGN - 1);
+
+	if ((chunk = rg->top) == NULL || chunk->cap - chunk->used < size)
+	{
+		chunk = push_chunk(rg, size);
+	}
+
+	ptr = chunk->data + chunk->used;
+	chunk->used += size;
+
+	return ptr;
+}
+
+char *region_memdup(struct region *rg, const void *ptr, size_t size)
+{
+	char *buf;
+
+	buf = region_alloc(rg, st_add(size, 1));
+	memcpy(buf, ptr, size);
+	buf[size] = 0;
+
+	return buf;
+}
+
+void region_destroy(struct region *rg)
+{
+	struct region_chunk *chunk;
+
+	while ((chunk = rg->top) != NULL)
+	{
+		rg->top = chunk->prev;
+
+		if (rg->secure)
+		{
+			zeromem(chunk->data, chunk->used);
+			unmap_secure_pages(chunk,
+					   sizeof(*chunk) + chunk->cap);
+		}
+		else
+		{
+			free(chunk);
+		}
+	}
+}
+
+static struct region cmd_region;
+
+static bool cmd_region_registered;
+
+static void destroy_command_region(void)
+{
+	region_destroy(&cmd_region);
+	cmd_region_registered = false;
+}
+
+struct region *command_region(void)
+{
+	if (!cmd_region_registered)
+	{
+		atexit_chain_push(destroy_command_region);
+		cmd_region_registered = true;
+	}
+
+	return &cmd_region;
+}
@@ -0,0 +1,66 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef REGION_H
+#define REGION_H
+
+struct region_chunk;
+
+/**
+ * a region hands out memory by bumping a pointer, nothing is freed
+ * until the whole region is destroyed at once; made for temporaries
+ * that all die together
+ */
+struct region
+{
+	struct region_chunk *top;
+
+	/**
+	 * chunks are locked pages kept out of core dumps, the same as
+	 * those of the secure arena, and are wiped on destroy; unlike
+	 * the secure arena, such a region belongs to whoever declared
+	 * it, so each thread can keep its secrets in a region of its own
+	 */
+	bool secure;
+};
+
+#define REGION_INIT { 0 }
+#define REGION_INIT_SECURE { .secure = true }
+
+void *region_alloc(struct region *rg, size_t size);
+
+/**
+ * copy ‘size’ bytes at ‘ptr’ to ‘rg’, a NUL is appended
+ */
+char *region_memdup(struct region *rg, const void *ptr, size_t size);
+
+#define region_strdup(rg__, str__) region_memdup(rg__, str__, strlen(str__))
+
+void region_destroy(struct region *rg);
+
+/**
+ * region of the running command, it's destroyed when the command
+ * returns (by the atexit chain, so once per command in a session)
+ */
+struct region *command_region(void);
+
+#endif /* REGION_H */
@@ -21,6 +21,9 @@
 ****************************************************************************/
 
 #include "security.h"
+#include "atexit-chain.h"
+#include "hex.h"
+#include <openssl/hmac.h>
 
 #define BLOBKEY_LEN 67
 #define KEYSALT_LEN 32
@@ -46,92 +49,194 @@ int random_bytes_routine(uint8_t **buf, size_t len, bool alloc_mem)
 	return 0;
 }
 
-/**
- * convert a hex char to decimal integer
- */
-#define hexchar2decint(c__)				\
-	(						\
-	  isupper(c__) ? ( (c__) - 'A' + 10 ) :		\
-	   islower(c__) ? ( (c__) - 'a' + 10 ) :	\
-	    ( (c__) - '0' )				\
-	)
-
-/**
- * opposite of hexchar2decint()
- */
-#define decint2hexchar(n__)\
-	( (n__) < 10 ? ( (n__) + '0' ) : ( (n__) - 10 + 'A' ) )
+void refill_random_pool(struct random_pool *pool)
+{
+	uint8_t *buf;
 
-size_t hex2bin(uint8_t **out, char *hex0, size_t hex_len)
+	buf = pool->buf;
+	EOE(random_bytes_buffered(&buf, RANDOM_POOL_SIZE));
+
+	pool->pos = 0;
+}
+
+void clean_random_pool(struct random_pool *pool)
 {
-	uint8_t *bin0, *bin_iter, *bin9;
-	size_t bin_len;
+	zeromem(pool->buf, RANDOM_POOL_SIZE);
+	pool->pos = RANDOM_POOL_SIZE;
+}
+
+#define SECURE_BLOCK_SIZE (64 * 1024)
+#define SECURE_ALIGN 16
+
+struct secure_block
+{
+	struct secure_block *prev;
+	size_t map_len;
+
+	/**
+	 * offset of data[0] in the arena as a whole, marks are
+	 * expressed in such offsets
+	 */
+	size_t base;
+	size_t used;
+	size_t cap;
+
+	uint8_t data[];
+};
 
-	bin_len = hex_len / 2;
+static struct secure_block *secure_top;
 
-	bin0 = (uint8_t *)hex0;
-	bin9 = bin0 + bin_len;
+static bool secure_registered;
 
-	bin_iter = bin0;
+static void wipe_secure_arena(void)
+{
+	secure_release(0);
+}
+
+static struct secure_block *push_secure_block(size_t size)
+{
+	struct secure_block *block;
+	size_t page, map_len;
+
+	page = secure_page_size();
+	map_len = sizeof(*block) + size;
+	map_len = map_len < SECURE_BLOCK_SIZE ? SECURE_BLOCK_SIZE :
+			(map_len + page - 1) / page * page;
 
-	while (bin_iter < bin9)
+	if ((block = map_secure_pages(map_len)) == NULL)
 	{
-		*bin_iter = (hexchar2decint(hex0[0]) << 4) |
-				hexchar2decint(hex0[1]);
+		die_errno("Unable to map pages for secrets");
+	}
 
-		bin_iter++;
-		hex0 += 2;
+	block->prev = secure_top;
+	block->map_len = map_len;
+	block->base = secure_top ? secure_top->base + secure_top->cap : 0;
+	block->used = 0;
+	block->cap = map_len - sizeof(*block);
+
+	secure_top = block;
+
+	if (!secure_registered)
+	{
+		atexit_chain_push(wipe_secure_arena);
+		secure_registered = true;
 	}
 
-	*out = bin0;
-	return bin_len;
+	return block;
 }
 
-size_t bin2hex(char **out, uint8_t *bin0, size_t bin_len)
+void *secure_alloc(size_t size)
 {
-	char *hex_iter, *hex0;
-	uint8_t *bin_iter;
-	size_t hex_len;
+	struct secure_block *block;
+	size_t pos;
 
-	hex_len = bin_len * 2;
+	size = (size + SECURE_ALIGN - 1) & ~(size_t)(SECURE_ALIGN - 1);
+
+	if ((block = secure_top) == NULL || block->cap - block->used < size)
+	{
+		block = push_secure_block(size);
+	}
+
+	pos = block->used;
+	block->used += size;
+
+	return block->data + pos;
+}
+
+char *secure_memdup(const void *ptr, size_t size)
+{
+	char *buf;
+
+	buf = secure_alloc(size + 1);
+	memcpy(buf, ptr, size);
+	buf[size] = 0;
+
+	return buf;
+}
+
+void secure_trim(void *last, size_t size)
+{
+	struct secure_block *block;
+	size_t pos;
+
+	if ((block = secure_top) == NULL ||
+	     (uint8_t *)last < block->data ||
+	      (pos = (uint8_t *)last - block->data) + size > block->used)
+	{
+		bug("‘%p’ is not the last secure allocation", last);
+	}
+
+	size = (size + SECURE_ALIGN - 1) & ~(size_t)(SECURE_ALIGN - 1);
+
+	zeromem(block->data + pos + size, block->used - pos - size);
+	block->used = pos + size;
+}
+
+size_t secure_mark(void)
+{
+	return secure_top ? secure_top->base + secure_top->used : 0;
+}
+
+void secure_release(size_t mark)
+{
+	struct secure_block *block;
 
-	bin0 = xrealloc(bin0, hex_len + 1);
-	bin_iter = bin0 + bin_len - 1;
+	while ((block = secure_top) != NULL && block->base >= mark)
+	{
+		secure_top = block->prev;
 
-	hex0 = (char *)bin0;
-	hex_iter = hex0 + hex_len - 1;
+		zeromem(block->data, block->used);
+		unmap_secure_pages(block, block->map_len);
+	}
 
-	while (bin_iter >= bin0)
+	if (block == NULL)
 	{
-		*(hex_iter - 0) = decint2hexchar(*bin_iter & 0x0F);
-		*(hex_iter - 1) = decint2hexchar(*bin_iter >> 4);
+		secure_registered = false;
+		return;
+	}
 
-		bin_iter--;
-		hex_iter -= 2;
+	if (mark < block->base + block->used)
+	{
+		zeromem(block->data + (mark - block->base),
+			block->base + block->used - mark);
+		block->used = mark - block->base;
 	}
+}
+
+size_t hex2bin(uint8_t **out, char *hex0, size_t hex_len)
+{
+	hex_decode((uint8_t *)hex0, hex0, hex_len);
+
+	*out = (uint8_t *)hex0;
+	return hex_len / 2;
+}
 
+size_t bin2hex(char **out, uint8_t *bin0, size_t bin_len)
+{
+	char *hex0;
+	size_t hex_len;
+
+	hex_len = bin_len * 2;
+
+	hex0 = xrealloc(bin0, hex_len + 1);
+	hex_encode(hex0, (uint8_t *)hex0, bin_len);
 	hex0[hex_len] = 0;
 
 	*out = hex0;
 	return hex_len;
 }
 
-size_t bin2blob(char **out, uint8_t *bin, size_t bin_len)
+size_t bin2blob_secure(char **out, const uint8_t *bin, size_t bin_len)
 {
-	char *hex, *blob;
-	size_t hex_len, blob_len;
+	size_t blob_len;
+	char *blob;
 
-	hex_len = bin2hex(&hex, bin, bin_len);
-
-	blob_len = hex_len + 3;
-	blob = xmalloc(blob_len + 1);
+	blob_len = bin_len * 2 + 3;
+	blob = secure_alloc(blob_len + 1);
 
 	blob[0] = 'x';
 	blob[1] = '\'';
-
-	memcpy(blob + 2, hex, hex_len);
-	free(hex);
-
+	hex_encode(blob + 2, bin, bin_len);
 	blob[blob_len - 1] = '\'';
 	blob[blob_len] = 0;
 
@@ -139,50 +244,33 @@ size_t bin2blob(char **out, uint8_t *bin, size_t bin_len)
 	return blob_len;
 }
 
-size_t blob2bin(uint8_t **out, char *blob, size_t blob_len)
+size_t bin2blob(char **out, uint8_t *bin, size_t bin_len)
 {
-	uint8_t *bin;
-	size_t bin_len;
-
-	bin_len = hex2bin(&bin, blob + 2, blob_len - 3);
-	memmove(blob, bin, bin_len);
+	size_t blob_len;
+	char *blob;
 
-	*out = (uint8_t *)blob;
-	return bin_len;
-}
+	blob_len = bin_len * 2 + 3;
+	blob = xmalloc(blob_len + 1);
 
-static bool is_hexstr(const char *str, size_t len)
-{
-	while (len > 0)
-	{
-		if (!in_range_i(*str, 'A', 'F') &&
-		     !in_range_i(*str, 'a', 'f') &&
-		      !isdigit(*str))
-		{
-			return false;
-		}
+	blob[0] = 'x';
+	blob[1] = '\'';
+	hex_encode(blob + 2, bin, bin_len);
+	blob[blob_len - 1] = '\'';
+	blob[blob_len] = 0;
 
-		str++;
-		len--;
-	}
+	free(bin);
 
-	return true;
+	*out = blob;
+	return blob_len;
 }
 
-static bool is_saltstr(const char *str, size_t len)
+size_t blob2bin(uint8_t **out, char *blob, size_t blob_len)
 {
-	while (len > 0)
-	{
-		if (*str != '0' && *str != '1')
-		{
-			return false;
-		}
+	/* decoded bytes land right at the head, no copy needed */
+	hex_decode((uint8_t *)blob, blob + 2, blob_len - 3);
 
-		str++;
-		len--;
-	}
-
-	return true;
+	*out = (uint8_t *)blob;
+	return (blob_len - 3) / 2;
 }
 
 bool is_blob_key(const char *key, size_t len)
@@ -197,14 +285,14 @@ bool is_blob_key(const char *key, size_t len)
 		return false;
 	}
 
-	if (!is_hexstr(key + 2, HEXKEY_LEN))
+	if (!is_hex_string(key + 2, HEXKEY_LEN))
 	{
 		return false;
 	}
 
 	if (len == BLOBKEY_LEN + KEYSALT_LEN)
 	{
-		if (!is_saltstr(key + 2 + HEXKEY_LEN, KEYSALT_LEN))
+		if (!is_bit_string(key + 2 + HEXKEY_LEN, KEYSALT_LEN))
 		{
 			return false;
 		}
@@ -267,6 +355,109 @@ int verify_digest_sha256(
 	return rescode;
 }
 
+uint8_t *hmac_message_sha256(const uint8_t *key, size_t key_length,
+			     const uint8_t *message, size_t message_length)
+{
+	uint8_t *out;
+
+	if ((out = OPENSSL_malloc(EVP_MD_size(EVP_sha256()))) == NULL ||
+	     HMAC(EVP_sha256(), key, key_length, message,
+		  message_length, out, NULL) == NULL)
+	{
+		die_openssl("An error occured while getting message hmac");
+	}
+
+	return out;
+}
+
+int verify_hmac_sha256(const uint8_t *key, size_t key_length,
+		       const uint8_t *message, size_t message_length,
+		       const uint8_t *prev_hmac)
+{
+	int rescode;
+	uint8_t *next_hmac;
+
+	next_hmac = hmac_message_sha256(key, key_length,
+					message, message_length);
+	rescode = CRYPTO_memcmp(next_hmac, prev_hmac,
+				EVP_MD_size(EVP_sha256()));
+
+	clean_digest(next_hmac);
+
+	return rescode;
+}
+
+static EVP_CIPHER_CTX *init_gcm(const uint8_t *key, const uint8_t *nonce,
+				const uint8_t *aad, size_t aad_length,
+				int encrypt)
+{
+	EVP_CIPHER_CTX *ctx;
+	int len;
+
+	if ((ctx = EVP_CIPHER_CTX_new()) == NULL ||
+	     EVP_CipherInit_ex(ctx, EVP_aes_256_gcm(), NULL,
+			       NULL, NULL, encrypt) != 1 ||
+	     EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN,
+				 SEAL_NONCE_LEN, NULL) != 1 ||
+	     EVP_CipherInit_ex(ctx, NULL, NULL, key, nonce, encrypt) != 1 ||
+	     EVP_CipherUpdate(ctx, NULL, &len, aad, aad_length) != 1)
+	{
+		die_openssl("An error occured while setting up AES-GCM");
+	}
+
+	return ctx;
+}
+
+void seal_message(const uint8_t *key, const uint8_t *nonce,
+		  const uint8_t *aad, size_t aad_length,
+		  const uint8_t *in, size_t length,
+		  uint8_t *out, uint8_t *tag)
+{
+	EVP_CIPHER_CTX *ctx;
+	int len;
+
+	ctx = init_gcm(key, nonce, aad, aad_length, 1);
+
+	if (EVP_EncryptUpdate(ctx, out, &len, in, length) != 1 ||
+	     EVP_EncryptFinal_ex(ctx, out + len, &len) != 1 ||
+	     EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG,
+				 SEAL_TAG_LEN, tag) != 1)
+	{
+		die_openssl("An error occured while sealing message");
+	}
+
+	EVP_CIPHER_CTX_free(ctx);
+}
+
+int open_message(const uint8_t *key, const uint8_t *nonce,
+		 const uint8_t *aad, size_t aad_length,
+		 const uint8_t *in, size_t length,
+		 uint8_t *out, const uint8_t *tag)
+{
+	EVP_CIPHER_CTX *ctx;
+	int len, rescode;
+
+	ctx = init_gcm(key, nonce, aad, aad_length, 0);
+
+	if (EVP_DecryptUpdate(ctx, out, &len, in, length) != 1 ||
+	     EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG,
+				 SEAL_TAG_LEN, (void *)tag) != 1)
+	{
+		die_openssl("An error occured while opening message");
+	}
+
+	rescode = 0;
+	if (EVP_DecryptFinal_ex(ctx, out + len, &len) != 1)
+	{
+		zeromem(out, length);
+		rescode = -1;
+	}
+
+	EVP_CIPHER_CTX_free(ctx);
+
+	return rescode;
+}
+
 size_t read_cmdkey(char **key0, const char *message)
 {
 	struct termios term;
@@ -279,42 +470,43 @@ size_t read_cmdkey(char **key0, const char *message)
 	}
 
 	char *key;
-	ssize_t len;
-	size_t cap;
+	size_t len;
 
-	key = NULL;
-	cap = 0;
+	/**
+	 * read straight into the arena, the key never touches stdio
+	 * buffers owned by us or the heap
+	 */
+	key = secure_alloc(CMDKEY_MAX + 2);
 
 	errno = 0;
 retry:
 	im_print(message);
-	if ((len = getline(&key, &cap, stdin)) == -1)
+	if (fgets(key, CMDKEY_MAX + 2, stdin) == NULL)
 	{
-		if (errno != 0)
+		if (ferror(stdin))
 		{
 			die_errno("An error occurred while getting input");
 		}
 
 		len = 0;
 	}
-	else if (len == 1 && *key == '\n')
+	else if (*key == '\n')
 	{
 		im_fputs("\nEmpty keys are not allowed, try again.\n", stderr);
-		free(key);
-
-		key = NULL;
-		len = 0;
-
 		goto retry;
 	}
 	else
 	{
-		while (key[len - 1] == '\n')
+		len = strlen(key);
+		if (key[len - 1] != '\n' && len > CMDKEY_MAX)
 		{
-			key[--len] = 0;
+			die("Keys are limited to %d bytes.", CMDKEY_MAX);
 		}
 
-		*key0 = key;
+		while (len > 0 && key[len - 1] == '\n')
+		{
+			key[--len] = 0;
+		}
 	}
 
 	if (!no_setattr)
@@ -322,5 +514,58 @@ retry:
 		termios_restore_config(&term);
 	}
 
+	secure_trim(key, len + 1);
+
+	*key0 = key;
 	return len;
 }
+
+size_t request_cmdkey(char **key)
+{
+	char  *cmdkey_buf1, *cmdkey_buf2;
+	size_t cmdkey_len1,  cmdkey_len2;
+	unsigned retry_count;
+	size_t mark;
+
+	retry_count = 0;
+	mark = secure_mark();
+retry:
+	if ((cmdkey_len1 =
+		read_cmdkey(&cmdkey_buf1, "[pk] key for encryption: ")) == 0)
+	{
+		im_putchar('\n');
+		error("No key was provided.");
+
+		if (retry_count > 0)
+		{
+			note("%u key entry attempt%s made.",
+				retry_count, retry_count > 1 ? "s" : "");
+		}
+		else
+		{
+			note("A key is required.");
+		}
+
+		exit(EXIT_FAILURE);
+	}
+
+	cmdkey_len2 = read_cmdkey(&cmdkey_buf2, "\n[pk] confirm key: ");
+	im_putchar('\n');
+
+	if (cmdkey_len1 != cmdkey_len2 || strcmp(cmdkey_buf1, cmdkey_buf2))
+	{
+		secure_release(mark);
+
+		im_fputs("Password does not match previous, "
+			  "try again.\n", stderr);
+
+		clearerr(stdin);
+		retry_count++;
+		goto retry;
+	}
+
+	secure_trim(cmdkey_buf2, 0);
+
+	*key = cmdkey_buf1;
+	return cmdkey_len1;
+}
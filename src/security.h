@@ -31,6 +31,53 @@ int random_bytes_routine(uint8_t **buf, size_t len, bool alloc_mem);
 #define random_bytes(buf__, len__) random_bytes_routine(buf__, len__, true)
 #define random_bytes_buffered(buf__, len__) random_bytes_routine(buf__, len__, false)
 
+#define RANDOM_POOL_SIZE 4096
+
+/**
+ * random bytes drawn from the CSPRNG a block at a time, so that
+ * consumers of a few bytes each do not pay one RAND_bytes() call
+ * per consumption
+ */
+struct random_pool
+{
+	uint8_t buf[RANDOM_POOL_SIZE];
+	size_t pos;
+};
+
+#define RANDOM_POOL_INIT { .pos = RANDOM_POOL_SIZE }
+
+void refill_random_pool(struct random_pool *pool);
+
+/**
+ * wipe the bytes that are not consumed yet
+ */
+void clean_random_pool(struct random_pool *pool);
+
+static inline FORCEINLINE uint8_t random_pool_byte(struct random_pool *pool)
+{
+	if (pool->pos == RANDOM_POOL_SIZE)
+	{
+		refill_random_pool(pool);
+	}
+
+	return pool->buf[pool->pos++];
+}
+
+static inline FORCEINLINE uint32_t random_pool_u32(struct random_pool *pool)
+{
+	uint32_t val;
+
+	if (pool->pos > RANDOM_POOL_SIZE - sizeof(val))
+	{
+		refill_random_pool(pool);
+	}
+
+	memcpy(&val, pool->buf + pool->pos, sizeof(val));
+	pool->pos += sizeof(val);
+
+	return val;
+}
+
 /**
  * convert at most hex_len characters of the hex0 string to binary data, 
  * hex_len must be a multiple of 2, this operation is in-place and hex0
@@ -52,6 +99,12 @@ size_t bin2hex(char **out, uint8_t *bin0, size_t bin_len);
  */
 size_t bin2blob(char **out, uint8_t *bin_key, size_t bin_len);
 
+/**
+ * same as bin2blob() except the blob string is put in the secure arena
+ * and ‘bin_key’ is left untouched
+ */
+size_t bin2blob_secure(char **out, const uint8_t *bin_key, size_t bin_len);
+
 /**
  * same as the hex2bin except it convert blob string (hex key is wrapped
  * by x'') to binary data
@@ -66,10 +119,91 @@ uint8_t *digest_message_sha256(const uint8_t *message, size_t message_length);
 
 int verify_digest_sha256(const uint8_t *message, size_t message_length, const uint8_t *prev_digest);
 
+/**
+ * same as digest_message_sha256() except the digest is keyed by ‘key’,
+ * free the result with clean_digest()
+ */
+uint8_t *hmac_message_sha256(const uint8_t *key, size_t key_length, const uint8_t *message, size_t message_length);
+
+/**
+ * compare in constant time
+ */
+int verify_hmac_sha256(const uint8_t *key, size_t key_length, const uint8_t *message, size_t message_length, const uint8_t *prev_hmac);
+
+#define SEAL_NONCE_LEN 12
+#define SEAL_TAG_LEN   16
+
+/**
+ * encrypt ‘length’ bytes at ‘in’ to ‘out’ with AES-256-GCM under the
+ * BINKEY_LEN bytes ‘key’, ‘aad’ is authenticated but left in clear;
+ * a nonce must never be used twice with the same key
+ */
+void seal_message(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aad_length, const uint8_t *in, size_t length, uint8_t *out, uint8_t *tag);
+
+/**
+ * reverse of seal_message(), returns -1 if ‘tag’ doesn't match, in
+ * which case ‘out’ is wiped
+ */
+int open_message(const uint8_t *key, const uint8_t *nonce, const uint8_t *aad, size_t aad_length, const uint8_t *in, size_t length, uint8_t *out, const uint8_t *tag);
+
+/**
+ * keys and decrypted secrets are carved out of locked pages that are
+ * kept out of core dumps and fenced by guard pages; allocations bump
+ * a pointer and can't be freed one by one, instead secure_release()
+ * wipes everything allocated after a mark in one pass
+ *
+ * the arena is wiped when the process exits (or, in a session, when
+ * a command returns), it's not thread-safe, threads keep their
+ * secrets in a secure region (see region.h) instead
+ */
+void *secure_alloc(size_t size);
+
+/**
+ * copy ‘size’ bytes at ‘ptr’ to the arena, a NUL is appended
+ */
+char *secure_memdup(const void *ptr, size_t size);
+
+#define secure_strdup(str__) secure_memdup(str__, strlen(str__))
+
+/**
+ * shrink the most recent allocation ‘last’ to ‘size’ bytes, the
+ * bytes given back are wiped
+ */
+void secure_trim(void *last, size_t size);
+
+size_t secure_mark(void);
+
+void secure_release(size_t mark);
+
+/**
+ * platform part of the arena, map ‘len’ bytes (a multiple of
+ * secure_page_size()) locked if possible and with a guard page
+ * on each side
+ */
+void *map_secure_pages(size_t len);
+
+void unmap_secure_pages(void *addr, size_t len);
+
+size_t secure_page_size(void);
+
 int termios_disable_echo(struct termios *term0);
 
 int termios_restore_config(struct termios *term0);
 
+/**
+ * longest key read from the command line
+ */
+#define CMDKEY_MAX 4096
+
+/**
+ * the key read is put in the secure arena
+ */
 size_t read_cmdkey(char **key0, const char *message);
 
+/**
+ * read a key from the command line twice and make sure they
+ * are matched, exit if no key was provided
+ */
+size_t request_cmdkey(char **key);
+
 #endif /* SECURITY_H */
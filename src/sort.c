@@ -21,6 +21,7 @@
 ****************************************************************************/
 
 #include "algorithm.h"
+#include "thread-pool.h"
 
 static void merge_sort_next(
 	void *array, size_t nmemb, size_t size,
@@ -85,3 +86,139 @@ void merge_sort(
 	free(buf);
 }
 
+
+/**
+ * one unit of a parallel sort, either sorting a slice in place or
+ * merging a piece of two sorted slices into ‘dst’
+ */
+struct sort_task
+{
+	uint8_t *dst;
+	const uint8_t *a, *b;
+	size_t na, nb;
+};
+
+static void sort_task_fn(void *task0, void *data)
+{
+	const struct sort_kernel *kernel = data;
+	struct sort_task *task = task0;
+
+	if (task->b == NULL)
+	{
+		kernel->sort(task->dst, (void *)task->a, task->na);
+	}
+	else
+	{
+		kernel->merge(task->dst, task->a, task->na,
+			      task->b, task->nb);
+	}
+}
+
+/**
+ * split merging a[0..na) and b[0..nb) into ‘pieces’ tasks of about
+ * equal output, so that the last rounds, when there are fewer pairs
+ * than threads, still keep every thread busy
+ */
+static size_t plan_merge(struct sort_task *task,
+			 const struct sort_kernel *kernel, uint8_t *dst,
+			 const uint8_t *a, size_t na,
+			 const uint8_t *b, size_t nb, size_t pieces)
+{
+	size_t i, k0, k1, i0, i1;
+
+	k0 = i0 = 0;
+	for (i = 0; i < pieces; i++)
+	{
+		k1 = (na + nb) * (i + 1) / pieces;
+		i1 = i + 1 == pieces ? na : kernel->split(a, na, b, nb, k1);
+
+		task[i] = (struct sort_task){
+			.dst = dst + k0 * kernel->size,
+			.a = a + i0 * kernel->size,
+			.na = i1 - i0,
+			.b = b + (k0 - i0) * kernel->size,
+			.nb = (k1 - i1) - (k0 - i0),
+		};
+
+		k0 = k1;
+		i0 = i1;
+	}
+
+	return pieces;
+}
+
+void parallel_sort(void *array, size_t nmemb,
+		   const struct sort_kernel *kernel, unsigned nthreads)
+{
+	struct sort_task *tasks;
+	uint8_t *buf, *src, *dst, *tmp;
+	size_t nparts, step, i, nr, pieces, lo, mid, hi;
+
+	if (nthreads == 0)
+	{
+		nthreads = online_cpu_count();
+	}
+
+	buf = xmalloc(st_mult(nmemb, kernel->size));
+	if (nthreads == 1 || nmemb < SORT_PARALLEL_MIN)
+	{
+		kernel->sort(array, buf, nmemb);
+		free(buf);
+		return;
+	}
+
+	/**
+	 * a power of four slices, so that after the even number of
+	 * merge rounds the result is back in ‘array’
+	 */
+	for (nparts = 4; nparts < nthreads; nparts *= 4);
+
+	MALLOC_ARRAY(tasks, nparts + nthreads);
+
+	for (i = 0; i < nparts; i++)
+	{
+		lo = nmemb * i / nparts;
+		hi = nmemb * (i + 1) / nparts;
+
+		tasks[i] = (struct sort_task){
+			.dst = (uint8_t *)array + lo * kernel->size,
+			.a = buf + lo * kernel->size,
+			.na = hi - lo,
+		};
+	}
+
+	run_thread_pool(tasks, nparts, sizeof(*tasks),
+			sort_task_fn, (void *)kernel, nthreads);
+
+	src = array;
+	dst = buf;
+	for (step = 1; step < nparts; step *= 2)
+	{
+		pieces = nthreads * step * 2 / nparts;
+		pieces = pieces == 0 ? 1 : pieces;
+
+		nr = 0;
+		for (i = 0; i < nparts; i += step * 2)
+		{
+			lo = nmemb * i / nparts;
+			mid = nmemb * (i + step) / nparts;
+			hi = nmemb * (i + step * 2) / nparts;
+
+			nr += plan_merge(tasks + nr, kernel,
+					 dst + lo * kernel->size,
+					 src + lo * kernel->size, mid - lo,
+					 src + mid * kernel->size, hi - mid,
+					 pieces);
+		}
+
+		run_thread_pool(tasks, nr, sizeof(*tasks),
+				sort_task_fn, (void *)kernel, nthreads);
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	free(tasks);
+	free(buf);
+}
@@ -22,63 +22,84 @@
 
 #include "pkproc.h"
 
-static int run_default_spinner(const void *period_mult0)
+static const struct spinner_frame default_frames[] = {
+	{ "\\\b", 1 },
+	{ "|\b",  1 },
+	{ "/\b",  1 },
+	{ "-\b",  1 },
+	{ NULL },
+};
+
+static const struct spinner_frame kawaii_frames[] = {
+	{ ">",        1 },
+	{ "_",        1 },
+	{ "<",        2 },
+	{ "\r   \r>", 1 },
+	{ NULL },
+};
+
+static const struct spinner_style spinner_styles[] = {
+	{
+		.name   = "default",
+		.period = DEFAULT_SPINNER_PERIOD * 75,
+		.frames = default_frames,
+	},
+	{
+		.name   = "kawaii",
+		.period = DEFAULT_SPINNER_PERIOD * 100,
+		.frames = kawaii_frames,
+		.loop   = 1, /* ‘>’ is shown only once */
+	},
+	{ NULL },
+};
+
+const struct spinner_style *find_spinner_style(const char *name)
 {
-	useconds_t period_mult;
-	int i;
-	const char *snch[] = { "\\\b", "|\b", "/\b", "-\b" };
+	const struct spinner_style *style;
 
-	period_mult = *(useconds_t *)period_mult0;
-	for (i = 0; ; i = (i + 1) % 4)
+	/* graphical editors turn spinner on without a style */
+	if (name == (void *)-1)
 	{
-		write(STDOUT_FILENO, snch[i], 2);
-		usleep(period_mult);
+		return &spinner_styles[0];
 	}
 
-	return 0; /* fake return */
+	for (style = spinner_styles; style->name != NULL; style++)
+	{
+		if (!strcmp(style->name, name))
+		{
+			return style;
+		}
+	}
+
+	note("Unknown spinner style ‘%s’, fallback to default style.", name);
+	return &spinner_styles[0];
 }
 
-static int run_kawaii_spinner(const void *period_mult0)
+useconds_t spin_once(struct spinner *sp)
 {
-	useconds_t period_mult;
-	int i;
-	const char *snch[] = { "_", "<", "\r   \r>" };
-
-	period_mult = *(useconds_t *)period_mult0;
-
-	write(STDOUT_FILENO, ">", 1);
-	usleep(period_mult);
+	const struct spinner_frame *frame;
 
-	for (i = 0; ; i = (i + 1) % 3)
+	frame = &sp->style->frames[sp->next++];
+	if (sp->style->frames[sp->next].str == NULL)
 	{
-		write(STDOUT_FILENO, snch[i], i == 2 ? 6 : 1);
-		usleep(period_mult * ((i % 2) + 1));
+		sp->next = sp->style->loop;
 	}
 
-	return 0;
+	write(STDOUT_FILENO, frame->str, strlen(frame->str));
+
+	return sp->style->period * frame->ticks;
 }
 
-int run_spinner(struct process_info *ctx, const char *style)
+int run_spinner(const void *style)
 {
-	useconds_t period;
-	procfn_t spinner_func;
+	struct spinner sp = {
+		.style = style,
+	};
 
-	if (!strcmp(style, "kawaii"))
-	{
-		period = DEFAULT_SPINNER_PERIOD * 100;
-		spinner_func = run_kawaii_spinner;
-	}
-	else
+	while (39)
 	{
-		if (strcmp(style, "default"))
-		{
-			note("Unknown spinner style ‘%s’, "
-				"fallback to default style.", style);
-		}
-
-		period = DEFAULT_SPINNER_PERIOD * 75;
-		spinner_func = run_default_spinner;
+		usleep(spin_once(&sp));
 	}
 
-	return mkprocf(ctx, spinner_func, &period);
+	return 0; /* fake return */
 }
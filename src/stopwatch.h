@@ -0,0 +1,57 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef STOPWATCH_H
+#define STOPWATCH_H
+
+struct stopwatch
+{
+	struct timespec start;
+};
+
+static inline FORCEINLINE uint64_t monotonic_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline FORCEINLINE void stopwatch_start(struct stopwatch *sw)
+{
+	clock_gettime(CLOCK_MONOTONIC, &sw->start);
+}
+
+/**
+ * elapsed time since stopwatch_start() in microseconds
+ */
+static inline FORCEINLINE uint64_t stopwatch_elapsed(const struct stopwatch *sw)
+{
+	return monotonic_usec() -
+		((uint64_t)sw->start.tv_sec * 1000000 +
+		  sw->start.tv_nsec / 1000);
+}
+
+#define usec_to_sec(usec) ( (double)(usec) / 1000000 )
+
+#endif /* STOPWATCH_H */
@@ -24,6 +24,33 @@
 
 char strbuf_defbuf[1];
 
+/**
+ * the old buffer is abandoned to the region, growth is geometric so
+ * that adds up to at most the final size
+ */
+static void strbuf_grow_region(struct strbuf *sb, size_t size)
+{
+	size_t cap;
+	char *buf;
+
+	if (size <= sb->capacity)
+	{
+		return;
+	}
+
+	cap = fixed_growth(sb->capacity);
+	cap = cap < size ? size : cap;
+
+	buf = region_alloc(sb->region, cap);
+	if (sb->buf != NULL)
+	{
+		memcpy(buf, sb->buf, sb->length + 1);
+	}
+
+	sb->buf = buf;
+	sb->capacity = cap;
+}
+
 static void strbuf_grow(struct strbuf *sb, size_t request_size)
 {
 	bool factory_new;
@@ -34,7 +61,15 @@ static void strbuf_grow(struct strbuf *sb, size_t request_size)
 		sb->buf = NULL;
 	}
 
-	CAPACITY_GROW(sb->buf, sb->length + request_size + 1, sb->capacity);
+	if (sb->region != NULL)
+	{
+		strbuf_grow_region(sb, sb->length + request_size + 1);
+	}
+	else
+	{
+		CAPACITY_GROW(sb->buf, sb->length + request_size + 1,
+				sb->capacity);
+	}
 
 	if (factory_new)
 	{
@@ -152,6 +187,19 @@ char *strbuf_detach(struct strbuf *sb)
 {
 	char *bufcopy;
 
+	if (sb->region != NULL)
+	{
+		/* hand the buffer over, the next write starts a new one */
+		bufcopy = sb->capacity ? sb->buf :
+				region_memdup(sb->region, "", 0);
+
+		sb->buf = strbuf_defbuf;
+		sb->length = 0;
+		sb->capacity = 0;
+
+		return bufcopy;
+	}
+
 	bufcopy = malloc(sb->length + 1); /* add one for null terminator */
 	memcpy(bufcopy, sb->buf, sb->length + 1);
 	strbuf_trunc(sb);
@@ -23,11 +23,19 @@
 #ifndef STRBUF_H
 #define STRBUF_H
 
+#include "region.h"
+
 struct strbuf
 {
 	char *buf;
 	size_t length;
 	size_t capacity;
+
+	/**
+	 * the buffer grows in ‘region’ if it's set, so it's never
+	 * freed by us and strbuf_detach() costs nothing
+	 */
+	struct region *region;
 };
 
 extern char strbuf_defbuf[];
@@ -35,13 +43,16 @@ extern char strbuf_defbuf[];
 #define STRBUF_INIT     { .buf = strbuf_defbuf }
 #define STRBUF_INIT_PTR &(struct strbuf){ .buf = strbuf_defbuf }
 
+#define STRBUF_INIT_REGION(rg) { .buf = strbuf_defbuf, .region = (rg) }
+#define STRBUF_INIT_PTR_REGION(rg) &(struct strbuf)STRBUF_INIT_REGION(rg)
+
 /**
  * free `sb->buf`, after calling this function, the `sb` shall not
  * be used again
  */
 static inline FORCEINLINE void strbuf_destroy(struct strbuf *sb)
 {
-	if (sb->capacity)
+	if (sb->capacity && sb->region == NULL)
 	{
 		free(sb->buf);
 	}
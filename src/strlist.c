@@ -24,7 +24,7 @@
 
 static void strlist_erase_at(struct strlist *sl, size_t idx, bool rmext)
 {
-	if (sl->dupstr)
+	if (sl->dupstr && sl->region == NULL)
 	{
 		free(sl->elvec[idx].str);
 	}
@@ -67,9 +67,16 @@ static struct strlist_elem *strlist_push_nodup(struct strlist *sl, char *str)
 	return el;
 }
 
+static char *strlist_dupstr(struct strlist *sl, const char *str, size_t len)
+{
+	return sl->region ? region_memdup(sl->region, str, len) :
+				strndup(str, len);
+}
+
 struct strlist_elem *strlist_push(struct strlist *sl, const char *str)
 {
-	return strlist_push_nodup(sl, sl->dupstr ? strdup(str) : (char *)str);
+	return strlist_push_nodup(sl, sl->dupstr ?
+			strlist_dupstr(sl, str, strlen(str)) : (char *)str);
 }
 
 struct strlist_elem *strlist_pop(struct strlist *sl)
@@ -107,7 +114,8 @@ size_t strlist_split(struct strlist *sl, const char *str, char delim, int maxspl
 
 		if(delim_pos)
 		{
-			strlist_push_nodup(sl, strndup(str, delim_pos - str));
+			strlist_push_nodup(sl, strlist_dupstr(sl, str,
+							delim_pos - str));
 			str = delim_pos + 1;
 		}
 		else
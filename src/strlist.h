@@ -23,6 +23,8 @@
 #ifndef STRLIST_H
 #define STRLIST_H
 
+#include "region.h"
+
 struct strlist_elem
 {
 	char *str;
@@ -35,6 +37,12 @@ struct strlist
 	size_t size;
 	size_t capacity;
 	bool   dupstr;
+
+	/**
+	 * duplicated strings are taken from ‘region’ if it's set, and
+	 * are left for the region to reclaim
+	 */
+	struct region *region;
 };
 
 enum strlist_join_ext_pos
@@ -49,6 +57,9 @@ enum strlist_join_ext_pos
 #define STRLIST_INIT_PTR_NODUP  &(struct strlist)STRLIST_INIT_NODUP
 #define STRLIST_INIT_PTR_DUPSTR &(struct strlist){ .dupstr = true }
 
+#define STRLIST_INIT_REGION(rg) { .dupstr = true, .region = (rg) }
+#define STRLIST_INIT_PTR_REGION(rg) &(struct strlist)STRLIST_INIT_REGION(rg)
+
 void strlist_destroy(struct strlist *sl, bool rmext);
 
 void strlist_trunc(struct strlist *sl, bool rmext);
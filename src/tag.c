@@ -0,0 +1,397 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "tag.h"
+
+#define TAG_MATCH_POINTER_TYPE "pk_tag_match"
+
+#define CREATE_TAG_SQLSTR "INSERT OR IGNORE INTO tag (name) VALUES (?1);"
+
+#define ADD_TAG_SQLSTR							\
+	"UPDATE tag SET bitmap = pk_bitmap_add(bitmap, ?2) "		\
+	"WHERE name = ?1;"
+
+#define REMOVE_TAG_SQLSTR						\
+	"UPDATE tag SET bitmap = pk_bitmap_remove(bitmap, ?2) "		\
+	"WHERE name = ?1;"
+
+#define DROP_EMPTY_TAG_SQLSTR						\
+	"DELETE FROM tag WHERE name = ?1 AND length(bitmap) = 0;"
+
+#define SELECT_TAG_SQLSTR "SELECT bitmap FROM tag WHERE name = ?;"
+
+/**
+ * the bitmap in the first argument and the rowid in the second, a
+ * NULL bitmap is empty
+ */
+static int load_bitmap_arg(struct sqlite3_context *ctx,
+			   struct sqlite3_value **argv, struct bitmap *bm,
+			   int64_t *id)
+{
+	if (bitmap_deserialize(bm, sqlite3_value_blob(argv[0]),
+				sqlite3_value_bytes(argv[0])) != 0)
+	{
+		sqlite3_result_error(ctx, "malformed tag bitmap", -1);
+		return -1;
+	}
+
+	*id = sqlite3_value_int64(argv[1]);
+	return 0;
+}
+
+static void result_bitmap(struct sqlite3_context *ctx, struct bitmap *bm)
+{
+	uint8_t *buf;
+	size_t len;
+
+	/* an empty bitmap is an empty blob, so that it's easy to find */
+	if (bm->nr == 0)
+	{
+		sqlite3_result_zeroblob(ctx, 0);
+		return;
+	}
+
+	buf = bitmap_serialize(bm, &len);
+	sqlite3_result_blob64(ctx, buf, len, free);
+}
+
+static void bitmap_add_fn(struct sqlite3_context *ctx, UNUSED int argc,
+			  struct sqlite3_value **argv)
+{
+	struct bitmap bm;
+	int64_t id;
+
+	if (load_bitmap_arg(ctx, argv, &bm, &id) != 0)
+	{
+		return;
+	}
+
+	bitmap_add(&bm, id);
+	result_bitmap(ctx, &bm);
+	bitmap_destroy(&bm);
+}
+
+static void bitmap_remove_fn(struct sqlite3_context *ctx, UNUSED int argc,
+			     struct sqlite3_value **argv)
+{
+	struct bitmap bm;
+	int64_t id;
+
+	if (load_bitmap_arg(ctx, argv, &bm, &id) != 0)
+	{
+		return;
+	}
+
+	bitmap_remove(&bm, id);
+	result_bitmap(ctx, &bm);
+	bitmap_destroy(&bm);
+}
+
+/**
+ * tested on the blob as it is, the delete trigger of account calls it
+ * for every tag
+ */
+static void bitmap_contains_fn(struct sqlite3_context *ctx,
+			       UNUSED int argc, struct sqlite3_value **argv)
+{
+	int rescode;
+
+	if ((rescode = bitmap_blob_contains(sqlite3_value_blob(argv[0]),
+					    sqlite3_value_bytes(argv[0]),
+					    sqlite3_value_int64(argv[1]))) == -1)
+	{
+		sqlite3_result_error(ctx, "malformed tag bitmap", -1);
+		return;
+	}
+
+	sqlite3_result_int(ctx, rescode);
+}
+
+static void bitmap_count_fn(struct sqlite3_context *ctx, UNUSED int argc,
+			    struct sqlite3_value **argv)
+{
+	struct bitmap bm;
+
+	if (bitmap_deserialize(&bm, sqlite3_value_blob(argv[0]),
+				sqlite3_value_bytes(argv[0])) != 0)
+	{
+		sqlite3_result_error(ctx, "malformed tag bitmap", -1);
+		return;
+	}
+
+	sqlite3_result_int64(ctx, bitmap_cardinality(&bm));
+	bitmap_destroy(&bm);
+}
+
+static void tag_match_fn(struct sqlite3_context *ctx, UNUSED int argc,
+			 struct sqlite3_value **argv)
+{
+	struct tag_match *match;
+
+	if ((match = sqlite3_value_pointer(argv[0],
+				TAG_MATCH_POINTER_TYPE)) == NULL)
+	{
+		sqlite3_result_int(ctx, 1);
+		return;
+	}
+
+	sqlite3_result_int(ctx, bitmap_contains(&match->bm,
+				sqlite3_value_int64(argv[1])) != match->negate);
+}
+
+int register_tag_functions(struct sqlite3 *db)
+{
+	static const struct
+	{
+		const char *name;
+		void (*fn)(struct sqlite3_context *, int,
+			   struct sqlite3_value **);
+		int argc;
+	} functions[] = {
+		{ "pk_bitmap_add",      bitmap_add_fn,      2 },
+		{ "pk_bitmap_remove",   bitmap_remove_fn,   2 },
+		{ "pk_bitmap_contains", bitmap_contains_fn, 2 },
+		{ "pk_bitmap_count",    bitmap_count_fn,    1 },
+		{ "pk_tag_match",       tag_match_fn,       2 },
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(functions) / sizeof(*functions); i++)
+	{
+		if (sqlite3_create_function(db, functions[i].name,
+					     functions[i].argc,
+					     SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+					     NULL, functions[i].fn,
+					     NULL, NULL) != SQLITE_OK)
+		{
+			return error_sqlerr(db, "cannot register tag "
+						 "functions on db ‘%s’",
+					     msqlite3_pathname);
+		}
+	}
+
+	return 0;
+}
+
+static int run_tag_sql(struct sqlite3 *db, const char *sql,
+		       const char *name, int64_t id)
+{
+	struct sqlite3_stmt *stmt;
+	int rescode;
+
+	if (msqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	rescode = -1;
+	if (msqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC) != SQLITE_OK)
+	{
+		goto finalize;
+	}
+
+	if (sqlite3_bind_parameter_count(stmt) > 1 &&
+	     msqlite3_bind_int64(stmt, 2, id) != SQLITE_OK)
+	{
+		goto finalize;
+	}
+
+	if (msqlite3_step(stmt) == SQLITE_DONE)
+	{
+		rescode = 0;
+	}
+
+finalize:
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+int tag_account(struct sqlite3 *db, int64_t id, const char *name)
+{
+	if (*name == 0)
+	{
+		return error("tag names cannot be empty");
+	}
+
+	if (run_tag_sql(db, CREATE_TAG_SQLSTR, name, id) != 0 ||
+	     run_tag_sql(db, ADD_TAG_SQLSTR, name, id) != 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+int untag_account(struct sqlite3 *db, int64_t id, const char *name)
+{
+	if (run_tag_sql(db, REMOVE_TAG_SQLSTR, name, id) != 0 ||
+	     run_tag_sql(db, DROP_EMPTY_TAG_SQLSTR, name, id) != 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+int load_tag_bitmap(struct sqlite3 *db, const char *name, struct bitmap *bm)
+{
+	struct sqlite3_stmt *stmt;
+	int rescode;
+
+	*bm = (struct bitmap)BITMAP_INIT;
+	if (msqlite3_prepare_v2(db, SELECT_TAG_SQLSTR,
+				 -1, &stmt, NULL) != SQLITE_OK)
+	{
+		return -1;
+	}
+
+	rescode = -1;
+	if (msqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC) != SQLITE_OK)
+	{
+		goto finalize;
+	}
+
+	switch (sqlite3_step(stmt))
+	{
+	case SQLITE_ROW:
+		if (bitmap_deserialize(bm, sqlite3_column_blob(stmt, 0),
+					sqlite3_column_bytes(stmt, 0)) != 0)
+		{
+			error("bitmap of tag ‘%s’ is malformed", name);
+			break;
+		}
+		/* fall through */
+	case SQLITE_DONE:
+		rescode = 0;
+		break;
+	default:
+		report_sqlite_error(sqlite3_step, db);
+	}
+
+finalize:
+	sqlite3_finalize(stmt);
+	return rescode;
+}
+
+/**
+ * ‘*acc’ = ‘*acc’ op each tag of ‘names’, where op is bitmap_and or
+ * bitmap_or; ‘*acc’ starts as the first tag if ‘init’ is false
+ */
+static int fold_tags(struct sqlite3 *db, const struct strlist *names,
+		     void (*op)(struct bitmap *, const struct bitmap *),
+		     struct bitmap *acc, bool init)
+{
+	struct bitmap bm;
+	size_t i;
+
+	for (i = 0; i < names->size; i++)
+	{
+		if (load_tag_bitmap(db, names->elvec[i].str,
+				     init ? &bm : acc) != 0)
+		{
+			return -1;
+		}
+		else if (!init)
+		{
+			init = true;
+			continue;
+		}
+
+		op(acc, &bm);
+		bitmap_destroy(&bm);
+	}
+
+	return 0;
+}
+
+int eval_tag_filter(struct sqlite3 *db, const struct tag_filter *filter,
+		    struct tag_match *match)
+{
+	struct bitmap any = BITMAP_INIT, none = BITMAP_INIT;
+	bool positive;
+
+	match->bm = (struct bitmap)BITMAP_INIT;
+	match->negate = false;
+
+	if (fold_tags(db, &filter->all, bitmap_and, &match->bm, false) != 0)
+	{
+		goto failure;
+	}
+	positive = filter->all.size > 0;
+
+	if (filter->any.size > 0)
+	{
+		if (fold_tags(db, &filter->any, bitmap_or, &any, true) != 0)
+		{
+			goto failure;
+		}
+
+		if (positive)
+		{
+			bitmap_and(&match->bm, &any);
+			bitmap_destroy(&any);
+		}
+		else
+		{
+			match->bm = any;
+			positive = true;
+		}
+	}
+
+	if (fold_tags(db, &filter->none, bitmap_or, &none, true) != 0)
+	{
+		goto failure;
+	}
+
+	if (positive)
+	{
+		bitmap_andnot(&match->bm, &none);
+		bitmap_destroy(&none);
+	}
+	else
+	{
+		match->bm = none;
+		match->negate = true;
+	}
+
+	return 0;
+
+failure:
+	bitmap_destroy(&match->bm);
+	bitmap_destroy(&any);
+	bitmap_destroy(&none);
+
+	return -1;
+}
+
+int bind_tag_match(struct sqlite3_stmt *stmt, int idx,
+		   struct tag_match *match)
+{
+	if (sqlite3_bind_pointer(stmt, idx, match, TAG_MATCH_POINTER_TYPE,
+				  NULL) != SQLITE_OK)
+	{
+		return error_sqlerr(sqlite3_db_handle(stmt),
+				     "cannot bind tag filter");
+	}
+
+	return 0;
+}
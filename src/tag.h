@@ -0,0 +1,85 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef TAG_H
+#define TAG_H
+
+#include "bitmap.h"
+#include "strlist.h"
+
+/**
+ * tags group accounts, table tag keeps the rowids of the accounts of
+ * each tag in a compressed bitmap (see bitmap.h), so that filtering by
+ * several tags is a few bitmap operations instead of joins; bitmaps
+ * are changed by the functions registered here, which the triggers
+ * of table account call as well
+ */
+int register_tag_functions(struct sqlite3 *db);
+
+int tag_account(struct sqlite3 *db, int64_t id, const char *name);
+
+/**
+ * a tag no account has any more is dropped
+ */
+int untag_account(struct sqlite3 *db, int64_t id, const char *name);
+
+/**
+ * load the bitmap of tag ‘name’, a tag that doesn't exist is empty
+ */
+int load_tag_bitmap(struct sqlite3 *db, const char *name, struct bitmap *bm);
+
+/**
+ * accounts having every tag of ‘all’, one of ‘any’ (if it's not empty)
+ * and none of ‘none’
+ */
+struct tag_filter
+{
+	struct strlist all;
+	struct strlist any;
+	struct strlist none;
+};
+
+#define TAG_FILTER_INIT \
+	{ STRLIST_INIT_NODUP, STRLIST_INIT_NODUP, STRLIST_INIT_NODUP }
+
+#define is_tag_filter_empty(f)\
+	( (f)->all.size == 0 && (f)->any.size == 0 && (f)->none.size == 0 )
+
+struct tag_match
+{
+	struct bitmap bm;
+
+	/* accounts not in ‘bm’ match, for a filter of only ‘none’ */
+	bool negate;
+};
+
+int eval_tag_filter(struct sqlite3 *db, const struct tag_filter *filter,
+		    struct tag_match *match);
+
+/**
+ * bind ‘match’ to parameter ‘idx’, for a statement that tests rows by
+ * ‘pk_tag_match(?, id)’; an unbound parameter matches every row
+ */
+int bind_tag_match(struct sqlite3_stmt *stmt, int idx,
+		   struct tag_match *match);
+
+#endif /* TAG_H */
@@ -0,0 +1,104 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "thread-pool.h"
+#include <stdatomic.h>
+
+struct pool_context
+{
+	uint8_t *tasks;
+	size_t nmemb;
+	size_t size;
+
+	taskfn_t taskfn;
+	void *data;
+
+	atomic_size_t next;
+};
+
+static int run_pool_worker(void *ctx0)
+{
+	struct pool_context *ctx;
+	size_t idx;
+
+	ctx = ctx0;
+	while ((idx = atomic_fetch_add(&ctx->next, 1)) < ctx->nmemb)
+	{
+		ctx->taskfn(ctx->tasks + idx * ctx->size, ctx->data);
+	}
+
+	return 0;
+}
+
+void run_thread_pool(
+	void *tasks, size_t nmemb, size_t size,
+	taskfn_t taskfn, void *data, unsigned nthreads)
+{
+	struct pool_context ctx = {
+		.tasks  = tasks,
+		.nmemb  = nmemb,
+		.size   = size,
+		.taskfn = taskfn,
+		.data   = data,
+	};
+	struct worker_info *workers;
+	size_t nworker, i;
+
+	atomic_init(&ctx.next, 0);
+
+	if (nthreads == 0)
+	{
+		nthreads = online_cpu_count();
+	}
+
+	/* calling thread is one of the workers */
+	nworker = nthreads < nmemb ? nthreads : nmemb;
+	nworker = nworker > 0 ? nworker - 1 : 0;
+
+	workers = NULL;
+	if (nworker > 0)
+	{
+		MALLOC_ARRAY(workers, nworker);
+	}
+
+	for (i = 0; i < nworker; i++)
+	{
+		/**
+		 * fewer workers only slows things down, the remaining
+		 * tasks are still taken by the threads already started
+		 */
+		if (mkworker(&workers[i], run_pool_worker, &ctx) != 0)
+		{
+			break;
+		}
+	}
+	nworker = i;
+
+	run_pool_worker(&ctx);
+
+	for (i = 0; i < nworker; i++)
+	{
+		join_worker(&workers[i]);
+	}
+
+	free(workers);
+}
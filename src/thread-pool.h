@@ -0,0 +1,119 @@
+/****************************************************************************
+**
+** Copyright 2023, 2024 Jiamu Sun
+** Contact: barroit@linux.com
+**
+** This file is part of PassKeeper.
+**
+** PassKeeper is free software: you can redistribute it and/or modify it
+** under the terms of the GNU General Public License as published by the
+** Free Software Foundation, either version 3 of the License, or (at your
+** option) any later version.
+**
+** PassKeeper is distributed in the hope that it will be useful, but
+** WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+** General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License along
+** with PassKeeper. If not, see <https://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
+typedef void (*taskfn_t)(void *task, void *data);
+
+struct worker_info
+{
+#ifdef LINUX
+	pthread_t tid;
+#else
+	HANDLE thread_handle;
+#endif
+	int (*fn)(void *);
+	void *args;
+};
+
+struct mutex
+{
+#ifdef LINUX
+	pthread_mutex_t handle;
+#else
+	CRITICAL_SECTION handle;
+#endif
+};
+
+#ifdef LINUX
+static inline FORCEINLINE void mutex_init(struct mutex *mtx)
+{
+	pthread_mutex_init(&mtx->handle, NULL);
+}
+
+static inline FORCEINLINE void mutex_lock(struct mutex *mtx)
+{
+	pthread_mutex_lock(&mtx->handle);
+}
+
+static inline FORCEINLINE void mutex_unlock(struct mutex *mtx)
+{
+	pthread_mutex_unlock(&mtx->handle);
+}
+
+static inline FORCEINLINE void mutex_destroy(struct mutex *mtx)
+{
+	pthread_mutex_destroy(&mtx->handle);
+}
+#else
+static inline FORCEINLINE void mutex_init(struct mutex *mtx)
+{
+	InitializeCriticalSection(&mtx->handle);
+}
+
+static inline FORCEINLINE void mutex_lock(struct mutex *mtx)
+{
+	EnterCriticalSection(&mtx->handle);
+}
+
+static inline FORCEINLINE void mutex_unlock(struct mutex *mtx)
+{
+	LeaveCriticalSection(&mtx->handle);
+}
+
+static inline FORCEINLINE void mutex_destroy(struct mutex *mtx)
+{
+	DeleteCriticalSection(&mtx->handle);
+}
+#endif
+
+/**
+ * start a thread running fn(args), the thread shall be joined by
+ * join_worker()
+ */
+int mkworker(struct worker_info *ctx, int (*fn)(void *), void *args);
+
+int join_worker(struct worker_info *ctx);
+
+/**
+ * number of processors currently online, at least 1
+ */
+unsigned online_cpu_count(void);
+
+/**
+ * run ‘taskfn’ on each of ‘nmemb’ tasks of ‘size’ bytes stored in
+ * ‘tasks’, with at most ‘nthreads’ threads (0 means one per online
+ * processor); calling thread takes tasks as well, and this function
+ * returns after all tasks are done
+ *
+ * tasks are handed out in order, so there's no ordering among results
+ * but the first task always starts first
+ */
+void run_thread_pool(void *tasks, size_t nmemb, size_t size,
+		     taskfn_t taskfn, void *data, unsigned nthreads);
+
+#endif /* THREAD_POOL_H */
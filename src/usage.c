@@ -21,6 +21,7 @@
 ****************************************************************************/
 
 #include "security.h"
+#include "hex.h"
 
 void vreportf(
 	const char *prefix,
@@ -127,7 +128,7 @@ void bug_routine(const char *file, int line, const char *format, ...)
 	exit(EXIT_FAILURE);
 }
 
-const char *msqlite3_pathname = NULL;
+_Thread_local const char *msqlite3_pathname = NULL;
 
 static int handle_sqlite3_exec_error(struct sqlite3 *db, va_list ap)
 {
@@ -153,26 +154,20 @@ static int handle_sqlite3_prepare_v2_error(struct sqlite3 *db, va_list ap)
 static int handle_sqlite3_bind_blob_error(struct sqlite3 *db, va_list ap)
 {
 	const uint8_t *bin;
-	int bin_len;
+	int bin_len, show_len;
 
-	char *hex;
-	int rescode;
+	char hex[16 * 2 + 1];
 
 	bin = va_arg(ap, const uint8_t *);
 	bin_len = va_arg(ap, int);
 
-	if (bin_len > 16)
-	{
-		bin_len = 16;
-	}
-	bin2hex(&hex, xmemdup(bin, bin_len), bin_len);
+	show_len = bin_len > 16 ? 16 : bin_len;
+	hex_encode(hex, bin, show_len);
+	hex[show_len * 2] = 0;
 
-	rescode = error_sqlerr(db, "Unable to bind blob value ‘%s%s’ on db "
+	return error_sqlerr(db, "Unable to bind blob value ‘%s%s’ on db "
 				"‘%s’", hex, bin_len > 16 ? "..." : "",
 				 msqlite3_pathname);
-
-	free(hex);
-	return rescode;
 }
 
 static int handle_sqlite3_bind_int64_error(struct sqlite3 *db, va_list ap)
@@ -277,6 +272,11 @@ int report_sqlite_error(void *sqlite3_fn, struct sqlite3 *db, ...)
 		rescode = error_sqlerr(db, "Failed to step statement on db "
 					"‘%s’", msqlite3_pathname);
 	}
+	else if (sqlite3_fn == sqlite3_backup_finish)
+	{
+		rescode = error_sqlerr(db, "Failed to back up to db ‘%s’",
+					msqlite3_pathname);
+	}
 	else
 	{
 		bug("unhandled function pointer %p", sqlite3_fn);
@@ -115,6 +115,35 @@ ssize_t pk_write(int fd, const void *buf, size_t n)
 	}
 }
 
+void xwritev(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t nr;
+
+	while (iovcnt > 0)
+	{
+		if ((nr = writev(fd, iov, iovcnt)) < 0)
+		{
+			if (errno == EINTR || handle_nonblock(fd, POLLOUT, errno))
+			{
+				continue;
+			}
+
+			xio_die(fd, "Unable to write content to");
+		}
+
+		for (; iovcnt > 0 && (size_t)nr >= iov->iov_len; iov++, iovcnt--)
+		{
+			nr -= iov->iov_len;
+		}
+
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (uint8_t *)iov->iov_base + nr;
+			iov->iov_len -= nr;
+		}
+	}
+}
+
 int xopen(const char *file, int oflag, ...)
 {
 	mode_t mode;
@@ -27,7 +27,13 @@ char *pk_strerror(int errnum);
 
 #define strerror pk_strerror
 
-#define exit(code) exit(code & 0xFF)
+/**
+ * exit() goes through pk_exit(), so that a session gets back control
+ * when a command fails, see catch_exit()
+ */
+#define exit(code) pk_exit((code) & 0xFF)
+
+void pk_exit(int status) __attribute__((noreturn));
 
 static inline FORCEINLINE void *xmalloc(size_t size)
 {
@@ -108,6 +114,12 @@ static inline FORCEINLINE ssize_t xwrite(int fd, const void *buf, size_t n)
 	return nr;
 }
 
+/**
+ * write out all ‘iovcnt’ buffers of ‘iov’, on as few writev() calls as
+ * the fd takes them in, ‘iov’ is consumed in the process
+ */
+void xwritev(int fd, struct iovec *iov, int iovcnt);
+
 static inline FORCEINLINE ssize_t xread(int fd, void *buf, size_t nbytes)
 {
 	ssize_t nr;
@@ -165,7 +177,9 @@ static inline FORCEINLINE int msqlite3_prepare_v2(
 	struct sqlite3 *db, const void *sql, int nr,
 	struct sqlite3_stmt **stmt, const char **tail)
 {
-	return run_sqlite3(db, sqlite3_prepare_v2, db, sql, nr, stmt, tail);
+	/* the error handler reports ‘sql’ */
+	return sqlite3_prepare_v2(db, sql, nr, stmt, tail) != SQLITE_OK ?
+		report_sqlite_error(sqlite3_prepare_v2, db, sql) : SQLITE_OK;
 }
 
 static inline FORCEINLINE int msqlite3_bind_blob(
@@ -211,11 +225,18 @@ static inline FORCEINLINE int msqlite3_step(struct sqlite3_stmt *stmt)
 		report_sqlite_error(sqlite3_step, sqlite3_db_handle(stmt));
 }
 
+/**
+ * savepoints nest, so these also work inside a session transaction
+ */
 #define msqlite3_begin_transaction(db)\
-	msqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL)
+	msqlite3_exec(db, "SAVEPOINT pk_transaction;", NULL, NULL, NULL)
 
 #define msqlite3_end_transaction(db)\
-	msqlite3_exec(db, "END TRANSACTION;", NULL, NULL, NULL)
+	msqlite3_exec(db, "RELEASE pk_transaction;", NULL, NULL, NULL)
+
+#define msqlite3_rollback_transaction(db)			\
+	msqlite3_exec(db, "ROLLBACK TO pk_transaction;"		\
+			  "RELEASE pk_transaction;", NULL, NULL, NULL)
 
 #define xsqlite3_open(filename, db)\
 	require_success(msqlite3_open(filename, db), SQLITE_OK)
@@ -256,6 +277,9 @@ static inline FORCEINLINE int msqlite3_step(struct sqlite3_stmt *stmt)
 #define xsqlite3_end_transaction(db)\
 	require_success(msqlite3_end_transaction(db), SQLITE_OK)
 
+#define xsqlite3_rollback_transaction(db)\
+	require_success(msqlite3_rollback_transaction(db), SQLITE_OK)
+
 #define xsqlite3_bind_or_null(ftype, stmt, idx, val, nr, des)		\
 	do								\
 	{								\
@@ -2,14 +2,20 @@
 
 int main(UNUSED int argc, const char **argv)
 {
-	size_t hexlen;
+	size_t hexlen, binlen;
+	uint8_t *bin;
+	char *hex;
 	argv++;
 
 	assert(*argv);
 	hexlen = strlen(*argv);
 	assert(!(hexlen % 2));
 
-	fputs(bin2hex(hex2bin(strdup(*argv), hexlen), hexlen / 2), stdout);
+	binlen = hex2bin(&bin, strdup(*argv), hexlen);
+	bin2hex(&hex, bin, binlen);
+
+	fputs(hex, stdout);
+	free(hex);
 
 	return 0;
 }
@@ -0,0 +1,23 @@
+use v5.38;
+use Test::More;
+use Env qw(TEST_BUILD_PREFIX);
+use IPC::Run 'run';
+
+my @cmd;
+my $output;
+my $PKBIN = "$TEST_BUILD_PREFIX/t1101-hex-kernels";
+
+@cmd = ($PKBIN, 200000);
+ok(run(\@cmd), 'kernels agree with the byte-at-a-time conversions');
+
+@cmd = ($PKBIN, 'bench');
+ok(run(\@cmd, '>', \$output), 'benchmark kernels');
+
+foreach (split /\n/, $output)
+{
+	my ($name, $ref, $kernel) = split;
+	diag(sprintf('%-8s 1 MiB: reference %6d us, kernel %6d us',
+		     $name, $ref, $kernel));
+}
+
+done_testing();
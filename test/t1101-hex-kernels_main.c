@@ -0,0 +1,201 @@
+#include "hex.h"
+#include "security.h"
+#include "stopwatch.h"
+
+/**
+ * the byte-at-a-time conversions the kernels replaced, kept as the
+ * reference for equivalence and the baseline for timing
+ */
+static const char ref_digits[] = "0123456789ABCDEF";
+
+static void ref_encode(char *hex, const uint8_t *bin, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+	{
+		hex[2 * i]     = ref_digits[bin[i] >> 4];
+		hex[2 * i + 1] = ref_digits[bin[i] & 0x0F];
+	}
+}
+
+static int ref_digit(char c)
+{
+	return isupper(c) ? c - 'A' + 10 : islower(c) ? c - 'a' + 10 : c - '0';
+}
+
+static void ref_decode(uint8_t *bin, const char *hex, size_t hex_len)
+{
+	size_t i;
+
+	for (i = 0; i < hex_len / 2; i++)
+	{
+		bin[i] = ref_digit(hex[2 * i]) << 4 | ref_digit(hex[2 * i + 1]);
+	}
+}
+
+static bool ref_is_hex(const char *str, size_t len)
+{
+	while (len--)
+	{
+		if (!in_range_i(*str, 'A', 'F') &&
+		     !in_range_i(*str, 'a', 'f') && !isdigit(*str))
+		{
+			return false;
+		}
+
+		str++;
+	}
+
+	return true;
+}
+
+static bool ref_is_bits(const char *str, size_t len)
+{
+	while (len--)
+	{
+		if (*str != '0' && *str != '1')
+		{
+			return false;
+		}
+
+		str++;
+	}
+
+	return true;
+}
+
+#define MAX_LEN 96
+
+static int fuzz(unsigned rounds)
+{
+	static const char alphabet[] = "0123456789abcdefABCDEF";
+	struct random_pool pool = RANDOM_POOL_INIT;
+	uint8_t bin[MAX_LEN], out1[MAX_LEN], out2[MAX_LEN + 2];
+	char hex[MAX_LEN * 2], ref[MAX_LEN * 2], str[MAX_LEN + 2];
+	size_t len, i;
+	int failed;
+
+	failed = 0;
+	while (rounds--)
+	{
+		len = random_pool_byte(&pool) % MAX_LEN;
+		for (i = 0; i < len; i++)
+		{
+			bin[i] = random_pool_byte(&pool);
+		}
+
+		hex_encode(hex, bin, len);
+		ref_encode(ref, bin, len);
+		failed |= memcmp(hex, ref, len * 2) != 0;
+
+		/* in place, as bin2hex() does */
+		memcpy(hex, bin, len);
+		hex_encode(hex, (uint8_t *)hex, len);
+		failed |= memcmp(hex, ref, len * 2) != 0;
+
+		/* mixed case digits */
+		for (i = 0; i < len * 2; i++)
+		{
+			hex[i] = alphabet[random_pool_byte(&pool) %
+					  (sizeof(alphabet) - 1)];
+		}
+
+		hex_decode(out1, hex, len * 2);
+		ref_decode(out2, hex, len * 2);
+		failed |= memcmp(out1, out2, len) != 0;
+
+		/* shifted in place, as blob2bin() does */
+		if (len * 2 <= MAX_LEN)
+		{
+			memcpy(out2 + 2, hex, len * 2);
+			hex_decode(out2, (char *)out2 + 2, len * 2);
+			failed |= memcmp(out1, out2, len) != 0;
+		}
+
+		/* any byte, valid ones more likely */
+		for (i = 0; i < len; i++)
+		{
+			str[i] = random_pool_byte(&pool) % 4 ?
+				alphabet[random_pool_byte(&pool) % 22] :
+				 (char)random_pool_byte(&pool);
+		}
+
+		failed |= is_hex_string(str, len) != ref_is_hex(str, len);
+
+		for (i = 0; i < len; i++)
+		{
+			str[i] = random_pool_byte(&pool) % 64 ?
+				'0' + (random_pool_byte(&pool) & 1) :
+				 (char)random_pool_byte(&pool);
+		}
+
+		failed |= is_bit_string(str, len) != ref_is_bits(str, len);
+	}
+
+	return failed;
+}
+
+#define BENCH_LEN (1 << 20)
+
+static void bench(void)
+{
+	volatile bool sink;
+	struct stopwatch sw;
+	uint64_t t[6];
+	uint8_t *bin;
+	char *hex;
+	size_t i;
+
+	bin = xmalloc(BENCH_LEN);
+	hex = xmalloc(BENCH_LEN * 2);
+	for (i = 0; i < BENCH_LEN; i++)
+	{
+		bin[i] = i * 2654435761U >> 13;
+	}
+
+	stopwatch_start(&sw);
+	ref_encode(hex, bin, BENCH_LEN);
+	t[0] = stopwatch_elapsed(&sw);
+
+	stopwatch_start(&sw);
+	hex_encode(hex, bin, BENCH_LEN);
+	t[1] = stopwatch_elapsed(&sw);
+
+	stopwatch_start(&sw);
+	ref_decode(bin, hex, BENCH_LEN * 2);
+	t[2] = stopwatch_elapsed(&sw);
+
+	stopwatch_start(&sw);
+	hex_decode(bin, hex, BENCH_LEN * 2);
+	t[3] = stopwatch_elapsed(&sw);
+
+	stopwatch_start(&sw);
+	sink = ref_is_hex(hex, BENCH_LEN * 2);
+	t[4] = stopwatch_elapsed(&sw);
+
+	stopwatch_start(&sw);
+	sink = is_hex_string(hex, BENCH_LEN * 2);
+	t[5] = stopwatch_elapsed(&sw);
+
+	(void)sink;
+
+	/* microseconds per MiB of binary data, reference then kernel */
+	printf("encode %"PRIu64" %"PRIu64"\n", t[0], t[1]);
+	printf("decode %"PRIu64" %"PRIu64"\n", t[2], t[3]);
+	printf("validate %"PRIu64" %"PRIu64"\n", t[4], t[5]);
+
+	free(bin);
+	free(hex);
+}
+
+int main(int argc, const char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "bench"))
+	{
+		bench();
+		return 0;
+	}
+
+	return fuzz(argc > 1 ? strtoul(argv[1], NULL, 10) : 100000);
+}
@@ -0,0 +1,22 @@
+use v5.38;
+use Test::More;
+use Env qw(TEST_BUILD_PREFIX);
+use IPC::Run 'run';
+
+my @cmd;
+my $output;
+my $PKBIN = "$TEST_BUILD_PREFIX/t1102-sort-kernels";
+
+@cmd = ($PKBIN, 200);
+ok(run(\@cmd), 'kernels and top-k agree with a stable qsort');
+
+@cmd = ($PKBIN, 'bench');
+ok(run(\@cmd, '>', \$output), 'benchmark kernels');
+
+foreach (split /\n/, $output)
+{
+	my ($name, $usec) = split;
+	diag(sprintf('%-12s 1M records: %7d us', $name, $usec));
+}
+
+done_testing();
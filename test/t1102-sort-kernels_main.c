@@ -0,0 +1,212 @@
+#include "algorithm.h"
+#include "security.h"
+#include "stopwatch.h"
+
+/**
+ * records with few distinct keys, so that stability is exercised, and
+ * the original position to check it by
+ */
+struct record
+{
+	uint64_t key;
+	size_t pos;
+};
+
+#define record_less(r1, r2) ((r1)->key < (r2)->key)
+#define record_key(r) ((r)->key)
+
+/* the order qsort() gives them, so that top-k results are unique */
+#define record_less_pos(r1, r2)						\
+	((r1)->key < (r2)->key ||					\
+	 ((r1)->key == (r2)->key && (r1)->pos < (r2)->pos))
+
+DEFINE_MERGE_SORT(sort_records, struct record, record_less)
+DEFINE_PARALLEL_MERGE_SORT(psort_records, struct record, record_less)
+DEFINE_RADIX_SORT(radix_records, struct record, record_key)
+DEFINE_TOP_K(top_records, struct record, record_less_pos)
+
+static int ref_compar(const void *o1, const void *o2)
+{
+	const struct record *r1 = o1, *r2 = o2;
+
+	if (r1->key != r2->key)
+	{
+		return r1->key < r2->key ? -1 : 1;
+	}
+
+	return (r1->pos > r2->pos) - (r1->pos < r2->pos);
+}
+
+static void fill(struct record *recs, size_t nmemb,
+		 struct random_pool *pool, unsigned key_bytes)
+{
+	size_t i;
+	unsigned j;
+
+	for (i = 0; i < nmemb; i++)
+	{
+		recs[i].key = 0;
+		for (j = 0; j < key_bytes; j++)
+		{
+			recs[i].key = recs[i].key << 8 |
+				random_pool_byte(pool);
+		}
+		recs[i].pos = i;
+	}
+}
+
+static int check(struct record *recs, const struct record *orig,
+		 const struct record *ref, size_t nmemb,
+		 void (*sortfn)(struct record *, size_t))
+{
+	memcpy(recs, orig, nmemb * sizeof(*recs));
+	sortfn(recs, nmemb);
+
+	return memcmp(recs, ref, nmemb * sizeof(*recs)) != 0;
+}
+
+/**
+ * the ‘k’ greatest records of ‘orig’, greatest first, are the last
+ * ones of ‘ref’ backwards
+ */
+static int check_top_k(struct record *recs, const struct record *orig,
+		       const struct record *ref, size_t nmemb, size_t k)
+{
+	size_t nr, i;
+	int failed;
+
+	nr = 0;
+	for (i = 0; i < nmemb; i++)
+	{
+		top_records_push(recs, &nr, k, orig[i]);
+	}
+	top_records_sort(recs, nr);
+
+	failed = nr != (k < nmemb ? k : nmemb);
+	for (i = 0; i < nr; i++)
+	{
+		failed |= memcmp(&recs[i], &ref[nmemb - 1 - i],
+				 sizeof(*recs)) != 0;
+	}
+
+	return failed;
+}
+
+static void psort_records_4(struct record *recs, size_t nmemb)
+{
+	psort_records(recs, nmemb, 4);
+}
+
+static void psort_records_7(struct record *recs, size_t nmemb)
+{
+	psort_records(recs, nmemb, 7);
+}
+
+static int fuzz(unsigned rounds)
+{
+	static const size_t sizes[] = {
+		0, 1, 2, 15, 16, 17, 100, 1000, SORT_PARALLEL_MIN,
+		SORT_PARALLEL_MIN * 3 + 5,
+	};
+	struct random_pool pool = RANDOM_POOL_INIT;
+	struct record *recs, *orig, *ref;
+	size_t nmemb;
+	int failed;
+
+	MALLOC_ARRAY(recs, SORT_PARALLEL_MIN * 4);
+	MALLOC_ARRAY(orig, SORT_PARALLEL_MIN * 4);
+	MALLOC_ARRAY(ref, SORT_PARALLEL_MIN * 4);
+
+	failed = 0;
+	while (rounds--)
+	{
+		nmemb = sizes[rounds % (sizeof(sizes) / sizeof(*sizes))];
+		fill(orig, nmemb, &pool, 1 + rounds % 8);
+
+		memcpy(ref, orig, nmemb * sizeof(*ref));
+		qsort(ref, nmemb, sizeof(*ref), ref_compar);
+
+		failed |= check(recs, orig, ref, nmemb, sort_records);
+		failed |= check(recs, orig, ref, nmemb, psort_records_4);
+		failed |= check(recs, orig, ref, nmemb, psort_records_7);
+		failed |= check(recs, orig, ref, nmemb, radix_records);
+
+		failed |= check_top_k(recs, orig, ref, nmemb, 0);
+		failed |= check_top_k(recs, orig, ref, nmemb, 1);
+		failed |= check_top_k(recs, orig, ref, nmemb, 10);
+		failed |= check_top_k(recs, orig, ref, nmemb, nmemb);
+	}
+
+	free(recs);
+	free(orig);
+	free(ref);
+
+	return failed;
+}
+
+static int key_compar(const void *o1, const void *o2)
+{
+	const struct record *r1 = o1, *r2 = o2;
+
+	return (r1->key > r2->key) - (r1->key < r2->key);
+}
+
+#define BENCH_NMEMB 1000000
+
+static void bench(void)
+{
+	struct random_pool pool = RANDOM_POOL_INIT;
+	struct record *recs, *orig;
+	struct stopwatch sw;
+	uint64_t t[5];
+
+	MALLOC_ARRAY(recs, BENCH_NMEMB);
+	MALLOC_ARRAY(orig, BENCH_NMEMB);
+	fill(orig, BENCH_NMEMB, &pool, 8);
+
+	memcpy(recs, orig, BENCH_NMEMB * sizeof(*recs));
+	stopwatch_start(&sw);
+	qsort(recs, BENCH_NMEMB, sizeof(*recs), key_compar);
+	t[0] = stopwatch_elapsed(&sw);
+
+	memcpy(recs, orig, BENCH_NMEMB * sizeof(*recs));
+	stopwatch_start(&sw);
+	MSORT(recs, BENCH_NMEMB, key_compar);
+	t[1] = stopwatch_elapsed(&sw);
+
+	memcpy(recs, orig, BENCH_NMEMB * sizeof(*recs));
+	stopwatch_start(&sw);
+	sort_records(recs, BENCH_NMEMB);
+	t[2] = stopwatch_elapsed(&sw);
+
+	memcpy(recs, orig, BENCH_NMEMB * sizeof(*recs));
+	stopwatch_start(&sw);
+	psort_records(recs, BENCH_NMEMB, 0);
+	t[3] = stopwatch_elapsed(&sw);
+
+	memcpy(recs, orig, BENCH_NMEMB * sizeof(*recs));
+	stopwatch_start(&sw);
+	radix_records(recs, BENCH_NMEMB);
+	t[4] = stopwatch_elapsed(&sw);
+
+	/* microseconds per million records */
+	printf("qsort %"PRIu64"\n", t[0]);
+	printf("merge_sort %"PRIu64"\n", t[1]);
+	printf("specialised %"PRIu64"\n", t[2]);
+	printf("parallel %"PRIu64"\n", t[3]);
+	printf("radix %"PRIu64"\n", t[4]);
+
+	free(recs);
+	free(orig);
+}
+
+int main(int argc, const char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "bench"))
+	{
+		bench();
+		return 0;
+	}
+
+	return fuzz(argc > 1 ? strtoul(argv[1], NULL, 10) : 200);
+}
@@ -0,0 +1,22 @@
+use v5.38;
+use Test::More;
+use Env qw(TEST_BUILD_PREFIX);
+use IPC::Run 'run';
+
+my @cmd;
+my $output;
+my $PKBIN = "$TEST_BUILD_PREFIX/t1103-hashmap";
+
+@cmd = ($PKBIN, 100000);
+ok(run(\@cmd), 'maps agree with a plain array');
+
+@cmd = ($PKBIN, 'bench');
+ok(run(\@cmd, '>', \$output), 'benchmark maps');
+
+foreach (split /\n/, $output)
+{
+	my ($name, $usec) = split;
+	diag(sprintf('%-8s 1M keys: %7d us', $name, $usec));
+}
+
+done_testing();
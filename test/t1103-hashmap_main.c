@@ -0,0 +1,195 @@
+#include "hashmap.h"
+#include "security.h"
+#include "stopwatch.h"
+
+DEFINE_U64MAP(u64_map, uint64_t)
+DEFINE_STRSET(str_set)
+
+/**
+ * a hash with only a few values, every probe sequence is long and
+ * every removal shifts a whole cluster back
+ */
+#define clash_hash(key) hash_u64((key) & 3)
+
+DEFINE_HASHMAP(clash_map, uint64_t, uint64_t, clash_hash, hash_u64_eq)
+
+#define KEY_SPACE 4096
+
+static uint64_t random_u64(struct random_pool *pool)
+{
+	uint64_t x;
+	unsigned i;
+
+	for (x = 0, i = 0; i < sizeof(x); i++)
+	{
+		x = x << 8 | random_pool_byte(pool);
+	}
+
+	return x;
+}
+
+/**
+ * run random inserts and removals on both kinds of map against a
+ * plain array indexed by key
+ */
+static int fuzz_u64(unsigned rounds)
+{
+	struct random_pool pool = RANDOM_POOL_INIT;
+	struct u64_map map = HASHMAP_INIT;
+	struct clash_map clash = HASHMAP_INIT;
+	struct u64_map_entry *entry;
+	struct clash_map_entry *centry;
+	uint64_t ref[KEY_SPACE];
+	bool present[KEY_SPACE] = { 0 };
+	size_t nr, i;
+	uint64_t key;
+	bool found;
+	int failed;
+
+	failed = 0;
+	nr = 0;
+	while (rounds--)
+	{
+		/* scatter the keys so that they don't hash in order */
+		i = random_u64(&pool) % KEY_SPACE;
+		key = i * 0x100000001ULL;
+
+		if (random_pool_byte(&pool) % 3)
+		{
+			entry = u64_map_insert(&map, key, &found);
+			centry = clash_map_insert(&clash, key, &found);
+			failed |= found != present[i];
+			if (!found)
+			{
+				ref[i] = random_u64(&pool);
+				present[i] = true;
+				nr++;
+			}
+			entry->value = centry->value = ref[i];
+		}
+		else
+		{
+			failed |= u64_map_remove(&map, key) != present[i];
+			failed |= clash_map_remove(&clash, key) != present[i];
+			nr -= present[i];
+			present[i] = false;
+		}
+
+		failed |= map.nr != nr || clash.nr != nr;
+	}
+
+	for (i = 0; i < KEY_SPACE; i++)
+	{
+		key = i * 0x100000001ULL;
+		entry = u64_map_find(&map, key);
+		centry = clash_map_find(&clash, key);
+
+		if (present[i])
+		{
+			failed |= entry == NULL || entry->value != ref[i];
+			failed |= centry == NULL || centry->value != ref[i];
+		}
+		else
+		{
+			failed |= entry != NULL || centry != NULL;
+		}
+	}
+
+	nr = 0;
+	hashmap_for_each(i, &map)
+	{
+		nr++;
+	}
+	failed |= nr != map.nr;
+
+	u64_map_destroy(&map);
+	clash_map_destroy(&clash);
+
+	return failed;
+}
+
+static int check_strings(void)
+{
+	static const char *const words[] = {
+		"", "a", "ab", "abc", "abcdefg", "abcdefgh", "abcdefghi",
+		"abcdefghijklmnop", "abcdefghijklmnopq", NULL,
+	};
+	struct str_set set = HASHMAP_INIT;
+	const char *const *word;
+	char buf[32];
+	bool found;
+	int failed;
+
+	failed = 0;
+	for (word = words; *word != NULL; word++)
+	{
+		str_set_insert(&set, *word, &found);
+		failed |= found;
+	}
+
+	/* equal strings at other addresses */
+	for (word = words; *word != NULL; word++)
+	{
+		strcpy(buf, *word);
+		failed |= str_set_find(&set, buf) == NULL;
+		buf[strlen(buf) + 1] = '\0';
+		buf[strlen(buf)] = 'z';
+		failed |= str_set_find(&set, buf) != NULL;
+	}
+
+	str_set_destroy(&set);
+
+	return failed;
+}
+
+#define BENCH_NMEMB 1000000
+
+static void bench(void)
+{
+	struct random_pool pool = RANDOM_POOL_INIT;
+	struct u64_map map = HASHMAP_INIT;
+	struct stopwatch sw;
+	uint64_t *keys, t[2];
+	volatile size_t hits;
+	bool found;
+	size_t i;
+
+	MALLOC_ARRAY(keys, BENCH_NMEMB);
+	for (i = 0; i < BENCH_NMEMB; i++)
+	{
+		keys[i] = random_u64(&pool);
+	}
+
+	stopwatch_start(&sw);
+	for (i = 0; i < BENCH_NMEMB; i++)
+	{
+		u64_map_insert(&map, keys[i], &found)->value = i;
+	}
+	t[0] = stopwatch_elapsed(&sw);
+
+	stopwatch_start(&sw);
+	for (hits = 0, i = 0; i < BENCH_NMEMB; i++)
+	{
+		hits += u64_map_find(&map, keys[i] + (i & 1)) != NULL;
+	}
+	t[1] = stopwatch_elapsed(&sw);
+
+	/* microseconds per million keys */
+	printf("insert %"PRIu64"\n", t[0]);
+	printf("find %"PRIu64"\n", t[1]);
+
+	u64_map_destroy(&map);
+	free(keys);
+}
+
+int main(int argc, const char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "bench"))
+	{
+		bench();
+		return 0;
+	}
+
+	return fuzz_u64(argc > 1 ? strtoul(argv[1], NULL, 10) : 100000) |
+		check_strings();
+}
@@ -0,0 +1,12 @@
+use v5.38;
+use Test::More;
+use Env qw(TEST_BUILD_PREFIX);
+use IPC::Run 'run';
+
+my @cmd;
+my $PKBIN = "$TEST_BUILD_PREFIX/t1104-bitmap";
+
+@cmd = ($PKBIN);
+ok(run(\@cmd), 'bitmaps agree with a plain array');
+
+done_testing();
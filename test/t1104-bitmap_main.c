@@ -0,0 +1,196 @@
+#include "bitmap.h"
+#include "security.h"
+
+/**
+ * integers span three containers, plus one far away so that keys
+ * above 32 bits are covered as well
+ */
+#define SPACE (3 << 16)
+#define FAR_OFFSET (UINT64_C(1) << 40)
+
+static uint32_t random_u32(struct random_pool *pool)
+{
+	uint32_t x;
+	size_t i;
+
+	for (x = 0, i = 0; i < sizeof(x); i++)
+	{
+		x = x << 8 | random_pool_byte(pool);
+	}
+
+	return x;
+}
+
+static uint64_t to_int(size_t i)
+{
+	return i < SPACE - 4096 ? i : FAR_OFFSET + i;
+}
+
+static int check_kinds(const struct bitmap *bm)
+{
+	size_t i;
+	int failed;
+
+	failed = 0;
+	for (i = 0; i < bm->nr; i++)
+	{
+		failed |= bm->conts[i].card == 0;
+		failed |= (bm->conts[i].cap == 0) !=
+			  (bm->conts[i].card > BITMAP_ARRAY_MAX);
+		failed |= i > 0 && bm->conts[i].key <= bm->conts[i - 1].key;
+	}
+
+	return failed;
+}
+
+/**
+ * compare ‘bm’ with ‘ref’ through every way of reading it
+ */
+static int check_bitmap(const struct bitmap *bm, const bool *ref)
+{
+	struct bitmap copy;
+	uint64_t *array;
+	uint8_t *buf;
+	size_t nr, len, i, j;
+	int failed;
+
+	failed = check_kinds(bm);
+	array = bitmap_to_array(bm, &nr);
+	buf = bitmap_serialize(bm, &len);
+	failed |= bitmap_deserialize(&copy, buf, len) != 0;
+
+	for (i = 0, j = 0; i < SPACE; i++)
+	{
+		failed |= bitmap_contains(bm, to_int(i)) != ref[i];
+		failed |= bitmap_contains(&copy, to_int(i)) != ref[i];
+		failed |= bitmap_blob_contains(buf, len, to_int(i)) != ref[i];
+
+		if (ref[i])
+		{
+			failed |= j >= nr || array[j++] != to_int(i);
+		}
+	}
+
+	failed |= j != nr || bitmap_cardinality(bm) != nr;
+	failed |= bitmap_cardinality(&copy) != nr;
+	bitmap_destroy(&copy);
+
+	/* a truncated blob is never taken */
+	failed |= nr > 0 && bitmap_deserialize(&copy, buf, len - 1) == 0;
+	failed |= nr > 0 &&
+		  bitmap_blob_contains(buf, len - 1, array[nr - 1]) != -1;
+
+	free(array);
+	free(buf);
+
+	return failed;
+}
+
+static void fill(struct random_pool *pool, struct bitmap *bm, bool *ref,
+		 unsigned rounds, unsigned add_ratio)
+{
+	size_t i;
+
+	while (rounds--)
+	{
+		i = random_u32(pool) % SPACE;
+
+		if (random_pool_byte(pool) % 100 < add_ratio)
+		{
+			bitmap_add(bm, to_int(i));
+			ref[i] = true;
+		}
+		else
+		{
+			bitmap_remove(bm, to_int(i));
+			ref[i] = false;
+		}
+	}
+}
+
+static int check_ops(const struct bitmap *a, const bool *ra,
+		     const struct bitmap *b, const bool *rb)
+{
+	struct bitmap copy;
+	static bool ref[SPACE];
+	uint8_t *buf;
+	size_t len, i;
+	int failed;
+
+	buf = bitmap_serialize(a, &len);
+	failed = 0;
+
+	bitmap_deserialize(&copy, buf, len);
+	bitmap_and(&copy, b);
+	for (i = 0; i < SPACE; i++)
+	{
+		ref[i] = ra[i] && rb[i];
+	}
+	failed |= check_bitmap(&copy, ref);
+	bitmap_destroy(&copy);
+
+	bitmap_deserialize(&copy, buf, len);
+	bitmap_or(&copy, b);
+	for (i = 0; i < SPACE; i++)
+	{
+		ref[i] = ra[i] || rb[i];
+	}
+	failed |= check_bitmap(&copy, ref);
+	bitmap_destroy(&copy);
+
+	bitmap_deserialize(&copy, buf, len);
+	bitmap_andnot(&copy, b);
+	for (i = 0; i < SPACE; i++)
+	{
+		ref[i] = ra[i] && !rb[i];
+	}
+	failed |= check_bitmap(&copy, ref);
+	bitmap_destroy(&copy);
+
+	free(buf);
+	return failed;
+}
+
+/**
+ * grow both bitmaps past BITMAP_ARRAY_MAX per container and shrink
+ * them back, checking them and the operations between them in each
+ * phase, so that every pair of container kinds meets
+ */
+int main(void)
+{
+	struct random_pool pool = RANDOM_POOL_INIT;
+	struct bitmap a = BITMAP_INIT, b = BITMAP_INIT;
+	static bool ra[SPACE], rb[SPACE];
+	static const unsigned phases[][2] = {
+		{ 2000,   90 },
+		{ 40000,  90 },
+		{ 20000,  50 },
+		{ 200000, 10 },
+	};
+	size_t i;
+	int failed;
+
+	failed = 0;
+	for (i = 0; i < sizeof(phases) / sizeof(*phases); i++)
+	{
+		fill(&pool, &a, ra, phases[i][0], phases[i][1]);
+		fill(&pool, &b, rb, phases[i][0] / (i % 2 + 1),
+		     phases[i][1]);
+
+		failed |= check_bitmap(&a, ra) | check_bitmap(&b, rb);
+		failed |= check_ops(&a, ra, &b, rb) | check_ops(&b, rb, &a, ra);
+	}
+
+	/* containers that run empty are dropped */
+	for (i = 0; i < SPACE; i++)
+	{
+		failed |= bitmap_remove(&a, to_int(i)) != ra[i];
+		failed |= bitmap_remove(&b, to_int(i)) != rb[i];
+	}
+	failed |= a.nr != 0 || b.nr != 0;
+
+	bitmap_destroy(&a);
+	bitmap_destroy(&b);
+
+	return failed;
+}
@@ -0,0 +1,26 @@
+use v5.38;
+use Test::More;
+use Env qw(TEST_BUILD_PREFIX);
+use IPC::Run 'run';
+
+my @cmd;
+my ($output, $error);
+my @rss = (0, 64, 256, 1024);
+my $PKBIN = "$TEST_BUILD_PREFIX/t1300-spawn-latency";
+
+@cmd = ($PKBIN, 'true', @rss);
+ok(run(\@cmd, '>', \$output, '2>', \$error), 'spawn programs at various rss');
+
+like($error, qr/failed to execute command ‘no-such-program’/,
+     'exec failure is reported');
+
+foreach (split /\n/, $output)
+{
+	my ($size, $spawn, $fork) = split;
+	diag(sprintf('rss %5d MiB: spawn %8.1f us, fork %8.1f us',
+		     $size, $spawn, $fork));
+}
+
+is(scalar(split /\n/, $output), scalar(@rss), 'latency of each rss');
+
+done_testing();
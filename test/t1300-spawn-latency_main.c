@@ -0,0 +1,89 @@
+#include "pkproc.h"
+#include "stopwatch.h"
+
+#define ROUNDS 32
+
+/* baseline: what mkprocl did before, a plain fork() and exec */
+static void fork_exec(const char *program)
+{
+	pid_t pid;
+
+	if ((pid = fork()) == 0)
+	{
+		execlp(program, program, NULL);
+		_exit(127);
+	}
+
+	waitpid(pid, NULL, 0);
+}
+
+static void spawn_exec(const char *program)
+{
+	struct process_info ctx = {
+		.program = program,
+	};
+
+	if (mkprocl(&ctx, program, program, NULL) != 0)
+	{
+		exit(EXIT_FAILURE);
+	}
+
+	finish_process(&ctx, false);
+}
+
+static double measure(void (*spawn)(const char *), const char *program)
+{
+	struct stopwatch sw;
+	int i;
+
+	stopwatch_start(&sw);
+	for (i = 0; i < ROUNDS; i++)
+	{
+		spawn(program);
+	}
+
+	return (double)stopwatch_elapsed(&sw) / ROUNDS;
+}
+
+/**
+ * usage: t1300-spawn-latency <program> <rss in MiB>...
+ * prints ‘<rss> <spawn usec> <fork usec>’ for each rss
+ */
+int main(UNUSED int argc, const char **argv)
+{
+	const char *program;
+	size_t rss;
+	char *ballast;
+
+	argv++;
+	program = *argv++;
+	assert(program);
+
+	for ( ; *argv; argv++)
+	{
+		rss = strtoul(*argv, NULL, 10) << 20;
+
+		/* touch every page so that it's really resident */
+		ballast = xmalloc(rss + 1);
+		memset(ballast, 1, rss + 1);
+
+		printf("%s %.1f %.1f\n", *argv,
+			measure(spawn_exec, program),
+			measure(fork_exec, program));
+
+		free(ballast);
+	}
+
+	struct process_info ctx = {
+		.program = "no-such-program",
+	};
+
+	/* exec failure is still reported through struct child_error */
+	if (mkprocl(&ctx, ctx.program, ctx.program, NULL) == 0)
+	{
+		finish_process(&ctx, false);
+		return EXIT_FAILURE;
+	}
+
+	return 0;
+}
@@ -5,6 +5,7 @@ use IPC::Run 'run';
 
 my @cmd;
 my $output;
+my $error;
 
 @cmd = ($PKBIN, 'makekey');
 run \@cmd, '>', \$output;
@@ -21,4 +22,28 @@ run \@cmd, '>', \$output;
 run \@cmd, '>', \$output;
 like($output, qr/0x[A-F0-9]{64}/, "run makekey with output to a special file");
 
+@cmd = ($PKBIN, 'makekey', '--count', '3');
+run \@cmd, '>', \$output;
+like($output, qr/\A(?:0x[A-F0-9]{64}\n){3}\z/, "run makekey with key count 3");
+
+@cmd = ($PKBIN, 'makekey', '--charset', 'a-c', '--size', '12', '--count', '2');
+run \@cmd, '>', \$output;
+like($output, qr/\A(?:[a-c]{12}\n){2}\z/, "run makekey with charset a-c");
+
+@cmd = ($PKBIN, 'makekey', '--charset', 'a');
+ok(!run(\@cmd, '>', \$output, '2>', \$error), "run makekey with a charset of 1 character");
+
+my $wordlist = "$ENV{TEST_TMP_PREFIX}/makekey.words";
+open(my $fh, '>', $wordlist) or die "cannot write $wordlist: $!";
+print $fh "# diceware list\n11111 alpha\n11112 bravo\ncharlie\n";
+close($fh);
+
+@cmd = ($PKBIN, 'makekey', '--words', $wordlist, '--size', '4');
+run \@cmd, '>', \$output;
+like($output, qr/\A(?:alpha|bravo|charlie)(?:-(?:alpha|bravo|charlie)){3}\n\z/,
+	"run makekey with words from a diceware list");
+
+@cmd = ($PKBIN, 'makekey', '--words', $wordlist, '--charset', 'a-z');
+ok(!run(\@cmd, '>', \$output, '2>', \$error), "run makekey with both charset and words");
+
 done_testing();